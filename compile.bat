@@ -1,4 +1,12 @@
 @mkdir bin >NUL 2>&1
 @mkdir obj >NUL 2>&1
-@cl /TC /nologo /wd4100 /wd4127 /wd4711 /wd4710 /wd4242 /wd4244 /wd4820 /D_CRT_SECURE_NO_WARNINGS /Fo.\obj\ /Wall /c src\builtins.c src\env.c src\eval.c src\main.c src\mpc.c src\parser.c src\utils.c src\val.c
-@link /nologo .\obj\builtins.obj .\obj\env.obj .\obj\eval.obj .\obj\main.obj .\obj\mpc.obj .\obj\parser.obj .\obj\utils.obj .\obj\val.obj /out:.\bin\lispy.exe
+@set CFLAGS=/TC /nologo /std:c11 /wd4100 /wd4127 /wd4201 /wd4711 /wd4710 /wd4242 /wd4244 /wd4820 /D_CRT_SECURE_NO_WARNINGS /Fo.\obj\ /Wall
+@set RUNTIME=.\obj\aot.obj .\obj\big.obj .\obj\bitset.obj .\obj\btree.obj .\obj\builtins.obj .\obj\closure.obj .\obj\dict.obj .\obj\env.obj .\obj\eval.obj .\obj\hamt.obj .\obj\ir.obj .\obj\iter.obj .\obj\jit.obj .\obj\kern.obj .\obj\mat.obj .\obj\mpc.obj .\obj\nvec.obj .\obj\opt.obj .\obj\parser.obj .\obj\queue.obj .\obj\quick.obj .\obj\record.obj .\obj\seq.obj .\obj\str.obj .\obj\table.obj .\obj\utils.obj .\obj\val.obj .\obj\vec.obj
+@cl %CFLAGS% /c src\aot.c src\big.c src\bitset.c src\btree.c src\builtins.c src\closure.c src\dict.c src\env.c src\eval.c src\hamt.c src\ir.c src\iter.c src\jit.c src\kern.c src\mat.c src\main.c src\mpc.c src\nvec.c src\opt.c src\parser.c src\queue.c src\quick.c src\record.c src\seq.c src\str.c src\table.c src\utils.c src\val.c src\vec.c
+@if "%~1"=="" (
+  @link /nologo %RUNTIME% .\obj\main.obj /out:.\bin\lispy.exe
+) else (
+  @rem a program generated by lispy --compile, built with the runtime
+  @cl %CFLAGS% /Isrc /c %1
+  @link /nologo %RUNTIME% .\obj\%~n1.obj /out:.\bin\%~n1.exe
+)
@@ -1,2 +1,9 @@
 #!/bin/bash
-cc -std=c99 -g -Wall src/builtins.c src/env.c src/eval.c src/main.c src/mpc.c src/parser.c src/utils.c src/val.c -ledit -o bin/lispy
+RUNTIME="src/aot.c src/big.c src/bitset.c src/btree.c src/builtins.c src/closure.c src/dict.c src/env.c src/eval.c src/hamt.c src/ir.c src/iter.c src/jit.c src/kern.c src/mat.c src/mpc.c src/nvec.c src/opt.c src/parser.c src/queue.c src/quick.c src/record.c src/seq.c src/str.c src/table.c src/utils.c src/val.c src/vec.c"
+
+if [ -z "$1" ]; then
+  cc -std=c11 -g -Wall -pthread $RUNTIME src/main.c -ledit -o bin/lispy
+else
+  # a program generated by lispy --compile, built with the runtime
+  cc -std=c11 -g -Wall -pthread -Isrc $RUNTIME "$1" -ledit -o bin/$(basename "$1" .c)
+fi
@@ -0,0 +1,575 @@
+#include "aot.h"
+#include "utils.h"
+#include "str.h"
+
+#include <limits.h>
+#include <stdarg.h>
+#include <string.h>
+
+/**
+ * A growing buffer of text
+ */
+typedef struct
+{
+  char* data;
+  int len;
+  int cap;
+} laot_buf;
+
+/**
+ * State of the compilation of a program
+ */
+typedef struct
+{
+  /** environment to resolve builtins **/
+  lenv* env;
+
+  /** definitions of the functions, every function before its callers **/
+  laot_buf funs;
+  int nfuns;
+
+  /** symbols S[], constants Q[] and the names of the builtins B[] **/
+  lval* syms;
+  lval* consts;
+  lval* builtins;
+
+  /** function compiled for every constant, or -1 **/
+  int* qfun;
+
+  /** functions of the top-level forms **/
+  int* forms;
+  int nforms;
+} laot;
+
+/**
+ * An entry in the table of compiled bodies
+ */
+typedef struct laot_entry
+{
+  lval* body;
+  lnative fn;
+  struct laot_entry* next;
+} laot_entry;
+
+laot_entry* _laot_table[LAOT_BUCKETS];
+int _laot_count = 0;
+
+void _laot_printf(laot_buf* b, char* fmt, ...)
+{
+  va_list va;
+  va_start(va, fmt);
+  int n = vsnprintf(NULL, 0, fmt, va);
+  va_end(va);
+
+  if (b->len + n + 1 > b->cap) {
+    b->cap = (b->len + n + 1) * 2;
+    b->data = realloc(b->data, b->cap);
+  }
+
+  va_start(va, fmt);
+  vsnprintf(b->data + b->len, n + 1, fmt, va);
+  va_end(va);
+  b->len += n;
+}
+
+/* a C string literal with the n chars of s */
+void _laot_cstrn(laot_buf* b, char* s, long n)
+{
+  _laot_printf(b, "\"");
+  for (long i = 0; i < n; i++) {
+    unsigned char ch = (unsigned char)s[i];
+    if (ch == '"' || ch == '\\') {
+      _laot_printf(b, "\\%c", ch);
+    } else if (ch < 32 || ch > 126) {
+      _laot_printf(b, "\\%03o", ch);
+    } else {
+      _laot_printf(b, "%c", ch);
+    }
+  }
+  _laot_printf(b, "\"");
+}
+
+/* a C string literal with the chars of s, up to its '\0' */
+void _laot_cstr(laot_buf* b, char* s)
+{
+  _laot_cstrn(b, s, strlen(s));
+}
+
+void _laot_num(char* out, long n)
+{
+  if (n == LONG_MIN) {
+    sprintf(out, "lval_num(-%ldL - 1)", LONG_MAX);
+  } else {
+    sprintf(out, "lval_num(%ldL)", n);
+  }
+}
+
+/* C expression that builds the value v */
+void _laot_value(laot_buf* b, lval* v)
+{
+  char num[LAOT_EXPR];
+
+  switch (v->type) {
+    case LVAL_NUM:
+      _laot_num(num, v->num);
+      _laot_printf(b, "%s", num);
+      break;
+
+    case LVAL_SYM:
+      _laot_printf(b, "lval_sym(");
+      _laot_cstr(b, v->sym);
+      _laot_printf(b, ")");
+      break;
+
+    case LVAL_STR:
+      _laot_printf(b, "lval_strn(");
+      _laot_cstrn(b, v->str->bytes, v->str->len);
+      _laot_printf(b, ", %li)", v->str->len);
+      break;
+
+    case LVAL_BIGNUM: {
+      char* s = lbig_str(v->big);
+      _laot_printf(b, "lval_bignum(lbig_parse(\"%s\"))", s);
+      free(s);
+      break;
+    }
+
+    case LVAL_FLOAT:
+      /* inf and nan have no literal, they are read back at run time */
+      if (v->dbl - v->dbl == 0.0) {
+        _laot_printf(b, "lval_float(%.16e)", v->dbl);
+      } else {
+        _laot_printf(b, "lval_float(strtod(\"%g\", NULL))", v->dbl);
+      }
+      break;
+
+    case LVAL_SEXPR:
+    case LVAL_QEXPR:
+      _laot_printf(b, "laot_list(%s, %d",
+          v->type == LVAL_QEXPR ? "LVAL_QEXPR" : "LVAL_SEXPR", v->count);
+      for (int i = 0; i < v->count; i++) {
+        _laot_printf(b, ", ");
+        _laot_value(b, v->cell[i]);
+      }
+      _laot_printf(b, ")");
+      break;
+  }
+}
+
+/* index of a value in a list, adding it if needed */
+int _laot_index(lval* list, lval* v)
+{
+  for (int i = 0; i < list->count; i++) {
+    if (lval_eq(list->cell[i], v)) {
+      return i;
+    }
+  }
+
+  lval_add(list, lval_copy(v));
+  return list->count - 1;
+}
+
+int _laot_sym(laot* c, lval* sym)
+{
+  return _laot_index(c->syms, sym);
+}
+
+int _laot_form(laot* c, lval* v);
+
+/* a Q-Expression that looks like code (it has symbols or S-Expressions) */
+int _laot_code(lval* v)
+{
+  for (int i = 0; i < v->count; i++) {
+    if (v->cell[i]->type == LVAL_SYM || v->cell[i]->type == LVAL_SEXPR) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+/**
+ * Index of a constant, a Q-Expression is compiled as a body if it
+ * looks like code or if 'force' is set
+ */
+int _laot_const(laot* c, lval* v, int force)
+{
+  int k = _laot_index(c->consts, v);
+  if (k == c->consts->count - 1) {
+    c->qfun = realloc(c->qfun, sizeof(int) * c->consts->count);
+    c->qfun[k] = -1;
+  }
+
+  if (v->type == LVAL_QEXPR && c->qfun[k] < 0 && (force || _laot_code(v))) {
+    int fn = _laot_form(c, v);
+    c->qfun[k] = fn;
+  }
+
+  return k;
+}
+
+/* C expression that evaluates v */
+void _laot_expr(laot* c, lval* v, char* out)
+{
+  switch (v->type) {
+    case LVAL_NUM:    _laot_num(out, v->num); break;
+    case LVAL_SYM:    sprintf(out, "lenv_get(e, S[%d])", _laot_sym(c, v)); break;
+    case LVAL_SEXPR:  sprintf(out, "_lf_%d(e)", _laot_form(c, v)); break;
+    default:          sprintf(out, "lval_copy(Q[%d])", _laot_const(c, v, 0)); break;
+  }
+}
+
+void _laot_generic(laot* c, lval* v, char (*args)[LAOT_EXPR])
+{
+  _laot_printf(&c->funs, "  lval* v = lval_sexpr();\n");
+  for (int i = 0; i < v->count; i++) {
+    _laot_printf(&c->funs, "  LAOT_ARG(v, %s);\n", args[i]);
+  }
+  _laot_printf(&c->funs, "  return leval_apply(e, v);\n");
+}
+
+/**
+ * Compiles a form (or a Q-Expression as the form it becomes when
+ * evaluated) to its own function, returns the number of the function
+ */
+int _laot_form(laot* c, lval* v)
+{
+  char (*args)[LAOT_EXPR] = malloc(sizeof(*args) * (v->count + 1));
+
+  /* for definitions (def and =) a symbol in the second child is not evaluated */
+  int isdef = (v->count > 0) && (v->cell[0]->type == LVAL_SYM)
+           && (is(v->cell[0]->sym, KW_GDEF) || is(v->cell[0]->sym, KW_LDEF));
+
+  for (int i = 0; i < v->count; i++) {
+    if (isdef && i == 1 && v->cell[1]->type == LVAL_SYM) {
+      sprintf(args[i], "lval_copy(S[%d])", _laot_sym(c, v->cell[1]));
+    } else {
+      _laot_expr(c, v->cell[i], args[i]);
+    }
+  }
+
+  /* a call to a builtin by its name */
+  lval* head = v->count > 1 ? v->cell[0] : NULL;
+  lval* f = NULL;
+  if (head && head->type == LVAL_SYM && lenv_watched(head->sym)) {
+    f = lenv_find(c->env, head);
+  }
+
+  int b = -1;
+  int s = -1;
+  if (f && f->type == LVAL_FUN && f->builtin && is(f->sym, head->sym)) {
+    b = _laot_index(c->builtins, head);
+    s = _laot_sym(c, head);
+  }
+
+  /* an 'if' with literal branches, compile the branches */
+  int branches[2] = { -1, -1 };
+  if (b >= 0 && f->builtin == BTNAME(IF) && v->count == 4
+      && v->cell[2]->type == LVAL_QEXPR && v->cell[3]->type == LVAL_QEXPR) {
+    int yes = _laot_const(c, v->cell[2], 1);
+    int no = _laot_const(c, v->cell[3], 1);
+    branches[0] = c->qfun[yes];
+    branches[1] = c->qfun[no];
+  }
+
+  int id = c->nfuns++;
+  laot_buf* out = &c->funs;
+  _laot_printf(out, "lval* _lf_%d(lenv* e)\n{\n", id);
+
+  if (v->count == 0) {
+    _laot_printf(out, "  return lval_sexpr();\n");
+
+  /* expression with just one children: return that children */
+  } else if (v->count == 1) {
+    _laot_printf(out, "  return %s;\n", args[0]);
+
+  } else if (branches[0] >= 0) {
+    _laot_printf(out,
+        "  static long epoch = -1;\n"
+        "  if (laot_resolved(e, S[%d], B[%d], &epoch)) {\n"
+        "    lval* x = %s;\n"
+        "    if (x->type == LVAL_NUM) {\n"
+        "      long t = x->num;\n"
+        "      lval_del(x);\n"
+        "      return t ? _lf_%d(e) : _lf_%d(e);\n"
+        "    }\n"
+        "    if (x->type == LVAL_ERR) {\n"
+        "      return x;\n"
+        "    }\n"
+        "    return B[%d](e, laot_list(LVAL_SEXPR, 3, x, %s, %s));\n"
+        "  }\n",
+        s, b, args[1], branches[0], branches[1], b, args[2], args[3]);
+    _laot_generic(c, v, args);
+
+  } else if (b >= 0) {
+    _laot_printf(out,
+        "  static long epoch = -1;\n"
+        "  int direct = laot_resolved(e, S[%d], B[%d], &epoch);\n"
+        "  lval* v = lval_sexpr();\n"
+        "  if (!direct) {\n"
+        "    LAOT_ARG(v, %s);\n"
+        "  }\n",
+        s, b, args[0]);
+    for (int i = 1; i < v->count; i++) {
+      _laot_printf(out, "  LAOT_ARG(v, %s);\n", args[i]);
+    }
+    _laot_printf(out, "  return direct ? B[%d](e, v) : leval_apply(e, v);\n", b);
+
+  } else {
+    _laot_generic(c, v, args);
+  }
+
+  _laot_printf(out, "}\n\n");
+  free(args);
+  return id;
+}
+
+/* compiles a top-level form, expanding (load "file") */
+int _laot_top(laot* c, lval* v)
+{
+  if (v->type == LVAL_SEXPR && v->count == 2 && v->cell[0]->type == LVAL_SYM
+      && is(v->cell[0]->sym, KW_LOAD) && v->cell[1]->type == LVAL_STR) {
+    lval* r = lparser_parse(c->env, v->cell[1]->str->bytes);
+    if (r) {
+      for (int i = 0; i < r->count; i++) {
+        _laot_top(c, r->cell[i]);
+      }
+      lval_del(r);
+      return 1;
+    }
+  }
+
+  int id;
+  if (v->type == LVAL_SEXPR) {
+    id = _laot_form(c, v);
+  } else {
+    char x[LAOT_EXPR];
+    _laot_expr(c, v, x);
+    id = c->nfuns++;
+    _laot_printf(&c->funs, "lval* _lf_%d(lenv* e)\n{\n  return %s;\n}\n\n", id, x);
+  }
+
+  c->forms = realloc(c->forms, sizeof(int) * (c->nforms + 1));
+  c->forms[c->nforms++] = id;
+  return 1;
+}
+
+void _laot_write(laot* c, FILE* f)
+{
+  laot_buf b = { NULL, 0, 0 };
+
+  _laot_printf(&b,
+      "/* generated by lispy --compile, build it with compile.sh */\n"
+      "#include \"aot.h\"\n"
+      "\n"
+      "static lval* S[%d];\n"
+      "static lval* Q[%d];\n"
+      "static lbuiltin B[%d];\n"
+      "\n",
+      c->syms->count + 1, c->consts->count + 1, c->builtins->count + 1);
+
+  fwrite(b.data, 1, b.len, f);
+  if (c->funs.len) {
+    fwrite(c->funs.data, 1, c->funs.len, f);
+  }
+  b.len = 0;
+
+  _laot_printf(&b, "static void init(lenv* e)\n{\n");
+  for (int i = 0; i < c->syms->count; i++) {
+    _laot_printf(&b, "  S[%d] = ", i);
+    _laot_value(&b, c->syms->cell[i]);
+    _laot_printf(&b, ";\n");
+  }
+  for (int i = 0; i < c->consts->count; i++) {
+    _laot_printf(&b, "  Q[%d] = ", i);
+    _laot_value(&b, c->consts->cell[i]);
+    _laot_printf(&b, ";\n");
+  }
+  for (int i = 0; i < c->builtins->count; i++) {
+    _laot_printf(&b, "  B[%d] = laot_builtin(e, ", i);
+    _laot_cstr(&b, c->builtins->cell[i]->sym);
+    _laot_printf(&b, ");\n");
+  }
+  for (int i = 0; i < c->consts->count; i++) {
+    if (c->qfun[i] >= 0) {
+      _laot_printf(&b, "  laot_register(Q[%d], _lf_%d);\n", i, c->qfun[i]);
+    }
+  }
+  _laot_printf(&b, "}\n\nstatic lnative forms[] = {\n");
+  for (int i = 0; i < c->nforms; i++) {
+    _laot_printf(&b, "  _lf_%d,\n", c->forms[i]);
+  }
+  _laot_printf(&b,
+      "  NULL\n"
+      "};\n"
+      "\n"
+      "int main(int argc, char** argv)\n"
+      "{\n"
+      "  return laot_main(init, forms);\n"
+      "}\n");
+
+  fwrite(b.data, 1, b.len, f);
+  free(b.data);
+}
+
+int laot_compile(lenv* e, char** files, int count, char* out)
+{
+  laot c = { e, { NULL, 0, 0 }, 0, lval_qexpr(), lval_qexpr(), lval_qexpr(), NULL, NULL, 0 };
+
+  int ok = 1;
+  for (int i = 0; i < count && ok; i++) {
+    lval* r = lparser_parse(e, files[i]);
+    if (!r) {
+      printf("could not load %s\n", files[i]);
+      ok = 0;
+      break;
+    }
+    for (int j = 0; j < r->count; j++) {
+      _laot_top(&c, r->cell[j]);
+    }
+    lval_del(r);
+  }
+
+  FILE* f = ok ? fopen(out, "w") : NULL;
+  if (ok && !f) {
+    printf("could not write %s\n", out);
+    ok = 0;
+  }
+  if (f) {
+    _laot_write(&c, f);
+    fclose(f);
+  }
+
+  free(c.funs.data);
+  free(c.qfun);
+  free(c.forms);
+  lval_del(c.syms);
+  lval_del(c.consts);
+  lval_del(c.builtins);
+  return ok ? 0 : 1;
+}
+
+lval* laot_list(int type, int n, ...)
+{
+  lval* v = type == LVAL_QEXPR ? lval_qexpr() : lval_sexpr();
+
+  va_list va;
+  va_start(va, n);
+  for (int i = 0; i < n; i++) {
+    lval_add(v, va_arg(va, lval*));
+  }
+  va_end(va);
+
+  return v;
+}
+
+lbuiltin laot_builtin(lenv* e, char* name)
+{
+  lval* k = lval_sym(name);
+  lval* f = lenv_find(e, k);
+  lval_del(k);
+
+  return f && f->type == LVAL_FUN ? f->builtin : NULL;
+}
+
+int laot_resolved(lenv* e, lval* sym, lbuiltin b, long* epoch)
+{
+  if (*epoch == lenv_epoch) {
+    return 1;
+  }
+
+  lval* f = lenv_find(e, sym);
+  if (b && f && f->type == LVAL_FUN && f->builtin == b) {
+    *epoch = lenv_epoch;
+    return 1;
+  }
+
+  return 0;
+}
+
+unsigned long _laot_hash(lval* v)
+{
+  unsigned long h = v->type;
+  char* s = NULL;
+
+  switch (v->type) {
+    case LVAL_NUM: h = h * 31 + (unsigned long)v->num; break;
+
+    case LVAL_BIGNUM:
+      for (int i = 0; i < v->big->len; i++) {
+        h = h * 31 + v->big->d[i];
+      }
+      break;
+
+    case LVAL_FLOAT: {
+      unsigned char* p = (unsigned char*)&v->dbl;
+      for (size_t i = 0; i < sizeof(double); i++) {
+        h = h * 31 + p[i];
+      }
+      break;
+    }
+
+    case LVAL_SYM: s = v->sym; break;
+    case LVAL_STR: s = v->str->bytes; break;
+
+    case LVAL_SEXPR:
+    case LVAL_QEXPR:
+      h = h * 31 + v->count;
+      for (int i = 0; i < v->count; i++) {
+        h = h * 31 + _laot_hash(v->cell[i]);
+      }
+      break;
+  }
+
+  for (; s && *s; s++) {
+    h = h * 31 + (unsigned char)*s;
+  }
+
+  return h;
+}
+
+void laot_register(lval* body, lnative fn)
+{
+  laot_entry* x = malloc(sizeof(laot_entry));
+  unsigned long h = _laot_hash(body) % LAOT_BUCKETS;
+  x->body = body;
+  x->fn = fn;
+  x->next = _laot_table[h];
+  _laot_table[h] = x;
+  _laot_count++;
+}
+
+lnative laot_find(lval* body)
+{
+  if (!_laot_count) {
+    return NULL;
+  }
+
+  laot_entry* x = _laot_table[_laot_hash(body) % LAOT_BUCKETS];
+  for (; x; x = x->next) {
+    if (lval_eq(x->body, body)) {
+      return x->fn;
+    }
+  }
+
+  return NULL;
+}
+
+int laot_main(void (*init)(lenv*), lnative* forms)
+{
+  lenv* env = lenv_new();
+  env->parser = lparser_new();
+  lenv_add_builtins(env);
+  init(env);
+
+  for (int i = 0; forms[i]; i++) {
+    lval* x = forms[i](env);
+    if (x->type == LVAL_ERR) {
+      lval_println(x);
+    }
+    lval_del(x);
+  }
+
+  lenv_del(env);
+  return 0;
+}
@@ -0,0 +1,124 @@
+#ifndef LISPY_AOT_H
+#define LISPY_AOT_H
+
+#include "big.h"
+#include "builtins.h"
+#include "env.h"
+#include "eval.h"
+#include "val.h"
+
+/**
+ * Size of the buffer that holds the C expression of a single value
+ */
+#define LAOT_EXPR 64
+
+/**
+ * Number of buckets of the table of compiled bodies
+ */
+#define LAOT_BUCKETS 256
+
+/**
+ * Adds the value of a C expression to an S-Expression being built by
+ * compiled code, if it is an error the S-Expression is deleted and the
+ * error returned (just as leval_sexpr() does)
+ */
+#define LAOT_ARG(v, x)                \
+  do {                                \
+    lval* _x = (x);                   \
+    if (_x->type == LVAL_ERR) {       \
+      lval_del(v);                    \
+      return _x;                      \
+    }                                 \
+    lval_add(v, _x);                  \
+  } while (0)
+
+/**
+ * Compiles lisp files into a C program
+ *
+ * Every form is translated into a C function that evaluates it the same
+ * way leval() does (every S-Expression to its own function), calls to
+ * builtins by their name go straight to the builtin and an 'if' with
+ * literal branches is a C 'if' while those names are not rebound (they
+ * are guarded by lenv_epoch).
+ *
+ * Every Q-Expression that looks like code is compiled too and registered
+ * as a body, when 'lambda' gets that same body the function runs the
+ * compiled code instead of evaluating its body. Code built at run time
+ * (and 'eval') is still evaluated by leval().
+ *
+ * A top-level (load "file") is read and compiled in place, so the program
+ * neither reads nor parses those files (the prelude) when it runs.
+ *
+ * The program is built with the runtime (every file except main.c) by
+ * compile.sh (or compile.bat) passing the generated file.
+ *
+ * lenv* e        the environment to resolve builtins in
+ * char** files   the files to compile, in order
+ * int count      the number of files
+ * char* out      the C file to write
+ *
+ * return     0 if the program was written, 1 otherwise
+ */
+int laot_compile(lenv* e, char** files, int count, char* out);
+
+/**
+ * Builds an S-Expression or a Q-Expression
+ *
+ * int type   LVAL_SEXPR or LVAL_QEXPR
+ * int n      the number of children, passed next as lval*
+ *
+ * return     the new expression
+ */
+lval* laot_list(int type, int n, ...);
+
+/**
+ * Finds a builtin by its name
+ *
+ * lenv* e      the environment with every builtin
+ * char* name   the name of the builtin
+ *
+ * return       the builtin, or NULL if no builtin has that name
+ */
+lbuiltin laot_builtin(lenv* e, char* name);
+
+/**
+ * Checks if a symbol resolves to a builtin, looking it up only
+ * when lenv_epoch is not the one of the last check
+ *
+ * lenv* e        the environment to look in
+ * lval* sym      the symbol
+ * lbuiltin b     the builtin
+ * long* epoch    the value of lenv_epoch at the last check
+ *
+ * return     1 if the symbol resolves to the builtin, 0 otherwise
+ */
+int laot_resolved(lenv* e, lval* sym, lbuiltin b, long* epoch);
+
+/**
+ * Registers the compiled code of a body
+ *
+ * lval* body     the body (LVAL_QEXPR), it is kept
+ * lnative fn     the function that evaluates the body
+ */
+void laot_register(lval* body, lnative fn);
+
+/**
+ * Finds the compiled code of a body
+ *
+ * lval* body     the body (LVAL_QEXPR) of a function being created
+ *
+ * return     the function that evaluates the body, or NULL
+ */
+lnative laot_find(lval* body);
+
+/**
+ * Runs a compiled program
+ *
+ * void(*init)(lenv*)   builds the constants and registers the bodies
+ * lnative* forms       the top-level forms, ending with NULL
+ *
+ * return     the exit code of the program
+ */
+int laot_main(void (*init)(lenv*), lnative* forms);
+
+#endif//LISPY_AOT_H
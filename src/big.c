@@ -0,0 +1,501 @@
+#include "big.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int lbig_add_overflow(long a, long b, long* r)
+{
+  if ((b > 0 && a > LONG_MAX - b) || (b < 0 && a < LONG_MIN - b)) {
+    return 1;
+  }
+  *r = a + b;
+  return 0;
+}
+
+int lbig_sub_overflow(long a, long b, long* r)
+{
+  if ((b < 0 && a > LONG_MAX + b) || (b > 0 && a < LONG_MIN + b)) {
+    return 1;
+  }
+  *r = a - b;
+  return 0;
+}
+
+int lbig_mul_overflow(long a, long b, long* r)
+{
+  if (a > 0) {
+    if (b > 0 ? a > LONG_MAX / b : b < LONG_MIN / a) {
+      return 1;
+    }
+  } else if (b > 0) {
+    if (a < LONG_MIN / b) {
+      return 1;
+    }
+  } else if (a != 0 && b < LONG_MAX / a) {
+    return 1;
+  }
+  *r = a * b;
+  return 0;
+}
+
+lbig* _lbig_new(int len)
+{
+  lbig* a = malloc(sizeof(lbig));
+  a->sign = 1;
+  a->len = len;
+  a->d = calloc(len ? len : 1, sizeof(uint32_t));
+  return a;
+}
+
+/* drops the limbs at the end that are 0 */
+lbig* _lbig_trim(lbig* a)
+{
+  while (a->len && !a->d[a->len - 1]) {
+    a->len--;
+  }
+  if (!a->len) {
+    a->sign = 1;
+  }
+  return a;
+}
+
+lbig* lbig_from_long(long x)
+{
+  lbig* a = _lbig_new((sizeof(long) + 3) / 4);
+  unsigned long m = x < 0 ? 0UL - (unsigned long)x : (unsigned long)x;
+  for (int i = 0; m; i++) {
+    a->d[i] = (uint32_t)(m & 0xFFFFFFFFUL);
+    /* in two shifts, a long may be 32 bits */
+    m = (m >> 16) >> 16;
+  }
+  a->sign = x < 0 ? -1 : 1;
+  return _lbig_trim(a);
+}
+
+/* a = a * m + c */
+void _lbig_muladd(lbig* a, uint32_t m, uint32_t c)
+{
+  uint64_t carry = c;
+  for (int i = 0; i < a->len; i++) {
+    uint64_t t = (uint64_t)a->d[i] * m + carry;
+    a->d[i] = (uint32_t)t;
+    carry = t >> 32;
+  }
+  if (carry) {
+    a->d = realloc(a->d, sizeof(uint32_t) * (a->len + 1));
+    a->d[a->len++] = (uint32_t)carry;
+  }
+}
+
+/* a = a / m, returns the remainder */
+uint32_t _lbig_divsmall(lbig* a, uint32_t m)
+{
+  uint64_t k = 0;
+  for (int i = a->len - 1; i >= 0; i--) {
+    uint64_t t = (k << 32) | a->d[i];
+    a->d[i] = (uint32_t)(t / m);
+    k = t % m;
+  }
+  _lbig_trim(a);
+  return (uint32_t)k;
+}
+
+lbig* lbig_parse(char* s)
+{
+  int sign = 1;
+  if (*s == '-') {
+    sign = -1;
+    s++;
+  }
+
+  /* nine digits at a time, those fit in a limb */
+  lbig* a = _lbig_new(0);
+  while (*s) {
+    uint32_t chunk = 0;
+    uint32_t scale = 1;
+    for (int i = 0; i < 9 && *s >= '0' && *s <= '9'; i++, s++) {
+      chunk = chunk * 10 + (uint32_t)(*s - '0');
+      scale *= 10;
+    }
+    if (scale == 1) {
+      break;
+    }
+    _lbig_muladd(a, scale, chunk);
+  }
+
+  a->sign = sign;
+  return _lbig_trim(a);
+}
+
+lbig* lbig_copy(lbig* a)
+{
+  lbig* x = _lbig_new(a->len);
+  x->sign = a->sign;
+  memcpy(x->d, a->d, sizeof(uint32_t) * a->len);
+  return x;
+}
+
+void lbig_del(lbig* a)
+{
+  free(a->d);
+  free(a);
+}
+
+int _lbig_cmpmag(uint32_t* a, int an, uint32_t* b, int bn)
+{
+  if (an != bn) {
+    return an < bn ? -1 : 1;
+  }
+  for (int i = an - 1; i >= 0; i--) {
+    if (a[i] != b[i]) {
+      return a[i] < b[i] ? -1 : 1;
+    }
+  }
+  return 0;
+}
+
+/* r = a + b, r has room for the longest one and one limb more */
+void _lbig_addmag(uint32_t* r, uint32_t* a, int an, uint32_t* b, int bn)
+{
+  int n = an > bn ? an : bn;
+  uint64_t carry = 0;
+  for (int i = 0; i < n; i++) {
+    uint64_t t = carry;
+    if (i < an) {
+      t += a[i];
+    }
+    if (i < bn) {
+      t += b[i];
+    }
+    r[i] = (uint32_t)t;
+    carry = t >> 32;
+  }
+  r[n] = (uint32_t)carry;
+}
+
+/* a = a - b, a must not be less than b */
+void _lbig_submag(uint32_t* a, int an, uint32_t* b, int bn)
+{
+  int64_t borrow = 0;
+  for (int i = 0; i < an && (i < bn || borrow); i++) {
+    int64_t t = (int64_t)a[i] - borrow - (i < bn ? (int64_t)b[i] : 0);
+    borrow = t < 0;
+    a[i] = (uint32_t)(t + (borrow << 32));
+  }
+}
+
+/* r = r + (x shifted 'off' limbs), r has rn limbs and the sum fits in them */
+void _lbig_addat(uint32_t* r, int rn, uint32_t* x, int xn, int off)
+{
+  uint64_t carry = 0;
+  int i = 0;
+  for (; i < xn && off + i < rn; i++) {
+    uint64_t t = (uint64_t)r[off + i] + x[i] + carry;
+    r[off + i] = (uint32_t)t;
+    carry = t >> 32;
+  }
+  for (; carry && off + i < rn; i++) {
+    uint64_t t = (uint64_t)r[off + i] + carry;
+    r[off + i] = (uint32_t)t;
+    carry = t >> 32;
+  }
+}
+
+/* r = a * b limb by limb, r has an + bn limbs */
+void _lbig_school(uint32_t* r, uint32_t* a, int an, uint32_t* b, int bn)
+{
+  memset(r, 0, sizeof(uint32_t) * (an + bn));
+  for (int i = 0; i < an; i++) {
+    uint64_t carry = 0;
+    for (int j = 0; j < bn; j++) {
+      uint64_t t = (uint64_t)a[i] * b[j] + r[i + j] + carry;
+      r[i + j] = (uint32_t)t;
+      carry = t >> 32;
+    }
+    r[i + bn] = (uint32_t)carry;
+  }
+}
+
+/**
+ * r = a * b, r has an + bn limbs
+ *
+ * Splitting both at m limbs, a = a1 * B^m + a0 and b = b1 * B^m + b0,
+ * the product is z2 * B^2m + z1 * B^m + z0 with z0 = a0 * b0, z2 = a1 * b1
+ * and z1 = (a0 + a1) * (b0 + b1) - z0 - z2: three multiplications of half
+ * the size instead of four (Karatsuba).
+ */
+void _lbig_mulmag(uint32_t* r, uint32_t* a, int an, uint32_t* b, int bn)
+{
+  if (an < bn) {
+    uint32_t* t = a;
+    a = b;
+    b = t;
+    int tn = an;
+    an = bn;
+    bn = tn;
+  }
+
+  if (bn < LBIG_KARATSUBA) {
+    _lbig_school(r, a, an, b, bn);
+    return;
+  }
+
+  int rn = an + bn;
+  int m = an / 2;
+  memset(r, 0, sizeof(uint32_t) * rn);
+
+  /* b is too short to be split, a is multiplied by it in two halves */
+  if (bn <= m) {
+    uint32_t* t = malloc(sizeof(uint32_t) * (an - m + bn));
+    _lbig_mulmag(t, a, m, b, bn);
+    _lbig_addat(r, rn, t, m + bn, 0);
+    _lbig_mulmag(t, a + m, an - m, b, bn);
+    _lbig_addat(r, rn, t, an - m + bn, m);
+    free(t);
+    return;
+  }
+
+  int a1n = an - m;
+  int b1n = bn - m;
+  int sbn = (m > b1n ? m : b1n) + 1;
+  int z1n = a1n + 1 + sbn;
+
+  uint32_t* z0 = malloc(sizeof(uint32_t) * 2 * m);
+  uint32_t* z2 = malloc(sizeof(uint32_t) * (a1n + b1n));
+  uint32_t* sa = malloc(sizeof(uint32_t) * (a1n + 1));
+  uint32_t* sb = malloc(sizeof(uint32_t) * sbn);
+  uint32_t* z1 = malloc(sizeof(uint32_t) * z1n);
+
+  _lbig_mulmag(z0, a, m, b, m);
+  _lbig_mulmag(z2, a + m, a1n, b + m, b1n);
+  _lbig_addmag(sa, a, m, a + m, a1n);
+  _lbig_addmag(sb, b, m, b + m, b1n);
+  _lbig_mulmag(z1, sa, a1n + 1, sb, sbn);
+  _lbig_submag(z1, z1n, z0, 2 * m);
+  _lbig_submag(z1, z1n, z2, a1n + b1n);
+
+  memcpy(r, z0, sizeof(uint32_t) * 2 * m);
+  _lbig_addat(r, rn, z2, a1n + b1n, 2 * m);
+  _lbig_addat(r, rn, z1, z1n, m);
+
+  free(z0);
+  free(z2);
+  free(sa);
+  free(sb);
+  free(z1);
+}
+
+int _lbig_clz(uint32_t x)
+{
+  int n = 0;
+  while (!(x & 0x80000000u)) {
+    x <<= 1;
+    n++;
+  }
+  return n;
+}
+
+/**
+ * q = u / v (long division, Knuth's algorithm D), u has m limbs and v
+ * has n, m >= n and the last limb of v is not 0, q has m - n + 1 limbs
+ */
+void _lbig_divmag(uint32_t* q, uint32_t* u, int m, uint32_t* v, int n)
+{
+  if (n == 1) {
+    uint64_t k = 0;
+    for (int j = m - 1; j >= 0; j--) {
+      uint64_t t = (k << 32) | u[j];
+      q[j] = (uint32_t)(t / v[0]);
+      k = t % v[0];
+    }
+    return;
+  }
+
+  /* normalized, so the last limb of v has its highest bit set */
+  int s = _lbig_clz(v[n - 1]);
+  uint32_t* vn = malloc(sizeof(uint32_t) * n);
+  uint32_t* un = malloc(sizeof(uint32_t) * (m + 1));
+  for (int i = n - 1; i > 0; i--) {
+    vn[i] = (v[i] << s) | (s ? (uint32_t)((uint64_t)v[i - 1] >> (32 - s)) : 0);
+  }
+  vn[0] = v[0] << s;
+  un[m] = s ? (uint32_t)((uint64_t)u[m - 1] >> (32 - s)) : 0;
+  for (int i = m - 1; i > 0; i--) {
+    un[i] = (u[i] << s) | (s ? (uint32_t)((uint64_t)u[i - 1] >> (32 - s)) : 0);
+  }
+  un[0] = u[0] << s;
+
+  const uint64_t B = (uint64_t)1 << 32;
+  for (int j = m - n; j >= 0; j--) {
+    /* estimate the limb of the quotient, off by at most one after this */
+    uint64_t num = ((uint64_t)un[j + n] << 32) | un[j + n - 1];
+    uint64_t qhat = num / vn[n - 1];
+    uint64_t rhat = num % vn[n - 1];
+    while (qhat >= B || qhat * vn[n - 2] > ((rhat << 32) | un[j + n - 2])) {
+      qhat--;
+      rhat += vn[n - 1];
+      if (rhat >= B) {
+        break;
+      }
+    }
+
+    /* multiply and subtract */
+    int64_t k = 0;
+    int64_t t;
+    for (int i = 0; i < n; i++) {
+      uint64_t p = qhat * vn[i];
+      t = (int64_t)un[i + j] - k - (int64_t)(p & 0xFFFFFFFFu);
+      un[i + j] = (uint32_t)t;
+      k = (int64_t)(p >> 32) - (t >> 32);
+    }
+    t = (int64_t)un[j + n] - k;
+    un[j + n] = (uint32_t)t;
+
+    /* subtracted too much, add back */
+    q[j] = (uint32_t)qhat;
+    if (t < 0) {
+      q[j]--;
+      k = 0;
+      for (int i = 0; i < n; i++) {
+        t = (int64_t)un[i + j] + vn[i] + k;
+        un[i + j] = (uint32_t)t;
+        k = t >> 32;
+      }
+      un[j + n] += (uint32_t)k;
+    }
+  }
+
+  free(vn);
+  free(un);
+}
+
+/* a + b with b of the sign given */
+lbig* _lbig_addsign(lbig* a, lbig* b, int bsign)
+{
+  if (a->sign == bsign) {
+    int n = a->len > b->len ? a->len : b->len;
+    lbig* r = _lbig_new(n + 1);
+    _lbig_addmag(r->d, a->d, a->len, b->d, b->len);
+    r->sign = a->sign;
+    return _lbig_trim(r);
+  }
+
+  /* the smallest magnitude is subtracted from the biggest */
+  int c = _lbig_cmpmag(a->d, a->len, b->d, b->len);
+  lbig* big = c >= 0 ? a : b;
+  lbig* small = c >= 0 ? b : a;
+  lbig* r = lbig_copy(big);
+  _lbig_submag(r->d, r->len, small->d, small->len);
+  r->sign = c >= 0 ? a->sign : bsign;
+  return _lbig_trim(r);
+}
+
+lbig* lbig_add(lbig* a, lbig* b)
+{
+  return _lbig_addsign(a, b, b->sign);
+}
+
+lbig* lbig_sub(lbig* a, lbig* b)
+{
+  return _lbig_addsign(a, b, -b->sign);
+}
+
+lbig* lbig_mul(lbig* a, lbig* b)
+{
+  if (!a->len || !b->len) {
+    return _lbig_new(0);
+  }
+
+  lbig* r = _lbig_new(a->len + b->len);
+  _lbig_mulmag(r->d, a->d, a->len, b->d, b->len);
+  r->sign = a->sign * b->sign;
+  return _lbig_trim(r);
+}
+
+lbig* lbig_div(lbig* a, lbig* b)
+{
+  if (_lbig_cmpmag(a->d, a->len, b->d, b->len) < 0) {
+    return _lbig_new(0);
+  }
+
+  lbig* q = _lbig_new(a->len - b->len + 1);
+  _lbig_divmag(q->d, a->d, a->len, b->d, b->len);
+  q->sign = a->sign * b->sign;
+  return _lbig_trim(q);
+}
+
+lbig* lbig_neg(lbig* a)
+{
+  lbig* r = lbig_copy(a);
+  r->sign = -a->sign;
+  return _lbig_trim(r);
+}
+
+int lbig_cmp(lbig* a, lbig* b)
+{
+  if (a->sign != b->sign) {
+    return a->sign;
+  }
+  return a->sign * _lbig_cmpmag(a->d, a->len, b->d, b->len);
+}
+
+int lbig_long(lbig* a, long* x)
+{
+  if (a->len > (int)(sizeof(long) / 4)) {
+    return 0;
+  }
+
+  unsigned long m = 0;
+  for (int i = a->len - 1; i >= 0; i--) {
+    m = ((m << 16) << 16) | a->d[i];
+  }
+
+  if (a->sign > 0) {
+    if (m > (unsigned long)LONG_MAX) {
+      return 0;
+    }
+    *x = (long)m;
+  } else {
+    if (m > (unsigned long)LONG_MAX + 1) {
+      return 0;
+    }
+    *x = m ? -(long)(m - 1) - 1 : 0;
+  }
+  return 1;
+}
+
+double lbig_double(lbig* a)
+{
+  double d = 0.0;
+  for (int i = a->len - 1; i >= 0; i--) {
+    d = d * 4294967296.0 + a->d[i];
+  }
+  return a->sign * d;
+}
+
+char* lbig_str(lbig* a)
+{
+  /* nine digits at a time, from the last ones */
+  lbig* t = lbig_copy(a);
+  int count = 0;
+  uint32_t* chunks = malloc(sizeof(uint32_t) * (a->len * 10 / 9 + 2));
+  do {
+    chunks[count++] = _lbig_divsmall(t, 1000000000u);
+  } while (t->len);
+  lbig_del(t);
+
+  char* s = malloc(count * 9 + 2);
+  char* p = s;
+  if (a->sign < 0) {
+    *p++ = '-';
+  }
+  p += sprintf(p, "%u", (unsigned)chunks[count - 1]);
+  for (int i = count - 2; i >= 0; i--) {
+    p += sprintf(p, "%09u", (unsigned)chunks[i]);
+  }
+
+  free(chunks);
+  return s;
+}
@@ -0,0 +1,95 @@
+#ifndef LISPY_BIG_H
+#define LISPY_BIG_H
+
+#include "fwd.h"
+
+#include <stdint.h>
+
+/**
+ * Number of limbs of both operands from which a multiplication is split
+ * in three smaller ones (Karatsuba) instead of done limb by limb
+ */
+#define LBIG_KARATSUBA 32
+
+/**
+ * Arithmetic on longs that detects overflows: computes a OP b in *r and
+ * is true if the result did not fit (*r is then not to be used)
+ */
+#if defined(__GNUC__) || defined(__clang__)
+#define LBIG_ADD(a, b, r) __builtin_add_overflow(a, b, r)
+#define LBIG_SUB(a, b, r) __builtin_sub_overflow(a, b, r)
+#define LBIG_MUL(a, b, r) __builtin_mul_overflow(a, b, r)
+#else
+#define LBIG_ADD(a, b, r) lbig_add_overflow(a, b, r)
+#define LBIG_SUB(a, b, r) lbig_sub_overflow(a, b, r)
+#define LBIG_MUL(a, b, r) lbig_mul_overflow(a, b, r)
+#endif
+
+int lbig_add_overflow(long a, long b, long* r);
+int lbig_sub_overflow(long a, long b, long* r);
+int lbig_mul_overflow(long a, long b, long* r);
+
+/**
+ * An integer of any size, used for the numbers that do not fit in a long
+ */
+struct lbig
+{
+  /** 1 or -1 **/
+  int sign;
+
+  /** limbs (base 2^32), the least significant first, the last one is never 0 **/
+  int len;
+  uint32_t* d;
+};
+
+/**
+ * Creates an integer from a long
+ */
+lbig* lbig_from_long(long x);
+
+/**
+ * Creates an integer from its digits (base 10), with an optional '-'
+ */
+lbig* lbig_parse(char* s);
+
+lbig* lbig_copy(lbig* a);
+void lbig_del(lbig* a);
+
+/**
+ * Operations, every one creates a new integer and leaves the operands
+ * untouched. The division truncates (just as the one of longs) and b
+ * must not be 0.
+ */
+lbig* lbig_add(lbig* a, lbig* b);
+lbig* lbig_sub(lbig* a, lbig* b);
+lbig* lbig_mul(lbig* a, lbig* b);
+lbig* lbig_div(lbig* a, lbig* b);
+lbig* lbig_neg(lbig* a);
+
+/**
+ * Compares two integers
+ *
+ * return     a negative number if a < b, 0 if a == b, positive if a > b
+ */
+int lbig_cmp(lbig* a, lbig* b);
+
+/**
+ * If the integer fits in a long, sets *x to it
+ *
+ * return     1 (true) if it fits, 0 (false) otherwise
+ */
+int lbig_long(lbig* a, long* x);
+
+/**
+ * The nearest double to the integer (or an infinity if too large)
+ */
+double lbig_double(lbig* a);
+
+/**
+ * The digits (base 10) of an integer, with a '-' if negative
+ *
+ * return     a new string, to be freed by the caller
+ */
+char* lbig_str(lbig* a);
+
+#endif//LISPY_BIG_H
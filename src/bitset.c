@@ -0,0 +1,117 @@
+#include "bitset.h"
+#include "kern.h"
+
+#include <string.h>
+
+#if defined(__GNUC__) || defined(__clang__)
+#define LBITSET_CTZ(x) __builtin_ctzll(x)
+#else
+#define LBITSET_CTZ(x) _lbitset_ctz(x)
+#endif
+
+int _lbitset_ctz(uint64_t x)
+{
+  int n = 0;
+  while (!(x & 1)) {
+    x >>= 1;
+    n++;
+  }
+  return n;
+}
+
+lbitset* lbitset_new(long len)
+{
+  lbitset* b = malloc(sizeof(lbitset));
+  b->refs = 1;
+  b->len = len > 0 ? len : 1;
+  b->words = calloc(b->len, sizeof(uint64_t));
+  return b;
+}
+
+void lbitset_del(lbitset* b)
+{
+  if (--b->refs == 0) {
+    free(b->words);
+    free(b);
+  }
+}
+
+void lbitset_set(lbitset* b, long i)
+{
+  long w = i / 64;
+  if (w >= b->len) {
+    long len = b->len * 2 > w ? b->len * 2 : w + 1;
+    b->words = realloc(b->words, sizeof(uint64_t) * len);
+    memset(b->words + b->len, 0, sizeof(uint64_t) * (len - b->len));
+    b->len = len;
+  }
+  b->words[w] |= (uint64_t)1 << (i % 64);
+}
+
+void lbitset_clear(lbitset* b, long i)
+{
+  if (i / 64 < b->len) {
+    b->words[i / 64] &= ~((uint64_t)1 << (i % 64));
+  }
+}
+
+int lbitset_test(lbitset* b, long i)
+{
+  return i / 64 < b->len && (b->words[i / 64] >> (i % 64) & 1);
+}
+
+long lbitset_count(lbitset* b)
+{
+  return lkern_get()->u64_popcount(b->words, b->len);
+}
+
+long lbitset_next(lbitset* b, long i)
+{
+  long w = i / 64;
+  if (w >= b->len) {
+    return -1;
+  }
+
+  /* the bits before i are left out of its word */
+  uint64_t m = b->words[w] & (~(uint64_t)0 << (i % 64));
+  while (!m) {
+    if (++w == b->len) {
+      return -1;
+    }
+    m = b->words[w];
+  }
+  return w * 64 + LBITSET_CTZ(m);
+}
+
+lbitset* lbitset_op(int op, lbitset* x, lbitset* y)
+{
+  /* the words x and y both have go through the kernel, the rest are x's (or y's) or 0 */
+  long n = x->len < y->len ? x->len : y->len;
+  long len = op == LKERN_AND ? n : op == LKERN_ANDNOT ? x->len
+      : x->len > y->len ? x->len : y->len;
+
+  lbitset* r = lbitset_new(len);
+  lkern_get()->u64_logic(op, r->words, x->words, y->words, n);
+  if (op != LKERN_AND) {
+    lbitset* rest = x->len > n ? x : y;
+    memcpy(r->words + n, rest->words + n, sizeof(uint64_t) * (len - n));
+  }
+  return r;
+}
+
+int lbitset_eq(lbitset* x, lbitset* y)
+{
+  long n = x->len < y->len ? x->len : y->len;
+  if (memcmp(x->words, y->words, sizeof(uint64_t) * n) != 0) {
+    return 0;
+  }
+
+  /* past the words of one of them, the other has no members */
+  lbitset* rest = x->len > n ? x : y;
+  for (long w = n; w < rest->len; w++) {
+    if (rest->words[w]) {
+      return 0;
+    }
+  }
+  return 1;
+}
@@ -0,0 +1,86 @@
+#ifndef LISPY_BITSET_H
+#define LISPY_BITSET_H
+
+#include "fwd.h"
+
+#include <stdint.h>
+
+/**
+ * Number of members printed of a bitset
+ */
+#define LBITSET_PRINT 16
+
+/**
+ * The members of a set of integers from 0 (LVAL_BITSET), the integer i
+ * is the bit (i % 64) of the word i / 64: a member takes one bit, and
+ * the union, intersection and difference of two sets are computed 64
+ * members (or more, see lkern) at a time. Like a vector, a bitset is
+ * changed in place and shared by every copy of the value.
+ *
+ * The words grow to twice as many when an integer past them is added.
+ */
+struct lbitset
+{
+  /** number of values sharing the bitset **/
+  int refs;
+
+  /** number of words, the ones past the greatest member are 0 **/
+  long len;
+  uint64_t* words;
+};
+
+/**
+ * Creates an empty bitset
+ *
+ * long len     number of words it has room for before it grows
+ */
+lbitset* lbitset_new(long len);
+
+/**
+ * Releases a reference to the bitset (freed with the last one)
+ */
+void lbitset_del(lbitset* b);
+
+/**
+ * Adds the integer i (not negative) to the set, growing it if needed
+ */
+void lbitset_set(lbitset* b, long i);
+
+/**
+ * Removes the integer i from the set
+ */
+void lbitset_clear(lbitset* b, long i);
+
+/**
+ * If the integer i is in the set
+ *
+ * return     1 (true) if it is, 0 (false) otherwise
+ */
+int lbitset_test(lbitset* b, long i);
+
+/**
+ * The number of members of the set
+ */
+long lbitset_count(lbitset* b);
+
+/**
+ * The least member of the set not less than i
+ *
+ * return     the member, or -1 if there is none
+ */
+long lbitset_next(lbitset* b, long i);
+
+/**
+ * A new bitset with the union (LKERN_OR), the intersection (LKERN_AND)
+ * or the difference (LKERN_ANDNOT, the members of x not in y) of x and y
+ */
+lbitset* lbitset_op(int op, lbitset* x, lbitset* y);
+
+/**
+ * If two bitsets have the same members
+ *
+ * return     1 (true) if they do, 0 (false) otherwise
+ */
+int lbitset_eq(lbitset* x, lbitset* y);
+
+#endif//LISPY_BITSET_H
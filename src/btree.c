@@ -0,0 +1,616 @@
+#include "btree.h"
+#include "big.h"
+#include "str.h"
+#include "val.h"
+
+#include <string.h>
+
+/** least and most number of entries of a node (but the root, which can have less) **/
+#define LBTREE_MIN (LBTREE_ORDER / 2 - 1)
+#define LBTREE_MAX (LBTREE_ORDER - 1)
+
+/**
+ * An entry of a tree, shared by the nodes of every tree having it
+ */
+typedef struct lbtree_entry
+{
+  int refs;
+  lval* key;
+  lval* val;
+} lbtree_entry;
+
+/* the keys go in 3 classes: the Numbers, then the Strings, then the Symbols */
+int _lbtree_class(lval* k)
+{
+  switch (k->type) {
+    case LVAL_STR: return 1;
+    case LVAL_SYM: return 2;
+  }
+  return 0;
+}
+
+double _lbtree_dbl(lval* v)
+{
+  switch (v->type) {
+    case LVAL_FLOAT:  return v->dbl;
+    case LVAL_BIGNUM: return lbig_double(v->big);
+  }
+  return (double)v->num;
+}
+
+int lbtree_cmp(lval* a, lval* b)
+{
+  int ca = _lbtree_class(a);
+  int cb = _lbtree_class(b);
+  if (ca != cb) {
+    return (ca > cb) - (ca < cb);
+  }
+
+  if (ca) {
+    int c = ca == 1 ? lstr_cmp(a->str, b->str) : strcmp(a->sym, b->sym);
+    return (c > 0) - (c < 0);
+  }
+
+  if (a->type == LVAL_NUM && b->type == LVAL_NUM) {
+    return (a->num > b->num) - (a->num < b->num);
+  }
+
+  int c;
+  if (a->type == LVAL_FLOAT || b->type == LVAL_FLOAT) {
+    double x = _lbtree_dbl(a);
+    double y = _lbtree_dbl(b);
+    c = x != x || y != y ? (x != x) - (y != y) : (x > y) - (x < y);
+  } else {
+    lbig* x = a->type == LVAL_BIGNUM ? a->big : lbig_from_long(a->num);
+    lbig* y = b->type == LVAL_BIGNUM ? b->big : lbig_from_long(b->num);
+    c = lbig_cmp(x, y);
+    if (a->type != LVAL_BIGNUM) {
+      lbig_del(x);
+    }
+    if (b->type != LVAL_BIGNUM) {
+      lbig_del(y);
+    }
+  }
+
+  /* the same value in numbers of different types, which are not equal */
+  return c ? c : (a->type > b->type) - (a->type < b->type);
+}
+
+lbtree_entry* _lbtree_entry(lval* k, lval* v)
+{
+  lbtree_entry* x = malloc(sizeof(lbtree_entry));
+  x->refs = 1;
+  x->key = k;
+  x->val = v;
+  return x;
+}
+
+void _lbtree_entry_del(lbtree_entry* x)
+{
+  if (--x->refs == 0) {
+    lval_del(x->key);
+    if (x->val) {
+      lval_del(x->val);
+    }
+    free(x);
+  }
+}
+
+lbtree* _lbtree_new(int leaf)
+{
+  lbtree* t = malloc(sizeof(lbtree));
+  t->refs = 1;
+  t->count = 0;
+  t->size = 0;
+  t->leaf = leaf;
+  return t;
+}
+
+void lbtree_del(lbtree* t)
+{
+  if (t && --t->refs == 0) {
+    for (int i = 0; i < t->count; i++) {
+      _lbtree_entry_del(t->ents[i]);
+    }
+    if (!t->leaf) {
+      for (int i = 0; i <= t->count; i++) {
+        lbtree_del(t->kids[i]);
+      }
+    }
+    free(t);
+  }
+}
+
+lbtree* lbtree_share(lbtree* t)
+{
+  if (t) {
+    t->refs++;
+  }
+  return t;
+}
+
+long lbtree_count(lbtree* t)
+{
+  return t ? t->size : 0;
+}
+
+/* the node to change: t itself if nothing else has it, otherwise a copy */
+lbtree* _lbtree_own(lbtree* t)
+{
+  if (t->refs == 1) {
+    return t;
+  }
+
+  lbtree* c = _lbtree_new(t->leaf);
+  c->count = t->count;
+  c->size = t->size;
+  for (int i = 0; i < t->count; i++) {
+    c->ents[i] = t->ents[i];
+    c->ents[i]->refs++;
+  }
+  if (!t->leaf) {
+    for (int i = 0; i <= t->count; i++) {
+      c->kids[i] = t->kids[i];
+      c->kids[i]->refs++;
+    }
+  }
+
+  t->refs--;
+  return c;
+}
+
+/* the number of entries of the node and the ones below, after a change */
+void _lbtree_resize(lbtree* t)
+{
+  t->size = t->count;
+  if (!t->leaf) {
+    for (int i = 0; i <= t->count; i++) {
+      t->size += t->kids[i]->size;
+    }
+  }
+}
+
+/* the index of the first key of the node not less than k, and if it is k */
+int _lbtree_search(lbtree* t, lval* k, int* found)
+{
+  int lo = 0;
+  int hi = t->count;
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (lbtree_cmp(t->ents[mid]->key, k) < 0) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  *found = lo < t->count && lbtree_cmp(t->ents[lo]->key, k) == 0;
+  return lo;
+}
+
+/* the key and value of an entry, the value of a set being its key */
+int _lbtree_out(lbtree_entry* x, lval** k, lval** v)
+{
+  *k = x->key;
+  *v = x->val ? x->val : x->key;
+  return 1;
+}
+
+/* the number of entries a tree of height h (1 for a leaf) has room for */
+long _lbtree_cap(int h)
+{
+  long cap = 1;
+  while (h--) {
+    cap *= LBTREE_ORDER;
+  }
+  return cap - 1;
+}
+
+/* a node of height h with the n entries of x, in order, each child as full as the others */
+lbtree* _lbtree_load(lbtree_entry** x, long n, int h)
+{
+  lbtree* t = _lbtree_new(h == 1);
+  t->size = n;
+  if (h == 1) {
+    memcpy(t->ents, x, sizeof(lbtree_entry*) * n);
+    t->count = (int)n;
+    return t;
+  }
+
+  /* the least number of children the entries fit in, which are at least half full */
+  long cap = _lbtree_cap(h - 1);
+  long c = (n + cap + 1) / (cap + 1);
+  long q = (n - (c - 1)) / c;
+  long r = (n - (c - 1)) % c;
+  for (long j = 0; j < c; j++) {
+    long m = q + (j < r);
+    t->kids[j] = _lbtree_load(x, m, h - 1);
+    x += m;
+    if (j < c - 1) {
+      t->ents[j] = *x++;
+    }
+  }
+  t->count = (int)c - 1;
+  return t;
+}
+
+/* a tree with the n entries of x, in order and with keys all different */
+lbtree* _lbtree_bulk(lbtree_entry** x, long n)
+{
+  if (n == 0) {
+    return NULL;
+  }
+  int h = 1;
+  while (_lbtree_cap(h) < n) {
+    h++;
+  }
+  return _lbtree_load(x, n, h);
+}
+
+/* sorts the n entries of x by their keys, keeping the order of equal ones */
+void _lbtree_sort(lbtree_entry** x, long n, lbtree_entry** tmp)
+{
+  if (n < 2) {
+    return;
+  }
+  long m = n / 2;
+  _lbtree_sort(x, m, tmp);
+  _lbtree_sort(x + m, n - m, tmp);
+
+  long i = 0;
+  long j = m;
+  long k = 0;
+  while (i < m && j < n) {
+    tmp[k++] = lbtree_cmp(x[j]->key, x[i]->key) < 0 ? x[j++] : x[i++];
+  }
+  while (i < m) {
+    tmp[k++] = x[i++];
+  }
+  memcpy(x, tmp, sizeof(lbtree_entry*) * k);
+}
+
+lbtree* lbtree_build(lval** k, lval** v, long n)
+{
+  lbtree_entry** x = malloc(sizeof(lbtree_entry*) * (n ? n : 1));
+  int sorted = 1;
+  for (long i = 0; i < n; i++) {
+    x[i] = _lbtree_entry(k[i], v ? v[i] : NULL);
+    if (i > 0 && sorted && lbtree_cmp(k[i - 1], k[i]) >= 0) {
+      sorted = 0;
+    }
+  }
+
+  if (!sorted) {
+    lbtree_entry** tmp = malloc(sizeof(lbtree_entry*) * n);
+    _lbtree_sort(x, n, tmp);
+    free(tmp);
+  }
+
+  /* of the equal keys, now next to each other, the last one is kept */
+  long m = 0;
+  for (long i = 0; i < n; i++) {
+    if (m > 0 && lbtree_cmp(x[m - 1]->key, x[i]->key) == 0) {
+      _lbtree_entry_del(x[m - 1]);
+      x[m - 1] = x[i];
+    } else {
+      x[m++] = x[i];
+    }
+  }
+
+  lbtree* t = _lbtree_bulk(x, m);
+  free(x);
+  return t;
+}
+
+lval* lbtree_get(lbtree* t, lval* k)
+{
+  while (t) {
+    int found;
+    int i = _lbtree_search(t, k, &found);
+    if (found) {
+      lbtree_entry* x = t->ents[i];
+      return x->val ? x->val : x->key;
+    }
+    t = t->leaf ? NULL : t->kids[i];
+  }
+  return NULL;
+}
+
+/* splits the child i (full) of the node t (owned, not full) in two, its middle entry going up to t */
+void _lbtree_split(lbtree* t, int i)
+{
+  int half = LBTREE_ORDER / 2;
+  lbtree* y = t->kids[i] = _lbtree_own(t->kids[i]);
+  lbtree* z = _lbtree_new(y->leaf);
+
+  z->count = half - 1;
+  memcpy(z->ents, y->ents + half, sizeof(lbtree_entry*) * (half - 1));
+  if (!y->leaf) {
+    memcpy(z->kids, y->kids + half, sizeof(lbtree*) * half);
+  }
+  y->count = half - 1;
+  _lbtree_resize(y);
+  _lbtree_resize(z);
+
+  memmove(t->kids + i + 2, t->kids + i + 1, sizeof(lbtree*) * (t->count - i));
+  memmove(t->ents + i + 1, t->ents + i, sizeof(lbtree_entry*) * (t->count - i));
+  t->kids[i + 1] = z;
+  t->ents[i] = y->ents[half - 1];
+  t->count++;
+}
+
+/* puts the entry x in the tree of the node t (owned, not full), 1 (true) if its key is new */
+int _lbtree_insert(lbtree* t, lbtree_entry* x)
+{
+  int found;
+  int i = _lbtree_search(t, x->key, &found);
+  if (found) {
+    _lbtree_entry_del(t->ents[i]);
+    t->ents[i] = x;
+    return 0;
+  }
+
+  if (t->leaf) {
+    memmove(t->ents + i + 1, t->ents + i, sizeof(lbtree_entry*) * (t->count - i));
+    t->ents[i] = x;
+    t->count++;
+    t->size++;
+    return 1;
+  }
+
+  /* a full child is split before going down, so there is room for an entry coming up */
+  if (t->kids[i]->count == LBTREE_MAX) {
+    _lbtree_split(t, i);
+    int c = lbtree_cmp(x->key, t->ents[i]->key);
+    if (c == 0) {
+      _lbtree_entry_del(t->ents[i]);
+      t->ents[i] = x;
+      return 0;
+    }
+    i += c > 0;
+  }
+
+  t->kids[i] = _lbtree_own(t->kids[i]);
+  int added = _lbtree_insert(t->kids[i], x);
+  t->size += added;
+  return added;
+}
+
+lbtree* lbtree_put(lbtree* t, lval* k, lval* v)
+{
+  lbtree_entry* x = _lbtree_entry(k, v);
+  if (!t) {
+    t = _lbtree_new(1);
+    t->ents[0] = x;
+    t->count = 1;
+    t->size = 1;
+    return t;
+  }
+
+  /* a full root is split, the tree grows one level */
+  t = _lbtree_own(t);
+  if (t->count == LBTREE_MAX) {
+    lbtree* r = _lbtree_new(0);
+    r->kids[0] = t;
+    r->size = t->size;
+    _lbtree_split(r, 0);
+    t = r;
+  }
+  _lbtree_insert(t, x);
+  return t;
+}
+
+/* the child i of the node t (owned) gets the entry i and the child i + 1 */
+void _lbtree_merge(lbtree* t, int i)
+{
+  lbtree* y = t->kids[i] = _lbtree_own(t->kids[i]);
+  lbtree* z = _lbtree_own(t->kids[i + 1]);
+
+  y->ents[y->count] = t->ents[i];
+  memcpy(y->ents + y->count + 1, z->ents, sizeof(lbtree_entry*) * z->count);
+  if (!y->leaf) {
+    memcpy(y->kids + y->count + 1, z->kids, sizeof(lbtree*) * (z->count + 1));
+  }
+  y->count += z->count + 1;
+  _lbtree_resize(y);
+  free(z);
+
+  memmove(t->ents + i, t->ents + i + 1, sizeof(lbtree_entry*) * (t->count - i - 1));
+  memmove(t->kids + i + 1, t->kids + i + 2, sizeof(lbtree*) * (t->count - i - 1));
+  t->count--;
+}
+
+/**
+ * the child i of the node t (owned), which has the least entries, gets one
+ * more from a sibling, or is merged with one; the index of the child the
+ * entries of the child i are in is returned
+ */
+int _lbtree_fill(lbtree* t, int i)
+{
+  if (i > 0 && t->kids[i - 1]->count > LBTREE_MIN) {
+    lbtree* l = t->kids[i - 1] = _lbtree_own(t->kids[i - 1]);
+    lbtree* c = t->kids[i] = _lbtree_own(t->kids[i]);
+    memmove(c->ents + 1, c->ents, sizeof(lbtree_entry*) * c->count);
+    c->ents[0] = t->ents[i - 1];
+    t->ents[i - 1] = l->ents[l->count - 1];
+    if (!c->leaf) {
+      memmove(c->kids + 1, c->kids, sizeof(lbtree*) * (c->count + 1));
+      c->kids[0] = l->kids[l->count];
+    }
+    c->count++;
+    l->count--;
+    _lbtree_resize(l);
+    _lbtree_resize(c);
+    return i;
+  }
+
+  if (i < t->count && t->kids[i + 1]->count > LBTREE_MIN) {
+    lbtree* c = t->kids[i] = _lbtree_own(t->kids[i]);
+    lbtree* r = t->kids[i + 1] = _lbtree_own(t->kids[i + 1]);
+    c->ents[c->count] = t->ents[i];
+    t->ents[i] = r->ents[0];
+    memmove(r->ents, r->ents + 1, sizeof(lbtree_entry*) * (r->count - 1));
+    if (!c->leaf) {
+      c->kids[c->count + 1] = r->kids[0];
+      memmove(r->kids, r->kids + 1, sizeof(lbtree*) * r->count);
+    }
+    c->count++;
+    r->count--;
+    _lbtree_resize(c);
+    _lbtree_resize(r);
+    return i;
+  }
+
+  if (i == t->count) {
+    i--;
+  }
+  _lbtree_merge(t, i);
+  return i;
+}
+
+/* the entry with the least (or greatest) key of the tree of t */
+lbtree_entry* _lbtree_edge(lbtree* t, int last)
+{
+  while (!t->leaf) {
+    t = t->kids[last ? t->count : 0];
+  }
+  return t->ents[last ? t->count - 1 : 0];
+}
+
+/* removes the key k, which is in the tree of the node t (owned, with more than the least entries but the root) */
+void _lbtree_delete(lbtree* t, lval* k)
+{
+  int found;
+  int i = _lbtree_search(t, k, &found);
+  t->size--;
+
+  if (t->leaf) {
+    _lbtree_entry_del(t->ents[i]);
+    memmove(t->ents + i, t->ents + i + 1, sizeof(lbtree_entry*) * (t->count - i - 1));
+    t->count--;
+    return;
+  }
+
+  /**
+   * in a node with children the entry takes the place of the one before
+   * (or after) it, which is removed from below, or if both children have
+   * the least entries they are merged with it in between
+   */
+  if (found) {
+    int j = t->kids[i]->count > LBTREE_MIN ? i
+        : t->kids[i + 1]->count > LBTREE_MIN ? i + 1 : -1;
+    if (j >= 0) {
+      lbtree_entry* x = _lbtree_edge(t->kids[j], j == i);
+      x->refs++;
+      _lbtree_entry_del(t->ents[i]);
+      t->ents[i] = x;
+      t->kids[j] = _lbtree_own(t->kids[j]);
+      _lbtree_delete(t->kids[j], x->key);
+      return;
+    }
+    _lbtree_merge(t, i);
+    _lbtree_delete(t->kids[i], k);
+    return;
+  }
+
+  /* the child the key is in gets more than the least entries before going down */
+  if (t->kids[i]->count == LBTREE_MIN) {
+    i = _lbtree_fill(t, i);
+  }
+  t->kids[i] = _lbtree_own(t->kids[i]);
+  _lbtree_delete(t->kids[i], k);
+}
+
+lbtree* lbtree_remove(lbtree* t, lval* k)
+{
+  if (!lbtree_get(t, k)) {
+    return t;
+  }
+
+  t = _lbtree_own(t);
+  _lbtree_delete(t, k);
+
+  /* a root left without entries gives its place to its only child */
+  if (t->count == 0) {
+    lbtree* r = t->leaf ? NULL : t->kids[0];
+    free(t);
+    return r;
+  }
+  return t;
+}
+
+long lbtree_rank(lbtree* t, lval* k, int* found)
+{
+  long r = 0;
+  *found = 0;
+  while (t) {
+    int i = _lbtree_search(t, k, found);
+    r += i;
+    if (t->leaf) {
+      break;
+    }
+    for (int j = 0; j < i + *found; j++) {
+      r += t->kids[j]->size;
+    }
+    t = *found ? NULL : t->kids[i];
+  }
+  return r;
+}
+
+int lbtree_nth(lbtree* t, long i, lval** k, lval** v)
+{
+  if (!t || i < 0 || i >= t->size) {
+    return 0;
+  }
+
+  /* down to the node with the entry, by the sizes of the children before it */
+  while (!t->leaf) {
+    int j = 0;
+    while (i >= t->kids[j]->size) {
+      i -= t->kids[j]->size;
+      if (i == 0) {
+        return _lbtree_out(t->ents[j], k, v);
+      }
+      i--;
+      j++;
+    }
+    t = t->kids[j];
+  }
+  return _lbtree_out(t->ents[i], k, v);
+}
+
+/* the entries of index 'from' to 'to' of the tree of t put in x from n on, shared, the new n returned */
+long _lbtree_collect(lbtree* t, long from, long to, lbtree_entry** x, long n)
+{
+  long base = 0;
+  for (int j = 0; j <= t->count && base < to; j++) {
+    if (!t->leaf) {
+      long s = t->kids[j]->size;
+      if (from < base + s) {
+        n = _lbtree_collect(t->kids[j], from - base, to - base, x, n);
+      }
+      base += s;
+    }
+    if (j < t->count && base >= from && base < to) {
+      x[n] = t->ents[j];
+      x[n++]->refs++;
+    }
+    base++;
+  }
+  return n;
+}
+
+lbtree* lbtree_slice(lbtree* t, long from, long to)
+{
+  long size = lbtree_count(t);
+  from = from < 0 ? 0 : from;
+  to = to > size ? size : to;
+  if (from >= to) {
+    return NULL;
+  }
+
+  lbtree_entry** x = malloc(sizeof(lbtree_entry*) * (to - from));
+  long n = _lbtree_collect(t, from, to, x, 0);
+  lbtree* s = _lbtree_bulk(x, n);
+  free(x);
+  return s;
+}
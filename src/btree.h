@@ -0,0 +1,136 @@
+#ifndef LISPY_BTREE_H
+#define LISPY_BTREE_H
+
+#include "fwd.h"
+
+/**
+ * Number of children of a full node of the tree, a node has up to
+ * LBTREE_ORDER - 1 entries and (but the root) at least half of them
+ */
+#define LBTREE_ORDER 32
+
+/**
+ * Number of entries printed of a sorted map or set
+ */
+#define LBTREE_PRINT 16
+
+/**
+ * A persistent B-tree, the entries of an LVAL_SMAP (a sorted map) and of
+ * an LVAL_SSET (a sorted set, whose entries have no value), in the order
+ * of their keys (see lbtree_cmp())
+ *
+ * A tree is its root node (NULL when empty). The nodes are wide, so a
+ * lookup goes down a few of them, searching the keys of each one in a
+ * single array. Every node, and every entry, is a counted reference shared
+ * by all the trees having it: a change copies only the nodes from the
+ * root to the entry (or changes them in place when nothing else has them).
+ * Every node knows the number of entries below it, so the entry with a
+ * given index, or the index of a key, is found going down once.
+ */
+struct lbtree
+{
+  /** number of trees and nodes having the node **/
+  int refs;
+
+  /** number of entries in the node, and in the node and all the ones below **/
+  int count;
+  long size;
+
+  /** if the node has no children **/
+  int leaf;
+
+  /** the entries, in order, and the children: 'kids[i]' has the keys before 'ents[i]' **/
+  struct lbtree_entry* ents[LBTREE_ORDER - 1];
+  lbtree* kids[LBTREE_ORDER];
+};
+
+/**
+ * The order of two keys (ldict_can_key() is true of both): -1, 0 or 1 as
+ * a is less, equal or greater than b
+ *
+ * The Numbers go first, by their value (nan after all of them, and a Float
+ * after an integer of the same value, as they are not equal), then the
+ * Strings and last the Symbols, each one by its characters
+ */
+int lbtree_cmp(lval* a, lval* b);
+
+/**
+ * Releases a reference to a tree (NULL is the empty one)
+ */
+void lbtree_del(lbtree* t);
+
+/**
+ * A new reference to a tree, to be released with lbtree_del()
+ */
+lbtree* lbtree_share(lbtree* t);
+
+/**
+ * Number of entries of a tree
+ */
+long lbtree_count(lbtree* t);
+
+/**
+ * Builds a tree from its entries, in O(n) if they are in the order of
+ * their keys, O(n log n) otherwise, as they are sorted first
+ *
+ * lval** k, v    the n keys (ldict_can_key() is true of them) and their
+ *                values (v is NULL for a set), all taken by the tree (or
+ *                destroyed): of the entries with equal keys the last one
+ *                is kept
+ *
+ * return     the new tree
+ */
+lbtree* lbtree_build(lval** k, lval** v, long n);
+
+/**
+ * The value of a key
+ *
+ * return     the value, the key itself in a set, still owned by the tree,
+ *            or NULL if the key is not in it
+ */
+lval* lbtree_get(lbtree* t, lval* k);
+
+/**
+ * Sets the value of a key
+ *
+ * lbtree* t      the tree, its reference is given to the new one
+ * lval* k, v     the key (ldict_can_key() is true of it) and its value
+ *                (NULL in a set), both taken by the tree (or destroyed)
+ *
+ * return     the new tree
+ */
+lbtree* lbtree_put(lbtree* t, lval* k, lval* v);
+
+/**
+ * Removes a key
+ *
+ * lbtree* t    the tree, its reference is given to the new one
+ *
+ * return     the new tree (t itself if the key was not in it)
+ */
+lbtree* lbtree_remove(lbtree* t, lval* k);
+
+/**
+ * The index of a key: the number of keys of the tree less than it
+ *
+ * int* found     set to 1 (true) if the key is in the tree, 0 otherwise
+ */
+long lbtree_rank(lbtree* t, lval* k, int* found);
+
+/**
+ * The entry with index i (0 to lbtree_count() - 1), in the order of the keys
+ *
+ * lval** k, v    set to its key and value (the key itself in a set),
+ *                owned by the tree
+ *
+ * return     1 (true) if there is one, 0 (false) if i is out of the tree
+ */
+int lbtree_nth(lbtree* t, long i, lval** k, lval** v);
+
+/**
+ * A new tree with the entries of index 'from' to 'to' (excluded) of t,
+ * shared with it
+ */
+lbtree* lbtree_slice(lbtree* t, long from, long to);
+
+#endif//LISPY_BTREE_H
@@ -1,7 +1,26 @@
 #include "builtins.h"
+#include "aot.h"
+#include "big.h"
+#include "bitset.h"
+#include "btree.h"
+#include "dict.h"
+#include "hamt.h"
 #include "eval.h"
 #include "utils.h"
 #include "parser.h"
+#include "queue.h"
+#include "record.h"
+#include "opt.h"
+#include "iter.h"
+#include "kern.h"
+#include "mat.h"
+#include "nvec.h"
+#include "seq.h"
+#include "str.h"
+#include "table.h"
+#include "vec.h"
+
+#include <limits.h>
 
 #define LASSERT(args, cond, fmt, ...)         \
   if (!(cond)) {                              \
@@ -30,9 +49,21 @@
 
 #define LASSERT_NOT_EMPTY(func, args, index)      \
   LASSERT(args, args->cell[index]->count != 0,    \
-      "function '%s' passed {} for argument %i. " \
+      "function '%s' passed {} for argument %i.", \
       func, index)
 
+#define LASSERT_COLL(func, args, index)                                     \
+  LASSERT(args, liter_can(args->cell[index]),                               \
+      "function '%s' passed incorrect type for argument %i. "               \
+      "got '%s', expected a collection.",                                   \
+      func, index, ltype_name(args->cell[index]->type))
+
+#define LASSERT_KEY(func, args, index)                                      \
+  LASSERT(args, ldict_can_key(args->cell[index]),                           \
+      "function '%s' passed incorrect type for argument %i. "               \
+      "got '%s', expected a Number, a String or a Symbol.",                 \
+      func, index, ltype_name(args->cell[index]->type))
+
 typedef void(*ldef)(lenv*, lval*, lval*);
 
 lval* _bt_def(lenv* e, lval* a, ldef func, char* fname)
@@ -87,15 +118,47 @@ lval* _bt_def(lenv* e, lval* a, ldef func, char* fname)
 BUILTIN(GDEF) { return _bt_def(e, a, lenv_def, KW_GDEF); }
 BUILTIN(LDEF) { return _bt_def(e, a, lenv_put, KW_LDEF); }
 
+/* every Range in the arguments is made a list, for functions that need one */
+void _bt_lists(lval* a)
+{
+  for (int i = 0; i < a->count; i++) {
+    if (a->cell[i]->type == LVAL_RANGE) {
+      a->cell[i] = lval_range_list(a->cell[i]);
+    }
+  }
+}
+
 BUILTIN(HEAD)
 {
   /* must have only one argument */
   LASSERT_NUM(KW_HEAD, a, 1);
 
-  /* and that argument must be a Q-Expression */
-  LASSERT_TYPE(KW_HEAD, a, 0, LVAL_QEXPR);
+  /* a range gives its first number, without being made a list */
+  if (a->cell[0]->type == LVAL_RANGE) {
+    LASSERT(a, a->cell[0]->len != 0,
+        "function '%s' passed {} for argument %i.", KW_HEAD, 0);
+    lval* v = lval_add(lval_qexpr(), lval_num(a->cell[0]->num));
+    lval_del(a);
+    return v;
+  }
+
+  /* any other collection gives the first element taken from it */
+  if (a->cell[0]->type != LVAL_QEXPR) {
+    LASSERT_COLL(KW_HEAD, a, 0);
+    liter it;
+    liter_init(&it, a->cell[0]);
+    lval* x = liter_next(e, &it);
+    liter_done(&it);
+    if (it.err) {
+      lval_del(a);
+      return it.err;
+    }
+    LASSERT(a, x, "function '%s' passed {} for argument %i.", KW_HEAD, 0);
+    lval_del(a);
+    return lval_add(lval_qexpr(), x);
+  }
 
-  /* and the argument must have len > 0 */
+  /* the argument must have len > 0 */
   LASSERT_NOT_EMPTY(KW_HEAD, a, 0);
 
   /* take the first argument */
@@ -114,10 +177,69 @@ BUILTIN(TAIL)
   /* must have only one argument */
   LASSERT_NUM(KW_TAIL, a, 1);
 
-  /* and that argument must be a Q-Expression */
-  LASSERT_TYPE(KW_TAIL, a, 0, LVAL_QEXPR);
+  /* a range gives the range after its first number */
+  if (a->cell[0]->type == LVAL_RANGE) {
+    LASSERT(a, a->cell[0]->len != 0,
+        "function '%s' passed {} for argument %i.", KW_TAIL, 0);
+    lval* v = lval_take(a, 0);
+    v->num = lval_range_at(v, 1);
+    v->len--;
+    return v;
+  }
+
+  /* a string gives the string after its first character */
+  if (a->cell[0]->type == LVAL_STR) {
+    lstr* s = a->cell[0]->str;
+    LASSERT(a, s->len > 0,
+        "function '%s' passed \"\" for argument %i.", KW_TAIL, 0);
+    lval* v = lval_strn(s->bytes + 1, s->len - 1);
+    lval_del(a);
+    return v;
+  }
+
+  /* a lazy sequence gives the sequence after its first element */
+  if (a->cell[0]->type == LVAL_LAZYSEQ) {
+    lseq* s = a->cell[0]->seq;
+    lval* err = lseq_force(e, s);
+    if (err) {
+      lval_del(a);
+      return err;
+    }
+    LASSERT(a, s->state != LSEQ_END,
+        "function '%s' passed {} for argument %i.", KW_TAIL, 0);
+    s->tail->refs++;
+    lval* v = lval_lazyseq(s->tail);
+    lval_del(a);
+    return v;
+  }
+
+  /* any other collection gives the elements taken from it after the first */
+  if (a->cell[0]->type != LVAL_QEXPR) {
+    LASSERT_COLL(KW_TAIL, a, 0);
+    liter it;
+    liter_init(&it, a->cell[0]);
+    lval* x = liter_next(e, &it);
+    lval* v = x ? lval_qexpr() : NULL;
+    if (x) {
+      lval_del(x);
+      while ((x = liter_next(e, &it))) {
+        lval_add(v, x);
+      }
+    }
+    liter_done(&it);
+    if (it.err) {
+      if (v) {
+        lval_del(v);
+      }
+      lval_del(a);
+      return it.err;
+    }
+    LASSERT(a, v, "function '%s' passed {} for argument %i.", KW_TAIL, 0);
+    lval_del(a);
+    return v;
+  }
 
-  /* and the argument must have len > 0 */
+  /* a Q-Expression must have len > 0 */
   LASSERT_NOT_EMPTY(KW_TAIL, a, 0);
 
   /* take the first argument */
@@ -140,6 +262,7 @@ BUILTIN(EVAL)
 {
   /* must have only one argument */
   LASSERT_NUM(KW_EVAL, a, 1);
+  _bt_lists(a);
 
   /* and that argument must be a Q-Expression */
   LASSERT_TYPE(KW_EVAL, a, 0, LVAL_QEXPR);
@@ -152,20 +275,66 @@ BUILTIN(EVAL)
   return leval(e, v);
 }
 
+lval* _bt_table_join(lval* a);
+
 BUILTIN(JOIN)
 {
+  /* the join of two tables is another thing */
+  if (a->count > 0 && a->cell[0]->type == LVAL_TABLE) {
+    return _bt_table_join(a);
+  }
+
   /* can receive any number of arguments ... */
   for (int i = 0; i < a->count; i++) {
-    /* ...but every argument must be a Q-Expression */
-    LASSERT_TYPE(KW_JOIN, a, i, LVAL_QEXPR);
+    /* ...but every argument must be a collection */
+    LASSERT_COLL(KW_JOIN, a, i);
   }
 
-  /* take first element */
-  lval* v = lval_pop(a, 0);
+  /* strings are joined into a string */
+  int strs = a->count > 0;
+  long slen = 0;
+  for (int i = 0; i < a->count; i++) {
+    strs = strs && a->cell[i]->type == LVAL_STR;
+    slen += strs ? a->cell[i]->str->len : 0;
+  }
+  if (strs) {
+    char* bytes = malloc(slen + 1);
+    long at = 0;
+    for (int i = 0; i < a->count; i++) {
+      memcpy(bytes + at, a->cell[i]->str->bytes, a->cell[i]->str->len);
+      at += a->cell[i]->str->len;
+    }
+    lval* v = lval_strn(bytes, slen);
+    free(bytes);
+    lval_del(a);
+    return v;
+  }
 
-  /* append the rest elements to the first one */
+  /* append the elements of every argument, in order */
+  lval* v = lval_qexpr();
   while (a->count) {
-    v = lval_join(v, lval_pop(a, 0));
+    lval* x = lval_pop(a, 0);
+
+    /* the children of a list are moved at once */
+    if (x->type == LVAL_QEXPR) {
+      v = lval_join(v, x);
+      continue;
+    }
+
+    liter it;
+    liter_init(&it, x);
+    lval* y;
+    while ((y = liter_next(e, &it))) {
+      lval_add(v, y);
+    }
+    liter_done(&it);
+    lval_del(x);
+
+    if (it.err) {
+      lval_del(v);
+      lval_del(a);
+      return it.err;
+    }
   }
 
   lval_del(a);
@@ -193,46 +362,188 @@ BUILTIN(LAMBDA)
   lval* body = lval_pop(a, 0);
   lval_del(a);
 
-  return lval_lambda(formals, body);
+  lnative native = laot_find(body);
+
+  lval* f = lval_lambda(formals, body);
+  if (native) {
+    lval_code(f)->native = native;
+  }
+  return f;
+}
+
+/* the integer of a number (a new one) */
+lbig* _bt_big(lval* v)
+{
+  return v->type == LVAL_BIGNUM ? lbig_copy(v->big) : lbig_from_long(v->num);
+}
+
+/* x op y, both consumed, as integers of any size */
+lval* _bt_bigop(char op, lval* x, lval* y)
+{
+  lbig* a = _bt_big(x);
+  lbig* b = _bt_big(y);
+  lbig* r = NULL;
+  switch (op) {
+    case '+': r = lbig_add(a, b); break;
+    case '-': r = lbig_sub(a, b); break;
+    case '*': r = lbig_mul(a, b); break;
+    case '/': r = lbig_div(a, b); break;
+  }
+  lbig_del(a);
+  lbig_del(b);
+  lval_del(x);
+  lval_del(y);
+  return lval_bignum(r);
+}
+
+/* the number as a double */
+double _bt_dbl(lval* v)
+{
+  switch (v->type) {
+    case LVAL_FLOAT:  return v->dbl;
+    case LVAL_BIGNUM: return lbig_double(v->big);
+  }
+  return (double)v->num;
+}
+
+/**
+ * op over numbers one of which is a float, all of them as doubles: they
+ * are put in an array first, so the kernels run over them in one loop
+ */
+lval* _bt_fop(lval* a, char* op)
+{
+  long n = a->count;
+  double* x = malloc(sizeof(double) * n);
+  for (long i = 0; i < n; i++) {
+    x[i] = _bt_dbl(a->cell[i]);
+  }
+  lval_del(a);
+
+  double r = x[0];
+  switch (op[0]) {
+    case '+': r = lkern_sum(x, n); break;
+    case '*': r = lkern_prod(x, n); break;
+    case '-': r = n == 1 ? -x[0] : x[0] - lkern_sum(x + 1, n - 1); break;
+    case '/':
+      for (long i = 1; i < n; i++) {
+        r /= x[i];
+      }
+      break;
+  }
+
+  free(x);
+  return lval_float(r);
 }
 
+int _bt_isvec(lval* v);
+lval* _bt_vop(lenv* e, lval* a, char* op);
+lval* _bt_vcmp(lval* a, char* op);
+lval* _bt_mop(int kop, lval* x, lval* y, char* fname);
+
 lval* _bt_op(lenv* e, lval* a, char* op)
 {
+  /* two longs (most calls) go straight to their result while it fits, anything else takes the loop */
+  if (a->count == 2 && a->cell[0]->type == LVAL_NUM && a->cell[1]->type == LVAL_NUM) {
+    lval* x = a->cell[0];
+    long y = a->cell[1]->num;
+    long r = 0;
+    int overflow = 0;
+    switch (op[0]) {
+      case '+': overflow = LBIG_ADD(x->num, y, &r); break;
+      case '-': overflow = LBIG_SUB(x->num, y, &r); break;
+      case '*': overflow = LBIG_MUL(x->num, y, &r); break;
+      case '/':
+        overflow = y == 0 || (x->num == LONG_MIN && y == -1);
+        r = overflow ? 0 : x->num / y;
+        break;
+    }
+    if (!overflow) {
+      x->num = r;
+      lval_del(a->cell[1]);
+      a->count = 0;
+      lval_del(a);
+      return x;
+    }
+  }
+
+  int floats = 0;
+  int vecs = 0;
   for (int i = 0; i < a->count; i++) {
-    if (a->cell[i]->type != LVAL_NUM) {
+    int t = a->cell[i]->type;
+    if (t != LVAL_NUM && t != LVAL_BIGNUM && t != LVAL_FLOAT
+        && t != LVAL_F64VEC && t != LVAL_I64VEC && t != LVAL_MATRIX) {
       lval* err = lval_err("function '%s' passed incorrect type for argument %i. got '%s', expected '%s'",
-          op, i, ltype_name(a->cell[i]->type), ltype_name(LVAL_NUM));
+          op, i, ltype_name(t), ltype_name(LVAL_NUM));
       lval_del(a);
       return err;
     }
+    floats += t == LVAL_FLOAT;
+    vecs += t == LVAL_F64VEC || t == LVAL_I64VEC || t == LVAL_MATRIX;
   }
 
-  /* pop the first element */
-  lval* x = lval_pop(a, 0);
+  /* a vector (or a matrix) is operated elementwise */
+  if (vecs) {
+    return _bt_vop(e, a, op);
+  }
 
-  if ((is(op, KW_SUB)) && a->count == 0) {
-    x->num = -x->num;
+  /* a float makes every number a float */
+  if (floats) {
+    return _bt_fop(a, op);
   }
 
-  while (a->count > 0) {
-    /* pop the next element */
-    lval* y = lval_pop(a, 0);
+  /* the first element */
+  lval* x = a->cell[0];
 
-    if (is(op, KW_ADD)) { x->num += y->num; }
-    if (is(op, KW_SUB)) { x->num -= y->num; }
-    if (is(op, KW_MUL)) { x->num *= y->num; }
-    if (is(op, KW_DIV)) {
-      if (y->num == 0) {
-        lval_del(x);
-        x = lval_err("division by zero");
-      } else {
-        x->num /= y->num;
+  if ((is(op, KW_SUB)) && a->count == 1) {
+    if (x->type == LVAL_NUM && x->num != LONG_MIN) {
+      x->num = -x->num;
+    } else {
+      x = _bt_bigop('-', lval_num(0), x);
+    }
+  }
+
+  /* every element is taken in place, not popped (which moves the rest) */
+  int i = 1;
+  for (; i < a->count; i++) {
+    lval* y = a->cell[i];
+
+    if (op[0] == '/' && y->type == LVAL_NUM && y->num == 0) {
+      lval_del(x);
+      x = lval_err("division by zero");
+      break;
+    }
+
+    /**
+     * two longs are operated as longs while the result fits, the overflow
+     * is checked and only then the integers of any size are used
+     */
+    if (x->type == LVAL_NUM && y->type == LVAL_NUM) {
+      long r = 0;
+      int overflow = 0;
+      switch (op[0]) {
+        case '+': overflow = LBIG_ADD(x->num, y->num, &r); break;
+        case '-': overflow = LBIG_SUB(x->num, y->num, &r); break;
+        case '*': overflow = LBIG_MUL(x->num, y->num, &r); break;
+        case '/':
+          overflow = x->num == LONG_MIN && y->num == -1;
+          r = overflow ? 0 : x->num / y->num;
+          break;
+      }
+      if (!overflow) {
+        x->num = r;
+        lval_del(y);
+        continue;
       }
     }
 
-    lval_del(y);
+    x = _bt_bigop(op[0], x, y);
   }
 
+  /* the elements not taken (after an error) */
+  for (; i < a->count; i++) {
+    lval_del(a->cell[i]);
+  }
+  a->count = 0;
   lval_del(a);
   return x;
 }
@@ -244,24 +555,64 @@ BUILTIN(DIV) { return _bt_op(e, a, KW_DIV); }
 
 lval* _bt_ord(lenv* e, lval* a, char* op)
 {
+  /* two longs (most calls) are compared right away, op is one of > >= < <= */
+  if (a->count == 2 && a->cell[0]->type == LVAL_NUM && a->cell[1]->type == LVAL_NUM) {
+    long x = a->cell[0]->num;
+    long y = a->cell[1]->num;
+    int num = op[0] == '>' ? (op[1] ? x >= y : x > y) : (op[1] ? x <= y : x < y);
+    lval_del(a);
+    return lval_num(num);
+  }
+
   /* must have two arguments */
   LASSERT_NUM(op, a, 2);
 
   /* and those arguments must be numbers */
-  LASSERT_TYPE(op, a, 0, LVAL_NUM);
-  LASSERT_TYPE(op, a, 1, LVAL_NUM);
+  for (int i = 0; i < 2; i++) {
+    int t = a->cell[i]->type;
+    LASSERT(a, t == LVAL_NUM || t == LVAL_BIGNUM || t == LVAL_FLOAT
+        || t == LVAL_F64VEC || t == LVAL_I64VEC,
+        "function '%s' passed incorrect type for argument %i. "
+        "got '%s', expected '%s'.",
+        op, i, ltype_name(t), ltype_name(LVAL_NUM));
+  }
 
-  int num = 0;
+  /* a vector is compared elementwise */
+  if (_bt_isvec(a->cell[0]) || _bt_isvec(a->cell[1])) {
+    return _bt_vcmp(a, op);
+  }
 
-  int left = a->cell[0]->num;
-  int right = a->cell[1]->num;
+  /* -1, 0 or 1 as the left one is less, equal or greater */
+  int c;
+  lval* x = a->cell[0];
+  lval* y = a->cell[1];
+  if (x->type == LVAL_FLOAT || y->type == LVAL_FLOAT) {
+    double l = _bt_dbl(x);
+    double r = _bt_dbl(y);
+
+    /* nan is neither less, equal nor greater than anything */
+    if (l != l || r != r) {
+      lval_del(a);
+      return lval_num(0);
+    }
+    c = (l > r) - (l < r);
+  } else if (x->type == LVAL_NUM && y->type == LVAL_NUM) {
+    c = (x->num > y->num) - (x->num < y->num);
+  } else {
+    lbig* l = _bt_big(x);
+    lbig* r = _bt_big(y);
+    c = lbig_cmp(l, r);
+    lbig_del(l);
+    lbig_del(r);
+  }
 
   lval_del(a);
 
-  if      (is(op, KW_GTE))  { num = left >= right; }
-  else if (is(op, KW_LTE))  { num = left <= right; }
-  else if (is(op, KW_GT))   { num = left >  right; }
-  else if (is(op, KW_LT))   { num = left <  right; }
+  int num = 0;
+  if      (is(op, KW_GTE))  { num = c >= 0; }
+  else if (is(op, KW_LTE))  { num = c <= 0; }
+  else if (is(op, KW_GT))   { num = c >  0; }
+  else if (is(op, KW_LT))   { num = c <  0; }
 
   return lval_num(num);
 }
@@ -271,6 +622,69 @@ BUILTIN(GTE) { return _bt_ord(e, a, KW_GTE); }
 BUILTIN(LT)  { return _bt_ord(e, a, KW_LT);  }
 BUILTIN(LTE) { return _bt_ord(e, a, KW_LTE); }
 
+/* a list, a range or a lazy sequence, the ones equal with the same elements */
+int _bt_is_seq(lval* v)
+{
+  return v->type == LVAL_QEXPR || v->type == LVAL_RANGE || v->type == LVAL_LAZYSEQ;
+}
+
+/**
+ * If x and y are equal (see lval_eq()), but a lazy sequence (in them or
+ * either of them) is equal to any list, range or lazy sequence with the
+ * same elements: it is taken one element at a time, up to the first one
+ * that differs, so a sequence without an end is unequal to any list
+ */
+int _bt_eq(lenv* e, lval* x, lval* y, lval** err)
+{
+  if (!_bt_is_seq(x) || !_bt_is_seq(y)) {
+    return lval_eq(x, y);
+  }
+
+  /* two lists are equal with equal children, any of them can be lazy */
+  if (x->type == LVAL_QEXPR && y->type == LVAL_QEXPR) {
+    if (x->count != y->count) {
+      return 0;
+    }
+    for (int k = 0; k < x->count; k++) {
+      if (!_bt_eq(e, x->cell[k], y->cell[k], err) || *err) {
+        return 0;
+      }
+    }
+    return 1;
+  }
+
+  if (x->type != LVAL_LAZYSEQ && y->type != LVAL_LAZYSEQ) {
+    return lval_eq(x, y);
+  }
+  if (x->type == y->type && x->seq == y->seq) {
+    return 1;
+  }
+
+  liter i;
+  liter j;
+  liter_init(&i, x);
+  liter_init(&j, y);
+  int eq = 1;
+  while (eq && !*err) {
+    lval* u = liter_next(e, &i);
+    lval* v = i.err ? NULL : liter_next(e, &j);
+    *err = i.err ? i.err : j.err;
+    eq = !u == !v && (!u || *err || _bt_eq(e, u, v, err));
+    if (u) {
+      lval_del(u);
+    }
+    if (v) {
+      lval_del(v);
+    }
+    if (!u || !v) {
+      break;
+    }
+  }
+  liter_done(&i);
+  liter_done(&j);
+  return eq;
+}
+
 lval* _bt_cmp(lenv* e, lval* a, char* op)
 {
   /* must have two arguments */
@@ -280,17 +694,22 @@ lval* _bt_cmp(lenv* e, lval* a, char* op)
   lval* right = lval_pop(a, 0);
 
   lval* result = NULL;
+  lval* err = NULL;
 
   if (is(op, KW_EQ)) {
-    result = lval_num(lval_eq(left, right));
+    result = lval_num(_bt_eq(e, left, right, &err));
   } else if (is(op, KW_NEQ)) {
-    result = lval_num(!lval_eq(left, right));
+    result = lval_num(!_bt_eq(e, left, right, &err));
   }
 
   if (result) {
     lval_del(left);
     lval_del(right);
     lval_del(a);
+    if (err) {
+      lval_del(result);
+      return err;
+    }
     return result;
   }
 
@@ -306,12 +725,16 @@ BUILTIN(IF)
   LASSERT_NUM_OR(KW_IF, a, 2, 3);
 
   /** the first 2 must be are required and must be a Number and a Q-Expr **/
-  LASSERT_TYPE(KW_IF, a, 0, LVAL_NUM);
+  int t = a->cell[0]->type;
+  LASSERT(a, t == LVAL_NUM || t == LVAL_BIGNUM || t == LVAL_FLOAT,
+      "function '%s' passed incorrect type for argument %i. got '%s', expected '%s'.",
+      KW_IF, 0, ltype_name(t), ltype_name(LVAL_NUM));
   LASSERT_TYPE(KW_IF, a, 1, LVAL_QEXPR);
 
   lval* x = lval_sexpr();
 
-  if (a->cell[0]->num) {
+  /** a bignum is never 0 **/
+  if (t == LVAL_BIGNUM || (t == LVAL_FLOAT ? a->cell[0]->dbl != 0.0 : a->cell[0]->num != 0)) {
     /** if the first argument is true, evaluate the "true" part **/
     a->cell[1]->type = LVAL_SEXPR;
     x = leval(e, lval_pop(a, 1));
@@ -332,11 +755,10 @@ BUILTIN(LOAD)
   LASSERT_NUM(KW_LOAD, a, 1);
   LASSERT_TYPE(KW_LOAD, a, 0, LVAL_STR);
 
-  lval* r = lparser_parse(e, a->cell[0]->str);
+  lval* r = lparser_parse(e, a->cell[0]->str->bytes);
   if (r) {
     while (r->count) {
-      lval* p = lval_pop(r, 0);
-      lval* x = leval(e, p);
+      lval* x = leval_form(e, lval_pop(r, 0));
       if (x->type == LVAL_ERR) {
         lval_println(x);
       }
@@ -346,7 +768,7 @@ BUILTIN(LOAD)
     lval_del(a);
     return lval_sexpr();
   } else {
-    lval* err = lval_err("could not load %s", a->cell[0]->str);
+    lval* err = lval_err("could not load %s", a->cell[0]->str->bytes);
     lval_del(a);
     return err;
   }
@@ -380,19 +802,3071 @@ BUILTIN(ERROR)
   /** that argument must be a string **/
   LASSERT_TYPE(KW_ERROR, a, 0, LVAL_STR);
 
-  lval* err = lval_err(a->cell[0]->str);
+  lval* err = lval_err(a->cell[0]->str->bytes);
   lval_del(a);
 
   return err;
 }
 
-void lenv_add_builtin(lenv* e, char* name, lbuiltin func)
+/**
+ * STAGES of a pipeline over the elements of a list
+ *
+ *    LSTAGE_MAP      (map f l)      every element is f of it
+ *    LSTAGE_FILTER   (filter f l)   only the elements f is true of
+ *    LSTAGE_FOLDL    (foldl f z l)  f of the accumulated value (z first)
+ *                                   and every element, always the last stage
+ *    LSTAGE_TAKE     (take n l)     the first n elements
+ *    LSTAGE_DROP     (drop n l)     every element but the first n
+ */
+enum { LSTAGE_MAP, LSTAGE_FILTER, LSTAGE_FOLDL, LSTAGE_TAKE, LSTAGE_DROP };
+
+/* name and number of arguments (besides the list) of every stage */
+char* _bt_stage_names[] = { KW_MAP, KW_FILTER, KW_FOLDL, KW_TAKE, KW_DROP };
+int _bt_stage_args[] = { 1, 1, 2, 1, 1 };
+
+/**
+ * A stage being run
+ */
+typedef struct
 {
-  lval* k = lval_sym(name);
-  lval* v = lval_fun(func, name);
-  lenv_put(e, k, v);
-  lval_del(k);
-  lval_del(v);
+  int kind;
+
+  /** the function (map, filter and foldl) **/
+  lval* fn;
+
+  /** the accumulated value (foldl) **/
+  lval* acc;
+
+  /** the elements to take or drop, and the ones taken or dropped **/
+  long n;
+  long count;
+} lstage;
+
+/* the value of an element, just as 'fst' evaluates it */
+lval* _bt_elem(lenv* e, lval* x)
+{
+  if (x->type == LVAL_SYM || x->type == LVAL_SEXPR) {
+    return leval(e, lval_copy(x));
+  }
+
+  return lval_copy(x);
+}
+
+lval* _bt_call(lenv* e, lval* f, lval* x, lval* y)
+{
+  lval* v = lval_add(lval_sexpr(), lval_copy(f));
+  if (x) {
+    lval_add(v, x);
+  }
+  lval_add(v, y);
+  return leval_apply(e, v);
+}
+
+/* passes the element x through the stage, returns NULL if it goes no further */
+lval* _bt_stage(lenv* e, lstage* s, lval* x)
+{
+  switch (s->kind) {
+    case LSTAGE_MAP: {
+      lval* y = _bt_elem(e, x);
+      lval_del(x);
+      return y->type == LVAL_ERR ? y : _bt_call(e, s->fn, NULL, y);
+    }
+
+    case LSTAGE_FILTER: {
+      lval* y = _bt_elem(e, x);
+      if (y->type != LVAL_ERR) {
+        y = _bt_call(e, s->fn, NULL, y);
+      }
+      if (y->type == LVAL_ERR) {
+        lval_del(x);
+        return y;
+      }
+      if (y->type != LVAL_NUM) {
+        lval* err = lval_err("function '%s' got '%s' from the predicate, expected '%s'.",
+            KW_FILTER, ltype_name(y->type), ltype_name(LVAL_NUM));
+        lval_del(x);
+        lval_del(y);
+        return err;
+      }
+      int keep = y->num != 0;
+      lval_del(y);
+      if (keep) {
+        return x;
+      }
+      break;
+    }
+
+    case LSTAGE_FOLDL: {
+      lval* y = _bt_elem(e, x);
+      lval_del(x);
+      if (y->type == LVAL_ERR) {
+        return y;
+      }
+      s->acc = _bt_call(e, s->fn, s->acc, y);
+      if (s->acc->type == LVAL_ERR) {
+        lval* err = s->acc;
+        s->acc = NULL;
+        return err;
+      }
+      return NULL;
+    }
+
+    case LSTAGE_TAKE:
+      if (s->count < s->n) {
+        s->count++;
+        return x;
+      }
+      break;
+
+    case LSTAGE_DROP:
+      if (s->count < s->n) {
+        s->count++;
+      } else {
+        return x;
+      }
+      break;
+  }
+
+  lval_del(x);
+  return NULL;
+}
+
+/* sets up a stage with its arguments, returns an error if those are not right */
+lval* _bt_stage_init(lstage* s, int kind, lval** args)
+{
+  s->kind = kind;
+  s->fn = args[0];
+  s->acc = kind == LSTAGE_FOLDL ? args[1] : NULL;
+  s->n = 0;
+  s->count = 0;
+
+  if (kind == LSTAGE_TAKE || kind == LSTAGE_DROP) {
+    if (s->fn->type != LVAL_NUM) {
+      return lval_err("function '%s' passed incorrect type for argument 0. "
+          "got '%s', expected '%s'.", _bt_stage_names[kind],
+          ltype_name(s->fn->type), ltype_name(LVAL_NUM));
+    }
+    if (s->fn->num < 0) {
+      return lval_err("function '%s' passed a negative number for argument 0.",
+          _bt_stage_names[kind]);
+    }
+    s->n = s->fn->num;
+    s->fn = NULL;
+  }
+
+  return NULL;
+}
+
+/**
+ * If no more elements can get through a full 'take', when strict only
+ * if there are no calls before it (those may still fail on the elements
+ * left)
+ */
+int _bt_full(lstage* stages, int count, int strict)
+{
+  for (int k = 0; k < count; k++) {
+    if (stages[k].kind == LSTAGE_TAKE && stages[k].count == stages[k].n) {
+      return 1;
+    }
+    if (strict && stages[k].kind < LSTAGE_TAKE) {
+      return 0;
+    }
+  }
+
+  return 0;
+}
+
+/**
+ * Runs the elements of the source through the stages (the first one gets
+ * the elements of the source, every other one those let through by the
+ * one before), every element goes through every stage before the next
+ * element is taken, so no list is built between stages.
+ *
+ * When strict the stages behave just as the list functions: elements past
+ * a full 'take' still go through the stages before it, and a 'take' or
+ * 'drop' of more elements than there are is an error.
+ *
+ * return     the list of elements let through the last stage, or the
+ *            accumulated value if it is a foldl
+ */
+lval* _bt_run(lenv* e, lstage* stages, int count, liter* src, int strict)
+{
+  /* the accumulated value is owned by the stage while running */
+  lstage* last = count ? &stages[count - 1] : NULL;
+  if (last && last->kind == LSTAGE_FOLDL) {
+    last->acc = lval_copy(last->acc);
+  }
+
+  lval* out = lval_qexpr();
+  lval* err = NULL;
+  lval* x = NULL;
+  while (!err && !_bt_full(stages, count, strict) && (x = liter_next(e, src))) {
+    for (int k = 0; k < count && x; k++) {
+      x = _bt_stage(e, &stages[k], x);
+      if (x && x->type == LVAL_ERR) {
+        err = x;
+        x = NULL;
+      }
+    }
+    if (x) {
+      lval_add(out, x);
+    }
+  }
+
+  if (!err && src->err) {
+    err = src->err;
+    src->err = NULL;
+  }
+
+  /* the list ended before every element to take or drop was there */
+  for (int k = 0; k < count && strict && !err; k++) {
+    if (stages[k].kind >= LSTAGE_TAKE && stages[k].count < stages[k].n) {
+      err = lval_err("function '%s' passed a list with less than %li elements.",
+          _bt_stage_names[stages[k].kind], stages[k].n);
+    }
+  }
+
+  /* foldl gives the accumulated value instead of the list */
+  if (last && last->kind == LSTAGE_FOLDL) {
+    lval_del(out);
+    out = last->acc;
+  }
+  if (err) {
+    if (out) {
+      lval_del(out);
+    }
+    out = err;
+  }
+
+  return out;
+}
+
+/**
+ * Takes and drops of a range are a slice of it, no list is made
+ *
+ * return     the range sliced (r is destroyed), or an error if there are
+ *            less numbers than to take or drop
+ */
+lval* _bt_cut(lstage* stages, int count, lval* r)
+{
+  for (int k = 0; k < count; k++) {
+    if (stages[k].n > r->len) {
+      lval_del(r);
+      return lval_err("function '%s' passed a list with less than %li elements.",
+          _bt_stage_names[stages[k].kind], stages[k].n);
+    }
+    if (stages[k].kind == LSTAGE_TAKE) {
+      r->len = stages[k].n;
+    } else {
+      r->num = lval_range_at(r, stages[k].n);
+      r->len -= stages[k].n;
+    }
+  }
+
+  return r;
+}
+
+/**
+ * Runs the list functions over the list (the last argument), the other
+ * arguments are the ones of every function, from the last one run to
+ * the first, just as (foldl f z (map g (take n l))) has them
+ */
+lval* _bt_pipe(lenv* e, lval* a, int* kinds, int count)
+{
+  lstage* stages = malloc(sizeof(lstage) * count);
+  lval* l = a->cell[a->count - 1];
+
+  /* the arguments are checked from the first stage, the one run first */
+  int arg = a->count - 1;
+  lval* err = NULL;
+  for (int i = count - 1; i >= 0 && !err; i--) {
+    arg -= _bt_stage_args[kinds[i]];
+    if (i == count - 1 && !liter_can(l)) {
+      err = lval_err("function '%s' passed incorrect type for argument %i. "
+          "got '%s', expected a collection.", _bt_stage_names[kinds[i]],
+          _bt_stage_args[kinds[i]], ltype_name(l->type));
+    } else {
+      err = _bt_stage_init(&stages[count - 1 - i], kinds[i], &a->cell[arg]);
+    }
+  }
+
+  int cut = l->type == LVAL_RANGE;
+  for (int k = 0; k < count; k++) {
+    cut = cut && stages[k].kind >= LSTAGE_TAKE;
+  }
+
+  lval* v = err;
+  if (!err && cut) {
+    v = _bt_cut(stages, count, lval_copy(l));
+  } else if (!err) {
+    liter src;
+    liter_init(&src, l);
+    v = _bt_run(e, stages, count, &src, 1);
+    liter_done(&src);
+  }
+
+  free(stages);
+  lval_del(a);
+  return v;
+}
+
+BUILTIN(MAP)
+{
+  LASSERT_NUM(KW_MAP, a, 2);
+  int kinds[] = { LSTAGE_MAP };
+  return _bt_pipe(e, a, kinds, 1);
+}
+
+BUILTIN(FILTER)
+{
+  LASSERT_NUM(KW_FILTER, a, 2);
+  int kinds[] = { LSTAGE_FILTER };
+  return _bt_pipe(e, a, kinds, 1);
+}
+
+BUILTIN(FOLDL)
+{
+  LASSERT_NUM(KW_FOLDL, a, 3);
+  int kinds[] = { LSTAGE_FOLDL };
+  return _bt_pipe(e, a, kinds, 1);
+}
+
+BUILTIN(TAKE)
+{
+  LASSERT_NUM(KW_TAKE, a, 2);
+  int kinds[] = { LSTAGE_TAKE };
+  return _bt_pipe(e, a, kinds, 1);
+}
+
+BUILTIN(DROP)
+{
+  LASSERT_NUM(KW_DROP, a, 2);
+  int kinds[] = { LSTAGE_DROP };
+  return _bt_pipe(e, a, kinds, 1);
+}
+
+BUILTIN(FUSE)
+{
+  /**
+   * (fuse {foldl map} f z g l) is (foldl f z (map g l)), the names of
+   * the stages (from the last one) and then their arguments
+   */
+  LASSERT(a, a->count > 0 && a->cell[0]->type == LVAL_QEXPR,
+      "function '%s' passed no stages.", KW_FUSE);
+
+  lval* names = lval_pop(a, 0);
+  int count = names->count;
+  int* kinds = malloc(sizeof(int) * (count + 1));
+  int args = 1;
+  for (int i = 0; i < count; i++) {
+    kinds[i] = -1;
+    for (int k = 0; k <= LSTAGE_DROP && names->cell[i]->type == LVAL_SYM; k++) {
+      if (is(names->cell[i]->sym, _bt_stage_names[k])) {
+        kinds[i] = k;
+      }
+    }
+    if (kinds[i] < 0 || (kinds[i] == LSTAGE_FOLDL && i > 0)) {
+      free(kinds);
+      lval_del(names);
+      lval_del(a);
+      return lval_err("function '%s' passed an invalid stage.", KW_FUSE);
+    }
+    args += _bt_stage_args[kinds[i]];
+  }
+  lval_del(names);
+
+  lval* v = NULL;
+  if (count == 0) {
+    v = lval_err("function '%s' passed no stages.", KW_FUSE);
+  } else if (a->count != args) {
+    v = lval_err("function '%s' passed incorrect number of arguments. "
+        "got '%i', expected '%i'.", KW_FUSE, a->count, args);
+  }
+  if (v) {
+    free(kinds);
+    lval_del(a);
+    return v;
+  }
+
+  v = _bt_pipe(e, a, kinds, count);
+  free(kinds);
+  return v;
+}
+
+BUILTIN(GUARD)
+{
+  /**
+   * (guard n {x} {y}) evaluates the call x rewritten by the optimizer if
+   * the functions it relied on are still bound (see lopt_valid()), and
+   * the original call y otherwise
+   */
+  lval* x = lval_pop(a, lopt_valid(e, a->cell[0]->num) ? 1 : 2);
+  lval_del(a);
+
+  x->type = LVAL_SEXPR;
+  return leval(e, x);
+}
+
+BUILTIN(SPEC)
+{
+  /**
+   * (spec n args...) calls the copy n of a function the optimizer
+   * specialized for some of its arguments (see lopt_spec())
+   */
+  lval* n = lval_pop(a, 0);
+  lval* f = lopt_spec(n->num, a);
+  lval_del(n);
+
+  lval* x = lcall(e, f, a);
+  lval_del(f);
+  return x;
+}
+
+BUILTIN(RANGE)
+{
+  /* (range to), (range from to) and (range from to step), 'to' excluded */
+  LASSERT(a, a->count >= 1 && a->count <= 3,
+      "function '%s' passed incorrect number of arguments. "
+      "got '%i', expected 1 to 3.", KW_RANGE, a->count);
+  for (int i = 0; i < a->count; i++) {
+    LASSERT_TYPE(KW_RANGE, a, i, LVAL_NUM);
+  }
+
+  long from = a->count > 1 ? a->cell[0]->num : 0;
+  long to = a->cell[a->count > 1]->num;
+  long step = a->count > 2 ? a->cell[2]->num : 1;
+  lval_del(a);
+
+  if (step == 0) {
+    return lval_err("function '%s' passed a step of 0.", KW_RANGE);
+  }
+
+  /* the difference of from and to, and the step, always fit in an unsigned long */
+  unsigned long len = 0;
+  if (step > 0 && to > from) {
+    len = ((unsigned long)to - (unsigned long)from - 1) / (unsigned long)step + 1;
+  } else if (step < 0 && to < from) {
+    len = ((unsigned long)from - (unsigned long)to - 1) / -(unsigned long)step + 1;
+  }
+
+  if (len > LONG_MAX) {
+    return lval_err("function '%s' passed a range of %lu numbers, "
+        "more than the length of a list can be.", KW_RANGE, len);
+  }
+
+  return lval_range(from, step, len);
+}
+
+BUILTIN(LEN)
+{
+  LASSERT_NUM(KW_LEN, a, 1);
+  LASSERT_COLL(KW_LEN, a, 0);
+
+  /* lists, ranges, strings and vectors know their length, the rest are counted */
+  lval* l = a->cell[0];
+  long len = 0;
+  switch (l->type) {
+    case LVAL_QEXPR:  len = l->count; break;
+    case LVAL_RANGE:  len = l->len; break;
+    case LVAL_STR:    len = l->str->len; break;
+    case LVAL_F64VEC:
+    case LVAL_I64VEC: len = l->vec->len; break;
+    case LVAL_MATRIX: len = l->rows; break;
+    case LVAL_DICT:   len = l->dict->count; break;
+    case LVAL_MAP:    len = lhamt_count(l->map); break;
+    case LVAL_SMAP:
+    case LVAL_SSET:   len = lbtree_count(l->tree); break;
+    case LVAL_VEC:    len = l->mvec->len; break;
+    case LVAL_DEQUE:  len = l->deque->len; break;
+    case LVAL_PQUEUE: len = l->heap->len; break;
+    case LVAL_TABLE:  len = l->table->rows; break;
+    case LVAL_BITSET: len = lbitset_count(l->bits); break;
+
+    default: {
+      liter it;
+      liter_init(&it, l);
+      lval* x;
+      while ((x = liter_next(e, &it))) {
+        lval_del(x);
+        len++;
+      }
+      liter_done(&it);
+      if (it.err) {
+        lval_del(a);
+        return it.err;
+      }
+    }
+  }
+
+  lval_del(a);
+  return lval_num(len);
+}
+
+BUILTIN(NTH)
+{
+  /* the element with index n, evaluated just as 'fst' does */
+  LASSERT_NUM(KW_NTH, a, 2);
+  LASSERT_TYPE(KW_NTH, a, 0, LVAL_NUM);
+  LASSERT_COLL(KW_NTH, a, 1);
+  LASSERT(a, a->cell[0]->num >= 0,
+      "function '%s' passed a negative index. got %li.", KW_NTH, a->cell[0]->num);
+
+  long n = a->cell[0]->num;
+  lval* l = a->cell[1];
+  long len = -1;
+  switch (l->type) {
+    case LVAL_QEXPR:  len = l->count; break;
+    case LVAL_RANGE:  len = l->len; break;
+    case LVAL_STR:    len = l->str->len; break;
+    case LVAL_F64VEC:
+    case LVAL_I64VEC: len = l->vec->len; break;
+    case LVAL_MATRIX: len = l->rows; break;
+  }
+  LASSERT(a, len < 0 || n < len,
+      "function '%s' passed an index out of the list. got %li, the length is %li.",
+      KW_NTH, n, len);
+
+  lval* v = NULL;
+  switch (l->type) {
+    case LVAL_QEXPR:  v = _bt_elem(e, l->cell[n]); break;
+    case LVAL_RANGE:  v = lval_num(lval_range_at(l, n)); break;
+    case LVAL_STR:    v = lval_strn(l->str->bytes + n, 1); break;
+    case LVAL_F64VEC: v = lval_float(l->vec->f[n]); break;
+    case LVAL_I64VEC: v = lval_num((long)l->vec->i[n]); break;
+    case LVAL_MATRIX: {
+      lnvec* row = lnvec_new(l->cols);
+      memcpy(row->f, l->vec->f + n * l->cols, sizeof(double) * l->cols);
+      v = lval_nvec(LVAL_F64VEC, row);
+      break;
+    }
+
+    /* the rest (a lazy sequence is only computed up to n) are gone through */
+    default: {
+      liter it;
+      liter_init(&it, l);
+      long i = 0;
+      while ((v = liter_next(e, &it)) && i < n) {
+        lval_del(v);
+        i++;
+      }
+      liter_done(&it);
+      if (it.err) {
+        v = it.err;
+      } else if (!v) {
+        v = lval_err("function '%s' passed an index out of the list. got %li, the length is %li.",
+            KW_NTH, n, i);
+      }
+      break;
+    }
+  }
+  lval_del(a);
+  return v;
+}
+
+BUILTIN(SLICE)
+{
+  /* (slice from to l) the elements of l from index 'from' to 'to' (excluded) */
+  LASSERT_NUM(KW_SLICE, a, 3);
+  LASSERT_TYPE(KW_SLICE, a, 0, LVAL_NUM);
+  LASSERT_TYPE(KW_SLICE, a, 1, LVAL_NUM);
+  LASSERT(a, a->cell[2]->type == LVAL_QEXPR || a->cell[2]->type == LVAL_RANGE,
+      "function '%s' passed incorrect type for argument 2. "
+      "got '%s', expected '%s' or '%s'.", KW_SLICE, ltype_name(a->cell[2]->type),
+      ltype_name(LVAL_QEXPR), ltype_name(LVAL_RANGE));
+
+  long from = a->cell[0]->num;
+  long to = a->cell[1]->num;
+  lval* l = a->cell[2];
+  long len = l->type == LVAL_RANGE ? l->len : l->count;
+  LASSERT(a, 0 <= from && from <= to && to <= len,
+      "function '%s' passed a slice out of the list. got %li to %li, the length is %li.",
+      KW_SLICE, from, to, len);
+
+  /* a slice of a range is a range */
+  lval* v = lval_take(a, 2);
+  if (v->type == LVAL_RANGE) {
+    v->num = lval_range_at(v, from);
+    v->len = to - from;
+    return v;
+  }
+
+  lval* x = lval_qexpr();
+  x->count = to - from;
+  x->cell = malloc(sizeof(lval*) * x->count);
+  for (long i = from; i < to; i++) {
+    x->cell[i - from] = lval_copy(v->cell[i]);
+  }
+  lval_del(v);
+  return x;
+}
+
+/* the builtins making the transducers of every stage */
+char* _bt_xform_names[] = { KW_XMAP, KW_XFILTER, KW_XREDUCE, KW_XTAKE, KW_XDROP };
+
+BUILTIN(XMAP)
+{
+  LASSERT_NUM(KW_XMAP, a, 1);
+  LASSERT_TYPE(KW_XMAP, a, 0, LVAL_FUN);
+  return lval_xform(KW_XMAP, a);
+}
+
+BUILTIN(XFILTER)
+{
+  LASSERT_NUM(KW_XFILTER, a, 1);
+  LASSERT_TYPE(KW_XFILTER, a, 0, LVAL_FUN);
+  return lval_xform(KW_XFILTER, a);
+}
+
+BUILTIN(XTAKE)
+{
+  LASSERT_NUM(KW_XTAKE, a, 1);
+  LASSERT_TYPE(KW_XTAKE, a, 0, LVAL_NUM);
+  LASSERT(a, a->cell[0]->num >= 0,
+      "function '%s' passed a negative number for argument 0.", KW_XTAKE);
+  return lval_xform(KW_XTAKE, a);
+}
+
+BUILTIN(XDROP)
+{
+  LASSERT_NUM(KW_XDROP, a, 1);
+  LASSERT_TYPE(KW_XDROP, a, 0, LVAL_NUM);
+  LASSERT(a, a->cell[0]->num >= 0,
+      "function '%s' passed a negative number for argument 0.", KW_XDROP);
+  return lval_xform(KW_XDROP, a);
+}
+
+BUILTIN(XREDUCE)
+{
+  LASSERT_NUM(KW_XREDUCE, a, 2);
+  LASSERT_TYPE(KW_XREDUCE, a, 0, LVAL_FUN);
+  return lval_xform(KW_XREDUCE, a);
+}
+
+/**
+ * Adds the transducers in v (a list of transducers is every one in it),
+ * returns what is not a transducer, or NULL
+ */
+lval* _bt_xforms(lval* v, lval*** xfs, int* count)
+{
+  if (v->type == LVAL_QEXPR) {
+    for (int i = 0; i < v->count; i++) {
+      lval* bad = _bt_xforms(v->cell[i], xfs, count);
+      if (bad) {
+        return bad;
+      }
+    }
+    return NULL;
+  }
+
+  if (v->type != LVAL_XFORM) {
+    return v;
+  }
+
+  *xfs = realloc(*xfs, sizeof(lval*) * (*count + 1));
+  (*xfs)[(*count)++] = v;
+  return NULL;
+}
+
+/**
+ * Runs the source through the transducers (every argument from 'from'),
+ * stops taking elements as soon as a 'take' is full
+ */
+lval* _bt_transduce(lenv* e, lval* a, int from, liter* src, char* fname)
+{
+  lval** xfs = NULL;
+  int count = 0;
+  lval* err = NULL;
+  for (int i = from; i < a->count && !err; i++) {
+    lval* bad = _bt_xforms(a->cell[i], &xfs, &count);
+    if (bad == a->cell[i]) {
+      err = lval_err("function '%s' passed incorrect type for stage %i (argument %i). "
+          "got '%s', expected '%s'.", fname, count + 1, i,
+          ltype_name(bad->type), ltype_name(LVAL_XFORM));
+    } else if (bad) {
+      err = lval_err("function '%s' passed a list with a '%s' for stage %i (argument %i), "
+          "expected a list of '%s'.", fname, ltype_name(bad->type), count + 1, i,
+          ltype_name(LVAL_XFORM));
+    }
+  }
+
+  lstage* stages = malloc(sizeof(lstage) * (count + 1));
+  for (int i = 0; i < count && !err; i++) {
+    lval* xf = xfs[i];
+    int kind = 0;
+    while (!is(xf->stage, _bt_xform_names[kind])) {
+      kind++;
+    }
+
+    if (kind == LSTAGE_FOLDL && i != count - 1) {
+      err = lval_err("function '%s' passed '%s' for stage %i of %i, "
+          "a reduction must be the last stage.", fname, xf->stage, i + 1, count);
+    } else {
+      err = _bt_stage_init(&stages[i], kind, xf->cell);
+    }
+  }
+
+  lval* v = err ? err : _bt_run(e, stages, count, src, 0);
+  free(stages);
+  free(xfs);
+  lval_del(a);
+  return v;
+}
+
+BUILTIN(PIPE)
+{
+  LASSERT(a, a->count > 0, "function '%s' passed no source.", KW_PIPE);
+  LASSERT_COLL(KW_PIPE, a, 0);
+
+  /* the cursor keeps the only reference to a sequence (if no one else
+     has it), so the elements taken are freed as it goes */
+  liter src;
+  liter_init(&src, a->cell[0]);
+  if (a->cell[0]->type == LVAL_LAZYSEQ) {
+    lval_del(a->cell[0]);
+    a->cell[0] = lval_qexpr();
+  }
+
+  lval* v = _bt_transduce(e, a, 1, &src, KW_PIPE);
+  liter_done(&src);
+  return v;
+}
+
+BUILTIN(PIPE_LINES)
+{
+  LASSERT(a, a->count > 0, "function '%s' passed no file.", KW_PIPE_LINES);
+  LASSERT_TYPE(KW_PIPE_LINES, a, 0, LVAL_STR);
+
+  FILE* file = fopen(a->cell[0]->str->bytes, "r");
+  LASSERT(a, file, "could not open %s", a->cell[0]->str->bytes);
+
+  /* the lines are read one at a time, the file is never read whole */
+  liter src;
+  liter_file(&src, file);
+  lval* v = _bt_transduce(e, a, 1, &src, KW_PIPE_LINES);
+  fclose(file);
+  return v;
+}
+
+/* a new reference to the sequence of v, a Lazy Sequence or any other collection */
+lseq* _bt_seq(lval* v)
+{
+  if (v->type == LVAL_LAZYSEQ) {
+    v->seq->refs++;
+    return v->seq;
+  }
+
+  if (v->type == LVAL_RANGE) {
+    lseq* s = lseq_new(LSEQ_RANGE);
+    s->from = v->num;
+    s->to = lval_range_end(v);
+    s->step = v->step;
+    return s;
+  }
+
+  return v->type == LVAL_QEXPR ? lseq_list(v) : lseq_coll(v);
+}
+
+BUILTIN(LAZY_RANGE)
+{
+  /**
+   * (lazy-range to), (lazy-range from to) and (lazy-range from to step),
+   * (iterate) gives the unbounded ones
+   */
+  LASSERT(a, a->count >= 1 && a->count <= 3,
+      "function '%s' passed incorrect number of arguments. "
+      "got '%i', expected 1 to 3.", KW_LAZY_RANGE, a->count);
+  for (int i = 0; i < a->count; i++) {
+    LASSERT_TYPE(KW_LAZY_RANGE, a, i, LVAL_NUM);
+  }
+
+  lseq* s = lseq_new(LSEQ_RANGE);
+  s->from = a->count > 1 ? a->cell[0]->num : 0;
+  s->to = a->cell[a->count > 1]->num;
+  s->step = a->count > 2 ? a->cell[2]->num : 1;
+  lval_del(a);
+
+  if (s->step == 0) {
+    lseq_del(s);
+    return lval_err("function '%s' passed a step of 0.", KW_LAZY_RANGE);
+  }
+
+  return lval_lazyseq(s);
+}
+
+BUILTIN(ITERATE)
+{
+  /* (iterate f x) is x, (f x), (f (f x))... */
+  LASSERT_NUM(KW_ITERATE, a, 2);
+  LASSERT_TYPE(KW_ITERATE, a, 0, LVAL_FUN);
+
+  lseq* s = lseq_new(LSEQ_ITERATE);
+  s->fn = lval_pop(a, 0);
+  s->val = lval_take(a, 0);
+  return lval_lazyseq(s);
+}
+
+BUILTIN(LAZY_MAP)
+{
+  LASSERT_NUM(KW_LAZY_MAP, a, 2);
+  LASSERT_TYPE(KW_LAZY_MAP, a, 0, LVAL_FUN);
+  LASSERT_COLL(KW_LAZY_MAP, a, 1);
+
+  lseq* s = lseq_new(LSEQ_MAP);
+  s->src = _bt_seq(a->cell[1]);
+  s->fn = lval_take(a, 0);
+  return lval_lazyseq(s);
+}
+
+BUILTIN(LAZY_FILTER)
+{
+  LASSERT_NUM(KW_LAZY_FILTER, a, 2);
+  LASSERT_TYPE(KW_LAZY_FILTER, a, 0, LVAL_FUN);
+  LASSERT_COLL(KW_LAZY_FILTER, a, 1);
+
+  lseq* s = lseq_new(LSEQ_FILTER);
+  s->src = _bt_seq(a->cell[1]);
+  s->fn = lval_take(a, 0);
+  return lval_lazyseq(s);
+}
+
+BUILTIN(LAZY_TAKE)
+{
+  LASSERT_NUM(KW_LAZY_TAKE, a, 2);
+  LASSERT_TYPE(KW_LAZY_TAKE, a, 0, LVAL_NUM);
+  LASSERT(a, a->cell[0]->num >= 0,
+      "function '%s' passed a negative number for argument 0.", KW_LAZY_TAKE);
+  LASSERT_COLL(KW_LAZY_TAKE, a, 1);
+
+  lseq* s = lseq_new(LSEQ_TAKE);
+  s->n = a->cell[0]->num;
+  s->src = _bt_seq(a->cell[1]);
+  lval_del(a);
+  return lval_lazyseq(s);
+}
+
+BUILTIN(REALIZE)
+{
+  /* every element of the collection, in a Q-Expression */
+  LASSERT_NUM(KW_REALIZE, a, 1);
+  LASSERT_COLL(KW_REALIZE, a, 0);
+
+  liter it;
+  liter_init(&it, a->cell[0]);
+  lval* v = lval_qexpr();
+  lval* x;
+  while ((x = liter_next(e, &it))) {
+    lval_add(v, x);
+  }
+  liter_done(&it);
+  lval_del(a);
+
+  if (it.err) {
+    lval_del(v);
+    return it.err;
+  }
+  return v;
+}
+
+BUILTIN(GENERATOR)
+{
+  /**
+   * (generator f s) the elements f gives: (f s) is {x t} for the element
+   * x, then (f t) gives the next one... until f gives {}
+   */
+  LASSERT_NUM(KW_GENERATOR, a, 2);
+  LASSERT_TYPE(KW_GENERATOR, a, 0, LVAL_FUN);
+
+  lseq* s = lseq_new(LSEQ_GEN);
+  s->fn = lval_pop(a, 0);
+  s->val = lval_take(a, 0);
+  return lval_lazyseq(s);
+}
+
+void lenv_add_builtin(lenv* e, char* name, lbuiltin func)
+{
+  lenv_watch(name);
+  lval* k = lval_sym(name);
+  lval* v = lval_fun(func, name);
+  lenv_put(e, k, v);
+  lval_del(k);
+  lval_del(v);
+}
+
+/* if the value is a numeric vector */
+int _bt_isvec(lval* v)
+{
+  return v->type == LVAL_F64VEC || v->type == LVAL_I64VEC;
+}
+
+/* if the double is a 64 bits integer, nan is not */
+int _bt_isint(double d)
+{
+  return d >= -9223372036854775808.0 && d < 9223372036854775808.0
+      && (double)(int64_t)d == d;
+}
+
+/* the error for n numbers that could not be allocated */
+lval* _bt_nomem(char* fname, long n)
+{
+  return lval_err("function '%s' could not allocate %li numbers.", fname, n);
+}
+
+/**
+ * Puts the number x (not consumed) at index n of the vector being made,
+ * as an integer while all of them are: the first one that is not turns
+ * the ones before into doubles (in place, they are the same size), but
+ * if the vector is to be of integers, where the others are an error
+ */
+lval* _bt_vput(lnvec* v, int* isf, long n, lval* x, int type, char* fname)
+{
+  if (x->type != LVAL_NUM && x->type != LVAL_FLOAT && x->type != LVAL_BIGNUM) {
+    return lval_err("function '%s' passed a collection with a '%s', expected numbers.",
+        fname, ltype_name(x->type));
+  }
+
+  if (*isf) {
+    v->f[n] = _bt_dbl(x);
+    return NULL;
+  }
+
+  if (x->type == LVAL_NUM) {
+    v->i[n] = x->num;
+    return NULL;
+  }
+
+  if (type == LVAL_I64VEC) {
+    /* a bignum does not fit */
+    if (x->type != LVAL_FLOAT || !_bt_isint(x->dbl)) {
+      return lval_err("function '%s' passed a number that is not a 64 bits integer.", fname);
+    }
+    v->i[n] = (int64_t)x->dbl;
+    return NULL;
+  }
+
+  for (long k = 0; k < n; k++) {
+    v->f[k] = (double)v->i[k];
+  }
+  *isf = 1;
+  v->f[n] = _bt_dbl(x);
+  return NULL;
+}
+
+/**
+ * The numbers of a collection (not consumed) in a new vector: of type
+ * 'type', or if it is 0 an LVAL_I64VEC when all of them are integers
+ * and an LVAL_F64VEC otherwise
+ */
+lval* _bt_tovec(lenv* e, lval* c, int type, char* fname)
+{
+  /* a vector is shared as it is, or converted */
+  if (_bt_isvec(c) && (!type || type == c->type)) {
+    return lval_copy(c);
+  }
+
+  /* the ones that know their length are filled in one go */
+  long cap = 16;
+  switch (c->type) {
+    case LVAL_QEXPR:  cap = c->count; break;
+    case LVAL_RANGE:  cap = c->len; break;
+    case LVAL_F64VEC:
+    case LVAL_I64VEC: cap = c->vec->len; break;
+  }
+
+  lnvec* v = lnvec_new(cap);
+  if (!v) {
+    return _bt_nomem(fname, cap);
+  }
+  int isf = type == LVAL_F64VEC;
+  long n = 0;
+  lval* err = NULL;
+
+  if (c->type == LVAL_F64VEC) {
+    for (; n < c->vec->len && !err; n++) {
+      double d = c->vec->f[n];
+      if (!_bt_isint(d)) {
+        err = lval_err("function '%s' passed a number that is not a 64 bits integer.", fname);
+      }
+      v->i[n] = err ? 0 : (int64_t)d;
+    }
+  } else if (c->type == LVAL_I64VEC) {
+    for (; n < c->vec->len; n++) {
+      v->f[n] = (double)c->vec->i[n];
+    }
+  } else if (c->type == LVAL_RANGE && !isf) {
+    for (; n < c->len; n++) {
+      v->i[n] = lval_range_at(c, n);
+    }
+  } else if (c->type == LVAL_QEXPR) {
+    for (; n < c->count && !err; n++) {
+      err = _bt_vput(v, &isf, n, c->cell[n], type, fname);
+    }
+  } else {
+    liter it;
+    liter_init(&it, c);
+    lval* x;
+    while (!err && (x = liter_next(e, &it))) {
+      /* the ones of unknown length double it as it fills up */
+      if (n == cap) {
+        lnvec* w = lnvec_new(cap * 2);
+        if (!w) {
+          err = _bt_nomem(fname, cap * 2);
+          lval_del(x);
+          break;
+        }
+        memcpy(w->i, v->i, sizeof(int64_t) * n);
+        lnvec_del(v);
+        v = w;
+        cap *= 2;
+      }
+      err = _bt_vput(v, &isf, n++, x, type, fname);
+      lval_del(x);
+    }
+    liter_done(&it);
+    err = err ? err : it.err;
+  }
+
+  if (err) {
+    lnvec_del(v);
+    return err;
+  }
+
+  v->len = n;
+  return lval_nvec(isf ? LVAL_F64VEC : LVAL_I64VEC, v);
+}
+
+/**
+ * The elements of x (a vector or a number) as doubles, and in *stride 1
+ * if it is a vector and 0 if a number (which is put in *tmp): those of
+ * an LVAL_I64VEC are converted into a new array, to be freed
+ */
+double* _bt_vf64(lval* x, double* tmp, int* stride)
+{
+  *stride = _bt_isvec(x);
+  if (x->type == LVAL_F64VEC) {
+    return x->vec->f;
+  }
+  if (x->type == LVAL_I64VEC) {
+    double* d = malloc(sizeof(double) * (x->vec->len + 1));
+    for (long k = 0; k < x->vec->len; k++) {
+      d[k] = (double)x->vec->i[k];
+    }
+    return d;
+  }
+  *tmp = _bt_dbl(x);
+  return tmp;
+}
+
+/* the same for an LVAL_I64VEC or a Number, nothing is converted */
+int64_t* _bt_vi64(lval* x, int64_t* tmp, int* stride)
+{
+  *stride = _bt_isvec(x);
+  if (x->type == LVAL_I64VEC) {
+    return x->vec->i;
+  }
+  *tmp = x->num;
+  return tmp;
+}
+
+/* if the numbers of x and y are operated as doubles */
+int _bt_visf(lval* x, lval* y)
+{
+  return x->type == LVAL_F64VEC || x->type == LVAL_FLOAT || x->type == LVAL_BIGNUM
+      || y->type == LVAL_F64VEC || y->type == LVAL_FLOAT || y->type == LVAL_BIGNUM;
+}
+
+/**
+ * x op y elementwise, of a vector and a vector of its length or a number
+ * (which goes with every element), both consumed. 'cmp' says if op is a
+ * comparison, which gives an LVAL_I64VEC of 1 where it holds and 0 where not.
+ */
+lval* _bt_vkern(int kop, int cmp, lval* x, lval* y, char* fname)
+{
+  long n = _bt_isvec(x) ? x->vec->len : y->vec->len;
+  lval* err = NULL;
+  if (_bt_isvec(x) && _bt_isvec(y) && x->vec->len != y->vec->len) {
+    err = lval_err("function '%s' passed vectors of different lengths. got %li and %li.",
+        fname, x->vec->len, y->vec->len);
+  }
+
+  lkern* k = lkern_get();
+  lnvec* r = NULL;
+  int type = cmp ? LVAL_I64VEC : LVAL_F64VEC;
+
+  if (!err && _bt_visf(x, y)) {
+    double xt, yt;
+    int sx, sy;
+    double* xa = _bt_vf64(x, &xt, &sx);
+    double* ya = _bt_vf64(y, &yt, &sy);
+    r = lnvec_new(n);
+    if (cmp) {
+      k->f64_cmp(kop, r->i, xa, sx, ya, sy, n);
+    } else {
+      k->f64_arith(kop, r->f, xa, sx, ya, sy, n);
+    }
+    if (x->type == LVAL_I64VEC) { free(xa); }
+    if (y->type == LVAL_I64VEC) { free(ya); }
+  } else if (!err) {
+    int64_t xt, yt;
+    int sx, sy;
+    int64_t* xa = _bt_vi64(x, &xt, &sx);
+    int64_t* ya = _bt_vi64(y, &yt, &sy);
+
+    /* the integers are not divided by 0 */
+    if (!cmp && kop == LKERN_DIV) {
+      for (long j = 0; j < (sy ? n : 1); j++) {
+        if (!ya[j]) {
+          err = lval_err("division by zero");
+          break;
+        }
+      }
+    }
+
+    if (!err) {
+      r = lnvec_new(n);
+      if (cmp) {
+        k->i64_cmp(kop, r->i, xa, sx, ya, sy, n);
+      } else {
+        k->i64_arith(kop, r->i, xa, sx, ya, sy, n);
+      }
+      type = LVAL_I64VEC;
+    }
+  }
+
+  lval_del(x);
+  lval_del(y);
+  return err ? err : lval_nvec(type, r);
+}
+
+/* + - * / with a vector (or a matrix) among the numbers, one pair at a time */
+lval* _bt_vop(lenv* e, lval* a, char* op)
+{
+  int kop = LKERN_ADD;
+  switch (op[0]) {
+    case '-': kop = LKERN_SUB; break;
+    case '*': kop = LKERN_MUL; break;
+    case '/': kop = LKERN_DIV; break;
+  }
+
+  lval* x = lval_pop(a, 0);
+  if (op[0] == '-' && a->count == 0) {
+    x = x->type == LVAL_MATRIX
+        ? _bt_mop(kop, lval_num(0), x, op)
+        : _bt_vkern(kop, 0, lval_num(0), x, op);
+  }
+
+  while (a->count > 0 && x->type != LVAL_ERR) {
+    lval* y = lval_pop(a, 0);
+    if (x->type == LVAL_MATRIX || y->type == LVAL_MATRIX) {
+      x = _bt_mop(kop, x, y, op);
+    } else if (_bt_isvec(x) || _bt_isvec(y)) {
+      x = _bt_vkern(kop, 0, x, y, op);
+    } else {
+      x = _bt_op(e, lval_add(lval_add(lval_sexpr(), x), y), op);
+    }
+  }
+
+  lval_del(a);
+  return x;
+}
+
+/* < <= > >= with a vector among the two numbers */
+lval* _bt_vcmp(lval* a, char* op)
+{
+  int kop = LKERN_LT;
+  if      (is(op, KW_GTE))  { kop = LKERN_GTE; }
+  else if (is(op, KW_LTE))  { kop = LKERN_LTE; }
+  else if (is(op, KW_GT))   { kop = LKERN_GT; }
+
+  lval* x = lval_pop(a, 0);
+  lval* y = lval_take(a, 0);
+  return _bt_vkern(kop, 1, x, y, op);
+}
+
+BUILTIN(F64VEC)
+{
+  /* (f64vec c) the numbers of a collection, (f64vec 1 2 3) those given */
+  if (a->count == 1 && liter_can(a->cell[0])) {
+    lval* v = _bt_tovec(e, a->cell[0], LVAL_F64VEC, KW_F64VEC);
+    lval_del(a);
+    return v;
+  }
+  a->type = LVAL_QEXPR;
+  lval* v = _bt_tovec(e, a, LVAL_F64VEC, KW_F64VEC);
+  lval_del(a);
+  return v;
+}
+
+BUILTIN(I64VEC)
+{
+  /* (i64vec c) the numbers of a collection, (i64vec 1 2 3) those given */
+  if (a->count == 1 && liter_can(a->cell[0])) {
+    lval* v = _bt_tovec(e, a->cell[0], LVAL_I64VEC, KW_I64VEC);
+    lval_del(a);
+    return v;
+  }
+  a->type = LVAL_QEXPR;
+  lval* v = _bt_tovec(e, a, LVAL_I64VEC, KW_I64VEC);
+  lval_del(a);
+  return v;
+}
+
+/**
+ * The only argument of the reductions, a vector or any other collection
+ * of numbers (made a vector), in place of the argument; or an error
+ */
+lval* _bt_vreduced(lenv* e, lval* a, char* fname)
+{
+  if (a->count != 1) {
+    return lval_err("function '%s' passed incorrect number of arguments. "
+        "got '%i', expected '%i'.", fname, a->count, 1);
+  }
+  if (!liter_can(a->cell[0])) {
+    return lval_err("function '%s' passed incorrect type for argument %i. "
+        "got '%s', expected a collection.", fname, 0, ltype_name(a->cell[0]->type));
+  }
+
+  lval* v = _bt_tovec(e, a->cell[0], 0, fname);
+  if (v->type == LVAL_ERR) {
+    return v;
+  }
+  lval_del(a->cell[0]);
+  a->cell[0] = v;
+  return NULL;
+}
+
+/**
+ * The exact sum of n integers, a Bignum if it does not fit in a long,
+ * or (if all) the list of the sums of the first 1, 2... n of them: for
+ * the sums the kernels found overflowing
+ */
+lval* _bt_isums(int64_t* x, long n, int all)
+{
+  /* the sum is s + part, part is added to s when it would overflow */
+  lbig* s = lbig_from_long(0);
+  long part = 0;
+  lval* sums = all ? lval_qexpr() : NULL;
+  for (long i = 0; i < n; i++) {
+    long t;
+    if (LBIG_ADD(part, (long)x[i], &t)) {
+      lbig* p = lbig_from_long(part);
+      lbig* u = lbig_add(s, p);
+      lbig_del(s);
+      lbig_del(p);
+      s = u;
+      t = (long)x[i];
+    }
+    part = t;
+
+    if (all) {
+      lbig* p = lbig_from_long(part);
+      lval_add(sums, lval_bignum(lbig_add(s, p)));
+      lbig_del(p);
+    }
+  }
+
+  if (all) {
+    lbig_del(s);
+    return sums;
+  }
+  lbig* p = lbig_from_long(part);
+  lval* v = lval_bignum(lbig_add(s, p));
+  lbig_del(s);
+  lbig_del(p);
+  return v;
+}
+
+BUILTIN(SUM)
+{
+  lval* err = _bt_vreduced(e, a, KW_SUM);
+  if (err) {
+    lval_del(a);
+    return err;
+  }
+
+  lnvec* v = a->cell[0]->vec;
+  lval* x = NULL;
+  if (a->cell[0]->type == LVAL_F64VEC) {
+    x = lval_float(lkern_get()->f64_sum(v->f, v->len));
+  } else {
+    int over = 0;
+    int64_t s = lkern_get()->i64_sum(v->i, v->len, &over);
+    x = over ? _bt_isums(v->i, v->len, 0) : lval_num((long)s);
+  }
+  lval_del(a);
+  return x;
+}
+
+lval* _bt_minmax(lenv* e, lval* a, char* fname)
+{
+  lval* err = _bt_vreduced(e, a, fname);
+  if (err) {
+    lval_del(a);
+    return err;
+  }
+  LASSERT(a, a->cell[0]->vec->len != 0,
+      "function '%s' passed {} for argument %i.", fname, 0);
+
+  lkern* k = lkern_get();
+  lnvec* v = a->cell[0]->vec;
+  int min = is(fname, KW_MIN);
+  lval* x = NULL;
+  if (a->cell[0]->type == LVAL_F64VEC) {
+    x = lval_float(min ? k->f64_min(v->f, v->len) : k->f64_max(v->f, v->len));
+  } else {
+    x = lval_num((long)(min ? k->i64_min(v->i, v->len) : k->i64_max(v->i, v->len)));
+  }
+  lval_del(a);
+  return x;
+}
+
+BUILTIN(MIN) { return _bt_minmax(e, a, KW_MIN); }
+BUILTIN(MAX) { return _bt_minmax(e, a, KW_MAX); }
+
+BUILTIN(CUMSUM)
+{
+  lval* err = _bt_vreduced(e, a, KW_CUMSUM);
+  if (err) {
+    lval_del(a);
+    return err;
+  }
+
+  lnvec* v = a->cell[0]->vec;
+  lnvec* r = lnvec_new(v->len);
+  int type = a->cell[0]->type;
+  if (type == LVAL_F64VEC) {
+    lkern_get()->f64_cumsum(r->f, v->f, v->len);
+  } else if (lkern_get()->i64_cumsum(r->i, v->i, v->len)) {
+    lnvec_del(r);
+    lval* x = _bt_isums(v->i, v->len, 1);
+    lval_del(a);
+    return x;
+  }
+  lval_del(a);
+  return lval_nvec(type, r);
+}
+
+BUILTIN(DOT)
+{
+  /* (dot x y) the sum of the products of the elements of two vectors */
+  LASSERT_NUM(KW_DOT, a, 2);
+  for (int i = 0; i < 2; i++) {
+    LASSERT_COLL(KW_DOT, a, i);
+    lval* v = _bt_tovec(e, a->cell[i], 0, KW_DOT);
+    if (v->type == LVAL_ERR) {
+      lval_del(a);
+      return v;
+    }
+    lval_del(a->cell[i]);
+    a->cell[i] = v;
+  }
+
+  lval* x = a->cell[0];
+  lval* y = a->cell[1];
+  long n = x->vec->len;
+  LASSERT(a, n == y->vec->len,
+      "function '%s' passed vectors of different lengths. got %li and %li.",
+      KW_DOT, n, y->vec->len);
+
+  lkern* k = lkern_get();
+  lval* r = NULL;
+  if (x->type == LVAL_I64VEC && y->type == LVAL_I64VEC) {
+    r = lval_num((long)k->i64_dot(x->vec->i, y->vec->i, n));
+  } else {
+    double xt, yt;
+    int sx, sy;
+    double* xa = _bt_vf64(x, &xt, &sx);
+    double* ya = _bt_vf64(y, &yt, &sy);
+    r = lval_float(k->f64_dot(xa, ya, n));
+    if (x->type == LVAL_I64VEC) { free(xa); }
+    if (y->type == LVAL_I64VEC) { free(ya); }
+  }
+
+  lval_del(a);
+  return r;
+}
+
+/* a matrix as the vector of its elements, consumed (anything else as it is) */
+lval* _bt_mvec(lval* x)
+{
+  if (x->type != LVAL_MATRIX) {
+    return x;
+  }
+  lval* v = lval_nvec(LVAL_F64VEC, x->vec);
+  v->vec->refs++;
+  lval_del(x);
+  return v;
+}
+
+/* x op y elementwise, of a matrix and a matrix of its size or a number */
+lval* _bt_mop(int kop, lval* x, lval* y, char* fname)
+{
+  lval* m = x->type == LVAL_MATRIX ? x : y;
+  lval* o = m == x ? y : x;
+  lval* err = NULL;
+  if (o->type == LVAL_MATRIX && (o->rows != m->rows || o->cols != m->cols)) {
+    err = lval_err("function '%s' passed matrices of different sizes. got %lix%li and %lix%li.",
+        fname, x->rows, x->cols, y->rows, y->cols);
+  } else if (_bt_isvec(o)) {
+    err = lval_err("function '%s' passed a '%s' and a '%s'.",
+        fname, ltype_name(x->type), ltype_name(y->type));
+  }
+  if (err) {
+    lval_del(x);
+    lval_del(y);
+    return err;
+  }
+
+  long rows = m->rows;
+  long cols = m->cols;
+  lval* r = _bt_vkern(kop, 0, _bt_mvec(x), _bt_mvec(y), fname);
+  if (r->type == LVAL_ERR) {
+    return r;
+  }
+  lnvec* v = r->vec;
+  v->refs++;
+  lval_del(r);
+  return lval_matrix(rows, cols, v);
+}
+
+BUILTIN(MATRIX)
+{
+  /**
+   * (matrix {{1 2} {3 4}}) the matrix of the rows of a collection, or
+   * (matrix r c x) of r rows and c columns, all x or the numbers of x
+   */
+  LASSERT_NUM_OR(KW_MATRIX, a, 1, 3);
+
+  if (a->count == 3) {
+    LASSERT_TYPE(KW_MATRIX, a, 0, LVAL_NUM);
+    LASSERT_TYPE(KW_MATRIX, a, 1, LVAL_NUM);
+    long rows = a->cell[0]->num;
+    long cols = a->cell[1]->num;
+    LASSERT(a, rows >= 0 && cols >= 0,
+        "function '%s' passed a negative size. got %lix%li.", KW_MATRIX, rows, cols);
+    LASSERT(a, cols == 0 || rows <= LONG_MAX / cols,
+        "function '%s' passed a size with more numbers than a long can count. got %lix%li.",
+        KW_MATRIX, rows, cols);
+
+    lval* x = a->cell[2];
+    if (x->type == LVAL_NUM || x->type == LVAL_FLOAT || x->type == LVAL_BIGNUM) {
+      lnvec* v = lnvec_new(rows * cols);
+      if (!v) {
+        lval_del(a);
+        return _bt_nomem(KW_MATRIX, rows * cols);
+      }
+      double d = _bt_dbl(x);
+      for (long i = 0; i < rows * cols; i++) {
+        v->f[i] = d;
+      }
+      lval_del(a);
+      return lval_matrix(rows, cols, v);
+    }
+
+    LASSERT_COLL(KW_MATRIX, a, 2);
+    lval* v = _bt_tovec(e, x, LVAL_F64VEC, KW_MATRIX);
+    if (v->type == LVAL_ERR) {
+      lval_del(a);
+      return v;
+    }
+    long len = v->vec->len;
+    if (len != rows * cols) {
+      lval_del(v);
+      lval_del(a);
+      return lval_err("function '%s' passed %li numbers for a %lix%li matrix.",
+          KW_MATRIX, len, rows, cols);
+    }
+    lnvec* m = v->vec;
+    m->refs++;
+    lval_del(v);
+    lval_del(a);
+    return lval_matrix(rows, cols, m);
+  }
+
+  LASSERT_COLL(KW_MATRIX, a, 0);
+
+  /* every row is made a vector, then copied after the ones before */
+  lnvec* m = lnvec_new(0);
+  long rows = 0;
+  long cols = 0;
+  long cap = 0;
+  lval* err = NULL;
+
+  liter it;
+  liter_init(&it, a->cell[0]);
+  lval* x;
+  while (!err && (x = liter_next(e, &it))) {
+    lval* row = liter_can(x) ? _bt_tovec(e, x, LVAL_F64VEC, KW_MATRIX)
+        : lval_err("function '%s' passed a row that is a '%s', expected a collection.",
+            KW_MATRIX, ltype_name(x->type));
+    lval_del(x);
+    if (row->type == LVAL_ERR) {
+      err = row;
+      break;
+    }
+
+    long n = row->vec->len;
+    if (rows == 0) {
+      cols = n;
+    }
+    if (n != cols) {
+      err = lval_err("function '%s' passed rows of different lengths. got %li and %li.",
+          KW_MATRIX, cols, n);
+      lval_del(row);
+      break;
+    }
+
+    /* room for twice the rows when it is full */
+    if (rows == cap) {
+      cap = cap ? 2 * cap : 16;
+      lnvec* w = cols == 0 || cap <= LONG_MAX / cols ? lnvec_new(cap * cols) : NULL;
+      if (!w) {
+        err = _bt_nomem(KW_MATRIX, cap * cols);
+        lval_del(row);
+        break;
+      }
+      memcpy(w->f, m->f, sizeof(double) * rows * cols);
+      lnvec_del(m);
+      m = w;
+    }
+    memcpy(m->f + rows * cols, row->vec->f, sizeof(double) * cols);
+    rows++;
+    lval_del(row);
+  }
+  liter_done(&it);
+  lval_del(a);
+
+  err = err ? err : it.err;
+  if (err) {
+    lnvec_del(m);
+    return err;
+  }
+
+  m->len = rows * cols;
+  return lval_matrix(rows, cols, m);
+}
+
+BUILTIN(SHAPE)
+{
+  /* (shape m) {rows cols} of the matrix */
+  LASSERT_NUM(KW_SHAPE, a, 1);
+  LASSERT_TYPE(KW_SHAPE, a, 0, LVAL_MATRIX);
+
+  lval* v = lval_qexpr();
+  lval_add(v, lval_num(a->cell[0]->rows));
+  lval_add(v, lval_num(a->cell[0]->cols));
+  lval_del(a);
+  return v;
+}
+
+BUILTIN(TRANSPOSE)
+{
+  LASSERT_NUM(KW_TRANSPOSE, a, 1);
+  LASSERT_TYPE(KW_TRANSPOSE, a, 0, LVAL_MATRIX);
+
+  lval* m = a->cell[0];
+  lnvec* t = lnvec_new(m->rows * m->cols);
+  lmat_transpose(t->f, m->vec->f, m->rows, m->cols);
+  lval* v = lval_matrix(m->cols, m->rows, t);
+  lval_del(a);
+  return v;
+}
+
+BUILTIN(MATMUL)
+{
+  /* (matmul a b) the product of two matrices, (matmul a b n) in n threads */
+  LASSERT_NUM_OR(KW_MATMUL, a, 2, 3);
+  LASSERT_TYPE(KW_MATMUL, a, 0, LVAL_MATRIX);
+  LASSERT_TYPE(KW_MATMUL, a, 1, LVAL_MATRIX);
+  if (a->count == 3) {
+    LASSERT_TYPE(KW_MATMUL, a, 2, LVAL_NUM);
+  }
+
+  lval* x = a->cell[0];
+  lval* y = a->cell[1];
+  LASSERT(a, x->cols == y->rows,
+      "function '%s' passed matrices that cannot be multiplied. got %lix%li and %lix%li.",
+      KW_MATMUL, x->rows, x->cols, y->rows, y->cols);
+
+  int threads = a->count == 3 ? (int)a->cell[2]->num : 1;
+  lnvec* c = y->cols == 0 || x->rows <= LONG_MAX / y->cols ? lnvec_new(x->rows * y->cols) : NULL;
+  LASSERT(a, c, "function '%s' could not allocate a %lix%li matrix.",
+      KW_MATMUL, x->rows, y->cols);
+  lmat_mul(c->f, x->vec->f, y->vec->f, x->rows, x->cols, y->cols, threads);
+  lval* v = lval_matrix(x->rows, y->cols, c);
+  lval_del(a);
+  return v;
+}
+
+/**
+ * the arguments from 'from' on, every 'step', that are keys as in 'def':
+ * {a} is the Symbol a (which given as it is would be evaluated)
+ */
+void _bt_keys(lval* a, int from, int step)
+{
+  for (int i = from; i < a->count; i += step) {
+    lval* k = a->cell[i];
+    if (k->type == LVAL_QEXPR && k->count == 1 && k->cell[0]->type == LVAL_SYM) {
+      a->cell[i] = lval_take(k, 0);
+    }
+  }
+}
+
+#define LASSERT_ASSOC(func, args, index)                                    \
+  LASSERT(args, args->cell[index]->type == LVAL_DICT                        \
+      || args->cell[index]->type == LVAL_MAP                                \
+      || args->cell[index]->type == LVAL_SMAP                               \
+      || args->cell[index]->type == LVAL_SSET,                              \
+      "function '%s' passed incorrect type for argument %i. "               \
+      "got '%s', expected a Dict, a Map, a Sorted Map or a Sorted Set.",    \
+      func, index, ltype_name(args->cell[index]->type))
+
+#define LASSERT_SORTED(func, args, index)                                   \
+  LASSERT(args, args->cell[index]->type == LVAL_SMAP                        \
+      || args->cell[index]->type == LVAL_SSET,                              \
+      "function '%s' passed incorrect type for argument %i. "               \
+      "got '%s', expected a Sorted Map or a Sorted Set.",                   \
+      func, index, ltype_name(args->cell[index]->type))
+
+/* what a Dict, Map, Sorted Map or Sorted Set is called in the errors */
+char* _bt_assoc_name(lval* d)
+{
+  switch (d->type) {
+    case LVAL_DICT: return "dict";
+    case LVAL_MAP:  return "map";
+    case LVAL_SMAP: return "sorted map";
+  }
+  return "sorted set";
+}
+
+/* the number of entries of a Dict, Map, Sorted Map or Sorted Set */
+long _bt_assoc_count(lval* d)
+{
+  switch (d->type) {
+    case LVAL_DICT: return d->dict->count;
+    case LVAL_MAP:  return lhamt_count(d->map);
+  }
+  return lbtree_count(d->tree);
+}
+
+/* the value of a key in a Dict, Map, Sorted Map or Sorted Set (the key itself), NULL if not in it */
+lval* _bt_lookup(lval* d, lval* k)
+{
+  switch (d->type) {
+    case LVAL_DICT: return ldict_get(d->dict, k);
+    case LVAL_MAP:  return lhamt_get(d->map, k);
+  }
+  return lbtree_get(d->tree, k);
+}
+
+/**
+ * sets the value of a key in a Dict (to be changed), Map, Sorted Map or
+ * Sorted Set (v being NULL), k and v are taken
+ */
+void _bt_assoc_put(lval* d, lval* k, lval* v)
+{
+  switch (d->type) {
+    case LVAL_DICT: ldict_put(d->dict, k, v); break;
+    case LVAL_MAP:  d->map = lhamt_put(d->map, k, v); break;
+    default:        d->tree = lbtree_put(d->tree, k, v); break;
+  }
+}
+
+/**
+ * the entries of the arguments put in d (an empty Dict, Map, Sorted Map or
+ * Sorted Set), from the pairs of a collection (already checked to be one)
+ * or keys and values; a set takes keys alone, both from a collection and
+ * as arguments. A sorted one is built at once from all the entries.
+ */
+lval* _bt_assoc(lenv* e, lval* a, lval* d, char* fname)
+{
+  int set = d->type == LVAL_SSET;
+  long n = 0;
+  long size = a->count == 1 && a->cell[0]->type == LVAL_QEXPR ? a->cell[0]->count : a->count;
+  size = size ? size : 1;
+  lval** keys = malloc(sizeof(lval*) * size);
+  lval** vals = malloc(sizeof(lval*) * size);
+  lval* err = NULL;
+
+  if (a->count == 1) {
+    liter it;
+    liter_init(&it, a->cell[0]);
+    lval* x;
+    while ((x = liter_next(e, &it))) {
+      if (set && !ldict_can_key(x)) {
+        err = lval_err("function '%s' passed a '%s' as a key, "
+            "expected a Number, a String or a Symbol.", fname, ltype_name(x->type));
+      } else if (!set && (x->type != LVAL_QEXPR || x->count != 2)) {
+        err = lval_err("function '%s' passed a '%s' as an entry, expected {key value}.",
+            fname, ltype_name(x->type));
+      } else if (!set && !ldict_can_key(x->cell[0])) {
+        err = lval_err("function '%s' passed a '%s' as a key, "
+            "expected a Number, a String or a Symbol.", fname, ltype_name(x->cell[0]->type));
+      }
+      if (err) {
+        lval_del(x);
+        break;
+      }
+
+      if (n == size) {
+        size *= 2;
+        keys = realloc(keys, sizeof(lval*) * size);
+        vals = realloc(vals, sizeof(lval*) * size);
+      }
+      keys[n] = set ? x : lval_pop(x, 0);
+      vals[n++] = set ? NULL : lval_take(x, 0);
+    }
+    liter_done(&it);
+    err = err ? err : it.err;
+
+  } else {
+    int step = set ? 1 : 2;
+    _bt_keys(a, 0, step);
+    if (a->count % step) {
+      err = lval_err("function '%s' passed incorrect number of arguments. "
+          "got %i, expected a collection or keys and values.", fname, a->count);
+    }
+    for (int i = 0; !err && i < a->count; i += step) {
+      if (!ldict_can_key(a->cell[i])) {
+        err = lval_err("function '%s' passed incorrect type for argument %i. "
+            "got '%s', expected a Number, a String or a Symbol.",
+            fname, i, ltype_name(a->cell[i]->type));
+      }
+    }
+
+    /* the keys and values are taken from the arguments */
+    for (int i = 0; !err && i < a->count; i += step) {
+      keys[n] = a->cell[i];
+      vals[n++] = set ? NULL : a->cell[i + 1];
+    }
+    if (!err) {
+      a->count = 0;
+    }
+  }
+  lval_del(a);
+
+  if (err) {
+    for (long i = 0; i < n; i++) {
+      lval_del(keys[i]);
+      if (vals[i]) {
+        lval_del(vals[i]);
+      }
+    }
+    lval_del(d);
+  } else if (d->type == LVAL_SMAP || set) {
+    d->tree = lbtree_build(keys, set ? NULL : vals, n);
+  } else {
+    for (long i = 0; i < n; i++) {
+      _bt_assoc_put(d, keys[i], vals[i]);
+    }
+  }
+  free(keys);
+  free(vals);
+  return err ? err : d;
+}
+
+BUILTIN(DICT)
+{
+  /**
+   * (dict {{k v} {k v}}) the dict of the pairs of a collection, or
+   * (dict k v k v) of its arguments
+   */
+  lval* x = a->cell[0];
+  if (a->count == 1) {
+    LASSERT_COLL(KW_DICT, a, 0);
+  }
+  long n = a->count == 1 ? (x->type == LVAL_QEXPR ? x->count : 0) : a->count / 2;
+  return _bt_assoc(e, a, lval_dict(ldict_new(n)), KW_DICT);
+}
+
+BUILTIN(HMAP)
+{
+  /* (hmap {{k v} {k v}}) or (hmap k v k v), the same as 'dict' */
+  if (a->count == 1) {
+    LASSERT_COLL(KW_HMAP, a, 0);
+  }
+  return _bt_assoc(e, a, lval_map(NULL), KW_HMAP);
+}
+
+BUILTIN(SMAP)
+{
+  /**
+   * (sorted-map {{k v} {k v}}) or (sorted-map k v k v), the same as 'dict'
+   * but in the order of the keys: built in one pass if they are given in
+   * order, otherwise they are sorted first
+   */
+  if (a->count == 1) {
+    LASSERT_COLL(KW_SMAP, a, 0);
+  }
+  return _bt_assoc(e, a, lval_sorted(LVAL_SMAP, NULL), KW_SMAP);
+}
+
+BUILTIN(SSET)
+{
+  /* (sorted-set {k k k}) the set of the keys of a collection, or (sorted-set k k k) of its arguments */
+  if (a->count == 1) {
+    LASSERT_COLL(KW_SSET, a, 0);
+  }
+  return _bt_assoc(e, a, lval_sorted(LVAL_SSET, NULL), KW_SSET);
+}
+
+BUILTIN(GET)
+{
+  /* (get d k) the value of k in d, (get d k x) or x if k is not in d */
+  LASSERT_NUM_OR(KW_GET, a, 2, 3);
+  LASSERT_ASSOC(KW_GET, a, 0);
+  _bt_keys(a, 1, 2);
+  LASSERT_KEY(KW_GET, a, 1);
+
+  lval* v = _bt_lookup(a->cell[0], a->cell[1]);
+  if (!v) {
+    LASSERT(a, a->count == 3, "function '%s' passed a key that is not in the %s.",
+        KW_GET, _bt_assoc_name(a->cell[0]));
+    v = a->cell[2];
+  }
+  v = lval_copy(v);
+  lval_del(a);
+  return v;
+}
+
+BUILTIN(PUT)
+{
+  /**
+   * (put d k v k v) a dict (or map, or sorted map) with the entries of d
+   * and the ones given, sharing all of d but the parts the new entries go
+   * in; (put s k k) a sorted set with the keys of s and the ones given
+   */
+  LASSERT_ASSOC(KW_PUT, a, 0);
+  int step = a->cell[0]->type == LVAL_SSET ? 1 : 2;
+  LASSERT(a, a->count > step && (a->count - 1) % step == 0,
+      "function '%s' passed incorrect number of arguments. "
+      "got %i, expected a %s then %s.", KW_PUT, a->count,
+      _bt_assoc_name(a->cell[0]), step == 1 ? "keys" : "keys and values");
+  _bt_keys(a, 1, step);
+  for (int i = 1; i < a->count; i += step) {
+    LASSERT_KEY(KW_PUT, a, i);
+  }
+
+  lval* d = lval_pop(a, 0);
+  if (d->type == LVAL_DICT) {
+    d->dict = ldict_edit(d->dict);
+  }
+  for (int i = 0; i < a->count; i += step) {
+    _bt_assoc_put(d, a->cell[i], step == 2 ? a->cell[i + 1] : NULL);
+  }
+  a->count = 0;
+  lval_del(a);
+  return d;
+}
+
+BUILTIN(DICT_DEL)
+{
+  /* (dict-del d k k) a dict (or map, sorted map or set) with the entries of d but the keys given (if in it) */
+  LASSERT(a, a->count >= 2,
+      "function '%s' passed incorrect number of arguments. "
+      "got %i, expected a dict then keys.", KW_DICT_DEL, a->count);
+  LASSERT_ASSOC(KW_DICT_DEL, a, 0);
+  _bt_keys(a, 1, 1);
+  for (int i = 1; i < a->count; i++) {
+    LASSERT_KEY(KW_DICT_DEL, a, i);
+  }
+
+  lval* d = lval_pop(a, 0);
+  for (int i = 0; i < a->count; i++) {
+    if (d->type == LVAL_MAP) {
+      d->map = lhamt_remove(d->map, a->cell[i]);
+
+    } else if (d->type == LVAL_SMAP || d->type == LVAL_SSET) {
+      d->tree = lbtree_remove(d->tree, a->cell[i]);
+
+    /* nothing is copied for the keys not in it */
+    } else if (ldict_get(d->dict, a->cell[i])) {
+      d->dict = ldict_edit(d->dict);
+      ldict_remove(d->dict, a->cell[i]);
+    }
+  }
+  lval_del(a);
+  return d;
+}
+
+/* the keys (or the values) of a dict, a map or a sorted one, in the order of its entries */
+lval* _bt_entries(lval* a, int vals, char* fname)
+{
+  LASSERT_NUM(fname, a, 1);
+  LASSERT_ASSOC(fname, a, 0);
+
+  lval* d = a->cell[0];
+  long n = _bt_assoc_count(d);
+  lval* v = lval_qexpr();
+  v->cell = malloc(sizeof(lval*) * n);
+  long i = 0;
+  lval* k;
+  lval* x;
+  while (lval_entry(d, &i, &k, &x)) {
+    v->cell[v->count++] = lval_copy(vals ? x : k);
+  }
+  lval_del(a);
+  return v;
+}
+
+BUILTIN(KEYS) { return _bt_entries(a, 0, KW_KEYS); }
+BUILTIN(VALS) { return _bt_entries(a, 1, KW_VALS); }
+
+BUILTIN(HAS)
+{
+  LASSERT_NUM(KW_HAS, a, 2);
+  LASSERT_ASSOC(KW_HAS, a, 0);
+  _bt_keys(a, 1, 1);
+  LASSERT_KEY(KW_HAS, a, 1);
+
+  int has = _bt_lookup(a->cell[0], a->cell[1]) != NULL;
+  lval_del(a);
+  return lval_num(has);
+}
+
+BUILTIN(SORTED_RANGE)
+{
+  /* (sorted-range s from to) the entries of s with keys from 'from' to 'to' (excluded), or from 'from' on */
+  LASSERT_NUM_OR(KW_SORTED_RANGE, a, 2, 3);
+  LASSERT_SORTED(KW_SORTED_RANGE, a, 0);
+  _bt_keys(a, 1, 1);
+  for (int i = 1; i < a->count; i++) {
+    LASSERT_KEY(KW_SORTED_RANGE, a, i);
+  }
+
+  lval* s = a->cell[0];
+  int found;
+  long from = lbtree_rank(s->tree, a->cell[1], &found);
+  long to = a->count == 3 ? lbtree_rank(s->tree, a->cell[2], &found) : lbtree_count(s->tree);
+  lval* v = lval_sorted(s->type, lbtree_slice(s->tree, from, to));
+  lval_del(a);
+  return v;
+}
+
+/**
+ * (sorted-floor s k) the entry of s with the greatest key not greater
+ * than k, (sorted-ceil s k) with the least key not less than k: the key
+ * in a set, a list {key value} in a map; (sorted-floor s k x) or x if
+ * there is none
+ */
+lval* _bt_bound(lval* a, int ceil, char* fname)
+{
+  LASSERT_NUM_OR(fname, a, 2, 3);
+  LASSERT_SORTED(fname, a, 0);
+  _bt_keys(a, 1, 2);
+  LASSERT_KEY(fname, a, 1);
+
+  lval* s = a->cell[0];
+  int found;
+  long i = lbtree_rank(s->tree, a->cell[1], &found);
+  if (!ceil && !found) {
+    i--;
+  }
+
+  lval* k;
+  lval* x;
+  lval* v;
+  if (lbtree_nth(s->tree, i, &k, &x)) {
+    v = s->type == LVAL_SSET ? lval_copy(k)
+        : lval_add(lval_add(lval_qexpr(), lval_copy(k)), lval_copy(x));
+  } else {
+    LASSERT(a, a->count == 3, "function '%s' passed a key with none %s it in the %s.",
+        fname, ceil ? "greater than or equal to" : "less than or equal to",
+        _bt_assoc_name(s));
+    v = lval_copy(a->cell[2]);
+  }
+  lval_del(a);
+  return v;
+}
+
+BUILTIN(SORTED_FLOOR) { return _bt_bound(a, 0, KW_SORTED_FLOOR); }
+BUILTIN(SORTED_CEIL)  { return _bt_bound(a, 1, KW_SORTED_CEIL);  }
+
+BUILTIN(VEC)
+{
+  /* (vec c) a new vector with the elements of a collection, (vec 1 2 3) with those given */
+  if (a->count == 1 && liter_can(a->cell[0])) {
+    lval* c = a->cell[0];
+    lvec* v = lvec_new(c->type == LVAL_QEXPR ? c->count : 0);
+    liter it;
+    liter_init(&it, c);
+    lval* x;
+    while ((x = liter_next(e, &it))) {
+      lvec_push(v, x);
+    }
+    liter_done(&it);
+    lval_del(a);
+    if (it.err) {
+      lvec_del(v);
+      return it.err;
+    }
+    return lval_vec(v);
+  }
+
+  lvec* v = lvec_new(a->count);
+  for (int i = 0; i < a->count; i++) {
+    lvec_push(v, a->cell[i]);
+  }
+  a->count = 0;
+  lval_del(a);
+  return lval_vec(v);
+}
+
+#define LASSERT_INDEX(func, args, index)                                    \
+  LASSERT_TYPE(func, args, index, LVAL_NUM);                                \
+  LASSERT(args, args->cell[index]->num >= 0                                 \
+      && args->cell[index]->num < args->cell[0]->mvec->len,                 \
+      "function '%s' passed an index out of the vector. "                   \
+      "got %li, the length is %li.", func, args->cell[index]->num,          \
+      args->cell[0]->mvec->len)
+
+BUILTIN(VEC_GET)
+{
+  /* (vec-get v i) the element with index i */
+  LASSERT_NUM(KW_VEC_GET, a, 2);
+  LASSERT_TYPE(KW_VEC_GET, a, 0, LVAL_VEC);
+  LASSERT_INDEX(KW_VEC_GET, a, 1);
+
+  lval* x = lval_copy(a->cell[0]->mvec->items[a->cell[1]->num]);
+  lval_del(a);
+  return x;
+}
+
+BUILTIN(VEC_SET)
+{
+  /* (vec-set! v i x) x is made the element with index i of v, which is returned */
+  LASSERT_NUM(KW_VEC_SET, a, 3);
+  LASSERT_TYPE(KW_VEC_SET, a, 0, LVAL_VEC);
+  LASSERT_INDEX(KW_VEC_SET, a, 1);
+
+  lvec* v = a->cell[0]->mvec;
+  long i = a->cell[1]->num;
+  lval_del(v->items[i]);
+  v->items[i] = lval_pop(a, 2);
+  return lval_take(a, 0);
+}
+
+BUILTIN(VEC_PUSH)
+{
+  /* (vec-push! v x y) x and y are added at the end of v, which is returned */
+  LASSERT(a, a->count >= 2,
+      "function '%s' passed incorrect number of arguments. "
+      "got %i, expected a vector then elements.", KW_VEC_PUSH, a->count);
+  LASSERT_TYPE(KW_VEC_PUSH, a, 0, LVAL_VEC);
+
+  lval* v = lval_pop(a, 0);
+  for (int i = 0; i < a->count; i++) {
+    lvec_push(v->mvec, a->cell[i]);
+  }
+  a->count = 0;
+  lval_del(a);
+  return v;
+}
+
+BUILTIN(VEC_POP)
+{
+  /* (vec-pop! v) the last element of v, removed from it */
+  LASSERT_NUM(KW_VEC_POP, a, 1);
+  LASSERT_TYPE(KW_VEC_POP, a, 0, LVAL_VEC);
+  LASSERT(a, a->cell[0]->mvec->len > 0,
+      "function '%s' passed an empty vector.", KW_VEC_POP);
+
+  lval* x = lvec_pop(a->cell[0]->mvec);
+  lval_del(a);
+  return x;
+}
+
+/**
+ * The order of a sort (or a priority queue) by a function, called with two
+ * elements: they are in order if it returns a Number other than 0
+ */
+typedef struct
+{
+  lenv* e;
+  lval* fn;
+  lval* err;
+
+  /** the builtin sorting, for the errors **/
+  char* fname;
+} lsortby;
+
+int _bt_sort_less(lval* x, lval* y, void* arg)
+{
+  lsortby* s = arg;
+  lval* r = _bt_call(s->e, s->fn, lval_copy(x), lval_copy(y));
+  if (r->type == LVAL_NUM) {
+    int less = r->num != 0;
+    lval_del(r);
+    return less;
+  }
+
+  if (r->type == LVAL_ERR) {
+    s->err = r;
+  } else {
+    s->err = lval_err("function '%s' got '%s' from the function comparing, expected '%s'.",
+        s->fname, ltype_name(r->type), ltype_name(LVAL_NUM));
+    lval_del(r);
+  }
+  return -1;
+}
+
+/* the order of the keys of a sorted map */
+int _bt_key_less(lval* x, lval* y, void* arg)
+{
+  return lbtree_cmp(x, y) < 0;
+}
+
+BUILTIN(VEC_SORT)
+{
+  /**
+   * (vec-sort! v) the elements of v (Numbers, Strings or Symbols) sorted
+   * in place, in the order of the keys of a sorted map; (vec-sort! v f)
+   * by the function f, true of two elements in order. v is returned.
+   */
+  LASSERT_NUM_OR(KW_VEC_SORT, a, 1, 2);
+  LASSERT_TYPE(KW_VEC_SORT, a, 0, LVAL_VEC);
+
+  lvec* v = a->cell[0]->mvec;
+  if (a->count == 1) {
+    for (long i = 0; i < v->len; i++) {
+      LASSERT(a, ldict_can_key(v->items[i]),
+          "function '%s' passed a vector with a '%s', expected Numbers, "
+          "Strings or Symbols (or a function to compare them).",
+          KW_VEC_SORT, ltype_name(v->items[i]->type));
+    }
+    lvec_sort(v, _bt_key_less, NULL);
+    return lval_take(a, 0);
+  }
+
+  LASSERT_TYPE(KW_VEC_SORT, a, 1, LVAL_FUN);
+  lsortby s = { e, a->cell[1], NULL, KW_VEC_SORT };
+  if (!lvec_sort(v, _bt_sort_less, &s)) {
+    lval_del(a);
+    return s.err;
+  }
+  return lval_take(a, 0);
+}
+
+BUILTIN(DEQUE)
+{
+  /* (deque c) a new deque with the elements of a collection, (deque 1 2 3) with those given */
+  if (a->count == 1 && liter_can(a->cell[0])) {
+    lval* c = a->cell[0];
+    ldeque* q = ldeque_new(c->type == LVAL_QEXPR ? c->count : 0);
+    liter it;
+    liter_init(&it, c);
+    lval* x;
+    while ((x = liter_next(e, &it))) {
+      ldeque_push(q, x, 1);
+    }
+    liter_done(&it);
+    lval_del(a);
+    if (it.err) {
+      ldeque_del(q);
+      return it.err;
+    }
+    return lval_deque(q);
+  }
+
+  ldeque* q = ldeque_new(a->count);
+  for (int i = 0; i < a->count; i++) {
+    ldeque_push(q, a->cell[i], 1);
+  }
+  a->count = 0;
+  lval_del(a);
+  return lval_deque(q);
+}
+
+/* (deque-push-back! q x y) x then y are added at the back (or front) of q, which is returned */
+lval* _bt_deque_push(lval* a, int back, char* fname)
+{
+  LASSERT(a, a->count >= 2,
+      "function '%s' passed incorrect number of arguments. "
+      "got %i, expected a deque then elements.", fname, a->count);
+  LASSERT_TYPE(fname, a, 0, LVAL_DEQUE);
+
+  lval* q = lval_pop(a, 0);
+  for (int i = 0; i < a->count; i++) {
+    ldeque_push(q->deque, a->cell[i], back);
+  }
+  a->count = 0;
+  lval_del(a);
+  return q;
+}
+
+/* (deque-pop-back! q) the last (or first) element of q, removed from it */
+lval* _bt_deque_pop(lval* a, int back, char* fname)
+{
+  LASSERT_NUM(fname, a, 1);
+  LASSERT_TYPE(fname, a, 0, LVAL_DEQUE);
+  LASSERT(a, a->cell[0]->deque->len > 0, "function '%s' passed an empty deque.", fname);
+
+  lval* x = ldeque_pop(a->cell[0]->deque, back);
+  lval_del(a);
+  return x;
+}
+
+BUILTIN(PUSH_FRONT) { return _bt_deque_push(a, 0, KW_PUSH_FRONT); }
+BUILTIN(PUSH_BACK)  { return _bt_deque_push(a, 1, KW_PUSH_BACK);  }
+BUILTIN(POP_FRONT)  { return _bt_deque_pop(a, 0, KW_POP_FRONT);   }
+BUILTIN(POP_BACK)   { return _bt_deque_pop(a, 1, KW_POP_BACK);    }
+
+/* the order of the elements of a priority queue, s is made ready for it */
+lvec_less _bt_heap_order(lenv* e, lheap* h, lsortby* s, char* fname)
+{
+  s->e = e;
+  s->fn = h->less;
+  s->err = NULL;
+  s->fname = fname;
+  return h->less ? _bt_sort_less : _bt_key_less;
+}
+
+/* an error unless x can be in the priority queue h: any value if h has a function ordering them, otherwise a key */
+lval* _bt_heap_can(lheap* h, lval* x, char* fname)
+{
+  if (h->less || ldict_can_key(x)) {
+    return NULL;
+  }
+  return lval_err("function '%s' passed a '%s' to a priority queue in the order of keys, "
+      "expected a Number, a String or a Symbol.", fname, ltype_name(x->type));
+}
+
+BUILTIN(PQUEUE)
+{
+  /**
+   * (pqueue c) a new priority queue with the elements of a collection
+   * (Numbers, Strings or Symbols), the least first in the order of the
+   * keys of a sorted map; (pqueue f c) in the order of the function f,
+   * true of two elements in order; (pqueue f) an empty one
+   */
+  LASSERT_NUM_OR(KW_PQUEUE, a, 1, 2);
+  lval* less = NULL;
+  if (a->count == 2 || a->cell[0]->type == LVAL_FUN) {
+    LASSERT_TYPE(KW_PQUEUE, a, 0, LVAL_FUN);
+    less = lval_pop(a, 0);
+  }
+  lheap* h = lheap_new(less, a->count ? (a->cell[0]->type == LVAL_QEXPR ? a->cell[0]->count : 0) : 0);
+  if (a->count == 0) {
+    lval_del(a);
+    return lval_pqueue(h);
+  }
+
+  lval* err = NULL;
+  if (!liter_can(a->cell[0])) {
+    err = lval_err("function '%s' passed incorrect type for argument %i. "
+        "got '%s', expected a collection.", KW_PQUEUE, less != NULL, ltype_name(a->cell[0]->type));
+  } else {
+    liter it;
+    liter_init(&it, a->cell[0]);
+    lval* x;
+    while (!err && (x = liter_next(e, &it))) {
+      err = _bt_heap_can(h, x, KW_PQUEUE);
+      if (err) {
+        lval_del(x);
+      } else {
+        lheap_add(h, x);
+      }
+    }
+    liter_done(&it);
+    err = err ? err : it.err;
+  }
+  lval_del(a);
+
+  lsortby s;
+  lvec_less order = _bt_heap_order(e, h, &s, KW_PQUEUE);
+  if (!err && !lheap_build(h, order, &s)) {
+    err = s.err;
+  }
+  if (err) {
+    lheap_del(h);
+    return err;
+  }
+  return lval_pqueue(h);
+}
+
+BUILTIN(PQ_PUSH)
+{
+  /* (pqueue-push! q x y) x and y are added to q, which is returned */
+  LASSERT(a, a->count >= 2,
+      "function '%s' passed incorrect number of arguments. "
+      "got %i, expected a priority queue then elements.", KW_PQ_PUSH, a->count);
+  LASSERT_TYPE(KW_PQ_PUSH, a, 0, LVAL_PQUEUE);
+
+  lheap* h = a->cell[0]->heap;
+  lsortby s;
+  lvec_less order = _bt_heap_order(e, h, &s, KW_PQ_PUSH);
+  while (a->count > 1) {
+    lval* x = lval_pop(a, 1);
+    lval* err = _bt_heap_can(h, x, KW_PQ_PUSH);
+    if (err || !lheap_push(h, x, order, &s)) {
+      lval_del(x);
+      lval_del(a);
+      return err ? err : s.err;
+    }
+  }
+  return lval_take(a, 0);
+}
+
+BUILTIN(PQ_POP)
+{
+  /* (pqueue-pop! q) the first element of q, removed from it */
+  LASSERT_NUM(KW_PQ_POP, a, 1);
+  LASSERT_TYPE(KW_PQ_POP, a, 0, LVAL_PQUEUE);
+  LASSERT(a, a->cell[0]->heap->len > 0,
+      "function '%s' passed an empty priority queue.", KW_PQ_POP);
+
+  lsortby s;
+  lheap* h = a->cell[0]->heap;
+  lval* x = lheap_pop(h, _bt_heap_order(e, h, &s, KW_PQ_POP), &s);
+  lval_del(a);
+  return x ? x : s.err;
+}
+
+BUILTIN(PQ_PEEK)
+{
+  /* (pqueue-peek q) the first element of q, left in it */
+  LASSERT_NUM(KW_PQ_PEEK, a, 1);
+  LASSERT_TYPE(KW_PQ_PEEK, a, 0, LVAL_PQUEUE);
+  LASSERT(a, a->cell[0]->heap->len > 0,
+      "function '%s' passed an empty priority queue.", KW_PQ_PEEK);
+
+  lval* x = lval_copy(a->cell[0]->heap->items[0]);
+  lval_del(a);
+  return x;
+}
+
+/* the name of the type of a value, for a record the name of its record type */
+char* _bt_type_name(lval* v)
+{
+  return v->type == LVAL_RECORD ? v->rec->type->name : ltype_name(v->type);
+}
+
+/* binds 'name' (a printf format of s1 and s2) to (\ formals body) */
+void _bt_defun(lenv* e, char* name, char* s1, char* s2, lval* formals, lval* body)
+{
+  char* sym = malloc(strlen(name) + strlen(s1) + strlen(s2) + 1);
+  sprintf(sym, name, s1, s2);
+  lval* k = lval_sym(sym);
+  free(sym);
+
+  lval* f = BTNAME(LAMBDA)(e, lval_add(lval_add(lval_sexpr(), formals), body));
+  lenv_def(e, k, f);
+  lval_del(k);
+  lval_del(f);
+}
+
+BUILTIN(DEFRECORD)
+{
+  /**
+   * (defrecord {point} {x y}) declares the record type point, the fields
+   * can have a type, checked when a record is made: {{x Number} y}
+   *
+   * It defines the functions:
+   *
+   *  point     (point 1 2) a new record       (\ {x y} {record-new id x y})
+   *  point-x   (point-x p) its field x        (\ {r} {record-get r id 0})
+   *  point?    (point? p) if p is a point     (\ {r} {record-is? r id})
+   *
+   * with the id of the type, so the optimizer inlines a call to any of them
+   * into the builtin, and reading a field is reading an index of the record
+   */
+  LASSERT_NUM(KW_DEFRECORD, a, 2);
+  LASSERT_TYPE(KW_DEFRECORD, a, 0, LVAL_QEXPR);
+  LASSERT_TYPE(KW_DEFRECORD, a, 1, LVAL_QEXPR);
+  LASSERT(a, a->cell[0]->count == 1 && a->cell[0]->cell[0]->type == LVAL_SYM,
+      "function '%s' passed incorrect name for argument 0. "
+      "expected a symbol, as in {point}.", KW_DEFRECORD);
+  LASSERT_NOT_EMPTY(KW_DEFRECORD, a, 1);
+
+  lval* spec = a->cell[1];
+  int n = spec->count;
+  char** fields = malloc(sizeof(char*) * n);
+  char** types = malloc(sizeof(char*) * n);
+  lval* err = NULL;
+  for (int i = 0; i < n && !err; i++) {
+    lval* x = spec->cell[i];
+    fields[i] = x->type == LVAL_SYM ? x->sym : NULL;
+    types[i] = NULL;
+    if (x->type == LVAL_QEXPR && x->count == 2 && x->cell[0]->type == LVAL_SYM
+        && (x->cell[1]->type == LVAL_SYM || x->cell[1]->type == LVAL_STR)) {
+      fields[i] = x->cell[0]->sym;
+      types[i] = x->cell[1]->type == LVAL_SYM ? x->cell[1]->sym : x->cell[1]->str->bytes;
+    }
+
+    if (!fields[i] || is(fields[i], KW_VARG)) {
+      err = lval_err("function '%s' passed incorrect field %i. "
+          "expected a symbol, or a symbol and a type as in {x Number}.", KW_DEFRECORD, i);
+    }
+    for (int j = 0; j < i && !err; j++) {
+      if (is(fields[i], fields[j])) {
+        err = lval_err("function '%s' passed the field '%s' twice.", KW_DEFRECORD, fields[i]);
+      }
+    }
+  }
+  if (err) {
+    free(fields);
+    free(types);
+    lval_del(a);
+    return err;
+  }
+
+  char* name = a->cell[0]->cell[0]->sym;
+  lrtype* t = lrtype_new(name, n, fields, types);
+  free(fields);
+  free(types);
+  lval_del(a);
+
+  lval* formals = lval_qexpr();
+  lval* body = lval_add(lval_add(lval_qexpr(), lval_sym(KW_RECORD_NEW)), lval_num(t->id));
+  for (int i = 0; i < n; i++) {
+    formals = lval_add(formals, lval_sym(t->fields[i]));
+    body = lval_add(body, lval_sym(t->fields[i]));
+  }
+  _bt_defun(e, "%s%s", t->name, "", formals, body);
+
+  for (int i = 0; i < n; i++) {
+    formals = lval_add(lval_qexpr(), lval_sym("r"));
+    body = lval_add(lval_qexpr(), lval_sym(KW_RECORD_GET));
+    body = lval_add(lval_add(lval_add(body, lval_sym("r")), lval_num(t->id)), lval_num(i));
+    _bt_defun(e, "%s-%s", t->name, t->fields[i], formals, body);
+  }
+
+  formals = lval_add(lval_qexpr(), lval_sym("r"));
+  body = lval_add(lval_qexpr(), lval_sym(KW_RECORD_IS));
+  body = lval_add(lval_add(body, lval_sym("r")), lval_num(t->id));
+  _bt_defun(e, "%s?%s", t->name, "", formals, body);
+
+  return lval_sexpr();
+}
+
+/* the record type with the id in argument index of a, NULL if none */
+lrtype* _bt_rtype(lval* a, int index)
+{
+  lval* x = a->cell[index];
+  return x->type == LVAL_NUM ? lrtype_find(x->num) : NULL;
+}
+
+BUILTIN(RECORD_NEW)
+{
+  /* (record-new t x y) a new record of the type with id t, with fields x and y */
+  LASSERT(a, a->count > 0 && _bt_rtype(a, 0),
+      "function '%s' passed incorrect argument 0. "
+      "expected the id of a record type.", KW_RECORD_NEW);
+
+  lrtype* t = _bt_rtype(a, 0);
+  LASSERT(a, a->count - 1 == t->count,
+      "function '%s' passed incorrect number of arguments. "
+      "got %i, expected %i.", t->name, a->count - 1, t->count);
+  for (int i = 0; i < t->count; i++) {
+    LASSERT(a, lrtype_can(t, i, a->cell[i + 1]),
+        "function '%s' passed incorrect type for field '%s'. "
+        "got '%s', expected '%s'.", t->name, t->fields[i],
+        _bt_type_name(a->cell[i + 1]), t->types[i]);
+  }
+
+  /* the fields are moved into the record */
+  lrecord* r = lrecord_new(t);
+  for (int i = 0; i < t->count; i++) {
+    r->fields[i] = a->cell[i + 1];
+  }
+  a->count = 1;
+  lval_del(a);
+  return lval_record(r);
+}
+
+BUILTIN(RECORD_GET)
+{
+  /* (record-get r t i) the field i of r, a record of the type with id t */
+  LASSERT_NUM(KW_RECORD_GET, a, 3);
+  lrtype* t = _bt_rtype(a, 1);
+  LASSERT(a, t, "function '%s' passed incorrect argument 1. "
+      "expected the id of a record type.", KW_RECORD_GET);
+  LASSERT_TYPE(KW_RECORD_GET, a, 2, LVAL_NUM);
+
+  long i = a->cell[2]->num;
+  LASSERT(a, i >= 0 && i < t->count,
+      "function '%s' passed a field out of the record. "
+      "got %li, '%s' has %i.", KW_RECORD_GET, i, t->name, t->count);
+
+  lval* r = a->cell[0];
+  LASSERT(a, r->type == LVAL_RECORD && r->rec->type == t,
+      "function '%s-%s' passed incorrect type for argument 0. "
+      "got '%s', expected '%s'.", t->name, t->fields[i], _bt_type_name(r), t->name);
+
+  lval* x = lval_copy(r->rec->fields[i]);
+  lval_del(a);
+  return x;
+}
+
+BUILTIN(RECORD_IS)
+{
+  /* (record-is? r t) 1 if r is a record of the type with id t, 0 otherwise */
+  LASSERT_NUM(KW_RECORD_IS, a, 2);
+  lrtype* t = _bt_rtype(a, 1);
+  LASSERT(a, t, "function '%s' passed incorrect argument 1. "
+      "expected the id of a record type.", KW_RECORD_IS);
+
+  lval* r = a->cell[0];
+  lval* x = lval_num(r->type == LVAL_RECORD && r->rec->type == t);
+  lval_del(a);
+  return x;
+}
+
+/* the index of the column of t named by a symbol, or an error */
+lval* _bt_column(ltable* t, lval* name, int* col, char* fname)
+{
+  if (name->type != LVAL_SYM) {
+    return lval_err("function '%s' passed a '%s' as the name of a column, expected '%s'.",
+        fname, ltype_name(name->type), ltype_name(LVAL_SYM));
+  }
+  *col = ltable_find(t, name->sym);
+  if (*col < 0) {
+    return lval_err("function '%s' passed the column '%s', not in the table.", fname, name->sym);
+  }
+  return NULL;
+}
+
+/* the index of every column named in the list q, in a new array, or NULL with the error */
+int* _bt_columns(ltable* t, lval* q, char* fname, lval** err)
+{
+  int* cols = malloc(sizeof(int) * (q->count + 1));
+  for (int i = 0; i < q->count && !*err; i++) {
+    *err = _bt_column(t, q->cell[i], &cols[i], fname);
+    for (int j = 0; j < i && !*err; j++) {
+      if (cols[j] == cols[i]) {
+        *err = lval_err("function '%s' passed the column '%s' twice.", fname, q->cell[i]->sym);
+      }
+    }
+  }
+  if (*err) {
+    free(cols);
+    return NULL;
+  }
+  return cols;
+}
+
+BUILTIN(TABLE)
+{
+  /**
+   * (table {a b} ca cb) a table with the columns a and b, the cells of
+   * the collections ca and cb: a list of Strings is a column of Strings,
+   * any other collection of numbers a column of Numbers or of Floats
+   * (if any of them is one)
+   */
+  LASSERT(a, a->count >= 1,
+      "function '%s' passed incorrect number of arguments. "
+      "got %i, expected the names of the columns then the columns.", KW_TABLE, a->count);
+  LASSERT_TYPE(KW_TABLE, a, 0, LVAL_QEXPR);
+
+  lval* names = a->cell[0];
+  LASSERT(a, names->count == a->count - 1,
+      "function '%s' passed %i names for %i columns.", KW_TABLE, names->count, a->count - 1);
+  for (int i = 0; i < names->count; i++) {
+    LASSERT(a, names->cell[i]->type == LVAL_SYM,
+        "function '%s' passed a '%s' as the name of a column, expected '%s'.",
+        KW_TABLE, ltype_name(names->cell[i]->type), ltype_name(LVAL_SYM));
+    for (int j = 0; j < i; j++) {
+      LASSERT(a, !is(names->cell[i]->sym, names->cell[j]->sym),
+          "function '%s' passed the column '%s' twice.", KW_TABLE, names->cell[i]->sym);
+    }
+    LASSERT_COLL(KW_TABLE, a, i + 1);
+  }
+
+  ltable* t = ltable_new(0, names->count);
+  lval* err = NULL;
+  for (int i = 0; i < names->count && !err; i++) {
+    lval* c = a->cell[i + 1];
+    lnvec* vec = NULL;
+    lval* strs = NULL;
+    int type = LVAL_NUM;
+
+    if (c->type == LVAL_QEXPR && c->count > 0 && c->cell[0]->type == LVAL_STR) {
+      for (int k = 0; k < c->count && !err; k++) {
+        if (c->cell[k]->type != LVAL_STR) {
+          err = lval_err("function '%s' passed a column of Strings with a '%s'.",
+              KW_TABLE, ltype_name(c->cell[k]->type));
+        }
+      }
+      if (!err) {
+        vec = ltable_encode(c->cell, c->count, &strs);
+        type = LVAL_STR;
+      }
+    } else {
+      lval* v = _bt_tovec(e, c, 0, KW_TABLE);
+      if (v->type == LVAL_ERR) {
+        err = v;
+      } else {
+        vec = v->vec;
+        vec->refs++;
+        type = v->type == LVAL_F64VEC ? LVAL_FLOAT : LVAL_NUM;
+        lval_del(v);
+      }
+    }
+
+    if (vec && i > 0 && vec->len != t->rows) {
+      err = lval_err("function '%s' passed columns of different lengths. got %li and %li.",
+          KW_TABLE, t->rows, vec->len);
+      lnvec_del(vec);
+      if (strs) {
+        lval_del(strs);
+      }
+    } else if (vec) {
+      t->rows = vec->len;
+      ltable_set(t, i, names->cell[i]->sym, type, vec, strs);
+    }
+  }
+  lval_del(a);
+
+  if (err) {
+    ltable_del(t);
+    return err;
+  }
+  return lval_table(t);
+}
+
+BUILTIN(COL)
+{
+  /* (col t {a}) the cells of the column a of t: a vector, or a list of Strings */
+  LASSERT_NUM(KW_COL, a, 2);
+  LASSERT_TYPE(KW_COL, a, 0, LVAL_TABLE);
+  _bt_keys(a, 1, 1);
+
+  ltable* t = a->cell[0]->table;
+  int i = 0;
+  lval* err = _bt_column(t, a->cell[1], &i, KW_COL);
+  if (err) {
+    lval_del(a);
+    return err;
+  }
+
+  /* the numbers are shared with the table */
+  lcolumn* c = &t->cols[i];
+  lval* v = NULL;
+  if (c->type == LVAL_STR) {
+    v = lval_qexpr();
+    for (long r = 0; r < t->rows; r++) {
+      lval_add(v, lval_copy(c->strs->cell[c->vec->i[r]]));
+    }
+  } else {
+    c->vec->refs++;
+    v = lval_nvec(c->type == LVAL_FLOAT ? LVAL_F64VEC : LVAL_I64VEC, c->vec);
+  }
+  lval_del(a);
+  return v;
+}
+
+/* sets in sel the rows of t where the numbers of m are not 0, or its members for a bitset */
+lval* _bt_where_mask(lenv* e, ltable* t, lval* m, uint64_t* sel)
+{
+  if (m->type == LVAL_BITSET) {
+    long last = lbitset_next(m->bits, t->rows);
+    if (last >= 0) {
+      return lval_err("function '%s' passed a table of %li rows and the row %li.",
+          KW_WHERE, t->rows, last);
+    }
+    long n = (t->rows + 63) / 64 < m->bits->len ? (t->rows + 63) / 64 : m->bits->len;
+    memcpy(sel, m->bits->words, sizeof(uint64_t) * n);
+    return NULL;
+  }
+
+  if (!liter_can(m)) {
+    return lval_err("function '%s' passed incorrect type for argument 1. "
+        "got '%s', expected a collection.", KW_WHERE, ltype_name(m->type));
+  }
+
+  lval* v = _bt_tovec(e, m, 0, KW_WHERE);
+  if (v->type == LVAL_ERR) {
+    return v;
+  }
+  if (v->vec->len != t->rows) {
+    lval* err = lval_err("function '%s' passed a table of %li rows and %li numbers.",
+        KW_WHERE, t->rows, v->vec->len);
+    lval_del(v);
+    return err;
+  }
+
+  /* 64 rows in every word, one bit each */
+  for (long w = 0; w * 64 < t->rows; w++) {
+    long n = t->rows - w * 64 < 64 ? t->rows - w * 64 : 64;
+    uint64_t bits = 0;
+    if (v->type == LVAL_F64VEC) {
+      double* x = v->vec->f + w * 64;
+      for (long b = 0; b < n; b++) {
+        bits |= (uint64_t)(x[b] != 0) << b;
+      }
+    } else {
+      int64_t* x = v->vec->i + w * 64;
+      for (long b = 0; b < n; b++) {
+        bits |= (uint64_t)(x[b] != 0) << b;
+      }
+    }
+    sel[w] = bits;
+  }
+
+  lval_del(v);
+  return NULL;
+}
+
+/* if (f x) is not 0 in *keep, or an error */
+lval* _bt_where_call(lenv* e, lval* f, lval* x, int* keep)
+{
+  lval* y = _bt_call(e, f, NULL, x);
+  if (y->type == LVAL_ERR) {
+    return y;
+  }
+  if (y->type != LVAL_NUM) {
+    lval* err = lval_err("function '%s' got '%s' from the predicate, expected '%s'.",
+        KW_WHERE, ltype_name(y->type), ltype_name(LVAL_NUM));
+    lval_del(y);
+    return err;
+  }
+  *keep = y->num != 0;
+  lval_del(y);
+  return NULL;
+}
+
+/* sets in sel the rows of t where (f x) is not 0 for the cell x of a column */
+lval* _bt_where_pred(lenv* e, ltable* t, lval* a, uint64_t* sel)
+{
+  _bt_keys(a, 1, 1);
+  int i = 0;
+  lval* err = _bt_column(t, a->cell[1], &i, KW_WHERE);
+  if (err) {
+    return err;
+  }
+  if (a->cell[2]->type != LVAL_FUN) {
+    return lval_err("function '%s' passed incorrect type for argument 2. "
+        "got '%s', expected '%s'.", KW_WHERE, ltype_name(a->cell[2]->type), ltype_name(LVAL_FUN));
+  }
+
+  lcolumn* c = &t->cols[i];
+  lval* f = a->cell[2];
+  int keep = 0;
+
+  /* the predicate of a String is the same in every row it is in */
+  if (c->type == LVAL_STR) {
+    int* keeps = malloc(sizeof(int) * (c->strs->count + 1));
+    for (int k = 0; k < c->strs->count && !err; k++) {
+      err = _bt_where_call(e, f, lval_copy(c->strs->cell[k]), &keeps[k]);
+    }
+    for (long r = 0; r < t->rows && !err; r++) {
+      sel[r / 64] |= (uint64_t)keeps[c->vec->i[r]] << (r % 64);
+    }
+    free(keeps);
+    return err;
+  }
+
+  for (long r = 0; r < t->rows && !err; r++) {
+    err = _bt_where_call(e, f, ltable_cell(t, i, r), &keep);
+    sel[r / 64] |= (uint64_t)keep << (r % 64);
+  }
+  return err;
+}
+
+BUILTIN(WHERE)
+{
+  /**
+   * (where t m) the rows of t where the collection of numbers m is not 0,
+   * as the comparisons of a column give it: (where t (> (col t {x}) 10)),
+   * or the rows in the bitset m
+   *
+   * (where t {a} f) the rows where (f x) is not 0, x the cell of the column
+   * a: f is called once for every different String of a column of them
+   */
+  LASSERT_NUM_OR(KW_WHERE, a, 2, 3);
+  LASSERT_TYPE(KW_WHERE, a, 0, LVAL_TABLE);
+
+  ltable* t = a->cell[0]->table;
+  uint64_t* sel = calloc((t->rows + 63) / 64 + 1, sizeof(uint64_t));
+  lval* err = a->count == 2
+      ? _bt_where_mask(e, t, a->cell[1], sel)
+      : _bt_where_pred(e, t, a, sel);
+
+  lval* v = err ? err : lval_table(ltable_select(t, sel));
+  free(sel);
+  lval_del(a);
+  return v;
+}
+
+/* the names of the aggregates, by their operation */
+char* _bt_agg_names[] = { "count", KW_SUM, KW_MIN, KW_MAX, "mean" };
+
+/* the operation, column and name of an aggregate {op a}, or an error */
+lval* _bt_aggregate(ltable* t, lval* x, int* op, int* col, char** name)
+{
+  *op = -1;
+  if (x->type == LVAL_QEXPR && x->count > 0 && x->cell[0]->type == LVAL_SYM) {
+    for (int i = 0; i <= LTABLE_MEAN; i++) {
+      if (is(x->cell[0]->sym, _bt_agg_names[i])) {
+        *op = i;
+      }
+    }
+  }
+  if (*op < 0 || x->count != (*op == LTABLE_COUNT ? 1 : 2)) {
+    return lval_err("function '%s' passed incorrect aggregate. "
+        "expected {count}, or {sum a}, {min a}, {max a} or {mean a} of a column a.", KW_GROUP_BY);
+  }
+
+  if (*op == LTABLE_COUNT) {
+    *name = malloc(strlen(_bt_agg_names[*op]) + 1);
+    strcpy(*name, _bt_agg_names[*op]);
+    return NULL;
+  }
+
+  lval* err = _bt_column(t, x->cell[1], col, KW_GROUP_BY);
+  if (err) {
+    return err;
+  }
+  if (t->cols[*col].type == LVAL_STR) {
+    return lval_err("function '%s' cannot %s the column '%s' of Strings.",
+        KW_GROUP_BY, _bt_agg_names[*op], t->cols[*col].name);
+  }
+  *name = malloc(strlen(_bt_agg_names[*op]) + strlen(t->cols[*col].name) + 2);
+  sprintf(*name, "%s-%s", _bt_agg_names[*op], t->cols[*col].name);
+  return NULL;
+}
+
+BUILTIN(GROUP_BY)
+{
+  /**
+   * (group-by t {a b} {{sum x} {mean y} {count}}) a table with a row for
+   * every different pair of a and b in t: those, then the aggregates of
+   * its rows in the columns sum-x, mean-y and count
+   */
+  LASSERT_NUM(KW_GROUP_BY, a, 3);
+  LASSERT_TYPE(KW_GROUP_BY, a, 0, LVAL_TABLE);
+  LASSERT_TYPE(KW_GROUP_BY, a, 1, LVAL_QEXPR);
+  LASSERT_TYPE(KW_GROUP_BY, a, 2, LVAL_QEXPR);
+  LASSERT_NOT_EMPTY(KW_GROUP_BY, a, 1);
+
+  ltable* t = a->cell[0]->table;
+  lval* err = NULL;
+  int* keys = _bt_columns(t, a->cell[1], KW_GROUP_BY, &err);
+  if (err) {
+    lval_del(a);
+    return err;
+  }
+
+  lval* aggs = a->cell[2];
+  int nkeys = a->cell[1]->count;
+  int n = aggs->count;
+  int* ops = malloc(sizeof(int) * (n + 1));
+  int* cols = malloc(sizeof(int) * (n + 1));
+  char** names = malloc(sizeof(char*) * (n + 1));
+  int made = 0;
+  for (; made < n && !err; made++) {
+    err = _bt_aggregate(t, aggs->cell[made], &ops[made], &cols[made], &names[made]);
+    if (err) {
+      break;
+    }
+
+    /* every column made must have a different name */
+    int same = 0;
+    for (int j = 0; j < nkeys; j++) {
+      same = same || is(t->cols[keys[j]].name, names[made]);
+    }
+    for (int j = 0; j < made; j++) {
+      same = same || is(names[j], names[made]);
+    }
+    if (same) {
+      err = lval_err("function '%s' makes the column '%s' twice.", KW_GROUP_BY, names[made]);
+    }
+  }
+
+  lval* v = err;
+  if (!err) {
+    int over;
+    ltable* r = ltable_group(t, keys, nkeys, ops, cols, n, names, &over);
+    v = r ? lval_table(r) : lval_err("function '%s' got a sum for the column '%s' "
+        "that does not fit in a 64 bits integer.", KW_GROUP_BY, names[over]);
+  }
+  for (int j = 0; j < made; j++) {
+    free(names[j]);
+  }
+  free(keys);
+  free(ops);
+  free(cols);
+  free(names);
+  lval_del(a);
+  return v;
+}
+
+lval* _bt_table_join(lval* a)
+{
+  /* (join x y {a b}) the rows of x and y with equal a and b (see ltable_join()) */
+  LASSERT_NUM(KW_JOIN, a, 3);
+  LASSERT_TYPE(KW_JOIN, a, 1, LVAL_TABLE);
+  LASSERT_TYPE(KW_JOIN, a, 2, LVAL_QEXPR);
+  LASSERT_NOT_EMPTY(KW_JOIN, a, 2);
+
+  ltable* x = a->cell[0]->table;
+  ltable* y = a->cell[1]->table;
+  lval* err = NULL;
+  int* xk = _bt_columns(x, a->cell[2], KW_JOIN, &err);
+  int* yk = err ? NULL : _bt_columns(y, a->cell[2], KW_JOIN, &err);
+  int n = a->cell[2]->count;
+
+  for (int j = 0; j < n && !err; j++) {
+    lcolumn* cx = &x->cols[xk[j]];
+    lcolumn* cy = &y->cols[yk[j]];
+    if (cx->type != cy->type) {
+      err = lval_err("function '%s' passed the key '%s' of types '%s' and '%s'.",
+          KW_JOIN, cx->name, ltype_name(cx->type), ltype_name(cy->type));
+    }
+  }
+
+  /* the columns of y, but the keys, go with those of x */
+  for (int i = 0; i < y->count && !err; i++) {
+    int key = 0;
+    for (int j = 0; j < n; j++) {
+      key = key || yk[j] == i;
+    }
+    if (!key && ltable_find(x, y->cols[i].name) >= 0) {
+      err = lval_err("function '%s' passed two tables with the column '%s'.",
+          KW_JOIN, y->cols[i].name);
+    }
+  }
+
+  lval* v = err ? err : lval_table(ltable_join(x, y, xk, yk, n));
+  free(xk);
+  free(yk);
+  lval_del(a);
+  return v;
+}
+
+#define LASSERT_MEMBER(func, args, index)                                   \
+  LASSERT_TYPE(func, args, index, LVAL_NUM);                                \
+  LASSERT(args, args->cell[index]->num >= 0,                                \
+      "function '%s' passed a negative member of a bitset. got %li.",       \
+      func, args->cell[index]->num)
+
+BUILTIN(BITSET)
+{
+  /* (bitset c) a new bitset with the numbers of a collection, (bitset 1 2 3) with those given */
+  if (a->count == 1 && liter_can(a->cell[0])) {
+    lbitset* b = lbitset_new(1);
+    liter it;
+    liter_init(&it, a->cell[0]);
+    lval* x;
+    while (!it.err && (x = liter_next(e, &it))) {
+      if (x->type != LVAL_NUM) {
+        it.err = lval_err("function '%s' passed a collection with a '%s', "
+            "expected '%s'.", KW_BITSET, ltype_name(x->type), ltype_name(LVAL_NUM));
+      } else if (x->num < 0) {
+        it.err = lval_err("function '%s' passed a negative member of a bitset. got %li.",
+            KW_BITSET, x->num);
+      } else {
+        lbitset_set(b, x->num);
+      }
+      lval_del(x);
+    }
+    liter_done(&it);
+    lval_del(a);
+    if (it.err) {
+      lbitset_del(b);
+      return it.err;
+    }
+    return lval_bitset(b);
+  }
+
+  for (int i = 0; i < a->count; i++) {
+    LASSERT_MEMBER(KW_BITSET, a, i);
+  }
+  lbitset* b = lbitset_new(1);
+  for (int i = 0; i < a->count; i++) {
+    lbitset_set(b, a->cell[i]->num);
+  }
+  lval_del(a);
+  return lval_bitset(b);
+}
+
+/* (bit-set! b i j) or (bit-clear! b i j), i and j are added to (removed from) b, which is returned */
+lval* _bt_bit_change(lval* a, int set, char* fname)
+{
+  LASSERT(a, a->count >= 2,
+      "function '%s' passed incorrect number of arguments. "
+      "got %i, expected a bitset then numbers.", fname, a->count);
+  LASSERT_TYPE(fname, a, 0, LVAL_BITSET);
+  for (int i = 1; i < a->count; i++) {
+    LASSERT_MEMBER(fname, a, i);
+  }
+
+  lbitset* b = a->cell[0]->bits;
+  for (int i = 1; i < a->count; i++) {
+    if (set) {
+      lbitset_set(b, a->cell[i]->num);
+    } else {
+      lbitset_clear(b, a->cell[i]->num);
+    }
+  }
+  return lval_take(a, 0);
+}
+
+BUILTIN(BIT_SET)
+{
+  return _bt_bit_change(a, 1, KW_BIT_SET);
+}
+
+BUILTIN(BIT_CLEAR)
+{
+  return _bt_bit_change(a, 0, KW_BIT_CLEAR);
+}
+
+BUILTIN(BIT_TEST)
+{
+  /* (bit-test b i) 1 if i is in b, 0 otherwise */
+  LASSERT_NUM(KW_BIT_TEST, a, 2);
+  LASSERT_TYPE(KW_BIT_TEST, a, 0, LVAL_BITSET);
+  LASSERT_MEMBER(KW_BIT_TEST, a, 1);
+
+  int has = lbitset_test(a->cell[0]->bits, a->cell[1]->num);
+  lval_del(a);
+  return lval_num(has);
+}
+
+BUILTIN(BIT_COUNT)
+{
+  /* (bit-count b) the number of members of b */
+  LASSERT_NUM(KW_BIT_COUNT, a, 1);
+  LASSERT_TYPE(KW_BIT_COUNT, a, 0, LVAL_BITSET);
+
+  long n = lbitset_count(a->cell[0]->bits);
+  lval_del(a);
+  return lval_num(n);
+}
+
+/* (bit-or x y z) a new bitset of the members of x, y and z (op of them, from the left) */
+lval* _bt_bit_op(lval* a, int op, char* fname)
+{
+  LASSERT(a, a->count >= 2,
+      "function '%s' passed incorrect number of arguments. "
+      "got %i, expected at least 2 bitsets.", fname, a->count);
+  for (int i = 0; i < a->count; i++) {
+    LASSERT_TYPE(fname, a, i, LVAL_BITSET);
+  }
+
+  lbitset* r = lbitset_op(op, a->cell[0]->bits, a->cell[1]->bits);
+  for (int i = 2; i < a->count; i++) {
+    lbitset* x = lbitset_op(op, r, a->cell[i]->bits);
+    lbitset_del(r);
+    r = x;
+  }
+  lval_del(a);
+  return lval_bitset(r);
+}
+
+BUILTIN(BIT_OR)
+{
+  return _bt_bit_op(a, LKERN_OR, KW_BIT_OR);
+}
+
+BUILTIN(BIT_AND)
+{
+  return _bt_bit_op(a, LKERN_AND, KW_BIT_AND);
+}
+
+BUILTIN(BIT_DIFF)
+{
+  return _bt_bit_op(a, LKERN_ANDNOT, KW_BIT_DIFF);
 }
 
 #define ADD_BTIN(N) lenv_add_builtin(e, KW_ ## N, BTNAME(N))
@@ -421,6 +3895,108 @@ void lenv_add_builtins(lenv* e)
   ADD_BTIN(TAIL);
   ADD_BTIN(EVAL);
   ADD_BTIN(JOIN);
+  ADD_BTIN(RANGE);
+  ADD_BTIN(LEN);
+  ADD_BTIN(NTH);
+  ADD_BTIN(SLICE);
+
+  /** high-order list functions **/
+  ADD_BTIN(MAP);
+  ADD_BTIN(FILTER);
+  ADD_BTIN(FOLDL);
+  ADD_BTIN(TAKE);
+  ADD_BTIN(DROP);
+
+  /** transducers **/
+  ADD_BTIN(PIPE);
+  ADD_BTIN(PIPE_LINES);
+  ADD_BTIN(XMAP);
+  ADD_BTIN(XFILTER);
+  ADD_BTIN(XTAKE);
+  ADD_BTIN(XDROP);
+  ADD_BTIN(XREDUCE);
+
+  /** lazy sequences **/
+  ADD_BTIN(LAZY_RANGE);
+  ADD_BTIN(ITERATE);
+  ADD_BTIN(LAZY_MAP);
+  ADD_BTIN(LAZY_FILTER);
+  ADD_BTIN(LAZY_TAKE);
+  ADD_BTIN(REALIZE);
+  ADD_BTIN(GENERATOR);
+
+  /** numeric vectors **/
+  ADD_BTIN(F64VEC);
+  ADD_BTIN(I64VEC);
+  ADD_BTIN(SUM);
+  ADD_BTIN(MIN);
+  ADD_BTIN(MAX);
+  ADD_BTIN(CUMSUM);
+  ADD_BTIN(DOT);
+
+  /** matrices **/
+  ADD_BTIN(MATRIX);
+  ADD_BTIN(SHAPE);
+  ADD_BTIN(TRANSPOSE);
+  ADD_BTIN(MATMUL);
+
+  /** dicts and maps **/
+  ADD_BTIN(DICT);
+  ADD_BTIN(HMAP);
+  ADD_BTIN(GET);
+  ADD_BTIN(PUT);
+  ADD_BTIN(DICT_DEL);
+  ADD_BTIN(KEYS);
+  ADD_BTIN(VALS);
+  ADD_BTIN(HAS);
+
+  /** sorted maps and sets **/
+  ADD_BTIN(SMAP);
+  ADD_BTIN(SSET);
+  ADD_BTIN(SORTED_FLOOR);
+  ADD_BTIN(SORTED_CEIL);
+  ADD_BTIN(SORTED_RANGE);
+
+  /** vectors **/
+  ADD_BTIN(VEC);
+  ADD_BTIN(VEC_GET);
+  ADD_BTIN(VEC_SET);
+  ADD_BTIN(VEC_PUSH);
+  ADD_BTIN(VEC_POP);
+  ADD_BTIN(VEC_SORT);
+
+  /** queues **/
+  ADD_BTIN(DEQUE);
+  ADD_BTIN(PUSH_FRONT);
+  ADD_BTIN(PUSH_BACK);
+  ADD_BTIN(POP_FRONT);
+  ADD_BTIN(POP_BACK);
+  ADD_BTIN(PQUEUE);
+  ADD_BTIN(PQ_PUSH);
+  ADD_BTIN(PQ_POP);
+  ADD_BTIN(PQ_PEEK);
+
+  /** records **/
+  ADD_BTIN(DEFRECORD);
+  ADD_BTIN(RECORD_NEW);
+  ADD_BTIN(RECORD_GET);
+  ADD_BTIN(RECORD_IS);
+
+  /** tables **/
+  ADD_BTIN(TABLE);
+  ADD_BTIN(COL);
+  ADD_BTIN(WHERE);
+  ADD_BTIN(GROUP_BY);
+
+  /** bitsets **/
+  ADD_BTIN(BITSET);
+  ADD_BTIN(BIT_SET);
+  ADD_BTIN(BIT_CLEAR);
+  ADD_BTIN(BIT_TEST);
+  ADD_BTIN(BIT_COUNT);
+  ADD_BTIN(BIT_OR);
+  ADD_BTIN(BIT_AND);
+  ADD_BTIN(BIT_DIFF);
 
   /** lambda **/
   ADD_BTIN(LAMBDA);
@@ -30,6 +30,87 @@
 #define   KW_PRINT    "print"
 #define   KW_PRINTLN  "println"
 #define   KW_ERROR    "error"
+#define   KW_MAP      "map"
+#define   KW_FILTER   "filter"
+#define   KW_FOLDL    "foldl"
+#define   KW_TAKE     "take"
+#define   KW_DROP     "drop"
+#define   KW_FUSE     "fuse"
+#define   KW_GUARD    "guard"
+#define   KW_SPEC     "spec"
+#define   KW_RANGE    "range"
+#define   KW_LEN      "len"
+#define   KW_NTH      "nth"
+#define   KW_SLICE    "slice"
+#define   KW_PIPE     "pipe"
+#define   KW_PIPE_LINES "pipe-lines"
+#define   KW_XMAP     "xmap"
+#define   KW_XFILTER  "xfilter"
+#define   KW_XTAKE    "xtake"
+#define   KW_XDROP    "xdrop"
+#define   KW_XREDUCE  "xreduce"
+#define   KW_LAZY_RANGE "lazy-range"
+#define   KW_ITERATE  "iterate"
+#define   KW_LAZY_MAP "lazy-map"
+#define   KW_LAZY_FILTER "lazy-filter"
+#define   KW_LAZY_TAKE "lazy-take"
+#define   KW_REALIZE  "realize"
+#define   KW_GENERATOR "generator"
+#define   KW_F64VEC   "f64vec"
+#define   KW_I64VEC   "i64vec"
+#define   KW_SUM      "sum"
+#define   KW_MIN      "min"
+#define   KW_MAX      "max"
+#define   KW_CUMSUM   "cumsum"
+#define   KW_DOT      "dot"
+#define   KW_MATRIX   "matrix"
+#define   KW_SHAPE    "shape"
+#define   KW_TRANSPOSE "transpose"
+#define   KW_MATMUL   "matmul"
+#define   KW_DICT     "dict"
+#define   KW_HMAP     "hmap"
+#define   KW_GET      "get"
+#define   KW_PUT      "put"
+#define   KW_DICT_DEL "dict-del"
+#define   KW_KEYS     "keys"
+#define   KW_VALS     "vals"
+#define   KW_HAS      "has?"
+#define   KW_SMAP     "sorted-map"
+#define   KW_SSET     "sorted-set"
+#define   KW_SORTED_FLOOR "sorted-floor"
+#define   KW_SORTED_CEIL  "sorted-ceil"
+#define   KW_SORTED_RANGE "sorted-range"
+#define   KW_VEC      "vec"
+#define   KW_VEC_GET  "vec-get"
+#define   KW_VEC_SET  "vec-set!"
+#define   KW_VEC_PUSH "vec-push!"
+#define   KW_VEC_POP  "vec-pop!"
+#define   KW_VEC_SORT "vec-sort!"
+#define   KW_DEQUE    "deque"
+#define   KW_PUSH_FRONT "deque-push-front!"
+#define   KW_PUSH_BACK  "deque-push-back!"
+#define   KW_POP_FRONT  "deque-pop-front!"
+#define   KW_POP_BACK   "deque-pop-back!"
+#define   KW_PQUEUE   "pqueue"
+#define   KW_PQ_PUSH  "pqueue-push!"
+#define   KW_PQ_POP   "pqueue-pop!"
+#define   KW_PQ_PEEK  "pqueue-peek"
+#define   KW_DEFRECORD  "defrecord"
+#define   KW_RECORD_NEW "record-new"
+#define   KW_RECORD_GET "record-get"
+#define   KW_RECORD_IS  "record-is?"
+#define   KW_TABLE    "table"
+#define   KW_COL      "col"
+#define   KW_WHERE    "where"
+#define   KW_GROUP_BY "group-by"
+#define   KW_BITSET     "bitset"
+#define   KW_BIT_SET    "bit-set!"
+#define   KW_BIT_CLEAR  "bit-clear!"
+#define   KW_BIT_TEST   "bit-test"
+#define   KW_BIT_COUNT  "bit-count"
+#define   KW_BIT_OR     "bit-or"
+#define   KW_BIT_AND    "bit-and"
+#define   KW_BIT_DIFF   "bit-diff"
 
 #define BTNAME(N) builtin_ ## N
 #define BUILTIN(N) lval* BTNAME(N) (lenv* e, lval* a)
@@ -57,6 +138,87 @@ BUILTIN(LOAD);    /*  load    */
 BUILTIN(PRINT);   /*  print   */
 BUILTIN(PRINTLN); /*  println */
 BUILTIN(ERROR);   /*  error   */
+BUILTIN(MAP);     /*  map     */
+BUILTIN(FILTER);  /*  filter  */
+BUILTIN(FOLDL);   /*  foldl   */
+BUILTIN(TAKE);    /*  take    */
+BUILTIN(DROP);    /*  drop    */
+BUILTIN(FUSE);    /*  fuse (only put in the code by the optimizer) */
+BUILTIN(GUARD);   /*  guard (only put in the code by the optimizer) */
+BUILTIN(SPEC);    /*  spec (only put in the code by the optimizer) */
+BUILTIN(RANGE);   /*  range   */
+BUILTIN(LEN);     /*  len     */
+BUILTIN(NTH);     /*  nth     */
+BUILTIN(SLICE);   /*  slice   */
+BUILTIN(PIPE);    /*  pipe    */
+BUILTIN(PIPE_LINES); /*  pipe-lines */
+BUILTIN(XMAP);    /*  xmap    */
+BUILTIN(XFILTER); /*  xfilter */
+BUILTIN(XTAKE);   /*  xtake   */
+BUILTIN(XDROP);   /*  xdrop   */
+BUILTIN(XREDUCE); /*  xreduce */
+BUILTIN(LAZY_RANGE);  /*  lazy-range  */
+BUILTIN(ITERATE);     /*  iterate     */
+BUILTIN(LAZY_MAP);    /*  lazy-map    */
+BUILTIN(LAZY_FILTER); /*  lazy-filter */
+BUILTIN(LAZY_TAKE);   /*  lazy-take   */
+BUILTIN(REALIZE);     /*  realize     */
+BUILTIN(GENERATOR);   /*  generator   */
+BUILTIN(F64VEC);  /*  f64vec  */
+BUILTIN(I64VEC);  /*  i64vec  */
+BUILTIN(SUM);     /*  sum     */
+BUILTIN(MIN);     /*  min     */
+BUILTIN(MAX);     /*  max     */
+BUILTIN(CUMSUM);  /*  cumsum  */
+BUILTIN(DOT);     /*  dot     */
+BUILTIN(MATRIX);  /*  matrix  */
+BUILTIN(SHAPE);   /*  shape   */
+BUILTIN(TRANSPOSE); /*  transpose */
+BUILTIN(MATMUL);  /*  matmul  */
+BUILTIN(DICT);    /*  dict    */
+BUILTIN(HMAP);    /*  hmap    */
+BUILTIN(GET);     /*  get     */
+BUILTIN(PUT);     /*  put     */
+BUILTIN(DICT_DEL); /*  dict-del */
+BUILTIN(KEYS);    /*  keys    */
+BUILTIN(VALS);    /*  vals    */
+BUILTIN(HAS);     /*  has?    */
+BUILTIN(SMAP);    /*  sorted-map */
+BUILTIN(SSET);    /*  sorted-set */
+BUILTIN(SORTED_FLOOR); /*  sorted-floor */
+BUILTIN(SORTED_CEIL);  /*  sorted-ceil  */
+BUILTIN(SORTED_RANGE); /*  sorted-range */
+BUILTIN(VEC);     /*  vec     */
+BUILTIN(VEC_GET);   /*  vec-get   */
+BUILTIN(VEC_SET);   /*  vec-set!  */
+BUILTIN(VEC_PUSH);  /*  vec-push! */
+BUILTIN(VEC_POP);   /*  vec-pop!  */
+BUILTIN(VEC_SORT);  /*  vec-sort! */
+BUILTIN(DEQUE);       /*  deque             */
+BUILTIN(PUSH_FRONT);  /*  deque-push-front! */
+BUILTIN(PUSH_BACK);   /*  deque-push-back!  */
+BUILTIN(POP_FRONT);   /*  deque-pop-front!  */
+BUILTIN(POP_BACK);    /*  deque-pop-back!   */
+BUILTIN(PQUEUE);      /*  pqueue            */
+BUILTIN(PQ_PUSH);     /*  pqueue-push!      */
+BUILTIN(PQ_POP);      /*  pqueue-pop!       */
+BUILTIN(PQ_PEEK);     /*  pqueue-peek       */
+BUILTIN(DEFRECORD);   /*  defrecord         */
+BUILTIN(RECORD_NEW);  /*  record-new        */
+BUILTIN(RECORD_GET);  /*  record-get        */
+BUILTIN(RECORD_IS);   /*  record-is?        */
+BUILTIN(TABLE);     /*  table     */
+BUILTIN(COL);       /*  col       */
+BUILTIN(WHERE);     /*  where     */
+BUILTIN(GROUP_BY);  /*  group-by  */
+BUILTIN(BITSET);      /*  bitset      */
+BUILTIN(BIT_SET);     /*  bit-set!    */
+BUILTIN(BIT_CLEAR);   /*  bit-clear!  */
+BUILTIN(BIT_TEST);    /*  bit-test    */
+BUILTIN(BIT_COUNT);   /*  bit-count   */
+BUILTIN(BIT_OR);      /*  bit-or      */
+BUILTIN(BIT_AND);     /*  bit-and     */
+BUILTIN(BIT_DIFF);    /*  bit-diff    */
 
 void lenv_add_builtins(lenv* e);
 
@@ -0,0 +1,433 @@
+#include "closure.h"
+#include "big.h"
+#include "builtins.h"
+#include "eval.h"
+#include "record.h"
+#include "utils.h"
+
+#include <limits.h>
+
+lclos* _lclos_new(lexec exec, lval* val)
+{
+  lclos* c = malloc(sizeof(lclos));
+  c->exec = exec;
+  c->val = val;
+  c->slot = -1;
+  c->builtin = NULL;
+  c->epoch = 0;
+  c->count = 0;
+  c->child = NULL;
+  c->branch[0] = NULL;
+  c->branch[1] = NULL;
+  return c;
+}
+
+void lclos_del(lclos* c)
+{
+  if (!c) {
+    return;
+  }
+
+  if (c->val) {
+    lval_del(c->val);
+  }
+  for (int i = 0; i < c->count; i++) {
+    lclos_del(c->child[i]);
+  }
+  free(c->child);
+  lclos_del(c->branch[0]);
+  lclos_del(c->branch[1]);
+  free(c);
+}
+
+lval* _lclos_const(lenv* e, lclos* c)
+{
+  return lval_copy(c->val);
+}
+
+lval* _lclos_sym(lenv* e, lclos* c)
+{
+  return lenv_get(e, c->val);
+}
+
+lval* _lclos_formal(lenv* e, lclos* c)
+{
+  /* formals are always bound in the environment of the function itself */
+  lval* v = lenv_here(e, c->val);
+  if (v) {
+    return lval_copy(v);
+  }
+
+  return lenv_get(e, c->val);
+}
+
+lval* _lclos_call(lenv* e, lclos* c)
+{
+  lval* v = lval_sexpr();
+  v->count = c->count;
+  v->cell = malloc(sizeof(lval*) * c->count);
+
+  /* evaluate all children of expression, if any of those is an error, return that */
+  for (int i = 0; i < c->count; i++) {
+    lval* x = c->child[i]->exec(e, c->child[i]);
+    if (x->type == LVAL_ERR) {
+      v->count = i;
+      lval_del(v);
+      return x;
+    }
+    v->cell[i] = x;
+  }
+
+  return leval_apply(e, v);
+}
+
+int _lclos_resolved(lenv* e, lclos* c)
+{
+  if (c->epoch == lenv_epoch) {
+    return 1;
+  }
+
+  /* a builtin may have been rebound, look it up again */
+  lval* f = lenv_get(e, c->child[0]->val);
+  int same = f->type == LVAL_FUN && f->builtin == c->builtin;
+  lval_del(f);
+
+  if (same) {
+    c->epoch = lenv_epoch;
+  }
+
+  return same;
+}
+
+lval* _lclos_builtin(lenv* e, lclos* c)
+{
+  if (!_lclos_resolved(e, c)) {
+    return _lclos_call(e, c);
+  }
+
+  lval* a = lval_sexpr();
+  a->count = c->count - 1;
+  a->cell = malloc(sizeof(lval*) * a->count);
+
+  for (int i = 1; i < c->count; i++) {
+    lval* x = c->child[i]->exec(e, c->child[i]);
+    if (x->type == LVAL_ERR) {
+      a->count = i - 1;
+      lval_del(a);
+      return x;
+    }
+    a->cell[i - 1] = x;
+  }
+
+  return c->builtin(e, a);
+}
+
+/**
+ * Evaluates both arguments of a numeric operation, if those are two
+ * numbers returns NULL, otherwise returns what the call evaluates to
+ */
+lval* _lclos_args2(lenv* e, lclos* c, lval** x, lval** y)
+{
+  if (!_lclos_resolved(e, c)) {
+    return _lclos_call(e, c);
+  }
+
+  *x = c->child[1]->exec(e, c->child[1]);
+  if ((*x)->type == LVAL_ERR) {
+    return *x;
+  }
+
+  *y = c->child[2]->exec(e, c->child[2]);
+  if ((*y)->type == LVAL_ERR) {
+    lval_del(*x);
+    return *y;
+  }
+
+  /* not two numbers, let the builtin handle (or report) it */
+  if ((*x)->type != LVAL_NUM || (*y)->type != LVAL_NUM) {
+    return c->builtin(e, lval_add(lval_add(lval_sexpr(), *x), *y));
+  }
+
+  return NULL;
+}
+
+#define LCLOS_NUMOP(N, EXPR)                    \
+  lval* _lclos_ ## N(lenv* e, lclos* c)         \
+  {                                             \
+    lval* x = NULL;                             \
+    lval* y = NULL;                             \
+    lval* r = _lclos_args2(e, c, &x, &y);       \
+    if (r) {                                    \
+      return r;                                 \
+    }                                           \
+    long a = x->num;                            \
+    long b = y->num;                            \
+    lval_del(y);                                \
+    x->num = (EXPR);                            \
+    return x;                                   \
+  }
+
+/* on an overflow the builtin makes it a bignum */
+#define LCLOS_CHECKED(N, OVERFLOW)              \
+  lval* _lclos_ ## N(lenv* e, lclos* c)         \
+  {                                             \
+    lval* x = NULL;                             \
+    lval* y = NULL;                             \
+    lval* r = _lclos_args2(e, c, &x, &y);       \
+    if (r) {                                    \
+      return r;                                 \
+    }                                           \
+    long n;                                     \
+    if (OVERFLOW(x->num, y->num, &n)) {         \
+      r = lval_add(lval_sexpr(), x);            \
+      return c->builtin(e, lval_add(r, y));     \
+    }                                           \
+    lval_del(y);                                \
+    x->num = n;                                 \
+    return x;                                   \
+  }
+
+LCLOS_CHECKED(ADD, LBIG_ADD)
+LCLOS_CHECKED(SUB, LBIG_SUB)
+LCLOS_CHECKED(MUL, LBIG_MUL)
+
+LCLOS_NUMOP(GT,  a >  b)
+LCLOS_NUMOP(GTE, a >= b)
+LCLOS_NUMOP(LT,  a <  b)
+LCLOS_NUMOP(LTE, a <= b)
+
+LCLOS_NUMOP(EQ,  a == b)
+LCLOS_NUMOP(NEQ, a != b)
+
+#undef LCLOS_NUMOP
+#undef LCLOS_CHECKED
+
+lval* _lclos_DIV(lenv* e, lclos* c)
+{
+  lval* x = NULL;
+  lval* y = NULL;
+  lval* r = _lclos_args2(e, c, &x, &y);
+  if (r) {
+    return r;
+  }
+
+  /* the only overflow, let the builtin make it a bignum */
+  if (x->num == LONG_MIN && y->num == -1) {
+    return c->builtin(e, lval_add(lval_add(lval_sexpr(), x), y));
+  }
+
+  long b = y->num;
+  lval_del(y);
+
+  if (b == 0) {
+    lval_del(x);
+    return lval_err("division by zero");
+  }
+
+  x->num /= b;
+  return x;
+}
+
+lval* _lclos_if(lenv* e, lclos* c)
+{
+  if (!_lclos_resolved(e, c)) {
+    return _lclos_call(e, c);
+  }
+
+  lval* x = c->child[1]->exec(e, c->child[1]);
+  if (x->type == LVAL_ERR) {
+    return x;
+  }
+
+  /* not a number, let the builtin report it */
+  if (x->type != LVAL_NUM) {
+    lval* a = lval_add(lval_sexpr(), x);
+    for (int i = 2; i < c->count; i++) {
+      lval_add(a, lval_copy(c->child[i]->val));
+    }
+    return BTNAME(IF)(e, a);
+  }
+
+  lclos* b = c->branch[x->num ? 0 : 1];
+  lval_del(x);
+
+  return b ? b->exec(e, b) : lval_sexpr();
+}
+
+/* (record-get r t i) with t and i constants, the field i is read right from the record */
+lval* _lclos_field(lenv* e, lclos* c)
+{
+  if (!_lclos_resolved(e, c)) {
+    return _lclos_call(e, c);
+  }
+
+  lval* r = c->child[1]->exec(e, c->child[1]);
+  if (r->type == LVAL_RECORD && r->rec->type->id == c->child[2]->val->num) {
+    lval* x = lval_copy(r->rec->fields[c->slot]);
+    lval_del(r);
+    return x;
+  }
+  if (r->type == LVAL_ERR) {
+    return r;
+  }
+
+  /* not a record of the type, let the builtin report it */
+  lval* a = lval_add(lval_sexpr(), r);
+  lval_add(a, lval_copy(c->child[2]->val));
+  lval_add(a, lval_copy(c->child[3]->val));
+  return c->builtin(e, a);
+}
+
+/* builtins compiled to their own closure */
+struct {
+  lbuiltin builtin;
+  lexec exec;
+} _lclos_numops[] = {
+  { BTNAME(ADD), _lclos_ADD }, { BTNAME(SUB), _lclos_SUB },
+  { BTNAME(MUL), _lclos_MUL }, { BTNAME(DIV), _lclos_DIV },
+  { BTNAME(GT),  _lclos_GT  }, { BTNAME(GTE), _lclos_GTE },
+  { BTNAME(LT),  _lclos_LT  }, { BTNAME(LTE), _lclos_LTE },
+  { BTNAME(EQ),  _lclos_EQ  }, { BTNAME(NEQ), _lclos_NEQ },
+  { NULL, NULL }
+};
+
+int _lclos_slot(lval* formals, char* sym)
+{
+  int slot = 0;
+  for (int i = 0; i < formals->count; i++) {
+    if (is(formals->cell[i]->sym, KW_VARG)) {
+      continue;
+    }
+    if (is(formals->cell[i]->sym, sym)) {
+      return slot;
+    }
+    slot++;
+  }
+
+  return -1;
+}
+
+lclos* _lclos_compile(lenv* e, lval* formals, lval* v);
+
+lclos* _lclos_form(lenv* e, lval* formals, lval* v)
+{
+  lclos* c = _lclos_new(_lclos_call, NULL);
+  c->count = v->count;
+  c->child = malloc(sizeof(lclos*) * c->count);
+
+  /* for definitions (def and =) a symbol in the second child is not evaluated */
+  int isdef = (v->count > 0) && (v->cell[0]->type == LVAL_SYM)
+           && (is(v->cell[0]->sym, KW_GDEF) || is(v->cell[0]->sym, KW_LDEF));
+
+  for (int i = 0; i < v->count; i++) {
+    if (isdef && i == 1 && v->cell[1]->type == LVAL_SYM) {
+      c->child[i] = _lclos_new(_lclos_const, lval_copy(v->cell[1]));
+    } else {
+      c->child[i] = _lclos_compile(e, formals, v->cell[i]);
+    }
+  }
+
+  /* a call to a builtin by its name is resolved now */
+  lval* head = v->count > 1 ? v->cell[0] : NULL;
+  if (!head || head->type != LVAL_SYM || c->child[0]->exec != _lclos_sym
+      || !lenv_watched(head->sym)) {
+    return c;
+  }
+
+  lval* f = lenv_get(e, head);
+  if (f->type == LVAL_FUN && f->builtin && is(f->sym, head->sym)) {
+    c->builtin = f->builtin;
+    c->epoch = lenv_epoch;
+    c->exec = _lclos_builtin;
+
+    if (v->count == 3) {
+      for (int i = 0; _lclos_numops[i].builtin; i++) {
+        if (f->builtin == _lclos_numops[i].builtin) {
+          c->exec = _lclos_numops[i].exec;
+        }
+      }
+    }
+
+    /* the field read is known at compile time if the type is */
+    if (f->builtin == BTNAME(RECORD_GET) && v->count == 4
+        && v->cell[2]->type == LVAL_NUM && v->cell[3]->type == LVAL_NUM) {
+      lrtype* t = lrtype_find(v->cell[2]->num);
+      if (t && v->cell[3]->num >= 0 && v->cell[3]->num < t->count) {
+        c->exec = _lclos_field;
+        c->slot = v->cell[3]->num;
+      }
+    }
+
+    int branches = (v->count == 3 || v->count == 4);
+    for (int i = 2; i < v->count; i++) {
+      branches = branches && v->cell[i]->type == LVAL_QEXPR;
+    }
+
+    if (f->builtin == BTNAME(IF) && branches) {
+      c->exec = _lclos_if;
+      for (int i = 2; i < v->count; i++) {
+        c->branch[i - 2] = _lclos_form(e, formals, v->cell[i]);
+      }
+    }
+  }
+  lval_del(f);
+
+  return c;
+}
+
+lclos* _lclos_compile(lenv* e, lval* formals, lval* v)
+{
+  if (v->type == LVAL_SEXPR) {
+    return _lclos_form(e, formals, v);
+  }
+
+  if (v->type == LVAL_SYM) {
+    int slot = formals ? _lclos_slot(formals, v->sym) : -1;
+    lclos* c = _lclos_new(slot >= 0 ? _lclos_formal : _lclos_sym, lval_copy(v));
+    c->slot = slot;
+    return c;
+  }
+
+  return _lclos_new(_lclos_const, lval_copy(v));
+}
+
+int _lclos_unique(lval* formals)
+{
+  for (int i = 0; i < formals->count; i++) {
+    for (int j = i + 1; j < formals->count; j++) {
+      if (is(formals->cell[i]->sym, formals->cell[j]->sym)) {
+        return 0;
+      }
+    }
+  }
+
+  return 1;
+}
+
+lclos* lclos_compile(lenv* e, lval* formals, lval* body)
+{
+  /* with repeated formals which one is read is not known */
+  if (formals && !_lclos_unique(formals)) {
+    formals = NULL;
+  }
+
+  return _lclos_form(e, formals, body);
+}
+
+lval* lclos_eval(lenv* e, lval* v)
+{
+  lclos* c = _lclos_compile(e, NULL, v);
+  lval_del(v);
+  lval* x = c->exec(e, c);
+  lclos_del(c);
+  return x;
+}
+
+lval* lclos_call(lval* f)
+{
+  if (!f->code->clos) {
+    f->code->clos = lclos_compile(f->env, f->code->formals, f->body);
+  }
+
+  return f->code->clos->exec(f->env, f->code->clos);
+}
@@ -0,0 +1,88 @@
+#ifndef LISPY_CLOSURE_H
+#define LISPY_CLOSURE_H
+
+#include "env.h"
+#include "val.h"
+
+/**
+ * Evaluates a closure
+ *
+ * lenv* e      the environment to evaluate in
+ * lclos* c     the closure, with its children
+ *
+ * return       the resulting value
+ */
+typedef lval*(*lexec)(lenv*, lclos*);
+
+/**
+ * A closure of the closure-compilation engine
+ *
+ * The code is compiled only once into a tree of closures, every closure
+ * knows at compile time what it does (read a constant, read a formal,
+ * call a builtin, take a branch of 'if', ...) and keeps it in its exec
+ * function, so evaluating it never looks again at the type of the lval*
+ * it was compiled from, nor at the names of the symbols.
+ *
+ * Builtins called by name are resolved at compile time, and are looked
+ * up again only if lenv_epoch says that one of them may have been rebound.
+ */
+struct lclos
+{
+  /** the function that evaluates this closure **/
+  lexec exec;
+
+  /** the constant, or the symbol read or called by this closure **/
+  lval* val;
+
+  /** index of the formal read among the formals of the function, or -1 **/
+  int slot;
+
+  /** builtin called directly, and the value of lenv_epoch when resolved **/
+  lbuiltin builtin;
+  long epoch;
+
+  /** children of the closure, for calls the arguments (the head is child 0) **/
+  int count;
+  lclos** child;
+
+  /** branches of 'if' **/
+  lclos* branch[2];
+};
+
+/**
+ * Compiles the body of a function
+ *
+ * lenv* e          the environment to resolve builtins in
+ * lval* formals    the formals of the function, read from its environment
+ * lval* body       the body (LVAL_QEXPR), it is not modified
+ *
+ * return     the root closure
+ */
+lclos* lclos_compile(lenv* e, lval* formals, lval* body);
+
+/**
+ * Destroys a tree of closures
+ */
+void lclos_del(lclos* c);
+
+/**
+ * Evaluates a form with the closure-compilation engine
+ *
+ * lenv* e    the environment to evaluate in
+ * lval* v    the form to evaluate, it is consumed
+ *
+ * return     the resulting value
+ */
+lval* lclos_eval(lenv* e, lval* v);
+
+/**
+ * Evaluates the body of a function with all its formals bound, the
+ * body is compiled the first time and shared by every copy of f
+ *
+ * lval* f    the function, its environment ready to evaluate the body
+ *
+ * return     the resulting value
+ */
+lval* lclos_call(lval* f);
+
+#endif//LISPY_CLOSURE_H
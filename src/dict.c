@@ -0,0 +1,491 @@
+#if defined(__SSE2__) || defined(_M_X64)
+#define LDICT_SSE2 1
+#endif
+
+#include "dict.h"
+#include "big.h"
+#include "str.h"
+#include "val.h"
+
+#include <string.h>
+
+#if defined(LDICT_SSE2)
+#include <emmintrin.h>
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define LDICT_CTZ(m) __builtin_ctz(m)
+#else
+#define LDICT_CTZ(m) _ldict_ctz(m)
+#endif
+
+/** control bytes of the slots without an entry, the ones with have 7 bits of its hash **/
+#define LDICT_EMPTY   0x80
+#define LDICT_DELETED 0xFE
+
+/** slots of a group that can be full, the rest keep every lookup short **/
+#define LDICT_LOAD (LDICT_GROUP * 7 / 8)
+
+/**
+ * LDICT_GROUP slots, the keys with their hashes and the values
+ */
+typedef struct
+{
+  int refs;
+  uint8_t ctrl[LDICT_GROUP];
+  uint64_t hash[LDICT_GROUP];
+  lval* key[LDICT_GROUP];
+  lval* val[LDICT_GROUP];
+} ldict_group;
+
+/**
+ * A node of the tree of groups, the group g is found from the root taking
+ * LDICT_BITS bits of g at a time, the most significant first
+ */
+struct ldict_node
+{
+  int refs;
+
+  /** the nodes of the level below, or groups at the bottom (NULL past the last group) **/
+  void* child[LDICT_FAN];
+};
+
+int _ldict_ctz(unsigned m)
+{
+  int i = 0;
+  while (!(m & 1)) {
+    m >>= 1;
+    i++;
+  }
+  return i;
+}
+
+/* the slots of a group whose control byte is c, one bit each */
+unsigned _ldict_match(ldict_group* grp, uint8_t c)
+{
+#if defined(LDICT_SSE2)
+  __m128i g = _mm_loadu_si128((__m128i*)grp->ctrl);
+  return (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(g, _mm_set1_epi8((char)c)));
+#else
+  unsigned m = 0;
+  for (int i = 0; i < LDICT_GROUP; i++) {
+    m |= (unsigned)(grp->ctrl[i] == c) << i;
+  }
+  return m;
+#endif
+}
+
+/* the slots of a group without an entry (empty or deleted), one bit each */
+unsigned _ldict_free(ldict_group* grp)
+{
+#if defined(LDICT_SSE2)
+  return (unsigned)_mm_movemask_epi8(_mm_loadu_si128((__m128i*)grp->ctrl));
+#else
+  unsigned m = 0;
+  for (int i = 0; i < LDICT_GROUP; i++) {
+    m |= (unsigned)(grp->ctrl[i] >> 7) << i;
+  }
+  return m;
+#endif
+}
+
+int ldict_can_key(lval* k)
+{
+  return k->type == LVAL_NUM || k->type == LVAL_BIGNUM || k->type == LVAL_FLOAT
+      || k->type == LVAL_STR || k->type == LVAL_SYM;
+}
+
+/* the bits of x spread over all 64 (the finalizer of splitmix64) */
+uint64_t _ldict_mix(uint64_t x)
+{
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+/* FNV-1a of n bytes */
+uint64_t _ldict_bytes(void* p, size_t n)
+{
+  unsigned char* s = p;
+  uint64_t h = 0xcbf29ce484222325ULL;
+  for (size_t i = 0; i < n; i++) {
+    h = (h ^ s[i]) * 0x100000001b3ULL;
+  }
+  return h;
+}
+
+uint64_t ldict_hash(lval* k)
+{
+  uint64_t h = 0;
+  switch (k->type) {
+    case LVAL_NUM:
+      h = (uint64_t)k->num;
+      break;
+
+    case LVAL_FLOAT: {
+      /* 0.0 and -0.0 are equal, so they must have the same hash */
+      double d = k->dbl == 0 ? 0.0 : k->dbl;
+      memcpy(&h, &d, sizeof(h));
+      break;
+    }
+
+    case LVAL_BIGNUM:
+      h = _ldict_bytes(k->big->d, sizeof(uint32_t) * k->big->len) ^ (uint64_t)k->big->sign;
+      break;
+
+    case LVAL_STR:
+      h = lstr_hash(k->str);
+      break;
+
+    case LVAL_SYM:
+      h = _ldict_bytes(k->sym, strlen(k->sym));
+      break;
+  }
+
+  /* keys of different types are never equal, they need not collide */
+  return _ldict_mix(h + (uint64_t)k->type * 0x9e3779b97f4a7c15ULL);
+}
+
+ldict_group* _ldict_group_new(void)
+{
+  ldict_group* grp = malloc(sizeof(ldict_group));
+  grp->refs = 1;
+  memset(grp->ctrl, LDICT_EMPTY, LDICT_GROUP);
+  return grp;
+}
+
+void _ldict_group_del(ldict_group* grp)
+{
+  if (grp && --grp->refs == 0) {
+    for (int i = 0; i < LDICT_GROUP; i++) {
+      if (grp->ctrl[i] < LDICT_EMPTY) {
+        lval_del(grp->key[i]);
+        lval_del(grp->val[i]);
+      }
+    }
+    free(grp);
+  }
+}
+
+void _ldict_node_del(struct ldict_node* n, int level)
+{
+  if (n && --n->refs == 0) {
+    for (int i = 0; i < LDICT_FAN; i++) {
+      if (level > 1) {
+        _ldict_node_del(n->child[i], level - 1);
+      } else {
+        _ldict_group_del(n->child[i]);
+      }
+    }
+    free(n);
+  }
+}
+
+/* the index in a node of the given level of the child group g is under */
+#define LDICT_CHILD(g, level) (((g) >> (((level) - 1) * LDICT_BITS)) & (LDICT_FAN - 1))
+
+ldict_group* _ldict_group(ldict* d, long g)
+{
+  struct ldict_node* n = d->root;
+  for (int l = d->levels; l > 1; l--) {
+    n = n->child[LDICT_CHILD(g, l)];
+  }
+  return n->child[LDICT_CHILD(g, 1)];
+}
+
+/* a node (of the given level) nothing else has, for one that is shared */
+struct ldict_node* _ldict_node_copy(struct ldict_node* n, int level)
+{
+  struct ldict_node* c = malloc(sizeof(struct ldict_node));
+  c->refs = 1;
+  for (int i = 0; i < LDICT_FAN; i++) {
+    c->child[i] = n->child[i];
+    if (!c->child[i]) {
+      continue;
+    }
+    if (level > 1) {
+      ((struct ldict_node*)c->child[i])->refs++;
+    } else {
+      ((ldict_group*)c->child[i])->refs++;
+    }
+  }
+  n->refs--;
+  return c;
+}
+
+/* the group g, to be changed: it and the nodes above it are copied if shared */
+ldict_group* _ldict_group_w(ldict* d, long g)
+{
+  if (d->root->refs > 1) {
+    d->root = _ldict_node_copy(d->root, d->levels);
+  }
+  struct ldict_node* n = d->root;
+  for (int l = d->levels; l > 1; l--) {
+    struct ldict_node* c = n->child[LDICT_CHILD(g, l)];
+    if (c->refs > 1) {
+      n->child[LDICT_CHILD(g, l)] = c = _ldict_node_copy(c, l - 1);
+    }
+    n = c;
+  }
+
+  ldict_group* grp = n->child[LDICT_CHILD(g, 1)];
+  if (grp->refs > 1) {
+    ldict_group* c = malloc(sizeof(ldict_group));
+    c->refs = 1;
+    memcpy(c->ctrl, grp->ctrl, LDICT_GROUP);
+    for (int i = 0; i < LDICT_GROUP; i++) {
+      if (grp->ctrl[i] < LDICT_EMPTY) {
+        c->hash[i] = grp->hash[i];
+        c->key[i] = lval_copy(grp->key[i]);
+        c->val[i] = lval_copy(grp->val[i]);
+      }
+    }
+    grp->refs--;
+    n->child[LDICT_CHILD(g, 1)] = grp = c;
+  }
+  return grp;
+}
+
+/* the smallest number of groups (a power of 2) with room for n entries */
+long _ldict_size(long n)
+{
+  long groups = 1;
+  while (groups * LDICT_LOAD <= n) {
+    groups *= 2;
+  }
+  return groups;
+}
+
+/* a node of empty groups, for the groups from 'first' (and before 'groups') */
+struct ldict_node* _ldict_node_new(long first, int level, long groups)
+{
+  struct ldict_node* n = malloc(sizeof(struct ldict_node));
+  n->refs = 1;
+  for (long i = 0; i < LDICT_FAN; i++) {
+    long g = first + (i << ((level - 1) * LDICT_BITS));
+    if (g >= groups) {
+      n->child[i] = NULL;
+    } else if (level > 1) {
+      n->child[i] = _ldict_node_new(g, level - 1, groups);
+    } else {
+      n->child[i] = _ldict_group_new();
+    }
+  }
+  return n;
+}
+
+/* a new tree of empty groups */
+void _ldict_alloc(ldict* d, long groups)
+{
+  d->groups = groups;
+  d->levels = 1;
+  while ((1L << (d->levels * LDICT_BITS)) < groups) {
+    d->levels++;
+  }
+  d->root = _ldict_node_new(0, d->levels, groups);
+}
+
+/**
+ * Probing: the groups are looked in from the one of the hash, then 1, 2,
+ * 3... groups after the one before (which goes through all of them, as
+ * the number of groups is a power of 2), until a group with an empty slot
+ */
+#define LDICT_PROBE(d, h, g, step) \
+  for (long step = 1, g = (long)((h) >> 7) & ((d)->groups - 1); step <= (d)->groups; \
+      g = (g + step) & ((d)->groups - 1), step++)
+
+/* the slot of a key, set in *g and *s, or 0 (false) if it is not in the dict */
+int _ldict_find(ldict* d, lval* k, uint64_t h, long* g, int* s)
+{
+  LDICT_PROBE(d, h, i, step) {
+    ldict_group* grp = _ldict_group(d, i);
+    unsigned m = _ldict_match(grp, h & 0x7F);
+    while (m) {
+      int j = LDICT_CTZ(m);
+      if (grp->hash[j] == h && lval_eq(grp->key[j], k)) {
+        *g = i;
+        *s = j;
+        return 1;
+      }
+      m &= m - 1;
+    }
+    if (_ldict_match(grp, LDICT_EMPTY)) {
+      return 0;
+    }
+  }
+  return 0;
+}
+
+/* the first slot without an entry a key of hash h can be put in */
+void _ldict_slot(ldict* d, uint64_t h, long* g, int* s)
+{
+  LDICT_PROBE(d, h, i, step) {
+    unsigned m = _ldict_free(_ldict_group(d, i));
+    if (m) {
+      *g = i;
+      *s = LDICT_CTZ(m);
+      return;
+    }
+  }
+}
+
+void _ldict_set(ldict* d, long g, int s, uint64_t h, lval* k, lval* v)
+{
+  ldict_group* grp = _ldict_group_w(d, g);
+  d->used += grp->ctrl[s] == LDICT_EMPTY;
+  d->count++;
+  grp->ctrl[s] = h & 0x7F;
+  grp->hash[s] = h;
+  grp->key[s] = k;
+  grp->val[s] = v;
+}
+
+/**
+ * every entry under a node (of the given level) put in the dict, the ones
+ * of groups nothing else has (the group and all the nodes above it) are
+ * moved, the others copied
+ */
+void _ldict_drain(ldict* d, struct ldict_node* n, int level, int own)
+{
+  own = own && n->refs == 1;
+  for (int c = 0; c < LDICT_FAN && n->child[c]; c++) {
+    if (level > 1) {
+      _ldict_drain(d, n->child[c], level - 1, own);
+      continue;
+    }
+
+    ldict_group* grp = n->child[c];
+    int move = own && grp->refs == 1;
+    for (int i = 0; i < LDICT_GROUP; i++) {
+      if (grp->ctrl[i] < LDICT_EMPTY) {
+        long g;
+        int s;
+        _ldict_slot(d, grp->hash[i], &g, &s);
+        _ldict_set(d, g, s, grp->hash[i],
+            move ? grp->key[i] : lval_copy(grp->key[i]),
+            move ? grp->val[i] : lval_copy(grp->val[i]));
+      }
+    }
+    if (move) {
+      free(grp);
+      n->child[c] = NULL;
+    }
+  }
+}
+
+/* every entry put in new groups, without the deleted slots */
+void _ldict_resize(ldict* d, long groups)
+{
+  struct ldict_node* root = d->root;
+  int levels = d->levels;
+  _ldict_alloc(d, groups);
+  d->count = 0;
+  d->used = 0;
+  _ldict_drain(d, root, levels, 1);
+  _ldict_node_del(root, levels);
+}
+
+ldict* ldict_new(long n)
+{
+  ldict* d = malloc(sizeof(ldict));
+  d->refs = 1;
+  d->count = 0;
+  d->used = 0;
+  _ldict_alloc(d, _ldict_size(n));
+  return d;
+}
+
+void ldict_del(ldict* d)
+{
+  if (--d->refs == 0) {
+    _ldict_node_del(d->root, d->levels);
+    free(d);
+  }
+}
+
+ldict* ldict_edit(ldict* d)
+{
+  if (d->refs == 1) {
+    return d;
+  }
+
+  /* the tree is shared, its nodes are copied as they are changed */
+  ldict* c = malloc(sizeof(ldict));
+  c->refs = 1;
+  c->count = d->count;
+  c->used = d->used;
+  c->groups = d->groups;
+  c->levels = d->levels;
+  c->root = d->root;
+  c->root->refs++;
+  d->refs--;
+  return c;
+}
+
+lval* ldict_get(ldict* d, lval* k)
+{
+  long g;
+  int s;
+  return _ldict_find(d, k, ldict_hash(k), &g, &s) ? _ldict_group(d, g)->val[s] : NULL;
+}
+
+void ldict_put(ldict* d, lval* k, lval* v)
+{
+  uint64_t h = ldict_hash(k);
+  long g;
+  int s;
+  if (_ldict_find(d, k, h, &g, &s)) {
+    ldict_group* grp = _ldict_group_w(d, g);
+    lval_del(grp->val[s]);
+    grp->val[s] = v;
+    lval_del(k);
+    return;
+  }
+
+  /* at most LDICT_LOAD slots of every LDICT_GROUP are used, half after it grows */
+  if (d->used + 1 > d->groups * LDICT_LOAD) {
+    _ldict_resize(d, _ldict_size(2 * d->count + 1));
+  }
+  _ldict_slot(d, h, &g, &s);
+  _ldict_set(d, g, s, h, k, v);
+}
+
+int ldict_remove(ldict* d, lval* k)
+{
+  long g;
+  int s;
+  if (!_ldict_find(d, k, ldict_hash(k), &g, &s)) {
+    return 0;
+  }
+
+  ldict_group* grp = _ldict_group_w(d, g);
+  lval_del(grp->key[s]);
+  lval_del(grp->val[s]);
+
+  /* a lookup stops at a group with an empty slot, so it can be one more */
+  if (_ldict_match(grp, LDICT_EMPTY)) {
+    grp->ctrl[s] = LDICT_EMPTY;
+    d->used--;
+  } else {
+    grp->ctrl[s] = LDICT_DELETED;
+  }
+  d->count--;
+  return 1;
+}
+
+int ldict_next(ldict* d, long* i, lval** k, lval** v)
+{
+  for (; *i < d->groups * LDICT_GROUP; (*i)++) {
+    ldict_group* grp = _ldict_group(d, *i / LDICT_GROUP);
+    int s = *i % LDICT_GROUP;
+    if (grp->ctrl[s] < LDICT_EMPTY) {
+      *k = grp->key[s];
+      *v = grp->val[s];
+      (*i)++;
+      return 1;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,117 @@
+#ifndef LISPY_DICT_H
+#define LISPY_DICT_H
+
+#include "fwd.h"
+
+#include <stdint.h>
+
+/**
+ * Number of slots of a group: a lookup compares the control bytes of a
+ * whole group at once (in one SSE2 register where there is one)
+ */
+#define LDICT_GROUP 16
+
+/**
+ * Number of children (2^LDICT_BITS) of a node of the tree the groups are
+ * in, the nodes of the bottom level have the groups
+ */
+#define LDICT_BITS 5
+#define LDICT_FAN (1 << LDICT_BITS)
+
+/**
+ * Number of entries printed of a dict
+ */
+#define LDICT_PRINT 16
+
+/**
+ * A hash table (LVAL_DICT) of open addressing, in the way of the Swiss
+ * tables: the slots are in groups of LDICT_GROUP, each one with a control
+ * byte holding 7 bits of the hash of its key (or that it is empty or was
+ * deleted), and the hash of every key is kept so it is never computed
+ * again, neither to compare two keys nor to grow the table
+ *
+ * The groups, and the nodes of the tree they are in, are counted
+ * references: a new version of a dict shares all of them with the old one
+ * but the group it changes and the nodes above it, which are copied (see
+ * ldict_edit()), so a change copies a few dozen pointers however large
+ * the dict is
+ */
+struct ldict
+{
+  /** number of values sharing the dict **/
+  int refs;
+
+  /** number of entries, and of slots not empty (entries and deleted ones) **/
+  long count;
+  long used;
+
+  /** number of groups (a power of 2), in a tree of 'levels' levels of nodes **/
+  long groups;
+  int levels;
+  struct ldict_node* root;
+};
+
+/**
+ * If a value can be a key: a Number (of any kind), a String or a Symbol
+ */
+int ldict_can_key(lval* k);
+
+/**
+ * The hash of a key, the same for the keys lval_eq() finds equal
+ */
+uint64_t ldict_hash(lval* k);
+
+/**
+ * Creates an empty dict
+ *
+ * long n     number of entries it has room for before it grows
+ */
+ldict* ldict_new(long n);
+
+/**
+ * Releases a reference to the dict (freed with the last one)
+ */
+void ldict_del(ldict* d);
+
+/**
+ * The dict to change to make a new version of d: d itself if nothing else
+ * has it, otherwise a new one sharing its tree. The reference to d is
+ * given to it, the one returned is the caller's.
+ */
+ldict* ldict_edit(ldict* d);
+
+/**
+ * The value of a key
+ *
+ * return     the value, still owned by the dict, or NULL if the key is
+ *            not in it
+ */
+lval* ldict_get(ldict* d, lval* k);
+
+/**
+ * Sets the value of a key in a dict (one from ldict_new() or ldict_edit())
+ *
+ * lval* k, v     the key (ldict_can_key() is true of it) and its value,
+ *                both taken by the dict (or destroyed)
+ */
+void ldict_put(ldict* d, lval* k, lval* v);
+
+/**
+ * Removes a key from a dict (one from ldict_new() or ldict_edit())
+ *
+ * return     1 (true) if it was in it, 0 (false) otherwise
+ */
+int ldict_remove(ldict* d, lval* k);
+
+/**
+ * Goes through the entries, in the order of their slots
+ *
+ * long* i        the slot to look from (0 for the first entry), moved past
+ *                the entry found
+ * lval** k, v    set to the key and value found, owned by the dict
+ *
+ * return     1 (true) if an entry was found, 0 (false) at the end
+ */
+int ldict_next(ldict* d, long* i, lval** k, lval** v);
+
+#endif//LISPY_DICT_H
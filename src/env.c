@@ -1,16 +1,31 @@
 #include "env.h"
+#include "dict.h"
+#include "hamt.h"
 #include "utils.h"
 #include <string.h>
 
+long lenv_epoch = 0;
+
+/**
+ * names watched by lenv_watch(), in a set open-addressed by their hash:
+ * the slots are a power of 2, at most half of them used
+ */
+char** _lenv_watch = NULL;
+long _lenv_nwatch = 0;
+long _lenv_watch_size = 0;
+
 lenv* lenv_new(void)
 {
   lenv* e = malloc(sizeof(lenv));
   e->debug = 0;
-  e->parser = lparser_new();
+  e->optimize = 0;
+  e->dumpopt = 0;
+  e->dumpir = 0;
+  e->parser = NULL;
   e->parent = NULL;
   e->count = 0;
-  e->syms = NULL;
-  e->vals = NULL;
+  e->map = NULL;
+  e->shadows = 0;
   return e;
 }
 
@@ -18,26 +33,20 @@ lenv* lenv_copy(lenv* e)
 {
   lenv* n = malloc(sizeof(lenv));
   n->debug = e->debug;
+  n->optimize = e->optimize;
+  n->dumpopt = e->dumpopt;
+  n->dumpir = e->dumpir;
   n->parser = NULL;
   n->parent = e->parent;
   n->count = e->count;
-  n->syms = malloc(sizeof(char*) * n->count);
-  n->vals = malloc(sizeof(lval*) * n->count);
-  for (int i = 0; i < n->count; i++) {
-    n->syms[i] = malloc(strlen(e->syms[i]) + i);
-    strcpy(n->syms[i], e->syms[i]);
-    n->vals[i] = lval_copy(e->vals[i]);
-  }
+  n->map = lhamt_share(e->map);
+  n->shadows = e->shadows;
   return n;
 }
 
 void lenv_def(lenv* e, lval* k, lval* v)
 {
-  while (e->parent) {
-    e = e->parent;
-  }
-
-  lenv_put(e, k, v);
+  lenv_put(lenv_global(e), k, v);
 }
 
 void lenv_del(lenv* e)
@@ -45,55 +54,64 @@ void lenv_del(lenv* e)
   if (e->parser) {
     lparser_del(e->parser);
   }
-  for (int i = 0; i < e->count; i++) {
-    free(e->syms[i]);
-    lval_del(e->vals[i]);
-  }
-  free(e->syms);
-  free(e->vals);
+  lhamt_del(e->map);
   free(e);
 }
 
 lval* lenv_get(lenv* e, lval* k)
 {
-  /* go over all items in environment */
-  for (int i = 0; i < e->count; i++) {
-    /* if the symbol is found then return a copy of it */
-    if (is(e->syms[i], k->sym)) {
-      return lval_copy(e->vals[i]);
-    }
+  /* if the symbol is found then return a copy of it */
+  lval* v = lenv_find(e, k);
+  if (v) {
+    return lval_copy(v);
   }
 
-  if (e->parent) {
-    /* if no symbol was found then look for it in the parent environment */
-    return lenv_get(e->parent, k);
-  } else {
-    /* if no symbol was found and there is no parent environment, then the symbols doesn't exist */
-    return lval_err("unbound symbol %s", k->sym);
-  }
+  /* if no symbol was found in any environment, then the symbols doesn't exist */
+  return lval_err("unbound symbol %s", k->sym);
 }
 
-void lenv_put(lenv* e, lval* k, lval* v)
+lval* lenv_here(lenv* e, lval* k)
+{
+  return lhamt_get(e->map, k);
+}
+
+lval* lenv_find(lenv* e, lval* k)
 {
-  /* go over all items in environment */
-  for (int i = 0; i < e->count; i++) {
-    /* if the symbol is found then delete it and replace it with the new one */
-    if (is(e->syms[i], k->sym)) {
-      lval_del(e->vals[i]);
-      e->vals[i] = lval_copy(v);
-      return;
+  /* from this environment to its parent, and so on, hashing the symbol once */
+  uint64_t hash = 0;
+  int hashed = 0;
+  for (; e; e = e->parent) {
+    if (!e->map) {
+      continue;
+    }
+    if (!hashed) {
+      hash = ldict_hash(k);
+      hashed = 1;
+    }
+    lval* v = lhamt_find(e->map, k, hash);
+    if (v) {
+      return v;
     }
   }
 
-  /* if no existing entry found, then allocate space for new entry */
-  e->count++;
-  e->vals = realloc(e->vals, sizeof(lval*) * e->count);
-  e->syms = realloc(e->syms, sizeof(char*) * e->count);
+  return NULL;
+}
+
+void lenv_put(lenv* e, lval* k, lval* v)
+{
+  lenv_move(e, lval_copy(k), lval_copy(v));
+}
+
+void lenv_move(lenv* e, lval* k, lval* v)
+{
+  if (lenv_watched(k->sym)) {
+    e->shadows = 1;
+    lenv_epoch++;
+  }
 
-  /* and save a new entry */
-  e->vals[e->count - 1] = lval_copy(v);
-  e->syms[e->count - 1] = malloc(strlen(k->sym) + 1);
-  strcpy(e->syms[e->count - 1], k->sym);
+  /* replaces the value if the symbol is there, the copies of the environment keep theirs */
+  e->map = lhamt_put(e->map, k, v);
+  e->count = lhamt_count(e->map);
 }
 
 lparser* lenv_getparser(lenv* e)
@@ -108,3 +126,60 @@ lparser* lenv_getparser(lenv* e)
 
   return NULL;
 }
+
+lenv* lenv_global(lenv* e)
+{
+  while (e->parent) {
+    e = e->parent;
+  }
+
+  return e;
+}
+
+/* the slot of a name in the set of watched names, empty (NULL) if it is not there */
+long _lenv_watch_slot(char* name)
+{
+  /* FNV-1a of the name */
+  unsigned long h = 0xcbf29ce484222325UL;
+  for (char* s = name; *s; s++) {
+    h = (h ^ (unsigned char)*s) * 0x100000001b3UL;
+  }
+
+  long mask = _lenv_watch_size - 1;
+  long i = (long)(h & mask);
+  while (_lenv_watch[i] && !is(_lenv_watch[i], name)) {
+    i = (i + 1) & mask;
+  }
+  return i;
+}
+
+void lenv_watch(char* name)
+{
+  if (lenv_watched(name)) {
+    return;
+  }
+
+  /* twice as many slots, with the names put again */
+  if (2 * (_lenv_nwatch + 1) > _lenv_watch_size) {
+    char** old = _lenv_watch;
+    long n = _lenv_watch_size;
+    _lenv_watch_size = n ? n * 2 : 256;
+    _lenv_watch = calloc(_lenv_watch_size, sizeof(char*));
+    for (long i = 0; i < n; i++) {
+      if (old[i]) {
+        _lenv_watch[_lenv_watch_slot(old[i])] = old[i];
+      }
+    }
+    free(old);
+  }
+
+  char* x = malloc(strlen(name) + 1);
+  strcpy(x, name);
+  _lenv_watch[_lenv_watch_slot(x)] = x;
+  _lenv_nwatch++;
+}
+
+int lenv_watched(char* name)
+{
+  return _lenv_nwatch && _lenv_watch[_lenv_watch_slot(name)];
+}
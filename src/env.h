@@ -13,6 +13,15 @@ struct lenv
   /** to debug or no debug **/
   int debug;
 
+  /** to optimize code before evaluating it or not (off unless --opt) **/
+  int optimize;
+
+  /** to print every optimized form or not **/
+  int dumpopt;
+
+  /** to print the IR of every function lowered or not **/
+  int dumpir;
+
   /** the parser (used by load) **/
   lparser* parser;
 
@@ -22,13 +31,21 @@ struct lenv
   /** number of items in the environment **/
   int count;
 
-  /** list of symbol names (as char*) **/
-  char** syms;
+  /** the symbols (LVAL_SYM) and their values, shared by the copies of the environment **/
+  lhamt* map;
 
-  /** list of symbols (as lval*) **/
-  lval** vals;
+  /** if a symbol named as a builtin is bound here **/
+  int shadows;
 };
 
+/**
+ * Advances every time a symbol named as a builtin is bound (in any
+ * environment) or an environment with such a symbol is used again
+ * to call a function. While it does not change every call to a
+ * builtin by its name resolves to that same builtin.
+ */
+extern long lenv_epoch;
+
 /**
  * Creates a new environment
  *
@@ -41,7 +58,9 @@ lenv* lenv_new(void);
  *
  * lenv* e    the environment to be copied
  *
- * return     a new copy with the same (copied) symbols of the original one
+ * return     a new copy with the same symbols of the original one, which
+ *            shares them with it (so it takes O(1)) until one of both
+ *            binds a symbol
  */
 lenv* lenv_copy(lenv* e);
 
@@ -67,6 +86,25 @@ void lenv_del(lenv* e);
  */
 lval* lenv_get(lenv* e, lval* key);
 
+/**
+ * Finds a symbol in an environment, the same way lenv_get() does
+ *
+ * lenv* e      the environment to search
+ * lval* key    an lval* of type LVAL_SYM to search in the environment
+ *
+ * return       the value of the symbol (not a copy, it must not be
+ *              modified nor deleted) or NULL if not found
+ */
+lval* lenv_find(lenv* e, lval* key);
+
+/**
+ * Finds a symbol in an environment only, not in its parents
+ *
+ * return       the value of the symbol (not a copy, it must not be
+ *              modified nor deleted) or NULL if not found
+ */
+lval* lenv_here(lenv* e, lval* key);
+
 /**
  * Adds a symbol to the environment
  *
@@ -76,6 +114,12 @@ lval* lenv_get(lenv* e, lval* key);
  */
 void lenv_put(lenv* e, lval* key, lval* value);
 
+/**
+ * Adds a symbol to the environment like lenv_put(), taking the key and
+ * the value instead of copying them (the formals bound by a call)
+ */
+void lenv_move(lenv* e, lval* key, lval* value);
+
 /**
  * Adds a symbol to the global environment. Starting with the passed environment
  * it goes "up" searching the parent of every environment until the global env
@@ -93,4 +137,24 @@ void lenv_def(lenv* e, lval* key, lval* value);
  */
 lparser* lenv_getparser(lenv* e);
 
+/**
+ * Watches a name, binding it anywhere advances lenv_epoch
+ *
+ * char* name     the name of a builtin
+ */
+void lenv_watch(char* name);
+
+/**
+ * Tests if a name is watched
+ *
+ * return     1 (true) if the name was passed to lenv_watch(), 0 (false) otherwise
+ */
+int lenv_watched(char* name);
+
+/**
+ * Given any environment, it returns the global environment
+ * (the one with no parent)
+ */
+lenv* lenv_global(lenv* e);
+
 #endif//LISPY_ENV_H
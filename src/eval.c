@@ -1,7 +1,14 @@
 #include "eval.h"
 #include "builtins.h"
+#include "closure.h"
+#include "ir.h"
+#include "jit.h"
+#include "opt.h"
+#include "quick.h"
 #include "utils.h"
 
+int lengine = LENGINE_TREE;
+
 lval* leval_sexpr(lenv* e, lval* v)
 {
   int isdef  = (v->count > 0) && (v->cell[0]->type == LVAL_SYM)
@@ -22,6 +29,11 @@ lval* leval_sexpr(lenv* e, lval* v)
     }
   }
 
+  return leval_apply(e, v);
+}
+
+lval* leval_apply(lenv* e, lval* v)
+{
   /* expression with no children */
   if (v->count == 0) {
     return v;
@@ -67,8 +79,20 @@ lval* lcall(lenv* e, lval* f, lval* a)
     return f->builtin(e, a);
   }
 
+  /* the code shared by the copies of the function, before any formal is bound */
+  lval_code(f);
+
+  /* hot functions are called with their machine code, if they can */
+  if (ljit_enabled) {
+    lval* r = ljit_call(e, f, a);
+    if (r) {
+      return r;
+    }
+  }
+
   int args_given = a->count;
   int args_total = f->formals->count;
+  long epoch = lenv_epoch;
 
   while (a->count) {
     if (f->formals->count == 0) {
@@ -97,10 +121,7 @@ lval* lcall(lenv* e, lval* f, lval* a)
 
     /* if function parameters are {a b c ...} */
     } else {
-      lval* val = lval_pop(a, 0);
-      lenv_put(f->env, sym, val);
-      lval_del(sym);
-      lval_del(val);
+      lenv_move(f->env, sym, lval_pop(a, 0));
     }
   }
 
@@ -127,9 +148,50 @@ lval* lcall(lenv* e, lval* f, lval* a)
   if (f->formals->count == 0) {
     /* if all formals have been bound evaluate the function */
     f->env->parent = e;
-    return BTNAME(EVAL)(f->env, lval_add(lval_sexpr(), lval_copy(f->body)));
+
+    /**
+     * builtins may resolve to the symbols bound in this environment, the
+     * epoch advances if they were bound before (binding one advanced it)
+     */
+    if (f->env->shadows && lenv_epoch == epoch) {
+      lenv_epoch++;
+    }
+
+    if (f->code->native) {
+      return f->code->native(f->env);
+    }
+
+    switch (lengine) {
+      case LENGINE_QUICK:   return lquick_call(f);
+      case LENGINE_CLOSURE: return lclos_call(f);
+      case LENGINE_IR:      return lir_call(f);
+    }
+
+    /* the body rewritten by the optimizer, the first time it is evaluated */
+    lcode* c = f->code;
+    if (!c->optimized) {
+      c->optimized = 1;
+      c->opt = lopt_body(f->env, c->formals, f->body, &c->guard);
+    }
+
+    return BTNAME(EVAL)(f->env, lval_add(lval_sexpr(), lval_copy(c->opt ? c->opt : f->body)));
   }
 
   /* if there are more parameters to be bound, return a copy */
   return lval_copy(f);
 }
+
+lval* leval_form(lenv* e, lval* v)
+{
+  switch (lengine) {
+    case LENGINE_QUICK:   return lquick_eval(e, v);
+    case LENGINE_CLOSURE: return lclos_eval(e, v);
+  }
+
+  /* the optimized form is evaluated by the tree-walking evaluator */
+  int guard;
+  v = lopt_form(e, v, &guard);
+  lval* x = leval(e, v);
+  lopt_release(guard);
+  return x;
+}
@@ -4,11 +4,34 @@
 #include "env.h"
 #include "val.h"
 
+/**
+ * ENGINES to evaluate the body of functions and top-level forms
+ *
+ *    LENGINE_TREE      walks the lval* tree of the code with leval()
+ *    LENGINE_QUICK     compiles the code into self-rewriting nodes (quick.h)
+ *    LENGINE_CLOSURE   compiles the code into a tree of closures (closure.h)
+ *    LENGINE_IR        lowers the body of functions into an optimized SSA
+ *                      IR and executes it (ir.h), top-level forms are
+ *                      walked as with LENGINE_TREE
+ */
+enum { LENGINE_TREE, LENGINE_QUICK, LENGINE_CLOSURE, LENGINE_IR };
+
+/**
+ * The engine in use (one of the enum 'ENGINES'), chosen at startup
+ */
+extern int lengine;
+
 /**
  * Eval an S-Expression
  */
 lval* leval_sexpr(lenv* e, lval* v);
 
+/**
+ * Apply an S-Expression whose children are already evaluated, the
+ * first child is called with the rest as arguments
+ */
+lval* leval_apply(lenv* e, lval* v);
+
 /**
  * Eval an lval
  */
@@ -19,4 +42,11 @@ lval* leval(lenv* e, lval* v);
  */
 lval* lcall(lenv* e, lval* f, lval* a);
 
+/**
+ * Eval a top-level form (read by load or the repl), the form
+ * is evaluated by the engine in use (and optimized before if
+ * that is the tree-walking evaluator, see opt.h)
+ */
+lval* leval_form(lenv* e, lval* v);
+
 #endif//LISPY_EVAL_H
@@ -6,11 +6,58 @@
 
 struct lenv;
 struct lval;
+struct lcode;
+struct lnode;
+struct lclos;
+struct ljit;
+struct lir;
+struct lins;
+struct lblock;
+struct lseq;
+struct liter;
+struct lbig;
+struct lkern;
+struct lnvec;
+struct lvec;
+struct ldeque;
+struct lheap;
+struct lrtype;
+struct lrecord;
+struct ltable;
+struct lbitset;
+struct lstr;
+struct lhamt;
+struct lbtree;
+struct ldict;
 struct lparser;
 typedef struct lenv lenv;
 typedef struct lval lval;
+typedef struct lcode lcode;
+typedef struct lnode lnode;
+typedef struct lclos lclos;
+typedef struct ljit ljit;
+typedef struct lir lir;
+typedef struct lins lins;
+typedef struct lblock lblock;
+typedef struct lseq lseq;
+typedef struct liter liter;
+typedef struct lbig lbig;
+typedef struct lkern lkern;
+typedef struct lnvec lnvec;
+typedef struct lvec lvec;
+typedef struct ldeque ldeque;
+typedef struct lheap lheap;
+typedef struct lrtype lrtype;
+typedef struct lrecord lrecord;
+typedef struct ltable ltable;
+typedef struct lbitset lbitset;
+typedef struct lstr lstr;
+typedef struct lhamt lhamt;
+typedef struct lbtree lbtree;
+typedef struct ldict ldict;
 typedef struct lparser lparser;
 
 typedef lval*(*lbuiltin)(lenv*, lval*);
+typedef lval*(*lnative)(lenv*);
 
 #endif//LISPY_FWD_H
@@ -0,0 +1,383 @@
+#include "hamt.h"
+#include "dict.h"
+#include "val.h"
+
+#include <string.h>
+
+#if defined(__GNUC__) || defined(__clang__)
+#define LHAMT_POPCOUNT(x) __builtin_popcount(x)
+#else
+#define LHAMT_POPCOUNT(x) _lhamt_popcount(x)
+#endif
+
+/** bits of the hash, the nodes past them have keys of the same hash **/
+#define LHAMT_HASH_BITS 64
+
+/** the child of a node with the given shift a hash is in **/
+#define LHAMT_INDEX(h, shift) ((uint32_t)((h) >> (shift)) & ((1u << LHAMT_BITS) - 1))
+
+/**
+ * An entry of a map, shared by the nodes of every map having it
+ */
+typedef struct lhamt_entry
+{
+  int refs;
+  uint64_t hash;
+  lval* key;
+  lval* val;
+} lhamt_entry;
+
+int _lhamt_popcount(uint32_t x)
+{
+  int n = 0;
+  while (x) {
+    x &= x - 1;
+    n++;
+  }
+  return n;
+}
+
+/* number of entries in the 'data' of a node */
+int _lhamt_ndata(lhamt* h)
+{
+  return h->datamap | h->nodemap ? LHAMT_POPCOUNT(h->datamap) : (int)h->size;
+}
+
+void _lhamt_entry_del(lhamt_entry* x)
+{
+  if (--x->refs == 0) {
+    lval_del(x->key);
+    lval_del(x->val);
+    free(x);
+  }
+}
+
+lhamt* _lhamt_new(void)
+{
+  lhamt* h = malloc(sizeof(lhamt));
+  h->refs = 1;
+  h->size = 0;
+  h->datamap = 0;
+  h->nodemap = 0;
+  h->data = NULL;
+  h->nodes = NULL;
+  return h;
+}
+
+/* frees a node, not what it has */
+void _lhamt_free(lhamt* h)
+{
+  free(h->data);
+  free(h->nodes);
+  free(h);
+}
+
+void lhamt_del(lhamt* h)
+{
+  if (h && --h->refs == 0) {
+    int nd = _lhamt_ndata(h);
+    for (int i = 0; i < nd; i++) {
+      _lhamt_entry_del(h->data[i]);
+    }
+    for (int i = 0; i < LHAMT_POPCOUNT(h->nodemap); i++) {
+      lhamt_del(h->nodes[i]);
+    }
+    _lhamt_free(h);
+  }
+}
+
+lhamt* lhamt_share(lhamt* h)
+{
+  if (h) {
+    h->refs++;
+  }
+  return h;
+}
+
+long lhamt_count(lhamt* h)
+{
+  return h ? h->size : 0;
+}
+
+/* the node to change: h itself if nothing else has it, otherwise a copy */
+lhamt* _lhamt_own(lhamt* h)
+{
+  if (h->refs == 1) {
+    return h;
+  }
+
+  lhamt* c = _lhamt_new();
+  c->size = h->size;
+  c->datamap = h->datamap;
+  c->nodemap = h->nodemap;
+
+  int nd = _lhamt_ndata(h);
+  c->data = malloc(sizeof(lhamt_entry*) * nd);
+  for (int i = 0; i < nd; i++) {
+    c->data[i] = h->data[i];
+    c->data[i]->refs++;
+  }
+  int nn = LHAMT_POPCOUNT(h->nodemap);
+  c->nodes = nn ? malloc(sizeof(lhamt*) * nn) : NULL;
+  for (int i = 0; i < nn; i++) {
+    c->nodes[i] = h->nodes[i];
+    c->nodes[i]->refs++;
+  }
+
+  h->refs--;
+  return c;
+}
+
+/* an array of n pointers with room for one more at index i */
+void* _lhamt_grow(void* a, int n, int i)
+{
+  char* p = realloc(a, sizeof(void*) * (n + 1));
+  memmove(p + sizeof(void*) * (i + 1), p + sizeof(void*) * i, sizeof(void*) * (n - i));
+  return p;
+}
+
+/* removes the pointer at index i of an array of n */
+void _lhamt_erase(void* a, int n, int i)
+{
+  char* p = a;
+  memmove(p + sizeof(void*) * i, p + sizeof(void*) * (i + 1), sizeof(void*) * (n - i - 1));
+}
+
+/* a node with the entry x */
+lhamt* _lhamt_leaf(lhamt_entry* x, int shift)
+{
+  lhamt* h = _lhamt_new();
+  h->size = 1;
+  h->data = malloc(sizeof(lhamt_entry*));
+  h->data[0] = x;
+  if (shift < LHAMT_HASH_BITS) {
+    h->datamap = 1u << LHAMT_INDEX(x->hash, shift);
+  }
+  return h;
+}
+
+/* a node with the entries x and y, of different keys */
+lhamt* _lhamt_pair(lhamt_entry* x, lhamt_entry* y, int shift)
+{
+  if (shift >= LHAMT_HASH_BITS) {
+    lhamt* h = _lhamt_leaf(x, shift);
+    h->data = _lhamt_grow(h->data, 1, 1);
+    h->data[1] = y;
+    h->size = 2;
+    return h;
+  }
+
+  uint32_t i = LHAMT_INDEX(x->hash, shift);
+  uint32_t j = LHAMT_INDEX(y->hash, shift);
+  lhamt* h = _lhamt_new();
+  h->size = 2;
+
+  /* the same bits here, they are told apart further down */
+  if (i == j) {
+    h->nodemap = 1u << i;
+    h->nodes = malloc(sizeof(lhamt*));
+    h->nodes[0] = _lhamt_pair(x, y, shift + LHAMT_BITS);
+    return h;
+  }
+
+  h->datamap = (1u << i) | (1u << j);
+  h->data = malloc(sizeof(lhamt_entry*) * 2);
+  h->data[0] = i < j ? x : y;
+  h->data[1] = i < j ? y : x;
+  return h;
+}
+
+lval* lhamt_get(lhamt* h, lval* k)
+{
+  return h ? lhamt_find(h, k, ldict_hash(k)) : NULL;
+}
+
+lval* lhamt_find(lhamt* h, lval* k, uint64_t hash)
+{
+  for (int shift = 0; h; shift += LHAMT_BITS) {
+    if (shift >= LHAMT_HASH_BITS) {
+      for (long i = 0; i < h->size; i++) {
+        if (lval_eq(h->data[i]->key, k)) {
+          return h->data[i]->val;
+        }
+      }
+      return NULL;
+    }
+
+    uint32_t bit = 1u << LHAMT_INDEX(hash, shift);
+    if (h->datamap & bit) {
+      lhamt_entry* x = h->data[LHAMT_POPCOUNT(h->datamap & (bit - 1))];
+      return x->hash == hash && lval_eq(x->key, k) ? x->val : NULL;
+    }
+    h = h->nodemap & bit ? h->nodes[LHAMT_POPCOUNT(h->nodemap & (bit - 1))] : NULL;
+  }
+
+  return NULL;
+}
+
+/* the node h with the entry x, which replaces the one of its key if any */
+lhamt* _lhamt_put(lhamt* h, lhamt_entry* x, int shift, int* added)
+{
+  h = _lhamt_own(h);
+
+  if (shift >= LHAMT_HASH_BITS) {
+    for (long i = 0; i < h->size; i++) {
+      if (lval_eq(h->data[i]->key, x->key)) {
+        _lhamt_entry_del(h->data[i]);
+        h->data[i] = x;
+        return h;
+      }
+    }
+    h->data = _lhamt_grow(h->data, h->size, h->size);
+    h->data[h->size++] = x;
+    *added = 1;
+    return h;
+  }
+
+  uint32_t bit = 1u << LHAMT_INDEX(x->hash, shift);
+  int i = LHAMT_POPCOUNT(h->datamap & (bit - 1));
+  int j = LHAMT_POPCOUNT(h->nodemap & (bit - 1));
+
+  if (h->datamap & bit) {
+    lhamt_entry* y = h->data[i];
+    if (y->hash == x->hash && lval_eq(y->key, x->key)) {
+      _lhamt_entry_del(y);
+      h->data[i] = x;
+      return h;
+    }
+
+    /* another key with the same bits here, both go to a new node below */
+    _lhamt_erase(h->data, LHAMT_POPCOUNT(h->datamap), i);
+    h->datamap &= ~bit;
+    h->nodes = _lhamt_grow(h->nodes, LHAMT_POPCOUNT(h->nodemap), j);
+    h->nodes[j] = _lhamt_pair(y, x, shift + LHAMT_BITS);
+    h->nodemap |= bit;
+    h->size++;
+    *added = 1;
+    return h;
+  }
+
+  if (h->nodemap & bit) {
+    h->nodes[j] = _lhamt_put(h->nodes[j], x, shift + LHAMT_BITS, added);
+    h->size += *added;
+    return h;
+  }
+
+  h->data = _lhamt_grow(h->data, LHAMT_POPCOUNT(h->datamap), i);
+  h->data[i] = x;
+  h->datamap |= bit;
+  h->size++;
+  *added = 1;
+  return h;
+}
+
+lhamt* lhamt_put(lhamt* h, lval* k, lval* v)
+{
+  lhamt_entry* x = malloc(sizeof(lhamt_entry));
+  x->refs = 1;
+  x->hash = ldict_hash(k);
+  x->key = k;
+  x->val = v;
+
+  if (!h) {
+    return _lhamt_leaf(x, 0);
+  }
+  int added = 0;
+  return _lhamt_put(h, x, 0, &added);
+}
+
+/* the node h without the key k, which is in it (NULL if none is left) */
+lhamt* _lhamt_remove(lhamt* h, lval* k, uint64_t hash, int shift)
+{
+  h = _lhamt_own(h);
+  h->size--;
+
+  if (shift >= LHAMT_HASH_BITS) {
+    for (int i = 0; i <= h->size; i++) {
+      if (lval_eq(h->data[i]->key, k)) {
+        _lhamt_entry_del(h->data[i]);
+        _lhamt_erase(h->data, h->size + 1, i);
+        break;
+      }
+    }
+  } else {
+    uint32_t bit = 1u << LHAMT_INDEX(hash, shift);
+    int i = LHAMT_POPCOUNT(h->datamap & (bit - 1));
+    int j = LHAMT_POPCOUNT(h->nodemap & (bit - 1));
+
+    if (h->datamap & bit) {
+      _lhamt_entry_del(h->data[i]);
+      _lhamt_erase(h->data, LHAMT_POPCOUNT(h->datamap), i);
+      h->datamap &= ~bit;
+    } else {
+      lhamt* c = _lhamt_remove(h->nodes[j], k, hash, shift + LHAMT_BITS);
+
+      /* a node left with one entry is not kept, the entry comes up here */
+      if (!c || (c->size == 1 && !c->nodemap)) {
+        _lhamt_erase(h->nodes, LHAMT_POPCOUNT(h->nodemap), j);
+        h->nodemap &= ~bit;
+      } else {
+        h->nodes[j] = c;
+      }
+      if (c && !(h->nodemap & bit)) {
+        lhamt_entry* x = c->data[0];
+        x->refs++;
+        lhamt_del(c);
+        h->data = _lhamt_grow(h->data, LHAMT_POPCOUNT(h->datamap), i);
+        h->data[i] = x;
+        h->datamap |= bit;
+      }
+    }
+  }
+
+  if (h->size == 0) {
+    _lhamt_free(h);
+    return NULL;
+  }
+  return h;
+}
+
+lhamt* lhamt_remove(lhamt* h, lval* k)
+{
+  if (!lhamt_get(h, k)) {
+    return h;
+  }
+  return _lhamt_remove(h, k, ldict_hash(k), 0);
+}
+
+int lhamt_nth(lhamt* h, long i, lval** k, lval** v)
+{
+  if (!h || i < 0 || i >= h->size) {
+    return 0;
+  }
+
+  /* down to the node with the entry, by the sizes of the ones before it */
+  while (h->datamap | h->nodemap) {
+    lhamt* down = NULL;
+    int d = 0;
+    int n = 0;
+    for (int b = 0; b < (1 << LHAMT_BITS) && !down; b++) {
+      uint32_t bit = 1u << b;
+      if (h->datamap & bit) {
+        if (i == 0) {
+          *k = h->data[d]->key;
+          *v = h->data[d]->val;
+          return 1;
+        }
+        i--;
+        d++;
+      } else if (h->nodemap & bit) {
+        if (i < h->nodes[n]->size) {
+          down = h->nodes[n];
+        } else {
+          i -= h->nodes[n++]->size;
+        }
+      }
+    }
+    h = down;
+  }
+
+  *k = h->data[i]->key;
+  *v = h->data[i]->val;
+  return 1;
+}
@@ -0,0 +1,110 @@
+#ifndef LISPY_HAMT_H
+#define LISPY_HAMT_H
+
+#include "fwd.h"
+
+#include <stdint.h>
+
+/**
+ * Number of bits of the hash taken at every level of the trie, a node
+ * has up to 2^LHAMT_BITS children
+ */
+#define LHAMT_BITS 5
+
+/**
+ * A persistent map (a hash array mapped trie), the symbols of an
+ * environment and the entries of an LVAL_MAP
+ *
+ * A map is its root node (NULL when empty): every node, and every entry,
+ * is a counted reference shared by all the maps having it. A change
+ * makes a new map copying only the nodes from the root to the entry (or
+ * changes them in place when nothing else has them), so copying a map is
+ * O(1) and changing it O(log32 n). The keys are those of a dict (see
+ * ldict_can_key()), with their hash kept in the entries.
+ */
+struct lhamt
+{
+  /** number of maps and nodes having the node **/
+  int refs;
+
+  /** number of entries in the node and all the nodes below **/
+  long size;
+
+  /**
+   * the entries and the nodes below, by the LHAMT_BITS of the hash of
+   * the level: the bit i of 'datamap' is set if there is an entry with
+   * those bits being i, in 'data' (in order of i), and the one of
+   * 'nodemap' if there is a node with them, in 'nodes'
+   *
+   * past the last level (of the 64 bits of the hash) 'data' has all the
+   * 'size' entries, whose keys have the same hash
+   */
+  uint32_t datamap;
+  uint32_t nodemap;
+  struct lhamt_entry** data;
+  lhamt** nodes;
+};
+
+/**
+ * Releases a reference to a map (NULL is the empty one)
+ */
+void lhamt_del(lhamt* h);
+
+/**
+ * A new reference to a map, to be released with lhamt_del()
+ */
+lhamt* lhamt_share(lhamt* h);
+
+/**
+ * Number of entries of a map
+ */
+long lhamt_count(lhamt* h);
+
+/**
+ * The value of a key
+ *
+ * return     the value, still owned by the map, or NULL if the key is
+ *            not in it
+ */
+lval* lhamt_get(lhamt* h, lval* k);
+
+/**
+ * The value of a key whose hash (ldict_hash()) is already known, to look
+ * the same key up in several maps hashing it once
+ *
+ * return     the value, still owned by the map, or NULL if the key is
+ *            not in it
+ */
+lval* lhamt_find(lhamt* h, lval* k, uint64_t hash);
+
+/**
+ * Sets the value of a key
+ *
+ * lhamt* h       the map, its reference is given to the new one
+ * lval* k, v     the key (ldict_can_key() is true of it) and its value,
+ *                both taken by the map (or destroyed)
+ *
+ * return     the new map
+ */
+lhamt* lhamt_put(lhamt* h, lval* k, lval* v);
+
+/**
+ * Removes a key
+ *
+ * lhamt* h     the map, its reference is given to the new one
+ *
+ * return     the new map (h itself if the key was not in it)
+ */
+lhamt* lhamt_remove(lhamt* h, lval* k);
+
+/**
+ * The entry with index i (0 to lhamt_count() - 1) in the order of the
+ * trie (that of the bits of the hashes of the keys)
+ *
+ * lval** k, v    set to its key and value, owned by the map
+ *
+ * return     1 (true) if there is one, 0 (false) if i is past the end
+ */
+int lhamt_nth(lhamt* h, long i, lval** k, lval** v);
+
+#endif//LISPY_HAMT_H
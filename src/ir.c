@@ -0,0 +1,1000 @@
+#include "ir.h"
+#include "builtins.h"
+#include "eval.h"
+#include "record.h"
+#include "utils.h"
+
+#include <string.h>
+
+/* builtins with no side effects, their calls can be reused and hoisted */
+lbuiltin _lir_pure[] = {
+  BTNAME(ADD),  BTNAME(SUB),  BTNAME(MUL),  BTNAME(DIV),
+  BTNAME(GT),   BTNAME(GTE),  BTNAME(LT),   BTNAME(LTE),
+  BTNAME(EQ),   BTNAME(NEQ),  BTNAME(HEAD), BTNAME(TAIL),
+  BTNAME(LIST), BTNAME(JOIN),  BTNAME(RECORD_NEW),
+  BTNAME(RECORD_GET), BTNAME(RECORD_IS),
+  NULL
+};
+
+char* _lir_names[] = {
+  "const",   "load", "copy",  "param",
+  "builtin", "call", "check", "nop",
+  "jmp",     "br",   "ret",   "tail"
+};
+
+/**
+ * State of the lowering of a body
+ */
+typedef struct
+{
+  lir* ir;
+
+  /** environment to resolve builtins **/
+  lenv* env;
+
+  /** block where the next instructions go **/
+  int block;
+} lir_build;
+
+int _lir_pure_builtin(lbuiltin b)
+{
+  for (int i = 0; _lir_pure[i]; i++) {
+    if (_lir_pure[i] == b) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+int _lir_block(lir* ir)
+{
+  ir->blocks = realloc(ir->blocks, sizeof(lblock) * (ir->nblocks + 1));
+  lblock* b = &ir->blocks[ir->nblocks];
+  b->count = 0;
+  b->ins = NULL;
+  b->param = -1;
+  return ir->nblocks++;
+}
+
+/* a new instruction, not in any block */
+int _lir_new(lir* ir, int op)
+{
+  ir->ins = realloc(ir->ins, sizeof(lins) * (ir->nins + 1));
+  lins* x = &ir->ins[ir->nins];
+  x->op = op;
+  x->val = NULL;
+  x->slot = -1;
+  x->builtin = NULL;
+  x->epoch = -1;
+  x->nargs = 0;
+  x->args = NULL;
+  x->moves = NULL;
+  x->target[0] = x->target[1] = x->target[2] = -1;
+  x->branch[0] = x->branch[1] = NULL;
+  x->deferred = 0;
+  return ir->nins++;
+}
+
+void _lir_append(lir* ir, int block, int id)
+{
+  lblock* b = &ir->blocks[block];
+  b->ins = realloc(b->ins, sizeof(int) * (b->count + 1));
+  b->ins[b->count++] = id;
+}
+
+int _lir_ins(lir_build* b, int op, lval* val)
+{
+  int id = _lir_new(b->ir, op);
+  b->ir->ins[id].val = val;
+  _lir_append(b->ir, b->block, id);
+  return id;
+}
+
+void _lir_arg(lir* ir, int id, int v)
+{
+  lins* x = &ir->ins[id];
+  x->args = realloc(x->args, sizeof(int) * (x->nargs + 1));
+  x->moves = realloc(x->moves, x->nargs + 1);
+  x->args[x->nargs] = v;
+  x->moves[x->nargs] = 0;
+  x->nargs++;
+}
+
+int _lir_slot(lval* formals, char* sym)
+{
+  int slot = 0;
+  for (int i = 0; i < formals->count; i++) {
+    if (is(formals->cell[i]->sym, KW_VARG)) {
+      continue;
+    }
+    if (is(formals->cell[i]->sym, sym)) {
+      return slot;
+    }
+    slot++;
+  }
+
+  return -1;
+}
+
+int _lir_form(lir_build* b, lval* v, int tail);
+
+int _lir_expr(lir_build* b, lval* v)
+{
+  if (v->type == LVAL_SEXPR) {
+    return _lir_form(b, v, 0);
+  }
+
+  if (v->type == LVAL_SYM) {
+    int id = _lir_ins(b, LIR_LOAD, lval_copy(v));
+    b->ir->ins[id].slot = _lir_slot(b->ir->formals, v->sym);
+    return id;
+  }
+
+  return _lir_ins(b, LIR_CONST, lval_copy(v));
+}
+
+/* the result of a branch, returned or passed to the join block */
+void _lir_leave(lir_build* b, int x, int join)
+{
+  if (x < 0) {
+    return;
+  }
+
+  if (join < 0) {
+    int ret = _lir_ins(b, LIR_RET, NULL);
+    _lir_arg(b->ir, ret, x);
+  } else {
+    int jmp = _lir_ins(b, LIR_JMP, NULL);
+    b->ir->ins[jmp].target[0] = join;
+    _lir_arg(b->ir, jmp, x);
+  }
+}
+
+int _lir_if(lir_build* b, lval* v, lbuiltin builtin, int tail)
+{
+  lir* ir = b->ir;
+  int c = _lir_expr(b, v->cell[1]);
+
+  int br = _lir_ins(b, LIR_BR, lval_copy(v->cell[0]));
+  _lir_arg(ir, br, c);
+  ir->ins[br].builtin = builtin;
+  ir->ins[br].branch[0] = lval_copy(v->cell[2]);
+  ir->ins[br].branch[1] = v->count == 4 ? lval_copy(v->cell[3]) : NULL;
+
+  int yes = _lir_block(ir);
+  int no = _lir_block(ir);
+  int join = tail ? -1 : _lir_block(ir);
+  ir->ins[br].target[0] = yes;
+  ir->ins[br].target[1] = no;
+  ir->ins[br].target[2] = join;
+
+  b->block = yes;
+  _lir_leave(b, _lir_form(b, v->cell[2], tail), join);
+
+  /* with no 'else' branch 'if' evaluates to () */
+  b->block = no;
+  if (v->count == 4) {
+    _lir_leave(b, _lir_form(b, v->cell[3], tail), join);
+  } else {
+    _lir_leave(b, _lir_ins(b, LIR_CONST, lval_sexpr()), join);
+  }
+
+  if (tail) {
+    return -1;
+  }
+
+  b->block = join;
+  int param = _lir_ins(b, LIR_PARAM, NULL);
+  ir->blocks[join].param = param;
+  return param;
+}
+
+/* lowers the children of v from the child 'from' as the operands of id */
+void _lir_operands(lir_build* b, lval* v, int from, int isdef, int id)
+{
+  for (int i = from; i < v->count; i++) {
+    int x;
+    if (isdef && i == 1 && v->cell[1]->type == LVAL_SYM) {
+      x = _lir_ins(b, LIR_CONST, lval_copy(v->cell[1]));
+    } else {
+      x = _lir_expr(b, v->cell[i]);
+    }
+    _lir_arg(b->ir, id, x);
+  }
+}
+
+/**
+ * Lowers a form (or the cells of a Q-Expression), returns its value or
+ * -1 if the form is in tail position and the block already returns
+ */
+int _lir_form(lir_build* b, lval* v, int tail)
+{
+  lir* ir = b->ir;
+
+  /* expression with no children */
+  if (v->count == 0) {
+    return _lir_ins(b, LIR_CONST, lval_sexpr());
+  }
+
+  /* expression with just one children: return that children */
+  if (v->count == 1) {
+    int x = _lir_expr(b, v->cell[0]);
+    int id = _lir_ins(b, LIR_COPY, NULL);
+    _lir_arg(ir, id, x);
+    return id;
+  }
+
+  /* for definitions (def and =) a symbol in the second child is not evaluated */
+  int isdef = (v->cell[0]->type == LVAL_SYM)
+           && (is(v->cell[0]->sym, KW_GDEF) || is(v->cell[0]->sym, KW_LDEF));
+
+  lval* head = v->cell[0];
+  lval* f = NULL;
+  if (head->type == LVAL_SYM && lenv_watched(head->sym)
+      && _lir_slot(ir->formals, head->sym) < 0) {
+    f = lenv_find(b->env, head);
+  }
+
+  /* a call to a builtin by its name */
+  if (f && f->type == LVAL_FUN && f->builtin && is(f->sym, head->sym)) {
+    int branches = (v->count == 3 || v->count == 4);
+    for (int i = 2; i < v->count; i++) {
+      branches = branches && v->cell[i]->type == LVAL_QEXPR;
+    }
+    if (f->builtin == BTNAME(IF) && branches) {
+      return _lir_if(b, v, f->builtin, tail);
+    }
+
+    int id = _lir_new(ir, LIR_BUILTIN);
+    ir->ins[id].val = lval_copy(head);
+    ir->ins[id].builtin = f->builtin;
+    _lir_operands(b, v, 1, isdef, id);
+    _lir_append(ir, b->block, id);
+    return id;
+  }
+
+  /* a call in tail position may be a call to the function itself */
+  int tailcall = tail && ir->loops && head->type == LVAL_SYM;
+
+  int id = _lir_new(ir, tailcall ? LIR_TAIL : LIR_CALL);
+  _lir_operands(b, v, 0, isdef, id);
+  _lir_append(ir, b->block, id);
+
+  return tailcall ? -1 : id;
+}
+
+/* uses of a value use another one */
+void _lir_replace(lir* ir, int from, int to)
+{
+  for (int i = 0; i < ir->nins; i++) {
+    for (int k = 0; k < ir->ins[i].nargs; k++) {
+      if (ir->ins[i].args[k] == from) {
+        ir->ins[i].args[k] = to;
+      }
+    }
+  }
+}
+
+void _lir_nop(lir* ir, int id)
+{
+  lins* x = &ir->ins[id];
+  x->op = LIR_NOP;
+  x->nargs = 0;
+}
+
+lins* _lir_last(lir* ir, int block)
+{
+  lblock* b = &ir->blocks[block];
+  return &ir->ins[b->ins[b->count - 1]];
+}
+
+/* calls that may do anything (bind any symbol, rebind builtins) */
+int _lir_clobbers(lins* x)
+{
+  return x->op == LIR_CALL || (x->op == LIR_BUILTIN && !_lir_pure_builtin(x->builtin));
+}
+
+void _lir_copyprop(lir* ir)
+{
+  for (int i = 0; i < ir->nins; i++) {
+    if (ir->ins[i].op == LIR_COPY) {
+      _lir_replace(ir, i, ir->ins[i].args[0]);
+      _lir_nop(ir, i);
+    }
+  }
+
+  /* a parameter set to the same value by every jump is that value */
+  for (int b = 0; b < ir->nblocks; b++) {
+    int p = ir->blocks[b].param;
+    if (p < 0) {
+      continue;
+    }
+
+    int same = -1;
+    int trivial = 1;
+    for (int k = 0; k < ir->nblocks && trivial; k++) {
+      lins* x = _lir_last(ir, k);
+      if (x->op == LIR_BR && x->target[2] == b) {
+        trivial = 0;
+      }
+      if (x->op == LIR_JMP && x->target[0] == b && x->nargs) {
+        trivial = (same < 0 || same == x->args[0]) && x->args[0] != p;
+        same = x->args[0];
+      }
+    }
+
+    if (trivial && same >= 0) {
+      for (int k = 0; k < ir->nblocks; k++) {
+        lins* x = _lir_last(ir, k);
+        if (x->op == LIR_JMP && x->target[0] == b) {
+          x->nargs = 0;
+        }
+      }
+      _lir_replace(ir, p, same);
+      _lir_nop(ir, p);
+      ir->blocks[b].param = -1;
+    }
+  }
+}
+
+/* the same value, computed the same way from the same operands (or an equal constant) */
+int _lir_same(lins* x, lins* y)
+{
+  if (x->op != y->op || x->nargs != y->nargs || x->builtin != y->builtin) {
+    return 0;
+  }
+  if (x->op == LIR_CONST) {
+    return x->val->type == y->val->type && lval_eq(x->val, y->val);
+  }
+  if (!is(x->val->sym, y->val->sym)) {
+    return 0;
+  }
+
+  for (int k = 0; k < x->nargs; k++) {
+    if (x->args[k] != y->args[k]) {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+int _lir_npreds(lir* ir, int block, int* pred)
+{
+  int n = 0;
+  for (int k = 0; k < ir->nblocks; k++) {
+    lins* x = _lir_last(ir, k);
+    int to = (x->op == LIR_JMP && x->target[0] == block)
+          || (x->op == LIR_BR && (x->target[0] == block || x->target[1] == block
+                                  || x->target[2] == block))
+          || (x->op == LIR_TAIL && block == 1);
+    if (to) {
+      *pred = k;
+      n++;
+    }
+  }
+
+  return n;
+}
+
+void _lir_cse(lir* ir)
+{
+  int any = 0;
+  for (int i = 0; i < ir->nins; i++) {
+    any = any || _lir_clobbers(&ir->ins[i]);
+  }
+
+  /* values available at the end of every block, and if a call was done before */
+  int** avail = calloc(ir->nblocks, sizeof(int*));
+  int* navail = calloc(ir->nblocks, sizeof(int));
+  int* dirty = calloc(ir->nblocks, sizeof(int));
+  int* table = malloc(sizeof(int) * (ir->nins + 1));
+
+  for (int b = 0; b < ir->nblocks; b++) {
+    int pred = -1;
+    int n = 0;
+    int d = (b > 1) && any;
+
+    /* blocks are created after their single predecessor */
+    if (_lir_npreds(ir, b, &pred) == 1 && pred < b) {
+      n = navail[pred];
+      memcpy(table, avail[pred], sizeof(int) * n);
+      d = dirty[pred];
+    }
+
+    lblock* blk = &ir->blocks[b];
+    for (int k = 0; k < blk->count; k++) {
+      int id = blk->ins[k];
+      lins* x = &ir->ins[id];
+
+      if (x->op == LIR_CONST || x->op == LIR_LOAD
+          || (x->op == LIR_BUILTIN && _lir_pure_builtin(x->builtin))) {
+        int found = -1;
+        for (int t = 0; t < n && found < 0; t++) {
+          if (_lir_same(&ir->ins[table[t]], x)) {
+            found = table[t];
+          }
+        }
+        if (found >= 0) {
+          _lir_replace(ir, id, found);
+          _lir_nop(ir, id);
+        } else {
+          table[n++] = id;
+        }
+      }
+
+      if (_lir_clobbers(x)) {
+        n = 0;
+        d = 1;
+      }
+    }
+
+    /* after a call 'if' may be rebound, and a branch may call anything */
+    if (_lir_last(ir, b)->op == LIR_BR && d) {
+      n = 0;
+    }
+
+    avail[b] = malloc(sizeof(int) * (n + 1));
+    memcpy(avail[b], table, sizeof(int) * n);
+    navail[b] = n;
+    dirty[b] = d;
+  }
+
+  for (int b = 0; b < ir->nblocks; b++) {
+    free(avail[b]);
+  }
+  free(avail);
+  free(navail);
+  free(dirty);
+  free(table);
+}
+
+void _lir_licm(lir* ir)
+{
+  int loop = 0;
+  for (int i = 0; i < ir->nins; i++) {
+    if (_lir_clobbers(&ir->ins[i])) {
+      return;
+    }
+    loop = loop || ir->ins[i].op == LIR_TAIL;
+  }
+
+  if (!loop) {
+    return;
+  }
+
+  char* inv = calloc(ir->nins, 1);
+  for (int k = 0; k < ir->blocks[0].count; k++) {
+    inv[ir->blocks[0].ins[k]] = 1;
+  }
+
+  /* the jump to the header goes after the hoisted instructions */
+  lblock* pre = &ir->blocks[0];
+  int jmp = pre->ins[--pre->count];
+
+  for (int b = 1; b < ir->nblocks; b++) {
+    for (int k = 0; k < ir->blocks[b].count; k++) {
+      int id = ir->blocks[b].ins[k];
+      lins* x = &ir->ins[id];
+
+      int hoist = x->op == LIR_CONST
+               || (x->op == LIR_LOAD && x->slot < 0)
+               || (x->op == LIR_BUILTIN && _lir_pure_builtin(x->builtin));
+      for (int a = 0; a < x->nargs; a++) {
+        hoist = hoist && inv[x->args[a]];
+      }
+      if (!hoist) {
+        continue;
+      }
+
+      /* an error is returned where the instruction was */
+      int op = x->op;
+      int check = _lir_new(ir, op == LIR_CONST ? LIR_NOP : LIR_CHECK);
+      if (op != LIR_CONST) {
+        _lir_arg(ir, check, id);
+        ir->ins[id].deferred = 1;
+      }
+      ir->blocks[b].ins[k] = check;
+
+      inv = realloc(inv, ir->nins);
+      inv[check] = 0;
+      inv[id] = 1;
+      _lir_append(ir, 0, id);
+    }
+  }
+
+  _lir_append(ir, 0, jmp);
+  free(inv);
+}
+
+void _lir_dce(lir* ir)
+{
+  int* uses = malloc(sizeof(int) * ir->nins);
+
+  int changed = 1;
+  while (changed) {
+    changed = 0;
+    memset(uses, 0, sizeof(int) * ir->nins);
+    for (int i = 0; i < ir->nins; i++) {
+      for (int k = 0; k < ir->ins[i].nargs; k++) {
+        uses[ir->ins[i].args[k]]++;
+      }
+    }
+
+    for (int i = 0; i < ir->nins; i++) {
+      lins* x = &ir->ins[i];
+      int safe = x->op == LIR_CONST || x->op == LIR_COPY || x->op == LIR_PARAM
+              || (x->op == LIR_LOAD && x->slot >= 0);
+      if (safe && !uses[i]) {
+        _lir_nop(ir, i);
+        changed = 1;
+      }
+    }
+  }
+
+  /* drop removed instructions (and parameters) from the blocks */
+  for (int b = 0; b < ir->nblocks; b++) {
+    lblock* blk = &ir->blocks[b];
+    int n = 0;
+    for (int k = 0; k < blk->count; k++) {
+      if (ir->ins[blk->ins[k]].op != LIR_NOP) {
+        blk->ins[n++] = blk->ins[k];
+      }
+    }
+    blk->count = n;
+    if (blk->param >= 0 && ir->ins[blk->param].op == LIR_NOP) {
+      blk->param = -1;
+    }
+  }
+
+  free(uses);
+}
+
+/* marks every operand that is the last use of its value */
+void _lir_moves(lir* ir)
+{
+  int nb = ir->nblocks;
+  int n = ir->nins;
+  char* in = calloc(nb * n, 1);
+  char* out = calloc(nb * n, 1);
+  char* live = malloc(n);
+
+  int changed = 1;
+  while (changed) {
+    changed = 0;
+    for (int b = nb - 1; b >= 0; b--) {
+      lins* t = _lir_last(ir, b);
+      int succ[3] = { -1, -1, -1 };
+      if (t->op == LIR_JMP) { succ[0] = t->target[0]; }
+      if (t->op == LIR_BR)  { memcpy(succ, t->target, sizeof(succ)); }
+      if (t->op == LIR_TAIL) { succ[0] = 1; }
+
+      char* o = out + b * n;
+      for (int s = 0; s < 3; s++) {
+        if (succ[s] >= 0) {
+          for (int v = 0; v < n; v++) {
+            o[v] |= in[succ[s] * n + v];
+          }
+        }
+      }
+
+      memcpy(live, o, n);
+      lblock* blk = &ir->blocks[b];
+      for (int k = blk->count - 1; k >= 0; k--) {
+        lins* x = &ir->ins[blk->ins[k]];
+        live[blk->ins[k]] = 0;
+        for (int a = 0; a < x->nargs; a++) {
+          live[x->args[a]] = 1;
+        }
+      }
+
+      if (memcmp(live, in + b * n, n) != 0) {
+        memcpy(in + b * n, live, n);
+        changed = 1;
+      }
+    }
+  }
+
+  for (int b = 0; b < nb; b++) {
+    memcpy(live, out + b * n, n);
+    lblock* blk = &ir->blocks[b];
+    for (int k = blk->count - 1; k >= 0; k--) {
+      lins* x = &ir->ins[blk->ins[k]];
+      live[blk->ins[k]] = 0;
+      for (int a = x->nargs - 1; a >= 0; a--) {
+        x->moves[a] = !live[x->args[a]] && x->op != LIR_CHECK;
+        live[x->args[a]] = 1;
+      }
+    }
+  }
+
+  free(in);
+  free(out);
+  free(live);
+}
+
+int _lir_count(lir* ir)
+{
+  int n = 0;
+  for (int b = 0; b < ir->nblocks; b++) {
+    n += ir->blocks[b].count;
+  }
+  return n;
+}
+
+void lir_print(lir* ir)
+{
+  for (int b = 0; b < ir->nblocks; b++) {
+    printf("b%d:\n", b);
+
+    lblock* blk = &ir->blocks[b];
+    for (int k = 0; k < blk->count; k++) {
+      int id = blk->ins[k];
+      lins* x = &ir->ins[id];
+
+      printf("  ");
+      if (x->op < LIR_JMP && x->op != LIR_CHECK) {
+        printf("v%d = ", id);
+      }
+      printf("%s", _lir_names[x->op]);
+      if (x->val) {
+        putchar(' ');
+        lval_print(x->val);
+      }
+      for (int a = 0; a < x->nargs; a++) {
+        printf(" v%d", x->args[a]);
+      }
+      for (int t = 0; t < 3; t++) {
+        if (x->target[t] >= 0) {
+          printf(" b%d", x->target[t]);
+        }
+      }
+      if (x->deferred) {
+        printf(" (hoisted)");
+      }
+      putchar('\n');
+    }
+  }
+}
+
+lir* lir_compile(lenv* e, lval* f)
+{
+  lir* ir = malloc(sizeof(lir));
+  ir->nins = 0;
+  ir->ins = NULL;
+  ir->nblocks = 0;
+  ir->blocks = NULL;
+  ir->code = f->code;
+  ir->formals = f->code->formals;
+  ir->epoch = -1;
+
+  /* a call to itself binds the formals again, those must be plain and unique */
+  ir->loops = 1;
+  for (int i = 0; i < ir->formals->count; i++) {
+    char* sym = ir->formals->cell[i]->sym;
+    if (is(sym, KW_VARG) || lenv_watched(sym) || _lir_slot(ir->formals, sym) != i) {
+      ir->loops = 0;
+    }
+  }
+
+  lir_build b = { ir, e, 0 };
+  _lir_block(ir);
+  _lir_block(ir);
+  int jmp = _lir_ins(&b, LIR_JMP, NULL);
+  ir->ins[jmp].target[0] = 1;
+
+  b.block = 1;
+  _lir_leave(&b, _lir_form(&b, f->body, 1), -1);
+
+  int dump = lenv_global(e)->dumpir;
+  int before = _lir_count(ir);
+  if (dump) {
+    printf("IR: ");
+    lval_println(f->body);
+    lir_print(ir);
+  }
+
+  _lir_copyprop(ir);
+  _lir_cse(ir);
+  _lir_licm(ir);
+  _lir_dce(ir);
+  _lir_moves(ir);
+
+  if (dump) {
+    printf("  => %d instructions, %d before\n", _lir_count(ir), before);
+    lir_print(ir);
+  }
+
+  return ir;
+}
+
+void lir_del(lir* ir)
+{
+  if (!ir) {
+    return;
+  }
+
+  for (int i = 0; i < ir->nins; i++) {
+    lins* x = &ir->ins[i];
+    if (x->val) {
+      lval_del(x->val);
+    }
+    if (x->branch[0]) {
+      lval_del(x->branch[0]);
+    }
+    if (x->branch[1]) {
+      lval_del(x->branch[1]);
+    }
+    free(x->args);
+    free(x->moves);
+  }
+  for (int b = 0; b < ir->nblocks; b++) {
+    free(ir->blocks[b].ins);
+  }
+  free(ir->ins);
+  free(ir->blocks);
+  free(ir);
+}
+
+int _lir_resolved(lenv* e, lins* x)
+{
+  if (x->epoch == lenv_epoch) {
+    return 1;
+  }
+
+  /* a builtin may have been rebound, look it up again */
+  lval* f = lenv_find(e, x->val);
+  if (f && f->type == LVAL_FUN && f->builtin == x->builtin) {
+    x->epoch = lenv_epoch;
+    return 1;
+  }
+
+  return 0;
+}
+
+/* every builtin called resolves to the builtin it was lowered for */
+int _lir_valid(lenv* e, lir* ir)
+{
+  if (ir->epoch == lenv_epoch) {
+    return 1;
+  }
+
+  for (int i = 0; i < ir->nins; i++) {
+    lins* x = &ir->ins[i];
+    if ((x->op == LIR_BUILTIN || x->op == LIR_BR) && !_lir_resolved(e, x)) {
+      return 0;
+    }
+  }
+
+  ir->epoch = lenv_epoch;
+  return 1;
+}
+
+lval* _lir_take(lval** r, lins* x, int a)
+{
+  int v = x->args[a];
+  if (x->moves[a]) {
+    lval* p = r[v];
+    r[v] = NULL;
+    return p;
+  }
+
+  return lval_copy(r[v]);
+}
+
+void _lir_set(lval** r, int id, lval* v)
+{
+  if (r[id]) {
+    lval_del(r[id]);
+  }
+  r[id] = v;
+}
+
+/* an S-Expression with the operands, from the operand 'from' */
+lval* _lir_sexpr(lval** r, lins* x, int from)
+{
+  lval* v = lval_sexpr();
+  v->count = x->nargs - from;
+  v->cell = malloc(sizeof(lval*) * v->count);
+  for (int a = from; a < x->nargs; a++) {
+    v->cell[a - from] = _lir_take(r, x, a);
+  }
+  return v;
+}
+
+lval* _lir_load(lenv* e, lins* x)
+{
+  /* formals are always bound in the environment of the function itself */
+  lval* v = x->slot >= 0 ? lenv_here(e, x->val) : NULL;
+  if (v) {
+    return lval_copy(v);
+  }
+
+  return lenv_get(e, x->val);
+}
+
+/* calls the builtin, or what its name resolves to */
+lval* _lir_apply(lenv* e, lins* x, lval* a)
+{
+  if (_lir_resolved(e, x)) {
+    return x->builtin(e, a);
+  }
+
+  lval* f = lenv_get(e, x->val);
+  if (f->type == LVAL_ERR) {
+    lval_del(a);
+    return f;
+  }
+
+  lval* v = lval_add(lval_sexpr(), f);
+  while (a->count) {
+    lval_add(v, lval_pop(a, 0));
+  }
+  lval_del(a);
+
+  return leval_apply(e, v);
+}
+
+lval* _lir_builtin(lenv* e, lval** r, lins* x)
+{
+  /* hoisted out of the loop, errors in the operands are returned later */
+  if (x->deferred) {
+    for (int a = 0; a < x->nargs; a++) {
+      if (r[x->args[a]]->type == LVAL_ERR) {
+        return lval_copy(r[x->args[a]]);
+      }
+    }
+  }
+
+  /* (record-get r t i) of a record of type t, the field is read right from it */
+  if (x->builtin == BTNAME(RECORD_GET) && x->nargs == 3 && _lir_resolved(e, x)) {
+    lval* v = r[x->args[0]];
+    lval* t = r[x->args[1]];
+    lval* i = r[x->args[2]];
+    if (v->type == LVAL_RECORD && t->type == LVAL_NUM && i->type == LVAL_NUM
+        && v->rec->type->id == t->num && i->num >= 0 && i->num < v->rec->type->count) {
+      lval* y = lval_copy(v->rec->fields[i->num]);
+      for (int a = 0; a < x->nargs; a++) {
+        if (x->moves[a]) {
+          _lir_set(r, x->args[a], NULL);
+        }
+      }
+      return y;
+    }
+  }
+
+  return _lir_apply(e, x, _lir_sexpr(r, x, 0));
+}
+
+lval* lir_exec(lenv* e, lir* ir)
+{
+  lval* small[LIR_REGS];
+  lval** r = ir->nins > LIR_REGS ? malloc(sizeof(lval*) * ir->nins) : small;
+  for (int i = 0; i < ir->nins; i++) {
+    r[i] = NULL;
+  }
+
+  lval* result = NULL;
+  int b = 0;
+
+  while (!result) {
+    lblock* blk = &ir->blocks[b];
+    int next = -1;
+
+    for (int k = 0; k < blk->count && !result && next < 0; k++) {
+      int id = blk->ins[k];
+      lins* x = &ir->ins[id];
+      lval* y = NULL;
+
+      switch (x->op) {
+        case LIR_CONST:   y = lval_copy(x->val); break;
+        case LIR_LOAD:    y = _lir_load(e, x); break;
+        case LIR_COPY:    y = _lir_take(r, x, 0); break;
+        case LIR_BUILTIN: y = _lir_builtin(e, r, x); break;
+        case LIR_CALL:    y = leval_apply(e, _lir_sexpr(r, x, 0)); break;
+
+        case LIR_CHECK:
+          if (r[x->args[0]]->type == LVAL_ERR) {
+            result = lval_copy(r[x->args[0]]);
+          }
+          continue;
+
+        case LIR_JMP:
+          next = x->target[0];
+          if (x->nargs) {
+            _lir_set(r, ir->blocks[next].param, _lir_take(r, x, 0));
+          }
+          continue;
+
+        case LIR_BR: {
+          lval* c = r[x->args[0]];
+          if (c->type == LVAL_NUM && _lir_resolved(e, x)) {
+            next = x->target[c->num ? 0 : 1];
+            if (x->moves[0]) {
+              _lir_set(r, x->args[0], NULL);
+            }
+            continue;
+          }
+
+          /* not a number (or 'if' rebound), let 'if' handle (or report) it */
+          lval* a = lval_add(lval_sexpr(), _lir_take(r, x, 0));
+          lval_add(a, lval_copy(x->branch[0]));
+          if (x->branch[1]) {
+            lval_add(a, lval_copy(x->branch[1]));
+          }
+          y = _lir_apply(e, x, a);
+          if (y->type == LVAL_ERR || x->target[2] < 0) {
+            result = y;
+          } else {
+            next = x->target[2];
+            _lir_set(r, ir->blocks[next].param, y);
+          }
+          continue;
+        }
+
+        case LIR_RET:
+          result = _lir_take(r, x, 0);
+          continue;
+
+        case LIR_TAIL: {
+          lval* f = r[x->args[0]];
+          int self = f->type == LVAL_FUN && !f->builtin && f->code == ir->code
+                  && f->env->count == 0 && x->nargs - 1 == ir->formals->count;
+          if (!self) {
+            result = leval_apply(e, _lir_sexpr(r, x, 0));
+            continue;
+          }
+
+          /* a call to itself: bind the formals again and loop */
+          for (int a = 1; a < x->nargs; a++) {
+            lval* v = _lir_take(r, x, a);
+            lenv_put(e, ir->formals->cell[a - 1], v);
+            lval_del(v);
+          }
+          if (x->moves[0]) {
+            _lir_set(r, x->args[0], NULL);
+          }
+          next = 1;
+          continue;
+        }
+
+        default:
+          continue;
+      }
+
+      if (y->type == LVAL_ERR && !x->deferred) {
+        result = y;
+      } else {
+        _lir_set(r, id, y);
+      }
+    }
+
+    b = next;
+  }
+
+  for (int i = 0; i < ir->nins; i++) {
+    if (r[i]) {
+      lval_del(r[i]);
+    }
+  }
+  if (r != small) {
+    free(r);
+  }
+
+  return result;
+}
+
+lval* lir_call(lval* f)
+{
+  if (!f->code->ir) {
+    f->code->ir = lir_compile(f->env, f);
+  }
+
+  /* a builtin is not what it was lowered for, evaluate it as it is */
+  if (!_lir_valid(f->env, f->code->ir)) {
+    return BTNAME(EVAL)(f->env, lval_add(lval_sexpr(), lval_copy(f->body)));
+  }
+
+  return lir_exec(f->env, f->code->ir);
+}
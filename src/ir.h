@@ -0,0 +1,182 @@
+#ifndef LISPY_IR_H
+#define LISPY_IR_H
+
+#include "env.h"
+#include "val.h"
+
+/**
+ * Number of registers kept in the C stack when executing, functions
+ * with more instructions allocate their registers
+ */
+#define LIR_REGS 64
+
+/**
+ * OPERATIONS of the instructions of the IR
+ *
+ *    LIR_CONST     a copy of a constant (val)
+ *    LIR_LOAD      the value of a symbol (val), read from the environment
+ *                  of the function (not its parents) if it is a formal
+ *    LIR_COPY      the value of its operand
+ *    LIR_PARAM     the parameter of a block (a phi), set by every jump
+ *                  to the block
+ *    LIR_BUILTIN   a call to a builtin by its name (val), while the name
+ *                  resolves to it, otherwise a call to what it resolves to
+ *    LIR_CALL      applies its first operand to the rest (leval_apply)
+ *    LIR_CHECK     returns its operand if it is an error (left where a
+ *                  hoisted instruction was)
+ *    LIR_NOP       nothing (removed instructions)
+ *
+ * and the last instruction of every block:
+ *
+ *    LIR_JMP       jumps to target[0], its operand (if any) is the
+ *                  parameter of that block
+ *    LIR_BR        an 'if' with literal branches: jumps to target[0] or
+ *                  target[1], the result of the branch is the parameter
+ *                  of target[2] (or is returned if there is no target[2])
+ *    LIR_RET       returns its operand
+ *    LIR_TAIL      a call in tail position: if the function called is the
+ *                  one being executed its formals are bound again and it
+ *                  jumps to the header of the function (a loop), otherwise
+ *                  returns the result of the call
+ */
+enum {  LIR_CONST,   LIR_LOAD, LIR_COPY,  LIR_PARAM,
+        LIR_BUILTIN, LIR_CALL, LIR_CHECK, LIR_NOP,
+        LIR_JMP,     LIR_BR,   LIR_RET,   LIR_TAIL };
+
+/**
+ * An instruction, its result is the value with its index
+ */
+struct lins
+{
+  /** the operation (one of the enum 'OPERATIONS') **/
+  int op;
+
+  /** the constant, or the symbol loaded or called **/
+  lval* val;
+
+  /** index of the formal loaded among the formals of the function, or -1 **/
+  int slot;
+
+  /** builtin called, and the value of lenv_epoch when resolved **/
+  lbuiltin builtin;
+  long epoch;
+
+  /** operands (values), and if each operand is its last use **/
+  int nargs;
+  int* args;
+  char* moves;
+
+  /** blocks jumped to **/
+  int target[3];
+
+  /** literal branches of LIR_BR, for when it can not branch itself **/
+  lval* branch[2];
+
+  /** hoisted out of the loop, an error is returned by a LIR_CHECK **/
+  int deferred;
+};
+
+/**
+ * A basic block
+ */
+struct lblock
+{
+  /** the instructions (indexes), the last one jumps or returns **/
+  int count;
+  int* ins;
+
+  /** the LIR_PARAM of the block, or -1 **/
+  int param;
+};
+
+/**
+ * The body of a function in SSA form
+ *
+ * A body is lowered into basic blocks (an 'if' with literal branches
+ * is a branch and a join block whose parameter is the result) where
+ * every value is defined once by an instruction. Block 0 jumps to
+ * block 1, the header of the function, and a call to the function
+ * itself in tail position jumps back to the header.
+ *
+ * The optimizations run in order:
+ *
+ *    - copy propagation: uses of LIR_COPY (and of parameters set to
+ *      the same value by every jump) use the original value
+ *
+ *    - common subexpression elimination: a load, or a call to a pure
+ *      builtin, with the same operands of one done before in the same
+ *      block (or in a single predecessor) and with no call between
+ *      them uses that value
+ *
+ *    - loop-invariant hoisting: in a tail loop with no calls, constants,
+ *      loads of non-formals and calls to pure builtins of those are
+ *      done once in block 0
+ *
+ *    - dead code elimination: removed instructions and those whose
+ *      result is never used (and can not fail) are dropped
+ *
+ * A call (or =, def, eval...) may bind any symbol or rebind a builtin,
+ * so no load is reused across one and a function with calls is never
+ * hoisted from. When a builtin name is rebound the IR is not used until
+ * it resolves to the same builtin again (guarded by lenv_epoch).
+ */
+struct lir
+{
+  /** instructions, blocks **/
+  int nins;
+  lins* ins;
+  int nblocks;
+  lblock* blocks;
+
+  /** the code of the function, to know a call to itself **/
+  lcode* code;
+
+  /** formals (symbols), the function loops only if it can bind them again **/
+  lval* formals;
+  int loops;
+
+  /** value of lenv_epoch when every builtin called was checked **/
+  long epoch;
+};
+
+/**
+ * Lowers the body of a function into the IR and optimizes it
+ *
+ * lenv* e        the environment to resolve builtins in
+ * lval* f        the function
+ *
+ * return     the IR
+ */
+lir* lir_compile(lenv* e, lval* f);
+
+/**
+ * Destroys the IR of a function
+ */
+void lir_del(lir* ir);
+
+/**
+ * Prints the IR of a function
+ */
+void lir_print(lir* ir);
+
+/**
+ * Executes the IR of a function
+ *
+ * lenv* e      the environment of the function, its formals bound
+ * lir* ir      the IR
+ *
+ * return       the resulting value
+ */
+lval* lir_exec(lenv* e, lir* ir);
+
+/**
+ * Evaluates the body of a function with all its formals bound, the
+ * body is compiled the first time and shared by every copy of f
+ *
+ * lval* f    the function, its environment ready to evaluate the body
+ *
+ * return     the resulting value
+ */
+lval* lir_call(lval* f);
+
+#endif//LISPY_IR_H
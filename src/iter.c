@@ -0,0 +1,180 @@
+#include "iter.h"
+#include "bitset.h"
+#include "dict.h"
+#include "nvec.h"
+#include "queue.h"
+#include "seq.h"
+#include "str.h"
+#include "table.h"
+#include "vec.h"
+
+#include <string.h>
+
+int liter_can(lval* v)
+{
+  return v->type == LVAL_QEXPR || v->type == LVAL_RANGE
+      || v->type == LVAL_STR || v->type == LVAL_LAZYSEQ
+      || v->type == LVAL_F64VEC || v->type == LVAL_I64VEC
+      || v->type == LVAL_MATRIX || v->type == LVAL_DICT
+      || v->type == LVAL_MAP || v->type == LVAL_SMAP
+      || v->type == LVAL_SSET || v->type == LVAL_VEC
+      || v->type == LVAL_DEQUE || v->type == LVAL_PQUEUE
+      || v->type == LVAL_TABLE || v->type == LVAL_BITSET;
+}
+
+void liter_init(liter* it, lval* v)
+{
+  it->coll = v;
+  it->file = NULL;
+  it->i = 0;
+  it->seq = NULL;
+  it->err = NULL;
+
+  if (v->type == LVAL_LAZYSEQ) {
+    it->seq = v->seq;
+    it->seq->refs++;
+  }
+}
+
+void liter_file(liter* it, FILE* file)
+{
+  it->coll = NULL;
+  it->file = file;
+  it->i = 0;
+  it->seq = NULL;
+  it->err = NULL;
+}
+
+/* the next line of the file, of any length and with any byte, a '\0' too */
+lval* _liter_line(FILE* file)
+{
+  size_t size = 256;
+  size_t len = 0;
+  char* line = malloc(size);
+  int c;
+  while ((c = getc(file)) != EOF) {
+    if (len == size) {
+      size *= 2;
+      line = realloc(line, size);
+    }
+    line[len++] = (char)c;
+    if (c == '\n') {
+      break;
+    }
+  }
+  if (len == 0) {
+    free(line);
+    return NULL;
+  }
+
+  /* without the end of line */
+  while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) {
+    len--;
+  }
+  lval* v = lval_strn(line, len);
+  free(line);
+  return v;
+}
+
+lval* liter_next(lenv* e, liter* it)
+{
+  if (it->file) {
+    return _liter_line(it->file);
+  }
+
+  if (it->seq) {
+    it->err = lseq_force(e, it->seq);
+    if (it->err || it->seq->state == LSEQ_END) {
+      return NULL;
+    }
+
+    /* the cells gone past are freed, unless something else has them */
+    lval* v = lval_copy(it->seq->head);
+    lseq* tail = it->seq->tail;
+    tail->refs++;
+    lseq_del(it->seq);
+    it->seq = tail;
+    return v;
+  }
+
+  lval* c = it->coll;
+  switch (c->type) {
+    case LVAL_RANGE:
+      return it->i < c->len ? lval_num(lval_range_at(c, it->i++)) : NULL;
+
+    case LVAL_STR:
+      return it->i < c->str->len ? lval_strn(c->str->bytes + it->i++, 1) : NULL;
+
+    case LVAL_QEXPR:
+      return it->i < c->count ? lval_copy(c->cell[it->i++]) : NULL;
+
+    case LVAL_VEC:
+      return it->i < c->mvec->len ? lval_copy(c->mvec->items[it->i++]) : NULL;
+
+    case LVAL_DEQUE:
+      return it->i < c->deque->len ? lval_copy(ldeque_get(c->deque, it->i++)) : NULL;
+
+    case LVAL_PQUEUE:
+      return it->i < c->heap->len ? lval_copy(c->heap->items[it->i++]) : NULL;
+
+    /* i is where to look for the next member, the ones added before it are left out */
+    case LVAL_BITSET: {
+      long i = it->i >= 0 ? lbitset_next(c->bits, it->i) : -1;
+      it->i = i >= 0 ? i + 1 : -1;
+      return i >= 0 ? lval_num(i) : NULL;
+    }
+
+    case LVAL_F64VEC:
+      return it->i < c->vec->len ? lval_float(c->vec->f[it->i++]) : NULL;
+
+    case LVAL_I64VEC:
+      return it->i < c->vec->len ? lval_num((long)c->vec->i[it->i++]) : NULL;
+
+    case LVAL_MATRIX: {
+      if (it->i == c->rows) {
+        return NULL;
+      }
+      lnvec* row = lnvec_new(c->cols);
+      memcpy(row->f, c->vec->f + it->i++ * c->cols, sizeof(double) * c->cols);
+      return lval_nvec(LVAL_F64VEC, row);
+    }
+
+    /* a row of a table is the list of its cells */
+    case LVAL_TABLE: {
+      if (it->i == c->table->rows) {
+        return NULL;
+      }
+      lval* row = lval_qexpr();
+      for (int k = 0; k < c->table->count; k++) {
+        lval_add(row, ltable_cell(c->table, k, it->i));
+      }
+      it->i++;
+      return row;
+    }
+
+    case LVAL_DICT:
+    case LVAL_MAP:
+    case LVAL_SMAP:
+    case LVAL_SSET: {
+      lval* k;
+      lval* v;
+      if (!lval_entry(c, &it->i, &k, &v)) {
+        return NULL;
+      }
+      if (c->type == LVAL_SSET) {
+        return lval_copy(k);
+      }
+      return lval_add(lval_add(lval_qexpr(), lval_copy(k)), lval_copy(v));
+    }
+  }
+
+  return NULL;
+}
+
+void liter_done(liter* it)
+{
+  if (it->seq) {
+    lseq_del(it->seq);
+    it->seq = NULL;
+  }
+}
@@ -0,0 +1,86 @@
+#ifndef LISPY_ITER_H
+#define LISPY_ITER_H
+
+#include "env.h"
+#include "val.h"
+
+/**
+ * A cursor over the elements of a collection, every builtin consuming a
+ * collection takes its elements one at a time from one of these, so
+ * none needs the collection to be a list:
+ *
+ *    LVAL_QEXPR      its children
+ *    LVAL_RANGE      its numbers
+ *    LVAL_STR        its characters (as Strings)
+ *    LVAL_F64VEC     its numbers (as Floats)
+ *    LVAL_I64VEC     its numbers
+ *    LVAL_MATRIX     its rows (as F64 Vectors)
+ *    LVAL_DICT       its entries (as lists {key value}), in no order
+ *    LVAL_MAP        its entries (as lists {key value}), in no order
+ *    LVAL_SMAP       its entries (as lists {key value}), by their keys
+ *    LVAL_SSET       its elements, in order
+ *    LVAL_VEC        its elements, the ones there are as each one is
+ *                    taken (it can be changed while going through it)
+ *    LVAL_DEQUE      its elements, front to back, as a vector
+ *    LVAL_PQUEUE     its elements, in the order of its heap (only the
+ *                    first one is sure to be the least), as a vector
+ *    LVAL_TABLE      its rows (as lists of their cells)
+ *    LVAL_BITSET     its members, in order, the ones there are as each
+ *                    one is taken (like a vector)
+ *    LVAL_LAZYSEQ    its elements, computed as they are taken (a user
+ *                    defined generator is one of these)
+ *    a file          its lines (as Strings), without the end of line
+ */
+struct liter
+{
+  /** the collection, or the file **/
+  lval* coll;
+  FILE* file;
+
+  /** index of the next element of the collection **/
+  long i;
+
+  /** the cell of the sequence to take next, and the error forcing it **/
+  lseq* seq;
+  lval* err;
+};
+
+/**
+ * If the elements of a value can be taken with a cursor
+ */
+int liter_can(lval* v);
+
+/**
+ * Starts a cursor over a collection
+ *
+ * liter* it    the cursor
+ * lval* v      the collection (one liter_can() is true of), it is not
+ *              consumed and must be kept until the cursor is done with
+ *              it, but a Lazy Sequence: the cursor has its own reference
+ *              to the sequence, so if v is destroyed the elements taken
+ *              are freed as it goes
+ */
+void liter_init(liter* it, lval* v);
+
+/**
+ * Starts a cursor over the lines of a file, open for reading
+ */
+void liter_file(liter* it, FILE* file);
+
+/**
+ * Takes the next element
+ *
+ * lenv* e      the environment to compute the elements of a sequence in
+ * liter* it    the cursor
+ *
+ * return     the element, or NULL if there are no more or it->err is
+ *            set (the error computing the element, owned by the caller)
+ */
+lval* liter_next(lenv* e, liter* it);
+
+/**
+ * Releases what the cursor has (not the collection nor the file)
+ */
+void liter_done(liter* it);
+
+#endif//LISPY_ITER_H
@@ -0,0 +1,654 @@
+#if defined(__x86_64__) && defined(__linux__)
+#define LJIT_X64 1
+#define _DEFAULT_SOURCE
+#endif
+
+#include "jit.h"
+#include "builtins.h"
+#include "utils.h"
+
+int ljit_enabled = 0;
+
+#ifdef LJIT_X64
+
+#include <stdarg.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/* set by the compiled code when it bails out */
+char _ljit_bail = 0;
+
+/**
+ * OPERATIONS compiled inline, in the order of _ljit_ops
+ */
+enum {  LJOP_ADD, LJOP_SUB, LJOP_MUL, LJOP_DIV,
+        LJOP_GT,  LJOP_GTE, LJOP_LT,  LJOP_LTE,
+        LJOP_EQ,  LJOP_NEQ };
+
+lbuiltin _ljit_ops[] = {
+  BTNAME(ADD), BTNAME(SUB), BTNAME(MUL), BTNAME(DIV),
+  BTNAME(GT),  BTNAME(GTE), BTNAME(LT),  BTNAME(LTE),
+  BTNAME(EQ),  BTNAME(NEQ),
+  NULL
+};
+
+/* setcc of every order or equality operation */
+unsigned char _ljit_setcc[] = {
+  0, 0, 0, 0,
+  0x9F, 0x9D, 0x9C, 0x9E,
+  0x94, 0x95
+};
+
+/**
+ * State of the compilation of a function
+ */
+typedef struct
+{
+  /** environment to resolve the names called **/
+  lenv* env;
+
+  /** the function being compiled **/
+  ljit* jit;
+  lval* formals;
+
+  /** the code emitted so far **/
+  unsigned char* code;
+  int len;
+  int cap;
+
+  /** 8 bytes slots pushed on the stack, to keep calls aligned **/
+  int depth;
+
+  /** jumps to be patched to the bail out code **/
+  int* bails;
+  int nbails;
+} ljit_asm;
+
+void _ljit_emit(ljit_asm* a, int n, ...)
+{
+  if (a->len + n > a->cap) {
+    a->cap = (a->cap + n) * 2;
+    a->code = realloc(a->code, a->cap);
+  }
+
+  va_list va;
+  va_start(va, n);
+  for (int i = 0; i < n; i++) {
+    a->code[a->len++] = (unsigned char)va_arg(va, int);
+  }
+  va_end(va);
+}
+
+void _ljit_imm32(ljit_asm* a, int x)
+{
+  unsigned int u = (unsigned int)x;
+  _ljit_emit(a, 4, u & 0xFF, (u >> 8) & 0xFF, (u >> 16) & 0xFF, (u >> 24) & 0xFF);
+}
+
+void _ljit_imm64(ljit_asm* a, long x)
+{
+  unsigned long u = (unsigned long)x;
+  _ljit_imm32(a, (int)(u & 0xFFFFFFFF));
+  _ljit_imm32(a, (int)(u >> 32));
+}
+
+/* mov rax, x */
+void _ljit_movrax(ljit_asm* a, long x)
+{
+  _ljit_emit(a, 2, 0x48, 0xB8);
+  _ljit_imm64(a, x);
+}
+
+/* mov rcx, x */
+void _ljit_movrcx(ljit_asm* a, long x)
+{
+  _ljit_emit(a, 2, 0x48, 0xB9);
+  _ljit_imm64(a, x);
+}
+
+/**
+ * Emits the opcode of a jump with a rel32 to be patched
+ * later, returns the position of that rel32
+ */
+int _ljit_jump(ljit_asm* a, int n, int op0, int op1)
+{
+  if (n == 1) {
+    _ljit_emit(a, 1, op0);
+  } else {
+    _ljit_emit(a, 2, op0, op1);
+  }
+  _ljit_imm32(a, 0);
+  return a->len - 4;
+}
+
+/* patches the jump at 'at' to land at the end of the code */
+void _ljit_patch(ljit_asm* a, int at)
+{
+  int rel = a->len - (at + 4);
+  memcpy(a->code + at, &rel, 4);
+}
+
+/* jne bail (or je bail, jo bail) */
+void _ljit_jbail(ljit_asm* a, int op)
+{
+  a->bails = realloc(a->bails, sizeof(int) * (a->nbails + 1));
+  a->bails[a->nbails++] = _ljit_jump(a, 2, 0x0F, op);
+}
+
+void _ljit_push(ljit_asm* a)
+{
+  _ljit_emit(a, 1, 0x50);
+  a->depth++;
+}
+
+/* mov rcx, rax ; pop rax */
+void _ljit_pop2(ljit_asm* a)
+{
+  _ljit_emit(a, 4, 0x48, 0x89, 0xC1, 0x58);
+  a->depth--;
+}
+
+/* lea rsp, [rbp-16] ; pop r12 ; pop rbx ; pop rbp ; ret */
+void _ljit_ret(ljit_asm* a)
+{
+  _ljit_emit(a, 9, 0x48, 0x8D, 0x65, 0xF0, 0x41, 0x5C, 0x5B, 0x5D, 0xC3);
+}
+
+void _ljit_add(lval*** syms, int* count, lval* sym)
+{
+  *syms = realloc(*syms, sizeof(lval*) * (*count + 1));
+  (*syms)[(*count)++] = lval_copy(sym);
+}
+
+int _ljit_find(lval** syms, int count, char* sym)
+{
+  for (int i = 0; i < count; i++) {
+    if (is(syms[i]->sym, sym)) {
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+/* index of a formal, or -1 */
+int _ljit_slot(lval* formals, char* sym)
+{
+  return _ljit_find(formals->cell, formals->count, sym);
+}
+
+/* number of formals, or -1 if those can not be passed in order */
+int _ljit_arity(lval* formals)
+{
+  if (formals->count > LJIT_MAX_ARGS) {
+    return -1;
+  }
+
+  for (int i = 0; i < formals->count; i++) {
+    if (is(formals->cell[i]->sym, KW_VARG)
+        || _ljit_slot(formals, formals->cell[i]->sym) != i) {
+      return -1;
+    }
+  }
+
+  return formals->count;
+}
+
+int _ljit_compile(lenv* e, lval* f);
+int _ljit_form(ljit_asm* a, lval* v);
+
+int _ljit_expr(ljit_asm* a, lval* v)
+{
+  if (v->type == LVAL_NUM) {
+    _ljit_movrax(a, v->num);
+    return 1;
+  }
+
+  if (v->type == LVAL_SYM) {
+    int slot = _ljit_slot(a->formals, v->sym);
+    if (slot < 0) {
+      return 0;
+    }
+
+    /* mov rax, [rbx + 8*slot] */
+    _ljit_emit(a, 3, 0x48, 0x8B, 0x83);
+    _ljit_imm32(a, 8 * slot);
+    return 1;
+  }
+
+  if (v->type == LVAL_SEXPR) {
+    return _ljit_form(a, v);
+  }
+
+  return 0;
+}
+
+int _ljit_arith(ljit_asm* a, int op, lval* v)
+{
+  if (!_ljit_expr(a, v->cell[1])) {
+    return 0;
+  }
+
+  /* neg rax ; jo bail */
+  if (op == LJOP_SUB && v->count == 2) {
+    _ljit_emit(a, 3, 0x48, 0xF7, 0xD8);
+    _ljit_jbail(a, 0x80);
+  }
+
+  for (int i = 2; i < v->count; i++) {
+    _ljit_push(a);
+    if (!_ljit_expr(a, v->cell[i])) {
+      return 0;
+    }
+    _ljit_pop2(a);
+
+    /* on an overflow (jo bail) the builtin makes it a bignum */
+    switch (op) {
+      /* add rax, rcx ; jo bail */
+      case LJOP_ADD:
+        _ljit_emit(a, 3, 0x48, 0x01, 0xC8);
+        _ljit_jbail(a, 0x80);
+        break;
+      /* sub rax, rcx ; jo bail */
+      case LJOP_SUB:
+        _ljit_emit(a, 3, 0x48, 0x29, 0xC8);
+        _ljit_jbail(a, 0x80);
+        break;
+      /* imul rax, rcx ; jo bail */
+      case LJOP_MUL:
+        _ljit_emit(a, 4, 0x48, 0x0F, 0xAF, 0xC1);
+        _ljit_jbail(a, 0x80);
+        break;
+      case LJOP_DIV:
+        /* test rcx, rcx ; je bail */
+        _ljit_emit(a, 3, 0x48, 0x85, 0xC9);
+        _ljit_jbail(a, 0x84);
+        /* cmp rcx, -1 ; je bail (leave the overflow to the builtin) */
+        _ljit_emit(a, 4, 0x48, 0x83, 0xF9, 0xFF);
+        _ljit_jbail(a, 0x84);
+        /* cqo ; idiv rcx */
+        _ljit_emit(a, 5, 0x48, 0x99, 0x48, 0xF7, 0xF9);
+        break;
+    }
+  }
+
+  return 1;
+}
+
+int _ljit_compare(ljit_asm* a, int op, lval* v)
+{
+  if (v->count != 3 || !_ljit_expr(a, v->cell[1])) {
+    return 0;
+  }
+
+  _ljit_push(a);
+  if (!_ljit_expr(a, v->cell[2])) {
+    return 0;
+  }
+  _ljit_pop2(a);
+
+  /* cmp rax, rcx */
+  _ljit_emit(a, 3, 0x48, 0x39, 0xC8);
+
+  /* setcc al ; movzx eax, al */
+  _ljit_emit(a, 6, 0x0F, _ljit_setcc[op], 0xC0, 0x0F, 0xB6, 0xC0);
+  return 1;
+}
+
+int _ljit_if(ljit_asm* a, lval* v)
+{
+  if (v->count != 4 || v->cell[2]->type != LVAL_QEXPR || v->cell[3]->type != LVAL_QEXPR) {
+    return 0;
+  }
+
+  if (!_ljit_expr(a, v->cell[1])) {
+    return 0;
+  }
+
+  /* test rax, rax ; je else */
+  _ljit_emit(a, 3, 0x48, 0x85, 0xC0);
+  int jelse = _ljit_jump(a, 2, 0x0F, 0x84);
+
+  if (!_ljit_form(a, v->cell[2])) {
+    return 0;
+  }
+
+  /* jmp end */
+  int jend = _ljit_jump(a, 1, 0xE9, 0);
+
+  _ljit_patch(a, jelse);
+  if (!_ljit_form(a, v->cell[3])) {
+    return 0;
+  }
+
+  _ljit_patch(a, jend);
+  return 1;
+}
+
+int _ljit_builtin(ljit_asm* a, lval* f, lval* v)
+{
+  lval* head = v->cell[0];
+  if (!is(f->sym, head->sym) || !lenv_watched(head->sym)) {
+    return 0;
+  }
+
+  ljit* j = a->jit;
+  if (_ljit_find(j->ops, j->nops, head->sym) < 0) {
+    j->builtins = realloc(j->builtins, sizeof(lbuiltin) * (j->nops + 1));
+    j->builtins[j->nops] = f->builtin;
+    _ljit_add(&j->ops, &j->nops, head);
+  }
+
+  if (f->builtin == BTNAME(IF)) {
+    return _ljit_if(a, v);
+  }
+
+  for (int op = 0; _ljit_ops[op]; op++) {
+    if (f->builtin == _ljit_ops[op]) {
+      return op <= LJOP_DIV ? _ljit_arith(a, op, v) : _ljit_compare(a, op, v);
+    }
+  }
+
+  return 0;
+}
+
+int _ljit_call(ljit_asm* a, lval* f, lval* v)
+{
+  int argc = v->count - 1;
+  if (f->env->count || _ljit_arity(f->formals) != argc) {
+    return 0;
+  }
+
+  /* the callee must be compiled too (or being compiled, when recursive) */
+  if (!_ljit_compile(a->env, f)) {
+    return 0;
+  }
+
+  ljit* j = a->jit;
+  if (_ljit_find(j->targets, j->ntargets, v->cell[0]->sym) < 0) {
+    j->codes = realloc(j->codes, sizeof(lcode*) * (j->ntargets + 1));
+    j->codes[j->ntargets] = lval_code(f);
+    _ljit_add(&j->targets, &j->ntargets, v->cell[0]);
+  }
+
+  /* room for the arguments, keeping the stack aligned to 16 bytes */
+  int slots = argc + ((a->depth + argc) & 1);
+
+  /* sub rsp, 8*slots */
+  _ljit_emit(a, 3, 0x48, 0x81, 0xEC);
+  _ljit_imm32(a, 8 * slots);
+  a->depth += slots;
+
+  for (int i = 0; i < argc; i++) {
+    if (!_ljit_expr(a, v->cell[i + 1])) {
+      return 0;
+    }
+    /* mov [rsp + 8*i], rax */
+    _ljit_emit(a, 4, 0x48, 0x89, 0x84, 0x24);
+    _ljit_imm32(a, 8 * i);
+  }
+
+  /* mov rdi, rsp ; mov rax, &code->jit ; mov rax, [rax] ; call [rax] */
+  _ljit_emit(a, 3, 0x48, 0x89, 0xE7);
+  _ljit_movrax(a, (long)&lval_code(f)->jit);
+  _ljit_emit(a, 5, 0x48, 0x8B, 0x00, 0xFF, 0x10);
+
+  /* add rsp, 8*slots */
+  _ljit_emit(a, 3, 0x48, 0x81, 0xC4);
+  _ljit_imm32(a, 8 * slots);
+  a->depth -= slots;
+
+  /* if the callee bailed out, bail out too */
+  _ljit_movrcx(a, (long)&_ljit_bail);
+  _ljit_emit(a, 3, 0x80, 0x39, 0x00);
+  _ljit_jbail(a, 0x85);
+
+  return 1;
+}
+
+int _ljit_form(ljit_asm* a, lval* v)
+{
+  /* expression with just one children: return that children */
+  if (v->count == 1) {
+    return _ljit_expr(a, v->cell[0]);
+  }
+
+  lval* head = v->count > 1 ? v->cell[0] : NULL;
+  if (!head || head->type != LVAL_SYM || _ljit_slot(a->formals, head->sym) >= 0) {
+    return 0;
+  }
+
+  lval* f = lenv_find(a->env, head);
+  if (!f || f->type != LVAL_FUN) {
+    return 0;
+  }
+
+  return f->builtin ? _ljit_builtin(a, f, v) : _ljit_call(a, f, v);
+}
+
+int _ljit_load(ljit* j, ljit_asm* a)
+{
+  long page = sysconf(_SC_PAGESIZE);
+  size_t size = (a->len + page - 1) / page * page;
+
+  void* mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mem == MAP_FAILED) {
+    return 0;
+  }
+
+  memcpy(mem, a->code, a->len);
+  if (mprotect(mem, size, PROT_READ | PROT_EXEC) != 0) {
+    munmap(mem, size);
+    return 0;
+  }
+
+  j->mem = mem;
+  j->size = size;
+  j->entry = (ljit_fn)mem;
+  return 1;
+}
+
+ljit* _ljit_new(void)
+{
+  ljit* j = malloc(sizeof(ljit));
+  j->entry = NULL;
+  j->state = LJIT_COMPILING;
+  j->arity = 0;
+  j->mem = NULL;
+  j->size = 0;
+  j->ntargets = 0;
+  j->targets = NULL;
+  j->codes = NULL;
+  j->nops = 0;
+  j->ops = NULL;
+  j->builtins = NULL;
+  j->epoch = 0;
+  return j;
+}
+
+/**
+ * Compiles a function (and the functions it calls), returns 0
+ * if the function can not be compiled
+ */
+int _ljit_compile(lenv* e, lval* f)
+{
+  lcode* c = lval_code(f);
+  if (c->jit) {
+    return c->jit->state != LJIT_FAILED;
+  }
+
+  ljit* j = c->jit = _ljit_new();
+  j->arity = _ljit_arity(c->formals);
+
+  ljit_asm a = { e, j, c->formals, NULL, 0, 0, 0, NULL, 0 };
+
+  /* push rbp ; mov rbp, rsp ; push rbx ; push r12 ; mov rbx, rdi */
+  _ljit_emit(&a, 10, 0x55, 0x48, 0x89, 0xE5, 0x53, 0x41, 0x54, 0x48, 0x89, 0xFB);
+
+  int ok = j->arity >= 0 && !f->env->count && _ljit_form(&a, f->body);
+  _ljit_ret(&a);
+
+  /* bail: mov byte [&_ljit_bail], 1 ; return */
+  for (int i = 0; i < a.nbails; i++) {
+    _ljit_patch(&a, a.bails[i]);
+  }
+  _ljit_movrcx(&a, (long)&_ljit_bail);
+  _ljit_emit(&a, 3, 0xC6, 0x01, 0x01);
+  _ljit_ret(&a);
+
+  ok = ok && _ljit_load(j, &a);
+  j->state = ok ? LJIT_DONE : LJIT_FAILED;
+  j->epoch = lenv_epoch;
+
+  free(a.code);
+  free(a.bails);
+  return ok;
+}
+
+/**
+ * Checks that every name called by the function, and by the functions
+ * it calls, resolves in the environment of the caller to what it was
+ * compiled for, and that no formal of those functions hides any of them
+ */
+int _ljit_check(lenv* e, lcode* c)
+{
+  lcode* seen[LJIT_MAX_CALLEES];
+  int nseen = 1;
+  seen[0] = c;
+
+  for (int i = 0; i < nseen; i++) {
+    ljit* j = seen[i]->jit;
+    if (!j || !j->entry) {
+      return 0;
+    }
+
+    for (int k = 0; k < j->ntargets; k++) {
+      lval* f = lenv_find(e, j->targets[k]);
+      if (!f || f->type != LVAL_FUN || f->builtin || f->code != j->codes[k] || f->env->count) {
+        return 0;
+      }
+
+      int found = 0;
+      for (int s = 0; s < nseen; s++) {
+        found = found || seen[s] == f->code;
+      }
+      if (!found) {
+        if (nseen == LJIT_MAX_CALLEES) {
+          return 0;
+        }
+        seen[nseen++] = f->code;
+      }
+    }
+
+    /* a builtin may have been rebound, look them up again */
+    if (j->epoch != lenv_epoch) {
+      for (int k = 0; k < j->nops; k++) {
+        lval* f = lenv_find(e, j->ops[k]);
+        if (!f || f->type != LVAL_FUN || f->builtin != j->builtins[k]) {
+          return 0;
+        }
+      }
+      j->epoch = lenv_epoch;
+    }
+  }
+
+  /* no function is called with an environment, names resolve past their formals */
+  for (int i = 0; i < nseen; i++) {
+    ljit* j = seen[i]->jit;
+    for (int s = 0; s < nseen; s++) {
+      lval* formals = seen[s]->formals;
+      for (int k = 0; k < j->ntargets; k++) {
+        if (_ljit_slot(formals, j->targets[k]->sym) >= 0) {
+          return 0;
+        }
+      }
+      for (int k = 0; k < j->nops; k++) {
+        if (_ljit_slot(formals, j->ops[k]->sym) >= 0) {
+          return 0;
+        }
+      }
+    }
+  }
+
+  return 1;
+}
+
+lval* ljit_call(lenv* e, lval* f, lval* a)
+{
+  /* only functions with no argument bound yet */
+  lcode* c = f->code;
+  if (f->env->count) {
+    return NULL;
+  }
+
+  if (!c->jit) {
+    if (++c->calls < LJIT_HOT) {
+      return NULL;
+    }
+    _ljit_compile(e, f);
+  }
+
+  ljit* j = c->jit;
+  if (!j->entry || a->count != j->arity) {
+    return NULL;
+  }
+
+  long args[LJIT_MAX_ARGS];
+  for (int i = 0; i < a->count; i++) {
+    if (a->cell[i]->type != LVAL_NUM) {
+      return NULL;
+    }
+    args[i] = a->cell[i]->num;
+  }
+
+  if (!_ljit_check(e, c)) {
+    return NULL;
+  }
+
+  _ljit_bail = 0;
+  long r = j->entry(args);
+  if (_ljit_bail) {
+    return NULL;
+  }
+
+  lval_del(a);
+  return lval_num(r);
+}
+
+void ljit_del(ljit* j)
+{
+  if (!j) {
+    return;
+  }
+
+  if (j->mem) {
+    munmap(j->mem, j->size);
+  }
+  for (int i = 0; i < j->ntargets; i++) {
+    lval_del(j->targets[i]);
+  }
+  for (int i = 0; i < j->nops; i++) {
+    lval_del(j->ops[i]);
+  }
+  free(j->targets);
+  free(j->codes);
+  free(j->ops);
+  free(j->builtins);
+  free(j);
+}
+
+#else
+
+/* no machine code for this platform, every call is interpreted */
+
+lval* ljit_call(lenv* e, lval* f, lval* a)
+{
+  return NULL;
+}
+
+void ljit_del(ljit* j)
+{
+}
+
+#endif
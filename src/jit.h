@@ -0,0 +1,99 @@
+#ifndef LISPY_JIT_H
+#define LISPY_JIT_H
+
+#include "env.h"
+#include "val.h"
+
+/**
+ * Number of calls to a function before it is compiled to machine code
+ */
+#define LJIT_HOT 16
+
+/**
+ * Maximum number of formals of a compiled function
+ */
+#define LJIT_MAX_ARGS 16
+
+/**
+ * Maximum number of functions reachable from a compiled function
+ */
+#define LJIT_MAX_CALLEES 32
+
+/**
+ * STATES of the compilation of a function
+ */
+enum { LJIT_COMPILING, LJIT_DONE, LJIT_FAILED };
+
+/**
+ * A function compiled to machine code, called with its arguments
+ * (numbers) in order
+ */
+typedef long(*ljit_fn)(long*);
+
+/**
+ * The machine code of a function (only on x86-64 Linux)
+ *
+ * A function is compiled after LJIT_HOT calls if its body is made only
+ * of numbers, its formals, arithmetic, order and equality builtins, 'if'
+ * with literal branches and calls to other functions that can be compiled
+ * too (itself included). Every value is then a number, kept unboxed in a
+ * register or in the stack, and no environment is ever created.
+ *
+ * The compiled code is used only when every argument is a number and every
+ * name it calls resolves, in the environment of the caller, to the same
+ * builtin or function (and code) it resolved to when compiled. If it can
+ * not go on (a division by zero, or an overflow that needs a bignum) it
+ * bails out and the whole call is interpreted again, that is safe because
+ * the code has no side effects.
+ */
+struct ljit
+{
+  /** the compiled code, NULL until compiled (or if it failed) **/
+  ljit_fn entry;
+
+  /** the state of the compilation (one of the enum 'STATES') **/
+  int state;
+
+  /** number of arguments **/
+  int arity;
+
+  /** memory mapped to hold the code **/
+  void* mem;
+  size_t size;
+
+  /** functions called by name, and the code each name resolved to **/
+  int ntargets;
+  lval** targets;
+  lcode** codes;
+
+  /** builtins called by name, and the value of lenv_epoch when resolved **/
+  int nops;
+  lval** ops;
+  lbuiltin* builtins;
+  long epoch;
+};
+
+/**
+ * To compile hot functions or not, chosen at startup
+ */
+extern int ljit_enabled;
+
+/**
+ * Calls a function with its compiled code, counting the call and
+ * compiling the function when it becomes hot
+ *
+ * lenv* e    the environment of the caller
+ * lval* f    the function to call, it is not modified
+ * lval* a    the arguments (LVAL_SEXPR), consumed only if the call is done
+ *
+ * return     the resulting value or NULL if the function has to be
+ *            interpreted (a is then left untouched)
+ */
+lval* ljit_call(lenv* e, lval* f, lval* a);
+
+/**
+ * Destroys the compiled code of a function
+ */
+void ljit_del(ljit* j);
+
+#endif//LISPY_JIT_H
@@ -0,0 +1,722 @@
+#include "kern.h"
+
+/**
+ * The instruction sets with their own kernels: SSE2 and AVX2 on x86 with
+ * gcc or clang (checked when run), SSE2 on x64 with msvc (it always has
+ * it), the scalar ones everywhere else
+ */
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define LKERN_SSE2 __attribute__((target("sse2")))
+#define LKERN_AVX2 __attribute__((target("avx2")))
+#define LKERN_HAS_SSE2 __builtin_cpu_supports("sse2")
+#define LKERN_HAS_AVX2 __builtin_cpu_supports("avx2")
+#elif defined(_MSC_VER) && defined(_M_X64)
+#include <emmintrin.h>
+#define LKERN_SSE2
+#define LKERN_HAS_SSE2 1
+#endif
+
+/** wrapping arithmetic on int64_t, done unsigned as overflowing signed is undefined **/
+#define LKERN_WRAP(x, op, y) ((int64_t)((uint64_t)(x) op (uint64_t)(y)))
+
+/** negative if x + y overflowed into s: both have the sign s does not have **/
+#define LKERN_OVER(x, y, s) (((x) ^ (s)) & ((y) ^ (s)))
+
+/************************************************************************
+ * scalar
+ ************************************************************************/
+
+void _lkern_f64_arith(int op, double* r, double* a, int sa, double* b, int sb, long n)
+{
+  switch (op) {
+    case LKERN_ADD: for (long k = 0; k < n; k++) { r[k] = a[k * sa] + b[k * sb]; } break;
+    case LKERN_SUB: for (long k = 0; k < n; k++) { r[k] = a[k * sa] - b[k * sb]; } break;
+    case LKERN_MUL: for (long k = 0; k < n; k++) { r[k] = a[k * sa] * b[k * sb]; } break;
+    case LKERN_DIV: for (long k = 0; k < n; k++) { r[k] = a[k * sa] / b[k * sb]; } break;
+  }
+}
+
+void _lkern_i64_arith(int op, int64_t* r, int64_t* a, int sa, int64_t* b, int sb, long n)
+{
+  switch (op) {
+    case LKERN_ADD: for (long k = 0; k < n; k++) { r[k] = LKERN_WRAP(a[k * sa], +, b[k * sb]); } break;
+    case LKERN_SUB: for (long k = 0; k < n; k++) { r[k] = LKERN_WRAP(a[k * sa], -, b[k * sb]); } break;
+    case LKERN_MUL: for (long k = 0; k < n; k++) { r[k] = LKERN_WRAP(a[k * sa], *, b[k * sb]); } break;
+    case LKERN_DIV:
+      /* the minimum by -1 wraps around too, instead of trapping */
+      for (long k = 0; k < n; k++) {
+        r[k] = b[k * sb] == -1 ? LKERN_WRAP(0, -, a[k * sa]) : a[k * sa] / b[k * sb];
+      }
+      break;
+  }
+}
+
+void _lkern_f64_cmp(int op, int64_t* r, double* a, int sa, double* b, int sb, long n)
+{
+  switch (op) {
+    case LKERN_LT:  for (long k = 0; k < n; k++) { r[k] = a[k * sa] <  b[k * sb]; } break;
+    case LKERN_LTE: for (long k = 0; k < n; k++) { r[k] = a[k * sa] <= b[k * sb]; } break;
+    case LKERN_GT:  for (long k = 0; k < n; k++) { r[k] = a[k * sa] >  b[k * sb]; } break;
+    case LKERN_GTE: for (long k = 0; k < n; k++) { r[k] = a[k * sa] >= b[k * sb]; } break;
+  }
+}
+
+void _lkern_i64_cmp(int op, int64_t* r, int64_t* a, int sa, int64_t* b, int sb, long n)
+{
+  switch (op) {
+    case LKERN_LT:  for (long k = 0; k < n; k++) { r[k] = a[k * sa] <  b[k * sb]; } break;
+    case LKERN_LTE: for (long k = 0; k < n; k++) { r[k] = a[k * sa] <= b[k * sb]; } break;
+    case LKERN_GT:  for (long k = 0; k < n; k++) { r[k] = a[k * sa] >  b[k * sb]; } break;
+    case LKERN_GTE: for (long k = 0; k < n; k++) { r[k] = a[k * sa] >= b[k * sb]; } break;
+  }
+}
+
+double _lkern_f64_sum(double* x, long n)
+{
+  double s[LKERN_LANES] = { 0.0, 0.0, 0.0, 0.0 };
+
+  long i = 0;
+  for (; i + LKERN_LANES <= n; i += LKERN_LANES) {
+    for (int j = 0; j < LKERN_LANES; j++) {
+      s[j] += x[i + j];
+    }
+  }
+  for (; i < n; i++) {
+    s[0] += x[i];
+  }
+
+  return (s[0] + s[1]) + (s[2] + s[3]);
+}
+
+double lkern_prod(double* x, long n)
+{
+  double p[LKERN_LANES] = { 1.0, 1.0, 1.0, 1.0 };
+
+  long i = 0;
+  for (; i + LKERN_LANES <= n; i += LKERN_LANES) {
+    for (int j = 0; j < LKERN_LANES; j++) {
+      p[j] *= x[i + j];
+    }
+  }
+  for (; i < n; i++) {
+    p[0] *= x[i];
+  }
+
+  return (p[0] * p[1]) * (p[2] * p[3]);
+}
+
+int64_t _lkern_i64_add(int64_t x, int64_t y, int* over)
+{
+  int64_t s = LKERN_WRAP(x, +, y);
+  *over |= LKERN_OVER(x, y, s) < 0;
+  return s;
+}
+
+int64_t _lkern_i64_sum(int64_t* x, long n, int* over)
+{
+  int64_t s = 0;
+  int64_t o = 0;
+  for (long i = 0; i < n; i++) {
+    int64_t t = LKERN_WRAP(s, +, x[i]);
+    o |= LKERN_OVER(s, x[i], t);
+    s = t;
+  }
+  *over |= o < 0;
+  return s;
+}
+
+/* the lanes of the vector sets are summed in this same order */
+double _lkern_f64_dot(double* x, double* y, long n)
+{
+  double s[LKERN_LANES] = { 0.0, 0.0, 0.0, 0.0 };
+
+  long i = 0;
+  for (; i + LKERN_LANES <= n; i += LKERN_LANES) {
+    for (int j = 0; j < LKERN_LANES; j++) {
+      s[j] += x[i + j] * y[i + j];
+    }
+  }
+  for (; i < n; i++) {
+    s[0] += x[i] * y[i];
+  }
+
+  return (s[0] + s[1]) + (s[2] + s[3]);
+}
+
+int64_t _lkern_i64_dot(int64_t* x, int64_t* y, long n)
+{
+  int64_t s = 0;
+  for (long i = 0; i < n; i++) {
+    s = LKERN_WRAP(s, +, LKERN_WRAP(x[i], *, y[i]));
+  }
+  return s;
+}
+
+double _lkern_f64_min(double* x, long n)
+{
+  double m = x[0];
+  for (long i = 1; i < n; i++) {
+    m = x[i] < m ? x[i] : m;
+  }
+  return m;
+}
+
+double _lkern_f64_max(double* x, long n)
+{
+  double m = x[0];
+  for (long i = 1; i < n; i++) {
+    m = x[i] > m ? x[i] : m;
+  }
+  return m;
+}
+
+int64_t _lkern_i64_min(int64_t* x, long n)
+{
+  int64_t m = x[0];
+  for (long i = 1; i < n; i++) {
+    m = x[i] < m ? x[i] : m;
+  }
+  return m;
+}
+
+int64_t _lkern_i64_max(int64_t* x, long n)
+{
+  int64_t m = x[0];
+  for (long i = 1; i < n; i++) {
+    m = x[i] > m ? x[i] : m;
+  }
+  return m;
+}
+
+/**
+ * in order, in every set: adding the doubles in any other order would
+ * not give the same bits as adding them one after the other
+ */
+void _lkern_f64_cumsum(double* r, double* x, long n)
+{
+  double s = 0.0;
+  for (long i = 0; i < n; i++) {
+    s += x[i];
+    r[i] = s;
+  }
+}
+
+int _lkern_i64_cumsum(int64_t* r, int64_t* x, long n)
+{
+  int64_t s = 0;
+  int64_t o = 0;
+  for (long i = 0; i < n; i++) {
+    int64_t t = LKERN_WRAP(s, +, x[i]);
+    o |= LKERN_OVER(s, x[i], t);
+    s = t;
+    r[i] = s;
+  }
+  return o < 0;
+}
+
+void _lkern_f64_axpy(double* y, double a, double* x, long n)
+{
+  for (long k = 0; k < n; k++) {
+    y[k] += a * x[k];
+  }
+}
+
+void _lkern_u64_logic(int op, uint64_t* r, uint64_t* a, uint64_t* b, long n)
+{
+  switch (op) {
+    case LKERN_OR:     for (long k = 0; k < n; k++) { r[k] = a[k] | b[k]; } break;
+    case LKERN_AND:    for (long k = 0; k < n; k++) { r[k] = a[k] & b[k]; } break;
+    case LKERN_ANDNOT: for (long k = 0; k < n; k++) { r[k] = a[k] & ~b[k]; } break;
+  }
+}
+
+long _lkern_u64_popcount(uint64_t* x, long n)
+{
+  /* the bits of every 2, 4 then 8 bits added in place, and the 8 bytes by a multiplication */
+  long c = 0;
+  for (long k = 0; k < n; k++) {
+    uint64_t v = x[k] - ((x[k] >> 1) & 0x5555555555555555ULL);
+    v = (v & 0x3333333333333333ULL) + ((v >> 2) & 0x3333333333333333ULL);
+    v = (v + (v >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+    c += (long)((v * 0x0101010101010101ULL) >> 56);
+  }
+  return c;
+}
+
+lkern _lkern_scalar = {
+  "scalar",
+  _lkern_f64_arith, _lkern_i64_arith, _lkern_f64_cmp, _lkern_i64_cmp,
+  _lkern_f64_sum, _lkern_i64_sum, _lkern_f64_dot, _lkern_i64_dot,
+  _lkern_f64_min, _lkern_f64_max, _lkern_i64_min, _lkern_i64_max,
+  _lkern_f64_cumsum, _lkern_i64_cumsum,
+  _lkern_f64_axpy,
+  _lkern_u64_logic, _lkern_u64_popcount
+};
+
+/************************************************************************
+ * SSE2 (2 lanes of 64 bits)
+ ************************************************************************/
+
+#ifdef LKERN_HAS_SSE2
+
+#define LKERN_SSE2_PD(OP)                                                     \
+  for (; k + 2 <= n; k += 2) {                                                \
+    __m128d x = sa ? _mm_loadu_pd(a + k) : _mm_set1_pd(a[0]);                 \
+    __m128d y = sb ? _mm_loadu_pd(b + k) : _mm_set1_pd(b[0]);                 \
+    OP;                                                                       \
+  }
+
+#define LKERN_SSE2_EPI64(OP)                                                  \
+  for (; k + 2 <= n; k += 2) {                                                \
+    __m128i x = sa ? _mm_loadu_si128((__m128i*)(a + k)) : _mm_set1_epi64x(a[0]); \
+    __m128i y = sb ? _mm_loadu_si128((__m128i*)(b + k)) : _mm_set1_epi64x(b[0]); \
+    _mm_storeu_si128((__m128i*)(r + k), OP(x, y));                            \
+  }
+
+LKERN_SSE2 void _lkern_sse2_f64_arith(int op, double* r, double* a, int sa, double* b, int sb, long n)
+{
+  long k = 0;
+  switch (op) {
+    case LKERN_ADD: LKERN_SSE2_PD(_mm_storeu_pd(r + k, _mm_add_pd(x, y))); break;
+    case LKERN_SUB: LKERN_SSE2_PD(_mm_storeu_pd(r + k, _mm_sub_pd(x, y))); break;
+    case LKERN_MUL: LKERN_SSE2_PD(_mm_storeu_pd(r + k, _mm_mul_pd(x, y))); break;
+    case LKERN_DIV: LKERN_SSE2_PD(_mm_storeu_pd(r + k, _mm_div_pd(x, y))); break;
+  }
+  _lkern_f64_arith(op, r + k, a + k * sa, sa, b + k * sb, sb, n - k);
+}
+
+LKERN_SSE2 void _lkern_sse2_i64_arith(int op, int64_t* r, int64_t* a, int sa, int64_t* b, int sb, long n)
+{
+  /* there is no multiplication nor division of 64 bits integers */
+  long k = 0;
+  switch (op) {
+    case LKERN_ADD: LKERN_SSE2_EPI64(_mm_add_epi64); break;
+    case LKERN_SUB: LKERN_SSE2_EPI64(_mm_sub_epi64); break;
+  }
+  _lkern_i64_arith(op, r + k, a + k * sa, sa, b + k * sb, sb, n - k);
+}
+
+/* the mask of a comparison (all ones where it holds) to 1 and 0 */
+#define LKERN_SSE2_CMP(CMP) \
+  LKERN_SSE2_PD(_mm_storeu_si128((__m128i*)(r + k), _mm_and_si128(_mm_castpd_si128(CMP(x, y)), one)))
+
+LKERN_SSE2 void _lkern_sse2_f64_cmp(int op, int64_t* r, double* a, int sa, double* b, int sb, long n)
+{
+  __m128i one = _mm_set1_epi64x(1);
+  long k = 0;
+  switch (op) {
+    case LKERN_LT:  LKERN_SSE2_CMP(_mm_cmplt_pd); break;
+    case LKERN_LTE: LKERN_SSE2_CMP(_mm_cmple_pd); break;
+    case LKERN_GT:  LKERN_SSE2_CMP(_mm_cmpgt_pd); break;
+    case LKERN_GTE: LKERN_SSE2_CMP(_mm_cmpge_pd); break;
+  }
+  _lkern_f64_cmp(op, r + k, a + k * sa, sa, b + k * sb, sb, n - k);
+}
+
+LKERN_SSE2 double _lkern_sse2_f64_sum(double* x, long n)
+{
+  /* lanes 0 and 1 in lo, 2 and 3 in hi */
+  __m128d lo = _mm_setzero_pd();
+  __m128d hi = _mm_setzero_pd();
+  long i = 0;
+  for (; i + LKERN_LANES <= n; i += LKERN_LANES) {
+    lo = _mm_add_pd(lo, _mm_loadu_pd(x + i));
+    hi = _mm_add_pd(hi, _mm_loadu_pd(x + i + 2));
+  }
+
+  double s[LKERN_LANES];
+  _mm_storeu_pd(s, lo);
+  _mm_storeu_pd(s + 2, hi);
+  for (; i < n; i++) {
+    s[0] += x[i];
+  }
+  return (s[0] + s[1]) + (s[2] + s[3]);
+}
+
+LKERN_SSE2 double _lkern_sse2_f64_dot(double* x, double* y, long n)
+{
+  __m128d lo = _mm_setzero_pd();
+  __m128d hi = _mm_setzero_pd();
+  long i = 0;
+  for (; i + LKERN_LANES <= n; i += LKERN_LANES) {
+    lo = _mm_add_pd(lo, _mm_mul_pd(_mm_loadu_pd(x + i), _mm_loadu_pd(y + i)));
+    hi = _mm_add_pd(hi, _mm_mul_pd(_mm_loadu_pd(x + i + 2), _mm_loadu_pd(y + i + 2)));
+  }
+
+  double s[LKERN_LANES];
+  _mm_storeu_pd(s, lo);
+  _mm_storeu_pd(s + 2, hi);
+  for (; i < n; i++) {
+    s[0] += x[i] * y[i];
+  }
+  return (s[0] + s[1]) + (s[2] + s[3]);
+}
+
+/* the bits where x + y overflowed into s, the sign bit of a lane is set if it did */
+#define LKERN_SSE2_OVER(x, y, s) \
+  _mm_and_si128(_mm_xor_si128(x, s), _mm_xor_si128(y, s))
+
+LKERN_SSE2 int64_t _lkern_sse2_i64_sum(int64_t* x, long n, int* over)
+{
+  __m128i s = _mm_setzero_si128();
+  __m128i o = _mm_setzero_si128();
+  long i = 0;
+  for (; i + 2 <= n; i += 2) {
+    __m128i v = _mm_loadu_si128((__m128i*)(x + i));
+    __m128i t = _mm_add_epi64(s, v);
+    o = _mm_or_si128(o, LKERN_SSE2_OVER(s, v, t));
+    s = t;
+  }
+
+  int64_t l[2], lo[2];
+  _mm_storeu_si128((__m128i*)l, s);
+  _mm_storeu_si128((__m128i*)lo, o);
+  *over |= (lo[0] | lo[1]) < 0;
+  int64_t r = _lkern_i64_add(l[0], l[1], over);
+  return _lkern_i64_add(r, _lkern_i64_sum(x + i, n - i, over), over);
+}
+
+#define LKERN_SSE2_MINMAX(NAME, OP, PICK)                                    \
+LKERN_SSE2 double NAME(double* x, long n)                                    \
+{                                                                            \
+  __m128d m = _mm_set1_pd(x[0]);                                             \
+  long i = 0;                                                                \
+  for (; i + 2 <= n; i += 2) {                                               \
+    m = OP(m, _mm_loadu_pd(x + i));                                          \
+  }                                                                          \
+  double l[2];                                                               \
+  _mm_storeu_pd(l, m);                                                       \
+  double r = PICK(l[0], l[1]);                                               \
+  for (; i < n; i++) {                                                       \
+    r = PICK(r, x[i]);                                                       \
+  }                                                                          \
+  return r;                                                                  \
+}
+
+#define LKERN_MIN(x, y) ((y) < (x) ? (y) : (x))
+#define LKERN_MAX(x, y) ((y) > (x) ? (y) : (x))
+
+LKERN_SSE2_MINMAX(_lkern_sse2_f64_min, _mm_min_pd, LKERN_MIN)
+LKERN_SSE2_MINMAX(_lkern_sse2_f64_max, _mm_max_pd, LKERN_MAX)
+
+LKERN_SSE2 int _lkern_sse2_i64_cumsum(int64_t* r, int64_t* x, long n)
+{
+  /* two at a time: {x0, x0 + x1} plus the sum of the ones before */
+  __m128i s = _mm_setzero_si128();
+  __m128i o = _mm_setzero_si128();
+  long i = 0;
+  for (; i + 2 <= n; i += 2) {
+    __m128i v = _mm_loadu_si128((__m128i*)(x + i));
+    __m128i p = _mm_slli_si128(v, 8);
+    __m128i t = _mm_add_epi64(v, p);
+    o = _mm_or_si128(o, LKERN_SSE2_OVER(v, p, t));
+    v = _mm_add_epi64(t, s);
+    o = _mm_or_si128(o, LKERN_SSE2_OVER(t, s, v));
+    _mm_storeu_si128((__m128i*)(r + i), v);
+    s = _mm_unpackhi_epi64(v, v);
+  }
+
+  int64_t lo[2];
+  _mm_storeu_si128((__m128i*)lo, o);
+  int over = (lo[0] | lo[1]) < 0;
+  int64_t c = i ? r[i - 1] : 0;
+  for (; i < n; i++) {
+    c = _lkern_i64_add(c, x[i], &over);
+    r[i] = c;
+  }
+  return over;
+}
+
+LKERN_SSE2 void _lkern_sse2_f64_axpy(double* y, double a, double* x, long n)
+{
+  __m128d va = _mm_set1_pd(a);
+  long k = 0;
+  for (; k + 2 <= n; k += 2) {
+    _mm_storeu_pd(y + k, _mm_add_pd(_mm_loadu_pd(y + k), _mm_mul_pd(va, _mm_loadu_pd(x + k))));
+  }
+  _lkern_f64_axpy(y + k, a, x + k, n - k);
+}
+
+LKERN_SSE2 void _lkern_sse2_u64_logic(int op, uint64_t* r, uint64_t* a, uint64_t* b, long n)
+{
+  /* andnot is ~x & y, so b goes first */
+  long k = 0;
+  for (; k + 2 <= n; k += 2) {
+    __m128i x = _mm_loadu_si128((__m128i*)(a + k));
+    __m128i y = _mm_loadu_si128((__m128i*)(b + k));
+    __m128i z = op == LKERN_OR ? _mm_or_si128(x, y)
+        : op == LKERN_AND ? _mm_and_si128(x, y) : _mm_andnot_si128(y, x);
+    _mm_storeu_si128((__m128i*)(r + k), z);
+  }
+  _lkern_u64_logic(op, r + k, a + k, b + k, n - k);
+}
+
+lkern _lkern_sse2 = {
+  "sse2",
+  _lkern_sse2_f64_arith, _lkern_sse2_i64_arith, _lkern_sse2_f64_cmp, _lkern_i64_cmp,
+  _lkern_sse2_f64_sum, _lkern_sse2_i64_sum, _lkern_sse2_f64_dot, _lkern_i64_dot,
+  _lkern_sse2_f64_min, _lkern_sse2_f64_max, _lkern_i64_min, _lkern_i64_max,
+  _lkern_f64_cumsum, _lkern_sse2_i64_cumsum,
+  _lkern_sse2_f64_axpy,
+  _lkern_sse2_u64_logic, _lkern_u64_popcount
+};
+
+#endif
+
+/************************************************************************
+ * AVX2 (4 lanes of 64 bits)
+ ************************************************************************/
+
+#ifdef LKERN_HAS_AVX2
+
+#define LKERN_AVX2_PD(OP)                                                     \
+  for (; k + 4 <= n; k += 4) {                                                \
+    __m256d x = sa ? _mm256_loadu_pd(a + k) : _mm256_set1_pd(a[0]);           \
+    __m256d y = sb ? _mm256_loadu_pd(b + k) : _mm256_set1_pd(b[0]);           \
+    OP;                                                                       \
+  }
+
+#define LKERN_AVX2_EPI64(OP)                                                  \
+  for (; k + 4 <= n; k += 4) {                                                \
+    __m256i x = sa ? _mm256_loadu_si256((__m256i*)(a + k)) : _mm256_set1_epi64x(a[0]); \
+    __m256i y = sb ? _mm256_loadu_si256((__m256i*)(b + k)) : _mm256_set1_epi64x(b[0]); \
+    _mm256_storeu_si256((__m256i*)(r + k), OP);                               \
+  }
+
+LKERN_AVX2 void _lkern_avx2_f64_arith(int op, double* r, double* a, int sa, double* b, int sb, long n)
+{
+  long k = 0;
+  switch (op) {
+    case LKERN_ADD: LKERN_AVX2_PD(_mm256_storeu_pd(r + k, _mm256_add_pd(x, y))); break;
+    case LKERN_SUB: LKERN_AVX2_PD(_mm256_storeu_pd(r + k, _mm256_sub_pd(x, y))); break;
+    case LKERN_MUL: LKERN_AVX2_PD(_mm256_storeu_pd(r + k, _mm256_mul_pd(x, y))); break;
+    case LKERN_DIV: LKERN_AVX2_PD(_mm256_storeu_pd(r + k, _mm256_div_pd(x, y))); break;
+  }
+  _lkern_f64_arith(op, r + k, a + k * sa, sa, b + k * sb, sb, n - k);
+}
+
+LKERN_AVX2 void _lkern_avx2_i64_arith(int op, int64_t* r, int64_t* a, int sa, int64_t* b, int sb, long n)
+{
+  /* there is no multiplication nor division of 64 bits integers */
+  long k = 0;
+  switch (op) {
+    case LKERN_ADD: LKERN_AVX2_EPI64(_mm256_add_epi64(x, y)); break;
+    case LKERN_SUB: LKERN_AVX2_EPI64(_mm256_sub_epi64(x, y)); break;
+  }
+  _lkern_i64_arith(op, r + k, a + k * sa, sa, b + k * sb, sb, n - k);
+}
+
+#define LKERN_AVX2_CMP(PRED) \
+  LKERN_AVX2_PD(_mm256_storeu_si256((__m256i*)(r + k), \
+      _mm256_and_si256(_mm256_castpd_si256(_mm256_cmp_pd(x, y, PRED)), one)))
+
+LKERN_AVX2 void _lkern_avx2_f64_cmp(int op, int64_t* r, double* a, int sa, double* b, int sb, long n)
+{
+  __m256i one = _mm256_set1_epi64x(1);
+  long k = 0;
+  switch (op) {
+    case LKERN_LT:  LKERN_AVX2_CMP(_CMP_LT_OQ); break;
+    case LKERN_LTE: LKERN_AVX2_CMP(_CMP_LE_OQ); break;
+    case LKERN_GT:  LKERN_AVX2_CMP(_CMP_GT_OQ); break;
+    case LKERN_GTE: LKERN_AVX2_CMP(_CMP_GE_OQ); break;
+  }
+  _lkern_f64_cmp(op, r + k, a + k * sa, sa, b + k * sb, sb, n - k);
+}
+
+LKERN_AVX2 void _lkern_avx2_i64_cmp(int op, int64_t* r, int64_t* a, int sa, int64_t* b, int sb, long n)
+{
+  /* only > is there: a < b is b > a, a <= b is not a > b... */
+  __m256i one = _mm256_set1_epi64x(1);
+  long k = 0;
+  switch (op) {
+    case LKERN_LT:  LKERN_AVX2_EPI64(_mm256_and_si256(_mm256_cmpgt_epi64(y, x), one)); break;
+    case LKERN_LTE: LKERN_AVX2_EPI64(_mm256_andnot_si256(_mm256_cmpgt_epi64(x, y), one)); break;
+    case LKERN_GT:  LKERN_AVX2_EPI64(_mm256_and_si256(_mm256_cmpgt_epi64(x, y), one)); break;
+    case LKERN_GTE: LKERN_AVX2_EPI64(_mm256_andnot_si256(_mm256_cmpgt_epi64(y, x), one)); break;
+  }
+  _lkern_i64_cmp(op, r + k, a + k * sa, sa, b + k * sb, sb, n - k);
+}
+
+LKERN_AVX2 double _lkern_avx2_f64_sum(double* x, long n)
+{
+  __m256d acc = _mm256_setzero_pd();
+  long i = 0;
+  for (; i + LKERN_LANES <= n; i += LKERN_LANES) {
+    acc = _mm256_add_pd(acc, _mm256_loadu_pd(x + i));
+  }
+
+  double s[LKERN_LANES];
+  _mm256_storeu_pd(s, acc);
+  for (; i < n; i++) {
+    s[0] += x[i];
+  }
+  return (s[0] + s[1]) + (s[2] + s[3]);
+}
+
+LKERN_AVX2 double _lkern_avx2_f64_dot(double* x, double* y, long n)
+{
+  /* no fused multiply-add, it would round differently than the others */
+  __m256d acc = _mm256_setzero_pd();
+  long i = 0;
+  for (; i + LKERN_LANES <= n; i += LKERN_LANES) {
+    acc = _mm256_add_pd(acc, _mm256_mul_pd(_mm256_loadu_pd(x + i), _mm256_loadu_pd(y + i)));
+  }
+
+  double s[LKERN_LANES];
+  _mm256_storeu_pd(s, acc);
+  for (; i < n; i++) {
+    s[0] += x[i] * y[i];
+  }
+  return (s[0] + s[1]) + (s[2] + s[3]);
+}
+
+LKERN_AVX2 int64_t _lkern_avx2_i64_sum(int64_t* x, long n, int* over)
+{
+  __m256i s = _mm256_setzero_si256();
+  __m256i o = _mm256_setzero_si256();
+  long i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256i v = _mm256_loadu_si256((__m256i*)(x + i));
+    __m256i t = _mm256_add_epi64(s, v);
+    o = _mm256_or_si256(o, _mm256_and_si256(_mm256_xor_si256(s, t), _mm256_xor_si256(v, t)));
+    s = t;
+  }
+
+  int64_t l[4], lo[4];
+  _mm256_storeu_si256((__m256i*)l, s);
+  _mm256_storeu_si256((__m256i*)lo, o);
+  *over |= (lo[0] | lo[1] | lo[2] | lo[3]) < 0;
+  int64_t r = _lkern_i64_add(_lkern_i64_add(l[0], l[1], over), _lkern_i64_add(l[2], l[3], over), over);
+  return _lkern_i64_add(r, _lkern_i64_sum(x + i, n - i, over), over);
+}
+
+#define LKERN_AVX2_MINMAX(NAME, OP, PICK)                                    \
+LKERN_AVX2 double NAME(double* x, long n)                                    \
+{                                                                            \
+  __m256d m = _mm256_set1_pd(x[0]);                                          \
+  long i = 0;                                                                \
+  for (; i + 4 <= n; i += 4) {                                               \
+    m = OP(m, _mm256_loadu_pd(x + i));                                       \
+  }                                                                          \
+  double l[4];                                                               \
+  _mm256_storeu_pd(l, m);                                                    \
+  double r = PICK(PICK(l[0], l[1]), PICK(l[2], l[3]));                       \
+  for (; i < n; i++) {                                                       \
+    r = PICK(r, x[i]);                                                       \
+  }                                                                          \
+  return r;                                                                  \
+}
+
+LKERN_AVX2_MINMAX(_lkern_avx2_f64_min, _mm256_min_pd, LKERN_MIN)
+LKERN_AVX2_MINMAX(_lkern_avx2_f64_max, _mm256_max_pd, LKERN_MAX)
+
+/* the lanes of m where x is less (min) or greater (max) are replaced by x */
+#define LKERN_AVX2_IMINMAX(NAME, A, B, PICK)                                 \
+LKERN_AVX2 int64_t NAME(int64_t* x, long n)                                  \
+{                                                                            \
+  __m256i m = _mm256_set1_epi64x(x[0]);                                      \
+  long i = 0;                                                                \
+  for (; i + 4 <= n; i += 4) {                                               \
+    __m256i v = _mm256_loadu_si256((__m256i*)(x + i));                       \
+    m = _mm256_blendv_epi8(m, v, _mm256_cmpgt_epi64(A, B));                  \
+  }                                                                          \
+  int64_t l[4];                                                              \
+  _mm256_storeu_si256((__m256i*)l, m);                                       \
+  int64_t r = PICK(PICK(l[0], l[1]), PICK(l[2], l[3]));                      \
+  for (; i < n; i++) {                                                       \
+    r = PICK(r, x[i]);                                                       \
+  }                                                                          \
+  return r;                                                                  \
+}
+
+LKERN_AVX2_IMINMAX(_lkern_avx2_i64_min, m, v, LKERN_MIN)
+LKERN_AVX2_IMINMAX(_lkern_avx2_i64_max, v, m, LKERN_MAX)
+
+LKERN_AVX2 void _lkern_avx2_f64_axpy(double* y, double a, double* x, long n)
+{
+  /* two registers at a time, the loads of one overlap the other */
+  __m256d va = _mm256_set1_pd(a);
+  long k = 0;
+  for (; k + 8 <= n; k += 8) {
+    __m256d y0 = _mm256_add_pd(_mm256_loadu_pd(y + k), _mm256_mul_pd(va, _mm256_loadu_pd(x + k)));
+    __m256d y1 = _mm256_add_pd(_mm256_loadu_pd(y + k + 4), _mm256_mul_pd(va, _mm256_loadu_pd(x + k + 4)));
+    _mm256_storeu_pd(y + k, y0);
+    _mm256_storeu_pd(y + k + 4, y1);
+  }
+  _lkern_sse2_f64_axpy(y + k, a, x + k, n - k);
+}
+
+LKERN_AVX2 void _lkern_avx2_u64_logic(int op, uint64_t* r, uint64_t* a, uint64_t* b, long n)
+{
+  long k = 0;
+  for (; k + 4 <= n; k += 4) {
+    __m256i x = _mm256_loadu_si256((__m256i*)(a + k));
+    __m256i y = _mm256_loadu_si256((__m256i*)(b + k));
+    __m256i z = op == LKERN_OR ? _mm256_or_si256(x, y)
+        : op == LKERN_AND ? _mm256_and_si256(x, y) : _mm256_andnot_si256(y, x);
+    _mm256_storeu_si256((__m256i*)(r + k), z);
+  }
+  _lkern_sse2_u64_logic(op, r + k, a + k, b + k, n - k);
+}
+
+LKERN_AVX2 long _lkern_avx2_u64_popcount(uint64_t* x, long n)
+{
+  /**
+   * the bits of each half of a byte looked up in a table of 16 (a shuffle
+   * of bytes), the two added, then the 8 bytes of every word summed
+   */
+  __m256i table = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                   0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+  __m256i low = _mm256_set1_epi8(0x0f);
+  __m256i acc = _mm256_setzero_si256();
+  long i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256i v = _mm256_loadu_si256((__m256i*)(x + i));
+    __m256i lo = _mm256_shuffle_epi8(table, _mm256_and_si256(v, low));
+    __m256i hi = _mm256_shuffle_epi8(table, _mm256_and_si256(_mm256_srli_epi16(v, 4), low));
+    acc = _mm256_add_epi64(acc, _mm256_sad_epu8(_mm256_add_epi8(lo, hi), _mm256_setzero_si256()));
+  }
+
+  int64_t l[4];
+  _mm256_storeu_si256((__m256i*)l, acc);
+  return (long)(l[0] + l[1] + l[2] + l[3]) + _lkern_u64_popcount(x + i, n - i);
+}
+
+lkern _lkern_avx2 = {
+  "avx2",
+  _lkern_avx2_f64_arith, _lkern_avx2_i64_arith, _lkern_avx2_f64_cmp, _lkern_avx2_i64_cmp,
+  _lkern_avx2_f64_sum, _lkern_avx2_i64_sum, _lkern_avx2_f64_dot, _lkern_i64_dot,
+  _lkern_avx2_f64_min, _lkern_avx2_f64_max, _lkern_avx2_i64_min, _lkern_avx2_i64_max,
+  _lkern_f64_cumsum, _lkern_sse2_i64_cumsum,
+  _lkern_avx2_f64_axpy,
+  _lkern_avx2_u64_logic, _lkern_avx2_u64_popcount
+};
+
+#endif
+
+double lkern_sum(double* x, long n)
+{
+  return lkern_get()->f64_sum(x, n);
+}
+
+lkern* lkern_get(void)
+{
+  static lkern* k = NULL;
+  if (k) {
+    return k;
+  }
+
+  k = &_lkern_scalar;
+#ifdef LKERN_HAS_SSE2
+  if (LKERN_HAS_SSE2) {
+    k = &_lkern_sse2;
+  }
+#endif
+#ifdef LKERN_HAS_AVX2
+  if (LKERN_HAS_AVX2) {
+    k = &_lkern_avx2;
+  }
+#endif
+  return k;
+}
@@ -0,0 +1,87 @@
+#ifndef LISPY_KERN_H
+#define LISPY_KERN_H
+
+#include "fwd.h"
+
+#include <stdint.h>
+
+/**
+ * Number of partial results kept by the kernels, they are independent of
+ * each other so the compiler can keep them in the lanes of one vector
+ * register (and the processor can overlap them when it does not)
+ */
+#define LKERN_LANES 4
+
+/**
+ * Kernels over contiguous numbers, the loops the builtins run instead of
+ * taking one lval at a time
+ *
+ * double* x    the numbers
+ * long n       how many
+ *
+ * return     the sum (0 if none) or the product (1 if none), the
+ *            partial results are added (multiplied) in a different order
+ *            than left to right, so the last bits may differ from it
+ */
+double lkern_sum(double* x, long n);
+double lkern_prod(double* x, long n);
+
+/**
+ * OPERATIONS of the elementwise kernels
+ */
+enum { LKERN_ADD, LKERN_SUB, LKERN_MUL, LKERN_DIV };
+enum { LKERN_LT, LKERN_LTE, LKERN_GT, LKERN_GTE };
+enum { LKERN_OR, LKERN_AND, LKERN_ANDNOT };
+
+/**
+ * The kernels over numeric vectors, in one set for every instruction set:
+ * lkern_get() picks the best one the processor has when first called
+ *
+ * The elementwise ones compute r[k] = a[k] op b[k] for k < n, where 'sa'
+ * ('sb') is 1 for a vector and 0 for a number (a[0], used for every k).
+ * A comparison gives 1 where it holds, 0 elsewhere. The integers wrap
+ * around on overflow and the division is not to be given a 0.
+ *
+ * The reductions add (in the lanes of LKERN_LANES, in the same order in
+ * every set, so they all give the same bits), min and max take at least
+ * one element. The sums of integers wrap around too, but tell if an
+ * addition overflowed: adding in lanes, that may be so where adding one
+ * after the other would not, the exact sum is then up to the caller. The
+ * dot product of integers wraps around.
+ */
+struct lkern
+{
+  /** name of the instruction set **/
+  char* name;
+
+  void (*f64_arith)(int op, double* r, double* a, int sa, double* b, int sb, long n);
+  void (*i64_arith)(int op, int64_t* r, int64_t* a, int sa, int64_t* b, int sb, long n);
+  void (*f64_cmp)(int op, int64_t* r, double* a, int sa, double* b, int sb, long n);
+  void (*i64_cmp)(int op, int64_t* r, int64_t* a, int sa, int64_t* b, int sb, long n);
+
+  double (*f64_sum)(double* x, long n);
+  int64_t (*i64_sum)(int64_t* x, long n, int* over);
+  double (*f64_dot)(double* x, double* y, long n);
+  int64_t (*i64_dot)(int64_t* x, int64_t* y, long n);
+  double (*f64_min)(double* x, long n);
+  double (*f64_max)(double* x, long n);
+  int64_t (*i64_min)(int64_t* x, long n);
+  int64_t (*i64_max)(int64_t* x, long n);
+
+  /** r[k] is the sum of x[0] to x[k], the integer one returns 1 if an addition overflowed **/
+  void (*f64_cumsum)(double* r, double* x, long n);
+  int (*i64_cumsum)(int64_t* r, int64_t* x, long n);
+
+  /** y[k] += a * x[k] (the step of a matrix multiplication) **/
+  void (*f64_axpy)(double* y, double a, double* x, long n);
+
+  /** r[k] = a[k] op b[k] over the words of bitsets (LKERN_ANDNOT is a[k] & ~b[k]) **/
+  void (*u64_logic)(int op, uint64_t* r, uint64_t* a, uint64_t* b, long n);
+
+  /** number of bits set in the n words of x **/
+  long (*u64_popcount)(uint64_t* x, long n);
+};
+
+lkern* lkern_get(void);
+
+#endif//LISPY_KERN_H
@@ -1,5 +1,8 @@
+#include "aot.h"
 #include "env.h"
+#include "hamt.h"
 #include "eval.h"
+#include "jit.h"
 #include "utils.h"
 #include "val.h"
 
@@ -23,6 +26,8 @@ void cmd_help(void)
     "\n"
     "  .help    prints this message\n"
     "  .env     prints environment\n"
+    "  .dumpopt prints every optimized form\n"
+    "  .dumpir  prints the IR of every function lowered\n"
     "  .exit    exits from repl\n"
     );
 }
@@ -30,9 +35,11 @@ void cmd_help(void)
 void cmd_env(lenv* e)
 {
   puts("{");
-  for (int i = 0; i < e->count; i++) {
-    printf("  %s: ", e->syms[i]);
-    lval_println(e->vals[i]);
+  lval* k;
+  lval* v;
+  for (long i = 0; lhamt_nth(e->map, i, &k, &v); i++) {
+    printf("  %s: ", k->sym);
+    lval_println(v);
   }
   puts("}");
 }
@@ -43,15 +50,89 @@ void cmd_debug(lenv* e)
   printf("debug %s\n", e->debug ? "on" : "off");
 }
 
+void cmd_dumpopt(lenv* e)
+{
+  e->dumpopt = !e->dumpopt;
+  printf("dumpopt %s\n", e->dumpopt ? "on" : "off");
+}
+
+void cmd_dumpir(lenv* e)
+{
+  e->dumpir = !e->dumpir;
+  printf("dumpir %s\n", e->dumpir ? "on" : "off");
+}
+
+/* set by --compile, and the file to write (-o) */
+int compile = 0;
+char* output = NULL;
+
+/**
+ * Reads the options (every argument starting with "--", and "-o file"),
+ * keeps the files passed and returns the number of those
+ */
+int read_options(lenv* e, int argc, char** argv, char** files)
+{
+  int count = 0;
+  for (int i = 1; i < argc; i++) {
+    if      (is(argv[i], "--opt"))            { e->optimize = 1;            }
+    else if (is(argv[i], "--no-opt"))         { e->optimize = 0;            }
+    else if (is(argv[i], "--dump-opt"))       { e->dumpopt = 1;             }
+    else if (is(argv[i], "--engine=tree"))    { lengine = LENGINE_TREE;     }
+    else if (is(argv[i], "--engine=quick"))   { lengine = LENGINE_QUICK;    }
+    else if (is(argv[i], "--engine=closure")) { lengine = LENGINE_CLOSURE;  }
+    else if (is(argv[i], "--engine=ir"))      { lengine = LENGINE_IR;       }
+    else if (is(argv[i], "--dump-ir"))        { e->dumpir = 1;              }
+    else if (is(argv[i], "--jit"))            { ljit_enabled = 1;           }
+    else if (is(argv[i], "--compile"))        { compile = 1;                }
+    else if (is(argv[i], "-o") && i + 1 < argc) { output = argv[++i];       }
+    else if (strncmp(argv[i], "--", 2) == 0) {
+      printf("unknown option %s\n", argv[i]);
+      exit(1);
+    }
+    else { files[count++] = argv[i]; }
+  }
+  return count;
+}
+
+/**
+ * Compiles the files into a C program, written to the file given
+ * with -o or to the first file with its extension changed to .c
+ */
+int cmd_compile(lenv* e, char** files, int count)
+{
+  if (!count) {
+    puts("nothing to compile");
+    return 1;
+  }
+
+  char* out = output;
+  if (!out) {
+    char* dot = strrchr(files[0], '.');
+    int len = dot ? (int)(dot - files[0]) : (int)strlen(files[0]);
+    out = malloc(len + 3);
+    sprintf(out, "%.*s.c", len, files[0]);
+  }
+
+  return laot_compile(e, files, count, out);
+}
+
 int main(int argc, char** argv)
 {
   lenv* env = lenv_new();
+  env->parser = lparser_new();
   lenv_add_builtins(env);
 
-  if (argc >= 2) {
+  char** files = malloc(sizeof(char*) * argc);
+  int count = read_options(env, argc, argv, files);
+
+  if (compile) {
+    return cmd_compile(env, files, count);
+  }
+
+  if (count) {
     /* read every file passed and load it */
-    for (int i = 1; i < argc; i++) {
-      lval* f = lval_add(lval_sexpr(), lval_str(argv[i]));
+    for (int i = 0; i < count; i++) {
+      lval* f = lval_add(lval_sexpr(), lval_str(files[i]));
       lval* x = BTNAME(LOAD)(env, f);
       if (x->type == LVAL_ERR) {
         lval_println(x);
@@ -72,10 +153,12 @@ int main(int argc, char** argv)
       else if (is(input, ".help"))  { cmd_help();     }
       else if (is(input, ".env"))   { cmd_env(env);   }
       else if (is(input, ".debug")) { cmd_debug(env); }
+      else if (is(input, ".dumpopt")) { cmd_dumpopt(env); }
+      else if (is(input, ".dumpir"))  { cmd_dumpir(env);  }
       else {
         lval* r = lparser_parse_stdin(env, input);
         if (r) {
-          lval* x = leval(env, r);
+          lval* x = leval_form(env, r);
           lval_println(x);
           lval_del(x);
         }
@@ -85,6 +168,7 @@ int main(int argc, char** argv)
     }
   }
 
+  free(files);
   lenv_del(env);
 
   return 0;
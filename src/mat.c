@@ -0,0 +1,142 @@
+#if defined(__unix__) || defined(__APPLE__)
+#define LMAT_PTHREADS 1
+#elif defined(_WIN32)
+#define LMAT_WINTHREADS 1
+#endif
+
+#include "mat.h"
+#include "kern.h"
+
+#include <string.h>
+
+#if defined(LMAT_PTHREADS)
+#include <pthread.h>
+#elif defined(LMAT_WINTHREADS)
+#include <windows.h>
+#endif
+
+/**
+ * The rows of the result a thread computes, from 'from' to 'to' (excluded)
+ */
+typedef struct
+{
+  double* c;
+  double* a;
+  double* b;
+  long m;
+  long p;
+  long from;
+  long to;
+} lmat_band;
+
+/**
+ * c = a * b for the rows of the band: the rows of c get, for every k, the
+ * row k of b times a[i][k] (so b and c are read and written along their
+ * rows), done tile by tile of b
+ */
+void _lmat_band(lmat_band* t)
+{
+  lkern* kern = lkern_get();
+  long m = t->m;
+  long p = t->p;
+
+  memset(t->c + t->from * p, 0, sizeof(double) * (t->to - t->from) * p);
+
+  for (long kk = 0; kk < m; kk += LMAT_TILE_K) {
+    long kend = kk + LMAT_TILE_K < m ? kk + LMAT_TILE_K : m;
+    for (long jj = 0; jj < p; jj += LMAT_TILE_J) {
+      long jn = jj + LMAT_TILE_J < p ? LMAT_TILE_J : p - jj;
+      for (long i = t->from; i < t->to; i++) {
+        double* ci = t->c + i * p + jj;
+        double* ai = t->a + i * m;
+        for (long k = kk; k < kend; k++) {
+          kern->f64_axpy(ci, ai[k], t->b + k * p + jj, jn);
+        }
+      }
+    }
+  }
+}
+
+#if defined(LMAT_PTHREADS)
+void* _lmat_thread(void* t)
+{
+  _lmat_band((lmat_band*)t);
+  return NULL;
+}
+#elif defined(LMAT_WINTHREADS)
+DWORD WINAPI _lmat_thread(LPVOID t)
+{
+  _lmat_band((lmat_band*)t);
+  return 0;
+}
+#endif
+
+void lmat_mul(double* c, double* a, double* b, long n, long m, long p, int threads)
+{
+#if !defined(LMAT_PTHREADS) && !defined(LMAT_WINTHREADS)
+  threads = 1;
+#endif
+  if (threads > LMAT_MAX_THREADS) {
+    threads = LMAT_MAX_THREADS;
+  }
+  if (threads > n) {
+    threads = (int)n;
+  }
+  if (threads < 1) {
+    threads = 1;
+  }
+
+  /* every thread gets as many rows, the calling thread the first ones */
+  lmat_band bands[LMAT_MAX_THREADS];
+  for (int t = 0; t < threads; t++) {
+    lmat_band band = { c, a, b, m, p, n * t / threads, n * (t + 1) / threads };
+    bands[t] = band;
+  }
+
+#if defined(LMAT_PTHREADS)
+  pthread_t ids[LMAT_MAX_THREADS];
+  int started[LMAT_MAX_THREADS];
+  for (int t = 1; t < threads; t++) {
+    started[t] = pthread_create(&ids[t], NULL, _lmat_thread, &bands[t]) == 0;
+  }
+  _lmat_band(&bands[0]);
+  for (int t = 1; t < threads; t++) {
+    if (started[t]) {
+      pthread_join(ids[t], NULL);
+    } else {
+      _lmat_band(&bands[t]);
+    }
+  }
+#elif defined(LMAT_WINTHREADS)
+  HANDLE ids[LMAT_MAX_THREADS];
+  for (int t = 1; t < threads; t++) {
+    ids[t] = CreateThread(NULL, 0, _lmat_thread, &bands[t], 0, NULL);
+  }
+  _lmat_band(&bands[0]);
+  for (int t = 1; t < threads; t++) {
+    if (ids[t]) {
+      WaitForSingleObject(ids[t], INFINITE);
+      CloseHandle(ids[t]);
+    } else {
+      _lmat_band(&bands[t]);
+    }
+  }
+#else
+  _lmat_band(&bands[0]);
+#endif
+}
+
+void lmat_transpose(double* t, double* a, long n, long m)
+{
+  for (long ii = 0; ii < n; ii += LMAT_TILE_T) {
+    long iend = ii + LMAT_TILE_T < n ? ii + LMAT_TILE_T : n;
+    for (long jj = 0; jj < m; jj += LMAT_TILE_T) {
+      long jend = jj + LMAT_TILE_T < m ? jj + LMAT_TILE_T : m;
+      for (long i = ii; i < iend; i++) {
+        for (long j = jj; j < jend; j++) {
+          t[j * n + i] = a[i * m + j];
+        }
+      }
+    }
+  }
+}
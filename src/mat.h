@@ -0,0 +1,46 @@
+#ifndef LISPY_MAT_H
+#define LISPY_MAT_H
+
+#include "fwd.h"
+
+/**
+ * Size of the tiles a multiplication goes through: LMAT_TILE_K rows of
+ * the right matrix by LMAT_TILE_J of its columns (256 KiB, in the L2
+ * cache) are used by every row of the left one before the next tile,
+ * with the LMAT_TILE_J elements of the row of the result in the L1 cache
+ */
+#define LMAT_TILE_K 128
+#define LMAT_TILE_J 256
+
+/**
+ * Size of the square blocks a transposition moves, read and written
+ * within the L1 cache
+ */
+#define LMAT_TILE_T 32
+
+/**
+ * Maximum number of threads a multiplication is split in
+ */
+#define LMAT_MAX_THREADS 64
+
+/**
+ * Multiplies two matrices of doubles, stored row after row
+ *
+ * double* c      the result, n by p (overwritten)
+ * double* a      the left matrix, n by m
+ * double* b      the right matrix, m by p
+ * int threads    number of threads to split the rows of c in, 1 (or
+ *                less) to multiply in the calling thread only; where
+ *                there are no threads it is always 1
+ */
+void lmat_mul(double* c, double* a, double* b, long n, long m, long p, int threads);
+
+/**
+ * Transposes a matrix of doubles
+ *
+ * double* t      the result, m by n
+ * double* a      the matrix, n by m
+ */
+void lmat_transpose(double* t, double* a, long n, long m);
+
+#endif//LISPY_MAT_H
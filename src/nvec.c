@@ -0,0 +1,31 @@
+#include "nvec.h"
+
+lnvec* lnvec_new(long len)
+{
+  if (len < 0 || (unsigned long)len > (SIZE_MAX - LNVEC_ALIGN) / sizeof(double)) {
+    return NULL;
+  }
+
+  lnvec* v = malloc(sizeof(lnvec));
+  v->refs = 1;
+  v->len = len;
+
+  /* malloc() aligns to less than the vector registers, so it is done here */
+  v->mem = malloc(sizeof(double) * len + LNVEC_ALIGN);
+  if (!v->mem) {
+    free(v);
+    return NULL;
+  }
+  uintptr_t p = ((uintptr_t)v->mem + LNVEC_ALIGN - 1) & ~(uintptr_t)(LNVEC_ALIGN - 1);
+  v->f = (double*)p;
+  v->i = (int64_t*)p;
+  return v;
+}
+
+void lnvec_del(lnvec* v)
+{
+  if (--v->refs == 0) {
+    free(v->mem);
+    free(v);
+  }
+}
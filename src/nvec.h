@@ -0,0 +1,54 @@
+#ifndef LISPY_NVEC_H
+#define LISPY_NVEC_H
+
+#include "fwd.h"
+
+#include <stdint.h>
+
+/**
+ * Alignment (bytes) of the numbers of a vector, that of the widest
+ * vector register the kernels use (see kern.h)
+ */
+#define LNVEC_ALIGN 32
+
+/**
+ * Number of elements printed of a numeric vector
+ */
+#define LNVEC_PRINT 16
+
+/**
+ * The numbers of a numeric vector (LVAL_F64VEC or LVAL_I64VEC), unboxed
+ * in one contiguous array, shared by every copy of the value: a vector
+ * is never changed once made, every operation makes a new one
+ */
+struct lnvec
+{
+  /** number of values sharing the numbers **/
+  int refs;
+
+  /** number of elements **/
+  long len;
+
+  /** the elements, 'f' of an LVAL_F64VEC, 'i' of an LVAL_I64VEC (both are the same memory) **/
+  double* f;
+  int64_t* i;
+
+  /** the memory allocated, the elements are aligned to LNVEC_ALIGN within it **/
+  void* mem;
+};
+
+/**
+ * Creates the numbers of a vector, not initialized
+ *
+ * long len     number of elements
+ *
+ * return     the numbers, or NULL if that many cannot be allocated
+ */
+lnvec* lnvec_new(long len);
+
+/**
+ * Releases a reference to the numbers (freed with the last one)
+ */
+void lnvec_del(lnvec* v);
+
+#endif//LISPY_NVEC_H
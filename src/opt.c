@@ -0,0 +1,1086 @@
+#include "opt.h"
+#include "builtins.h"
+#include "utils.h"
+
+/**
+ * The state of an optimization
+ */
+typedef struct lopt
+{
+  /** environment used to resolve symbols, and the global one **/
+  lenv* env;
+  lenv* global;
+
+  /** symbols bound by the code being optimized, those are never resolved **/
+  lval* shadow;
+
+  /** the code defines symbols not known until evaluated, nothing is resolved **/
+  int opaque;
+
+  /** symbols resolved for the calls rewritten, and the functions found **/
+  lval* syms;
+  lval* vals;
+
+  /** guard of the calls rewritten, and the number of those **/
+  int guard;
+  int rewrites;
+} lopt;
+
+/**
+ * The symbols checked by a guard (see lopt_valid())
+ */
+typedef struct lguard
+{
+  /** lenv_epoch when those were last looked up, and if all were found bound as before **/
+  long epoch;
+  int valid;
+
+  /** the symbols (NULL if the guard is free) and the functions those were bound to **/
+  lval* syms;
+  lval* vals;
+} lguard;
+
+lguard* _lopt_guards = NULL;
+int _lopt_nguards = 0;
+
+/* the guards released, to be given again */
+int* _lopt_free = NULL;
+int _lopt_nfree = 0;
+
+/**
+ * Uses of the formal parameters in the body of a function to inline
+ */
+typedef struct luse
+{
+  /** number of times each formal is used **/
+  int uses[LOPT_INLINE_SIZE];
+
+  /** if a formal is used inside an 'if' branch **/
+  int cond[LOPT_INLINE_SIZE];
+
+  /** index of the formals used outside branches, in evaluation order **/
+  int order[LOPT_INLINE_SIZE];
+  int count;
+} luse;
+
+/* builtins without side effects, safe to call at optimization time */
+lbuiltin _lopt_pure[] = {
+  BTNAME(ADD), BTNAME(SUB), BTNAME(MUL), BTNAME(DIV),
+  BTNAME(GT),  BTNAME(GTE), BTNAME(LT),  BTNAME(LTE),
+  BTNAME(EQ),  BTNAME(NEQ),
+  BTNAME(HEAD), BTNAME(TAIL), BTNAME(LIST), BTNAME(JOIN),
+  BTNAME(RECORD_NEW), BTNAME(RECORD_GET), BTNAME(RECORD_IS),
+  NULL
+};
+
+lval* _lopt_call(lopt* o, lval* v);
+lval* _lopt_unwrap(lval* v);
+int _lopt_pureval(lopt* o, lval* v, lval* formals, int depth);
+
+int _lopt_ispure(lval* f)
+{
+  if (!f->builtin) {
+    return 0;
+  }
+
+  for (int i = 0; _lopt_pure[i]; i++) {
+    if (f->builtin == _lopt_pure[i]) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+int _lopt_isif(lval* f)
+{
+  return f && f->builtin == BTNAME(IF);
+}
+
+int _lopt_const(lval* v)
+{
+  return v->type == LVAL_NUM || v->type == LVAL_BIGNUM || v->type == LVAL_FLOAT
+      || v->type == LVAL_STR || v->type == LVAL_QEXPR;
+}
+
+int _lopt_find(lval* syms, char* sym)
+{
+  for (int i = 0; i < syms->count; i++) {
+    if (syms->cell[i]->type == LVAL_SYM && is(syms->cell[i]->sym, sym)) {
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+int _lopt_size(lval* v)
+{
+  int size = 1;
+  if (v->type == LVAL_SEXPR || v->type == LVAL_QEXPR) {
+    for (int i = 0; i < v->count; i++) {
+      size += _lopt_size(v->cell[i]);
+    }
+  }
+  return size;
+}
+
+int _lopt_mentions(lval* v, char* sym)
+{
+  if (v->type == LVAL_SYM) {
+    return is(v->sym, sym);
+  }
+
+  if (v->type == LVAL_SEXPR || v->type == LVAL_QEXPR) {
+    for (int i = 0; i < v->count; i++) {
+      if (_lopt_mentions(v->cell[i], sym)) {
+        return 1;
+      }
+    }
+  }
+
+  return 0;
+}
+
+void _lopt_collect(lopt* o, lval* v)
+{
+  if (v->type != LVAL_SEXPR && v->type != LVAL_QEXPR) {
+    return;
+  }
+
+  /* every symbol defined with def or = is bound by the code */
+  if (v->count > 1 && v->cell[0]->type == LVAL_SYM
+      && (is(v->cell[0]->sym, KW_GDEF) || is(v->cell[0]->sym, KW_LDEF))) {
+    lval* k = v->cell[1];
+    if (k->type == LVAL_SYM) {
+      lval_add(o->shadow, lval_copy(k));
+    } else if (k->type == LVAL_QEXPR) {
+      for (int i = 0; i < k->count; i++) {
+        lval_add(o->shadow, lval_copy(k->cell[i]));
+      }
+    } else {
+      o->opaque = 1;
+    }
+  }
+
+  for (int i = 0; i < v->count; i++) {
+    _lopt_collect(o, v->cell[i]);
+  }
+}
+
+lval* _lopt_resolve(lopt* o, lval* sym)
+{
+  /* a function put in the code by the optimizer resolves to itself */
+  if (sym->type == LVAL_FUN) {
+    return lval_copy(sym);
+  }
+
+  if (o->opaque || sym->type != LVAL_SYM || _lopt_find(o->shadow, sym->sym) >= 0) {
+    return NULL;
+  }
+
+  /**
+   * only the functions bound in the global environment (and not partially
+   * applied), the guard checks that the symbol still finds the function
+   * where the call is evaluated, and binding it advances lenv_epoch
+   */
+  lval* f = lenv_here(o->global, sym);
+  if (!f || f->type != LVAL_FUN || (!f->builtin && f->env->count)) {
+    return NULL;
+  }
+
+  if (!lenv_watched(sym->sym)) {
+    lenv_watch(sym->sym);
+  }
+  lval_add(o->syms, lval_copy(sym));
+  lval_add(o->vals, lval_copy(f));
+
+  return lval_copy(f);
+}
+
+/* forgets the symbols resolved from the one at i on */
+void _lopt_forget(lopt* o, int i)
+{
+  while (o->syms->count > i) {
+    lval_del(lval_pop(o->syms, i));
+    lval_del(lval_pop(o->vals, i));
+  }
+}
+
+int _lopt_isguard(lval* v)
+{
+  return (v->type == LVAL_SEXPR || v->type == LVAL_QEXPR) && v->count == 4
+      && v->cell[0]->type == LVAL_FUN && v->cell[0]->builtin == BTNAME(GUARD);
+}
+
+/* the code of a branch of a guard (2 is the rewritten call, 3 the original one) */
+lval* _lopt_branch(lval* g, int i)
+{
+  lval* x = lval_copy(g->cell[i]);
+  x->type = LVAL_SEXPR;
+  return _lopt_unwrap(x);
+}
+
+lval* _lopt_unwrap(lval* v)
+{
+  /* (x) evaluates to x for any value that is not a symbol */
+  if (v->type == LVAL_SEXPR && v->count == 1 && v->cell[0]->type != LVAL_SYM) {
+    return lval_take(v, 0);
+  }
+
+  return v;
+}
+
+lval* _lopt_code(lopt* o, lval* q)
+{
+  /* a Q-Expression used as code is evaluated as an S-Expression */
+  q->type = LVAL_SEXPR;
+  lval* x = _lopt_call(o, q);
+
+  if (x->type == LVAL_SEXPR) {
+    x->type = LVAL_QEXPR;
+    return x;
+  }
+
+  return lval_add(lval_qexpr(), x);
+}
+
+lval* _lopt_if(lopt* o, lval* v)
+{
+  if (v->count < 3 || v->count > 4 || v->cell[1]->type != LVAL_NUM) {
+    return v;
+  }
+
+  for (int i = 2; i < v->count; i++) {
+    if (v->cell[i]->type != LVAL_QEXPR) {
+      return v;
+    }
+  }
+
+  lval* x = NULL;
+  if (v->cell[1]->num) {
+    x = lval_copy(v->cell[2]);
+  } else if (v->count == 4) {
+    x = lval_copy(v->cell[3]);
+  } else {
+    x = lval_qexpr();
+  }
+
+  /* the branch is evaluated just like 'if' does */
+  x->type = LVAL_SEXPR;
+  return x;
+}
+
+lval* _lopt_fold(lopt* o, lval* f, lval* v)
+{
+  for (int i = 1; i < v->count; i++) {
+    if (!_lopt_const(v->cell[i])) {
+      return v;
+    }
+  }
+
+  lval* a = lval_sexpr();
+  for (int i = 1; i < v->count; i++) {
+    lval_add(a, lval_copy(v->cell[i]));
+  }
+
+  /* errors are left to be reported when evaluated */
+  lval* r = f->builtin(o->env, a);
+  if (!_lopt_const(r)) {
+    lval_del(r);
+    return v;
+  }
+
+  return r;
+}
+
+int _lopt_scan_form(lopt* o, lval* v, lval* formals, int cond, luse* u);
+
+int _lopt_scan(lopt* o, lval* v, lval* formals, int cond, luse* u)
+{
+  if (v->type == LVAL_SEXPR) {
+    return _lopt_scan_form(o, v, formals, cond, u);
+  }
+
+  if (v->type == LVAL_SYM) {
+    int i = _lopt_find(formals, v->sym);
+    if (i >= 0) {
+      u->uses[i]++;
+      if (cond) {
+        u->cond[i] = 1;
+      } else {
+        u->order[u->count++] = i;
+      }
+    }
+  }
+
+  return 1;
+}
+
+int _lopt_scan_form(lopt* o, lval* v, lval* formals, int cond, luse* u)
+{
+  if (v->count == 0) {
+    return 1;
+  }
+
+  if (v->count == 1) {
+    return _lopt_scan(o, v->cell[0], formals, cond, u);
+  }
+
+  /* every call must be to a pure builtin or 'if' */
+  lval* head = v->cell[0];
+  if (head->type != LVAL_SYM || _lopt_find(formals, head->sym) >= 0) {
+    return 0;
+  }
+
+  lval* f = _lopt_resolve(o, head);
+  int isif = _lopt_isif(f);
+  int ok = f && (isif || _lopt_ispure(f));
+  if (f) { lval_del(f); }
+
+  for (int i = 1; ok && i < v->count; i++) {
+    if (isif && i >= 2 && v->cell[i]->type == LVAL_QEXPR) {
+      ok = _lopt_scan_form(o, v->cell[i], formals, 1, u);
+    } else {
+      ok = _lopt_scan(o, v->cell[i], formals, cond, u);
+    }
+  }
+
+  return ok;
+}
+
+void _lopt_subst(lopt* o, lval* v, lval* formals, lval* vals)
+{
+  int isif = 0;
+  if (v->count > 1) {
+    lval* f = _lopt_resolve(o, v->cell[0]);
+    isif = _lopt_isif(f);
+    if (f) { lval_del(f); }
+  }
+
+  for (int i = 0; i < v->count; i++) {
+    lval* x = v->cell[i];
+    if (x->type == LVAL_SYM) {
+      int j = _lopt_find(formals, x->sym);
+      if (j >= 0) {
+        lval_del(x);
+        v->cell[i] = lval_copy(vals->cell[j]);
+      }
+    } else if (x->type == LVAL_SEXPR || (isif && i >= 2 && x->type == LVAL_QEXPR)) {
+      _lopt_subst(o, x, formals, vals);
+    }
+  }
+}
+
+lval* _lopt_inline(lopt* o, lval* f, lval* v)
+{
+  lval* formals = f->formals;
+  int n = formals->count;
+
+  /* only fully unapplied functions with a fixed number of arguments */
+  if (n != v->count - 1 || n > LOPT_INLINE_SIZE || f->env->count != 0
+      || _lopt_find(formals, KW_VARG) >= 0) {
+    return v;
+  }
+
+  /* only small and non-recursive functions */
+  if (_lopt_size(f->body) > LOPT_INLINE_SIZE
+      || (v->cell[0]->type == LVAL_SYM && _lopt_mentions(f->body, v->cell[0]->sym))) {
+    return v;
+  }
+
+  luse u = {{0}, {0}, {0}, 0};
+  if (!_lopt_scan_form(o, f->body, formals, 0, &u)) {
+    return v;
+  }
+
+  /**
+   * arguments that are not constants or symbols must be evaluated
+   * exactly once and in the same order they were passed, and bind
+   * nothing, as the symbols of the body are now resolved after those
+   */
+  for (int i = 0; i < n; i++) {
+    lval* x = v->cell[i + 1];
+    if (x->type == LVAL_SEXPR
+        && (u.uses[i] != 1 || u.cond[i] || !_lopt_pureval(o, x, o->shadow, 0))) {
+      return v;
+    }
+  }
+
+  int last = -1;
+  for (int i = 0; i < u.count; i++) {
+    if (v->cell[u.order[i] + 1]->type == LVAL_SEXPR) {
+      if (u.order[i] < last) {
+        return v;
+      }
+      last = u.order[i];
+    }
+  }
+
+  lval* vals = lval_copy(v);
+  lval_del(lval_pop(vals, 0));
+  lval* x = lval_copy(f->body);
+  _lopt_subst(o, x, formals, vals);
+  lval_del(vals);
+
+  x->type = LVAL_SEXPR;
+  return _lopt_call(o, x);
+}
+
+int _lopt_invariant(lval* v, char* name, lval* formals, int i)
+{
+  if (v->type != LVAL_SEXPR && v->type != LVAL_QEXPR) {
+    return 1;
+  }
+
+  /* every recursive call must pass the formal itself at the same position */
+  if (v->count > 0 && v->cell[0]->type == LVAL_SYM && is(v->cell[0]->sym, name)) {
+    if (v->count != formals->count + 1
+        || v->cell[i + 1]->type != LVAL_SYM
+        || !is(v->cell[i + 1]->sym, formals->cell[i]->sym)) {
+      return 0;
+    }
+  }
+
+  for (int j = 0; j < v->count; j++) {
+    if (!_lopt_invariant(v->cell[j], name, formals, i)) {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+lval* _lopt_constarg(lopt* o, lval* a)
+{
+  if (_lopt_const(a)) {
+    return lval_copy(a);
+  }
+
+  /* a function bound to a symbol (checked again when called, see lopt_spec()) */
+  if (a->type == LVAL_SYM) {
+    lval* f = o->opaque || _lopt_find(o->shadow, a->sym) >= 0 ? NULL : lenv_here(o->global, a);
+    return f && f->type == LVAL_FUN ? lval_copy(f) : NULL;
+  }
+
+  if (a->type == LVAL_FUN) {
+    return lval_copy(a);
+  }
+
+  /* a lambda expression, creating it has no side effects */
+  if (a->type == LVAL_SEXPR && a->count == 3
+      && a->cell[1]->type == LVAL_QEXPR && a->cell[2]->type == LVAL_QEXPR) {
+    lval* f = _lopt_resolve(o, a->cell[0]);
+    int islambda = f && f->builtin == BTNAME(LAMBDA);
+    if (f) { lval_del(f); }
+    if (islambda) {
+      lval* args = lval_copy(a);
+      lval_del(lval_pop(args, 0));
+      lval* x = BTNAME(LAMBDA)(o->env, args);
+      if (x->type == LVAL_FUN) {
+        return x;
+      }
+      lval_del(x);
+    }
+  }
+
+  return NULL;
+}
+
+/**
+ * The functions specialized, each one as {f consts spec}: the function,
+ * the constants (an empty S-Expression for the formals not specialized)
+ * and the copy of the function with those constants in its body
+ */
+lval* _lopt_specs = NULL;
+
+/* the specialization of f for the constants, and the number of those of f */
+int _lopt_spec_find(lval* f, lval* consts, int* count)
+{
+  *count = 0;
+  for (int i = 0; i < _lopt_specs->count; i++) {
+    lval* entry = _lopt_specs->cell[i];
+    if (lval_eq(entry->cell[0], f)) {
+      (*count)++;
+      if (lval_eq(entry->cell[1], consts)) {
+        return i;
+      }
+    }
+  }
+
+  return -1;
+}
+
+int _lopt_spec_new(lopt* fo, lval* f, lval* consts)
+{
+  lval* cformals = lval_qexpr();
+  lval* cvals = lval_qexpr();
+  for (int i = 0; i < consts->count; i++) {
+    if (consts->cell[i]->type != LVAL_SEXPR) {
+      lval_add(cformals, lval_copy(f->formals->cell[i]));
+      lval_add(cvals, lval_copy(consts->cell[i]));
+    }
+  }
+
+  /**
+   * the constants replace their formals in the code of the body, those
+   * are still bound (the functions called may look those up), and the
+   * recursive calls are specialized when the copy is optimized
+   */
+  lval* body = lval_copy(f->body);
+  _lopt_subst(fo, body, cformals, cvals);
+  lval_del(cformals);
+  lval_del(cvals);
+
+  if (lval_eq(body, f->body)) {
+    lval_del(body);
+    return -1;
+  }
+
+  lval* entry = lval_qexpr();
+  lval_add(entry, lval_copy(f));
+  lval_add(entry, lval_copy(consts));
+  lval_add(entry, lval_lambda(lval_copy(f->formals), body));
+  lval_add(_lopt_specs, entry);
+
+  return _lopt_specs->count - 1;
+}
+
+lval* _lopt_specialize(lopt* o, lval* f, lval* v)
+{
+  char* name = v->cell[0]->sym;
+  lval* formals = f->formals;
+  int n = formals->count;
+
+  /* only fully unapplied functions with a fixed number of arguments */
+  if (n != v->count - 1 || f->env->count != 0 || _lopt_find(formals, KW_VARG) >= 0) {
+    return v;
+  }
+
+  lopt fo = *o;
+  fo.shadow = lval_copy(formals);
+  fo.opaque = 0;
+  _lopt_collect(&fo, f->body);
+
+  /**
+   * a formal is specialized if a constant is passed to it, and that
+   * constant is passed unchanged to every recursive call, an empty
+   * S-Expression marks the formals not specialized
+   */
+  lval* consts = lval_qexpr();
+  int count = 0;
+  for (int i = 0; i < n; i++) {
+    lval* c = NULL;
+    if (fo.shadow->count == n && !fo.opaque && _lopt_invariant(f->body, name, formals, i)) {
+      c = _lopt_constarg(o, v->cell[i + 1]);
+    }
+    if (c) {
+      count++;
+    }
+    lval_add(consts, c ? c : lval_sexpr());
+  }
+
+  int spec = -1;
+  if (count) {
+    if (!_lopt_specs) {
+      _lopt_specs = lval_qexpr();
+    }
+
+    int specs = 0;
+    spec = _lopt_spec_find(f, consts, &specs);
+    if (spec < 0 && specs < LOPT_SPEC_LIMIT) {
+      spec = _lopt_spec_new(&fo, f, consts);
+    }
+  }
+
+  /* (spec n args...) with the same arguments */
+  if (spec >= 0) {
+    lval* x = lval_add(lval_sexpr(), lval_fun(BTNAME(SPEC), KW_SPEC));
+    lval_add(x, lval_num(spec));
+    for (int i = 1; i < v->count; i++) {
+      lval_add(x, lval_copy(v->cell[i]));
+    }
+    v = x;
+  }
+
+  lval_del(consts);
+  lval_del(fo.shadow);
+  return v;
+}
+
+int _lopt_purecode(lopt* o, lval* v, lval* formals, int depth);
+
+int _lopt_pureval(lopt* o, lval* v, lval* formals, int depth)
+{
+  return v->type != LVAL_SEXPR || _lopt_purecode(o, v, formals, depth);
+}
+
+/* every call in the code is to a pure builtin, 'if' or a pure function */
+int _lopt_purecode(lopt* o, lval* v, lval* formals, int depth)
+{
+  if (v->count == 0) {
+    return 1;
+  }
+
+  if (v->count == 1) {
+    return _lopt_pureval(o, v->cell[0], formals, depth);
+  }
+
+  /* a call rewritten by the optimizer, either of its forms may be evaluated */
+  if (_lopt_isguard(v)) {
+    return _lopt_purecode(o, v->cell[2], formals, depth)
+        && _lopt_purecode(o, v->cell[3], formals, depth);
+  }
+
+  lval* head = v->cell[0];
+  if (head->type != LVAL_SYM || _lopt_find(formals, head->sym) >= 0
+      || depth > LOPT_PURE_DEPTH) {
+    return 0;
+  }
+
+  lval* f = _lopt_resolve(o, head);
+  if (!f) {
+    return 0;
+  }
+
+  int isif = _lopt_isif(f);
+  int pure = isif || _lopt_ispure(f) || f->builtin == BTNAME(LAMBDA)
+          || (!f->builtin && _lopt_purecode(o, f->body, f->formals, depth + 1));
+  lval_del(f);
+
+  for (int i = 1; pure && i < v->count; i++) {
+    if (isif && i >= 2 && v->cell[i]->type == LVAL_QEXPR) {
+      pure = _lopt_purecode(o, v->cell[i], formals, depth);
+    } else {
+      pure = _lopt_pureval(o, v->cell[i], formals, depth);
+    }
+  }
+
+  return pure;
+}
+
+/* a function (or a lambda expression) that only calls pure functions */
+int _lopt_purefn(lopt* o, lval* x)
+{
+  if (x->type == LVAL_SEXPR && x->count == 3
+      && x->cell[1]->type == LVAL_QEXPR && x->cell[2]->type == LVAL_QEXPR) {
+    lval* f = _lopt_resolve(o, x->cell[0]);
+    int pure = f && f->builtin == BTNAME(LAMBDA)
+            && _lopt_purecode(o, x->cell[2], x->cell[1], 0);
+    if (f) { lval_del(f); }
+    return pure;
+  }
+
+  if (x->type != LVAL_SYM && x->type != LVAL_FUN) {
+    return 0;
+  }
+
+  lval* f = _lopt_resolve(o, x);
+  if (!f) {
+    return 0;
+  }
+
+  int pure = _lopt_ispure(f)
+          || (!f->builtin && _lopt_purecode(o, f->body, f->formals, 0));
+  lval_del(f);
+  return pure;
+}
+
+/**
+ * The stages of a call to a list function (map, filter, foldl, take or
+ * drop) or to 'fuse', from the last one, or NULL if it is not a call
+ * to one of those
+ */
+lval* _lopt_stages(lval* f, lval* v)
+{
+  if (f->builtin == BTNAME(FUSE)) {
+    return (v->count > 2 && v->cell[1]->type == LVAL_QEXPR) ? lval_copy(v->cell[1]) : NULL;
+  }
+
+  int args = -1;
+  if (f->builtin == BTNAME(MAP) || f->builtin == BTNAME(FILTER)
+      || f->builtin == BTNAME(TAKE) || f->builtin == BTNAME(DROP)) {
+    args = 1;
+  }
+  if (f->builtin == BTNAME(FOLDL)) {
+    args = 2;
+  }
+
+  if (args < 0 || v->count != args + 2) {
+    return NULL;
+  }
+
+  return lval_add(lval_qexpr(), lval_sym(f->sym));
+}
+
+/**
+ * The functions passed to the stages of a call to 'fuse' are called
+ * element by element, those must be pure if there is more than one
+ */
+int _lopt_fusable(lopt* o, lval* x)
+{
+  lval* names = x->cell[1];
+  int arg = 2;
+  int fns = 0;
+  int pure = 1;
+
+  for (int i = 0; i < names->count; i++) {
+    lval* name = names->cell[i];
+    if (name->type != LVAL_SYM || (i > 0 && is(name->sym, KW_FOLDL))) {
+      return 0;
+    }
+    if (is(name->sym, KW_MAP) || is(name->sym, KW_FILTER) || is(name->sym, KW_FOLDL)) {
+      fns++;
+      pure = pure && arg < x->count && _lopt_purefn(o, x->cell[arg]);
+    }
+    arg += is(name->sym, KW_FOLDL) ? 2 : 1;
+  }
+
+  return arg == x->count - 1 && (fns < 2 || pure);
+}
+
+lval* _lopt_fuse(lopt* o, lval* f, lval* v)
+{
+  lval* outer = _lopt_stages(f, v);
+  if (!outer) {
+    return v;
+  }
+
+  /* the list is built by another stage */
+  lval* in = v->cell[v->count - 1];
+  lval* g = (in->type == LVAL_SEXPR && in->count > 1) ? _lopt_resolve(o, in->cell[0]) : NULL;
+  lval* inner = g ? _lopt_stages(g, in) : NULL;
+  int infuse = g && g->builtin == BTNAME(FUSE);
+  if (g) { lval_del(g); }
+
+  if (!inner) {
+    lval_del(outer);
+    return v;
+  }
+
+  lval* x = lval_add(lval_sexpr(), lval_fun(BTNAME(FUSE), KW_FUSE));
+  lval_add(x, lval_join(outer, inner));
+  for (int i = f->builtin == BTNAME(FUSE) ? 2 : 1; i < v->count - 1; i++) {
+    lval_add(x, lval_copy(v->cell[i]));
+  }
+  for (int i = infuse ? 2 : 1; i < in->count; i++) {
+    lval_add(x, lval_copy(in->cell[i]));
+  }
+
+  if (!_lopt_fusable(o, x)) {
+    lval_del(x);
+    return v;
+  }
+
+  return x;
+}
+
+/* the arguments of a call, with the calls rewritten in a guard as they were rewritten */
+lval* _lopt_peel(lval* v)
+{
+  lval* x = v;
+  for (int i = 1; i < v->count; i++) {
+    if (v->cell[i]->type == LVAL_SEXPR && _lopt_isguard(v->cell[i])) {
+      if (x == v) {
+        x = lval_copy(v);
+      }
+      lval_del(x->cell[i]);
+      x->cell[i] = _lopt_branch(v->cell[i], 2);
+    }
+  }
+
+  return x;
+}
+
+/* the code as it was written, every guard in it replaced by the original call */
+lval* _lopt_strip(lval* v)
+{
+  if (v->type != LVAL_SEXPR && v->type != LVAL_QEXPR) {
+    return v;
+  }
+
+  if (_lopt_isguard(v)) {
+    int type = v->type;
+    v = lval_take(v, 3);
+    v->type = type;
+    return v;
+  }
+
+  for (int i = 0; i < v->count; i++) {
+    v->cell[i] = _lopt_strip(v->cell[i]);
+  }
+
+  return v;
+}
+
+lval* _lopt_quote(lval* x)
+{
+  if (x->type == LVAL_SEXPR) {
+    x->type = LVAL_QEXPR;
+    return x;
+  }
+
+  return lval_add(lval_qexpr(), x);
+}
+
+/* (guard n {x} {v}), both consumed */
+lval* _lopt_guard(lopt* o, lval* x, lval* v)
+{
+  /* a guard right in the rewritten call checks the same symbols */
+  if (x->type == LVAL_SEXPR && _lopt_isguard(x)) {
+    lval* y = _lopt_branch(x, 2);
+    lval_del(x);
+    x = y;
+  }
+
+  o->rewrites++;
+  lval* g = lval_add(lval_sexpr(), lval_fun(BTNAME(GUARD), KW_GUARD));
+  lval_add(g, lval_num(o->guard));
+  lval_add(g, _lopt_quote(x));
+  return lval_add(g, _lopt_quote(_lopt_strip(v)));
+}
+
+lval* _lopt_call(lopt* o, lval* v)
+{
+  if (v->count == 0) {
+    return v;
+  }
+
+  if (v->count == 1) {
+    if (v->cell[0]->type == LVAL_SEXPR) {
+      v->cell[0] = _lopt_call(o, v->cell[0]);
+    }
+    return _lopt_unwrap(v);
+  }
+
+  /* for definitions (def and =) a symbol in the second child is not evaluated */
+  int isdef = (v->cell[0]->type == LVAL_SYM)
+           && (is(v->cell[0]->sym, KW_GDEF) || is(v->cell[0]->sym, KW_LDEF));
+
+  /* the function called is only relied on if the call is rewritten */
+  int head = o->syms->count;
+  lval* f = _lopt_resolve(o, v->cell[0]);
+  int resolved = o->syms->count > head;
+  int isif = _lopt_isif(f);
+
+  for (int i = 0; i < v->count; i++) {
+    lval* x = v->cell[i];
+    if (isdef && i == 1) {
+      continue;
+    }
+    if (x->type == LVAL_SEXPR) {
+      v->cell[i] = _lopt_call(o, x);
+    } else if (isif && i >= 2 && x->type == LVAL_QEXPR) {
+      v->cell[i] = _lopt_code(o, x);
+    }
+  }
+
+  if (!f) {
+    return _lopt_unwrap(v);
+  }
+
+  /* the call is rewritten with its arguments as those were rewritten */
+  lval* a = _lopt_peel(v);
+  int mark = o->syms->count;
+
+  lval* x = a;
+  if (isif) {
+    x = _lopt_if(o, a);
+  } else if (_lopt_ispure(f)) {
+    x = _lopt_fold(o, f, a);
+  } else if (f->builtin) {
+    x = _lopt_fuse(o, f, a);
+  } else {
+    x = _lopt_inline(o, f, a);
+    if (x == a && a->cell[0]->type == LVAL_SYM) {
+      x = _lopt_specialize(o, f, a);
+    }
+  }
+  lval_del(f);
+
+  if (a != v) {
+    lval_del(a);
+  }
+
+  if (x == a) {
+    _lopt_forget(o, mark);
+    if (resolved) {
+      lval_del(lval_pop(o->syms, head));
+      lval_del(lval_pop(o->vals, head));
+    }
+    return _lopt_unwrap(v);
+  }
+
+  return _lopt_guard(o, x, v);
+}
+
+void _lopt_dump(lval* formals, lval* before, lval* after)
+{
+  if (lval_eq(before, after)) {
+    return;
+  }
+
+  lval* forms[] = { before, after };
+  for (int i = 0; i < 2; i++) {
+    printf(i ? "  => " : "OPT: ");
+    if (formals) {
+      printf("(\\ ");
+      lval_print(formals);
+      putchar(' ');
+      lval_print(forms[i]);
+      puts(")");
+    } else {
+      lval_println(forms[i]);
+    }
+  }
+}
+
+void _lopt_init(lopt* o, lenv* e, lval* shadow)
+{
+  o->env = e;
+  o->global = lenv_global(e);
+  o->shadow = shadow;
+  o->opaque = 0;
+  o->syms = lval_qexpr();
+  o->vals = lval_qexpr();
+  o->rewrites = 0;
+
+  if (_lopt_nfree) {
+    o->guard = _lopt_free[--_lopt_nfree];
+  } else {
+    o->guard = _lopt_nguards++;
+    _lopt_guards = realloc(_lopt_guards, sizeof(lguard) * _lopt_nguards);
+  }
+}
+
+/* the guard of the calls rewritten (-1 if none), with every symbol once */
+int _lopt_done(lopt* o)
+{
+  lval_del(o->shadow);
+
+  for (int i = o->syms->count - 1; i > 0; i--) {
+    if (_lopt_find(o->syms, o->syms->cell[i]->sym) < i) {
+      lval_del(lval_pop(o->syms, i));
+      lval_del(lval_pop(o->vals, i));
+    }
+  }
+
+  /* checked the first time, the environment may not find what the global one does */
+  lguard* g = &_lopt_guards[o->guard];
+  g->epoch = -1;
+  g->valid = 0;
+  g->syms = o->syms;
+  g->vals = o->vals;
+
+  if (!o->rewrites) {
+    lopt_release(o->guard);
+    return -1;
+  }
+
+  return o->guard;
+}
+
+lval* lopt_form(lenv* e, lval* v, int* guard)
+{
+  *guard = -1;
+
+  lenv* g = lenv_global(e);
+  if (!g->optimize || v->type != LVAL_SEXPR) {
+    return v;
+  }
+
+  lopt o;
+  _lopt_init(&o, e, lval_qexpr());
+  _lopt_collect(&o, v);
+
+  lval* before = g->dumpopt ? lval_copy(v) : NULL;
+  v = _lopt_call(&o, v);
+
+  if (before) {
+    _lopt_dump(NULL, before, v);
+    lval_del(before);
+  }
+
+  *guard = _lopt_done(&o);
+  return v;
+}
+
+lval* lopt_body(lenv* e, lval* formals, lval* body, int* guard)
+{
+  *guard = -1;
+
+  lenv* g = lenv_global(e);
+  if (!g->optimize) {
+    return NULL;
+  }
+
+  lopt o;
+  _lopt_init(&o, e, lval_copy(formals));
+  _lopt_collect(&o, body);
+
+  lval* x = _lopt_code(&o, lval_copy(body));
+  if (g->dumpopt) {
+    _lopt_dump(formals, body, x);
+  }
+
+  *guard = _lopt_done(&o);
+  if (*guard < 0) {
+    lval_del(x);
+    return NULL;
+  }
+
+  return x;
+}
+
+int _lopt_same(lval* f, lval* x)
+{
+  return f->type == LVAL_FUN && (f->builtin || !f->env->count) && lval_eq(f, x);
+}
+
+lval* lopt_spec(int spec, lval* a)
+{
+  lval* entry = _lopt_specs->cell[spec];
+  lval* consts = entry->cell[1];
+
+  /* a constant is passed where the function was specialized for it */
+  int same = consts->count == a->count;
+  for (int i = 0; same && i < consts->count; i++) {
+    same = consts->cell[i]->type == LVAL_SEXPR || lval_eq(consts->cell[i], a->cell[i]);
+  }
+
+  return lval_copy(entry->cell[same ? 2 : 0]);
+}
+
+int lopt_valid(lenv* e, int guard)
+{
+  lguard* g = &_lopt_guards[guard];
+  if (g->epoch == lenv_epoch) {
+    return g->valid;
+  }
+
+  lenv* global = lenv_global(e);
+  g->valid = 1;
+  for (int i = 0; g->valid && i < g->syms->count; i++) {
+    lval* f = lenv_find(e, g->syms->cell[i]);
+    g->valid = f && f == lenv_here(global, g->syms->cell[i]) && _lopt_same(f, g->vals->cell[i]);
+  }
+  g->epoch = lenv_epoch;
+
+  return g->valid;
+}
+
+void lopt_release(int guard)
+{
+  if (guard < 0) {
+    return;
+  }
+
+  lguard* g = &_lopt_guards[guard];
+  lval_del(g->syms);
+  lval_del(g->vals);
+  g->syms = NULL;
+  g->vals = NULL;
+
+  _lopt_free = realloc(_lopt_free, sizeof(int) * (_lopt_nfree + 1));
+  _lopt_free[_lopt_nfree++] = guard;
+}
@@ -0,0 +1,118 @@
+#ifndef LISPY_OPT_H
+#define LISPY_OPT_H
+
+#include "env.h"
+#include "val.h"
+
+/**
+ * Maximum number of nodes in the body of a function to be inlined
+ */
+#define LOPT_INLINE_SIZE 16
+
+/**
+ * Maximum number of specializations of a single function
+ */
+#define LOPT_SPEC_LIMIT 16
+
+/**
+ * Maximum depth of calls followed to know if a function is pure
+ */
+#define LOPT_PURE_DEPTH 8
+
+/**
+ * Optimizes a form before it is evaluated
+ *
+ * The optimizer rewrites the form into an equivalent (and cheaper) one:
+ *
+ *    - calls to pure builtins with constant arguments are folded
+ *      into their result: (+ 1 2) => 3
+ *
+ *    - an 'if' with a constant condition is replaced by the branch
+ *      it would take: (if 1 {a} {b}) => (a)
+ *
+ *    - calls to small non-recursive functions made only of pure
+ *      builtins are inlined: (not x) => (- 1 x)
+ *
+ *    - calls to functions passing constants (literals or functions)
+ *      that are passed unchanged to every recursive call go to a copy
+ *      of the function with those constants in its body, cached apart
+ *      from the environment by the code of the function and the
+ *      constants: (foldl + 0 l) => (spec n + 0 l), the copy is only
+ *      called if the constants are passed (see lopt_spec())
+ *
+ *    - chains of map, filter, take and drop (ending in any of those or
+ *      in foldl) are fused into a single pass over the list that builds
+ *      no list between them: (foldl f z (map g l)) => (fuse {foldl map} f z g l)
+ *      when the functions passed are pure (if more than one is passed),
+ *      as those are called element by element instead of stage by stage
+ *      (if more than one fails, the error of another one may be reported)
+ *
+ * Only the functions bound in the global environment are resolved, and
+ * a rewritten call is left in the code with its original form behind a
+ * guard: (guard n {3} {+ 1 2}) evaluates 3 while every symbol resolved
+ * by the optimizer is still bound, where it is evaluated, to the same
+ * function it was bound to, and (+ 1 2) otherwise (see lopt_valid()).
+ * So the optimized form gives the same value as the original one even
+ * if a function it relied on is redefined later or bound in the scope
+ * of a caller.
+ *
+ * The optimized code is evaluated by the tree-walking evaluator, the
+ * other engines compile the code as it was written (and resolve the
+ * builtins on their own).
+ *
+ * Does nothing if the optimizer is disabled in the global environment
+ * (it is unless enabled with --opt)
+ *
+ * lenv* e      the environment used to resolve symbols
+ * lval* v      the form to optimize, it is consumed
+ * int* guard   set to the guard of the rewritten calls, to be released
+ *              with lopt_release() once the form is evaluated
+ *
+ * return     the optimized form, evaluating it gives the same value as v
+ */
+lval* lopt_form(lenv* e, lval* v, int* guard);
+
+/**
+ * Optimizes the body of a function, the same way lopt_form() does
+ *
+ * lenv* e          the environment used to resolve symbols
+ * lval* formals    the formal parameters of the function, those
+ *                  symbols are never resolved by the optimizer
+ * lval* body       the body (LVAL_QEXPR) of the function
+ * int* guard       set to the guard of the rewritten calls, to be
+ *                  released with lopt_release() with the body
+ *
+ * return     the optimized body (LVAL_QEXPR), or NULL if the optimizer
+ *            is disabled or had nothing to rewrite
+ */
+lval* lopt_body(lenv* e, lval* formals, lval* body, int* guard);
+
+/**
+ * The function called by (spec n args...), put in the code by the
+ * optimizer for a call to a function specialized for some constants
+ *
+ * int spec     the specialization n
+ * lval* a      the arguments passed
+ *
+ * return     a copy of the specialized function if the arguments are
+ *            the constants, a copy of the function itself otherwise
+ */
+lval* lopt_spec(int spec, lval* a);
+
+/**
+ * If the rewritten calls of a guard can be evaluated in an environment:
+ * every symbol the optimizer resolved still finds, from that environment,
+ * the function it found in the global environment. Those are looked up
+ * again only if lenv_epoch advanced (the symbols are watched).
+ *
+ * return     1 (true) if those can be evaluated, 0 (false) if the
+ *            original forms must be evaluated instead
+ */
+int lopt_valid(lenv* e, int guard);
+
+/**
+ * Releases a guard given by lopt_form() or lopt_body() (nothing if -1)
+ */
+void lopt_release(int guard);
+
+#endif//LISPY_OPT_H
@@ -1,4 +1,5 @@
 #include "parser.h"
+#include "big.h"
 #include "val.h"
 #include "utils.h"
 
@@ -18,7 +19,7 @@ lparser* lparser_new(void)
   /* Define them with the folowwing Language */
   mpca_lang(MPCA_LANG_DEFAULT,
     "                                                       \
-      number    : /-?[0-9]+/ ;                              \
+      number    : /-?[0-9]+(\\.[0-9]+)?(e[-+]?[0-9]+)?/ ;   \
       symbol    : /[a-zA-Z0-9_+\\-*\\/\\\\=<>!:\?]+/ ;      \
       string    : /\"(\\\\.|[^\"])*\"/ ;                    \
       comment   : /;[^\\r\\n]*/ ;                           \
@@ -46,20 +47,53 @@ void lparser_del(lparser* p)
 
 lval* lparser_read_num(mpc_ast_t* t)
 {
+  /* a fraction or an exponent makes it a float */
+  if (strpbrk(t->contents, ".e")) {
+    return lval_float(strtod(t->contents, NULL));
+  }
+
   errno = 0;
   long x = strtol(t->contents, NULL, 10);
-  return errno != ERANGE ? lval_num(x) : lval_err("invalid number");
+  return errno != ERANGE ? lval_num(x) : lval_bignum(lbig_parse(t->contents));
 }
 
 lval* lparser_read_str(mpc_ast_t* t)
 {
-  char* str = t->contents;
-  str[strlen(str) - 1] = '\0';
-  char* unescaped = malloc(strlen(str + 1) + 1);
-  strcpy(unescaped, str + 1);
-  unescaped = mpcf_unescape(unescaped);
-  lval* s = lval_str(unescaped);
-  free(unescaped);
+  /* the contents between the quotes, no longer once unescaped */
+  char* str = t->contents + 1;
+  long n = strlen(str) - 1;
+  char* bytes = malloc(n + 1);
+  long len = 0;
+
+  /* mpc stops unescaping at a '\0', so each part up to a \0 is unescaped on its own */
+  long from = 0;
+  for (long i = 0; i <= n; i++) {
+    int nul = i < n && str[i] == '\\' && str[i + 1] == '0';
+    if (i < n && str[i] == '\\' && !nul) {
+      i++;
+      continue;
+    }
+    if (i < n && !nul) {
+      continue;
+    }
+
+    char* part = malloc(i - from + 1);
+    memcpy(part, str + from, i - from);
+    part[i - from] = '\0';
+    part = mpcf_unescape(part);
+    long m = strlen(part);
+    memcpy(bytes + len, part, m);
+    len += m;
+    free(part);
+
+    if (nul) {
+      bytes[len++] = '\0';
+      from = ++i + 1;
+    }
+  }
+
+  lval* s = lval_strn(bytes, len);
+  free(bytes);
   return s;
 }
 
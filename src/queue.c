@@ -0,0 +1,192 @@
+#include "queue.h"
+#include "val.h"
+
+#include <string.h>
+
+ldeque* ldeque_new(long cap)
+{
+  ldeque* q = malloc(sizeof(ldeque));
+  q->refs = 1;
+  q->head = 0;
+  q->len = 0;
+  q->cap = 1;
+  while (q->cap < cap) {
+    q->cap *= 2;
+  }
+  q->items = malloc(sizeof(lval*) * q->cap);
+  return q;
+}
+
+void ldeque_del(ldeque* q)
+{
+  if (--q->refs == 0) {
+    for (long i = 0; i < q->len; i++) {
+      lval_del(ldeque_get(q, i));
+    }
+    free(q->items);
+    free(q);
+  }
+}
+
+lval* ldeque_get(ldeque* q, long i)
+{
+  return q->items[(q->head + i) & (q->cap - 1)];
+}
+
+void ldeque_push(ldeque* q, lval* x, int back)
+{
+  /* a full ring is unwrapped into one twice as large */
+  if (q->len == q->cap) {
+    lval** items = malloc(sizeof(lval*) * q->cap * 2);
+    for (long i = 0; i < q->len; i++) {
+      items[i] = ldeque_get(q, i);
+    }
+    free(q->items);
+    q->items = items;
+    q->head = 0;
+    q->cap *= 2;
+  }
+
+  if (back) {
+    q->items[(q->head + q->len) & (q->cap - 1)] = x;
+  } else {
+    q->head = (q->head - 1) & (q->cap - 1);
+    q->items[q->head] = x;
+  }
+  q->len++;
+}
+
+lval* ldeque_pop(ldeque* q, int back)
+{
+  q->len--;
+  if (back) {
+    return ldeque_get(q, q->len);
+  }
+  lval* x = q->items[q->head];
+  q->head = (q->head + 1) & (q->cap - 1);
+  return x;
+}
+
+lheap* lheap_new(lval* less, long cap)
+{
+  lheap* h = malloc(sizeof(lheap));
+  h->refs = 1;
+  h->less = less;
+  h->len = 0;
+  h->cap = cap > 0 ? cap : 1;
+  h->items = malloc(sizeof(lval*) * h->cap);
+  return h;
+}
+
+void lheap_del(lheap* h)
+{
+  if (--h->refs == 0) {
+    for (long i = 0; i < h->len; i++) {
+      lval_del(h->items[i]);
+    }
+    if (h->less) {
+      lval_del(h->less);
+    }
+    free(h->items);
+    free(h);
+  }
+}
+
+void lheap_add(lheap* h, lval* x)
+{
+  if (h->len == h->cap) {
+    h->cap *= 2;
+    h->items = realloc(h->items, sizeof(lval*) * h->cap);
+  }
+  h->items[h->len++] = x;
+}
+
+/**
+ * the place x goes down to from i, in the heap of the first n elements:
+ * the children it goes past are put in 'path' and their number returned,
+ * -1 on an error. Nothing is moved, so an error leaves the heap as it was.
+ */
+int _lheap_path(lheap* h, lval* x, long i, long n, long* path, lvec_less less, void* arg)
+{
+  int depth = 0;
+  for (long c = 2 * i + 1; c < n; c = 2 * c + 1) {
+    if (c + 1 < n) {
+      int r = less(h->items[c + 1], h->items[c], arg);
+      if (r < 0) {
+        return -1;
+      }
+      c += r;
+    }
+    int r = less(h->items[c], x, arg);
+    if (r <= 0) {
+      return r < 0 ? -1 : depth;
+    }
+    path[depth++] = c;
+  }
+  return depth;
+}
+
+/* the children on the path from i go up a level, x takes the place of the last one */
+void _lheap_move(lheap* h, lval* x, long i, long* path, int depth)
+{
+  for (int k = 0; k < depth; k++) {
+    h->items[i] = h->items[path[k]];
+    i = path[k];
+  }
+  h->items[i] = x;
+}
+
+int lheap_build(lheap* h, lvec_less less, void* arg)
+{
+  long path[64];
+  for (long i = h->len / 2 - 1; i >= 0; i--) {
+    lval* x = h->items[i];
+    int depth = _lheap_path(h, x, i, h->len, path, less, arg);
+    if (depth < 0) {
+      return 0;
+    }
+    _lheap_move(h, x, i, path, depth);
+  }
+  return 1;
+}
+
+int lheap_push(lheap* h, lval* x, lvec_less less, void* arg)
+{
+  /* the place x goes up to, found before moving anything */
+  long i = h->len;
+  while (i > 0) {
+    int r = less(x, h->items[(i - 1) / 2], arg);
+    if (r < 0) {
+      return 0;
+    }
+    if (!r) {
+      break;
+    }
+    i = (i - 1) / 2;
+  }
+
+  lheap_add(h, x);
+  for (long j = h->len - 1; j != i; j = (j - 1) / 2) {
+    h->items[j] = h->items[(j - 1) / 2];
+  }
+  h->items[i] = x;
+  return 1;
+}
+
+lval* lheap_pop(lheap* h, lvec_less less, void* arg)
+{
+  /* the last element takes the place of the first one, and goes down */
+  long path[64];
+  lval* x = h->items[h->len - 1];
+  int depth = _lheap_path(h, x, 0, h->len - 1, path, less, arg);
+  if (depth < 0) {
+    return NULL;
+  }
+
+  lval* top = h->items[0];
+  h->len--;
+  if (h->len > 0) {
+    _lheap_move(h, x, 0, path, depth);
+  }
+  return top;
+}
@@ -0,0 +1,134 @@
+#ifndef LISPY_QUEUE_H
+#define LISPY_QUEUE_H
+
+#include "fwd.h"
+#include "vec.h"
+
+/**
+ * Number of elements printed of a deque or a priority queue
+ */
+#define LQUEUE_PRINT 16
+
+/**
+ * The elements of a deque (LVAL_DEQUE), in a ring: the array wraps
+ * around, so elements are added and removed at both ends in O(1) without
+ * moving the others. It doubles when full. Like a vector (see vec.h) a
+ * deque is changed in place and shared by every copy of the value.
+ */
+struct ldeque
+{
+  /** number of values sharing the deque **/
+  int refs;
+
+  /** index in 'items' of the first element, and number of elements **/
+  long head;
+  long len;
+
+  /** the elements, 'cap' of them (a power of 2), owned by the deque **/
+  long cap;
+  lval** items;
+};
+
+/**
+ * The elements of a priority queue (LVAL_PQUEUE), in a binary heap: the
+ * element i goes before (or with) its children 2i+1 and 2i+2, so the
+ * first one is the least, and one is added or removed in O(log n). Like a
+ * vector (see vec.h) a priority queue is changed in place and shared by
+ * every copy of the value.
+ */
+struct lheap
+{
+  /** number of values sharing the queue **/
+  int refs;
+
+  /** the function ordering the elements (true of two in order), NULL for the order of keys **/
+  lval* less;
+
+  /** number of elements, and of the ones there is room for **/
+  long len;
+  long cap;
+
+  /** the elements, in the order of the heap, owned by the queue **/
+  lval** items;
+};
+
+/**
+ * Creates an empty deque
+ *
+ * long cap     number of elements it has room for before it grows
+ */
+ldeque* ldeque_new(long cap);
+
+/**
+ * Releases a reference to the deque (freed, with its elements, with the last one)
+ */
+void ldeque_del(ldeque* q);
+
+/**
+ * The element with index i (0 the first one), owned by the deque
+ */
+lval* ldeque_get(ldeque* q, long i);
+
+/**
+ * Adds an element at the front (or the back), x is taken by the deque
+ */
+void ldeque_push(ldeque* q, lval* x, int back);
+
+/**
+ * Removes the first (or last) element, the deque must not be empty
+ *
+ * return     the element, now owned by the caller
+ */
+lval* ldeque_pop(ldeque* q, int back);
+
+/**
+ * Creates an empty priority queue
+ *
+ * lval* less     the function ordering the elements (taken by the queue),
+ *                or NULL for the order of the keys of a sorted map
+ * long cap       number of elements it has room for before it grows
+ */
+lheap* lheap_new(lval* less, long cap);
+
+/**
+ * Releases a reference to the queue (freed, with its elements, with the last one)
+ */
+void lheap_del(lheap* h);
+
+/**
+ * Makes a heap of the elements added with lheap_add(), in O(n)
+ *
+ * lvec_less less, arg    the order of the elements, as in lvec_sort()
+ *
+ * return     1 (true), or 0 (false) if stopped by an error
+ */
+int lheap_build(lheap* h, lvec_less less, void* arg);
+
+/**
+ * Adds an element after the others, not in its place in the heap (before
+ * lheap_build()), x is taken by the queue
+ */
+void lheap_add(lheap* h, lval* x);
+
+/**
+ * Adds an element in its place
+ *
+ * lval* x                the element, taken by the queue but on an error
+ * lvec_less less, arg    the order of the elements, as in lvec_sort()
+ *
+ * return     1 (true), or 0 (false) if stopped by an error, with the
+ *            queue left as it was
+ */
+int lheap_push(lheap* h, lval* x, lvec_less less, void* arg);
+
+/**
+ * Removes the first element (the queue must not be empty)
+ *
+ * lvec_less less, arg    the order of the elements, as in lvec_sort()
+ *
+ * return     the element, now owned by the caller, or NULL if stopped
+ *            by an error, with the queue left as it was
+ */
+lval* lheap_pop(lheap* h, lvec_less less, void* arg);
+
+#endif//LISPY_QUEUE_H
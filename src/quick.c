@@ -0,0 +1,344 @@
+#include "quick.h"
+#include "big.h"
+#include "builtins.h"
+#include "eval.h"
+#include "utils.h"
+
+#include <limits.h>
+
+/**
+ * OPERATIONS of LNODE_NUMOP
+ */
+enum {  LOP_ADD, LOP_SUB, LOP_MUL, LOP_DIV,
+        LOP_GT,  LOP_GTE, LOP_LT,  LOP_LTE,
+        LOP_EQ,  LOP_NEQ };
+
+/* builtins quickened into LNODE_NUMOP, in the order of 'OPERATIONS' */
+lbuiltin _lquick_numops[] = {
+  BTNAME(ADD), BTNAME(SUB), BTNAME(MUL), BTNAME(DIV),
+  BTNAME(GT),  BTNAME(GTE), BTNAME(LT),  BTNAME(LTE),
+  BTNAME(EQ),  BTNAME(NEQ),
+  NULL
+};
+
+lnode* _lquick_new(int kind, lval* val)
+{
+  lnode* n = malloc(sizeof(lnode));
+  n->kind = kind;
+  n->val = val;
+  n->op = 0;
+  n->builtin = NULL;
+  n->epoch = 0;
+  n->misses = 0;
+  n->count = 0;
+  n->child = NULL;
+  n->branch[0] = NULL;
+  n->branch[1] = NULL;
+  return n;
+}
+
+lnode* _lquick_call_node(lval* v)
+{
+  lnode* n = _lquick_new(LNODE_CALL, NULL);
+  n->count = v->count;
+  n->child = malloc(sizeof(lnode*) * n->count);
+
+  /* for definitions (def and =) a symbol in the second child is not evaluated */
+  int isdef = (v->count > 0) && (v->cell[0]->type == LVAL_SYM)
+           && (is(v->cell[0]->sym, KW_GDEF) || is(v->cell[0]->sym, KW_LDEF));
+
+  for (int i = 0; i < v->count; i++) {
+    if (isdef && i == 1 && v->cell[1]->type == LVAL_SYM) {
+      n->child[i] = _lquick_new(LNODE_CONST, lval_copy(v->cell[1]));
+    } else {
+      n->child[i] = lquick_compile(v->cell[i]);
+    }
+  }
+
+  return n;
+}
+
+lnode* lquick_compile(lval* v)
+{
+  switch (v->type) {
+    case LVAL_SYM:    return _lquick_new(LNODE_SYM, lval_copy(v));
+    case LVAL_SEXPR:  return _lquick_call_node(v);
+  }
+
+  return _lquick_new(LNODE_CONST, lval_copy(v));
+}
+
+lnode* lquick_compile_body(lval* body)
+{
+  return _lquick_call_node(body);
+}
+
+void lquick_del(lnode* n)
+{
+  if (!n) {
+    return;
+  }
+
+  if (n->val) {
+    lval_del(n->val);
+  }
+  for (int i = 0; i < n->count; i++) {
+    lquick_del(n->child[i]);
+  }
+  free(n->child);
+  lquick_del(n->branch[0]);
+  lquick_del(n->branch[1]);
+  free(n);
+}
+
+lval* _lquick_sym(lenv* e, lnode* n)
+{
+  /* look in the current environment first, if found remember it */
+  lval* v = lenv_here(e, n->val);
+  if (v) {
+    if (n->misses < LQUICK_MISSES) {
+      n->kind = LNODE_LOCAL;
+    }
+    return lval_copy(v);
+  }
+
+  if (e->parent) {
+    return lenv_get(e->parent, n->val);
+  }
+
+  return lval_err("unbound symbol %s", n->val->sym);
+}
+
+lval* _lquick_local(lenv* e, lnode* n)
+{
+  lval* v = lenv_here(e, n->val);
+  if (v) {
+    return lval_copy(v);
+  }
+
+  n->kind = LNODE_SYM;
+  n->misses++;
+  return _lquick_sym(e, n);
+}
+
+void _lquick_quicken(lnode* n, lval* f, lval* v)
+{
+  if (n->misses >= LQUICK_MISSES || !f->builtin) {
+    return;
+  }
+
+  /* the head must be the symbol that names the builtin, not any other binding */
+  lnode* head = n->child[0];
+  if ((head->kind != LNODE_SYM && head->kind != LNODE_LOCAL)
+      || !is(head->val->sym, f->sym) || !lenv_watched(f->sym)) {
+    return;
+  }
+
+  if (v->count == 2 && v->cell[0]->type == LVAL_NUM && v->cell[1]->type == LVAL_NUM) {
+    for (int i = 0; _lquick_numops[i]; i++) {
+      if (f->builtin == _lquick_numops[i]) {
+        n->kind = LNODE_NUMOP;
+        n->op = i;
+        n->builtin = f->builtin;
+        n->epoch = lenv_epoch;
+        return;
+      }
+    }
+  }
+
+  if (f->builtin == BTNAME(IF) && (v->count == 2 || v->count == 3)) {
+    for (int i = 2; i < n->count; i++) {
+      if (n->child[i]->kind != LNODE_CONST || n->child[i]->val->type != LVAL_QEXPR) {
+        return;
+      }
+    }
+    n->kind = LNODE_IF;
+    n->epoch = lenv_epoch;
+  }
+}
+
+lval* _lquick_apply(lenv* e, lnode* n, lval* v)
+{
+  /* expression with no children */
+  if (v->count == 0) {
+    return v;
+  }
+
+  /* expression with just one children: return that children */
+  if (v->count == 1) {
+    return lval_take(v, 0);
+  }
+
+  lval* f = lval_pop(v, 0);
+  if (f->type != LVAL_FUN) {
+    lval* err = lval_err("%s does not start with a function", ltype_name(v->type));
+    lval_del(v);
+    lval_del(f);
+    return err;
+  }
+
+  if (n) {
+    _lquick_quicken(n, f, v);
+  }
+
+  lval* result = lcall(e, f, v);
+  lval_del(f);
+  return result;
+}
+
+lval* _lquick_call(lenv* e, lnode* n)
+{
+  lval* v = lval_sexpr();
+  v->count = n->count;
+  v->cell = malloc(sizeof(lval*) * n->count);
+
+  /* evaluate all children of expression, if any of those is an error, return that */
+  for (int i = 0; i < n->count; i++) {
+    lval* x = lquick_exec(e, n->child[i]);
+    if (x->type == LVAL_ERR) {
+      v->count = i;
+      lval_del(v);
+      return x;
+    }
+    v->cell[i] = x;
+  }
+
+  return _lquick_apply(e, n, v);
+}
+
+void _lquick_deopt(lnode* n)
+{
+  n->kind = LNODE_CALL;
+  n->misses++;
+}
+
+lval* _lquick_numop(lenv* e, lnode* n)
+{
+  if (n->epoch != lenv_epoch) {
+    _lquick_deopt(n);
+    return _lquick_call(e, n);
+  }
+
+  lval* x = lquick_exec(e, n->child[1]);
+  if (x->type == LVAL_ERR) {
+    return x;
+  }
+
+  lval* y = lquick_exec(e, n->child[2]);
+  if (y->type == LVAL_ERR) {
+    lval_del(x);
+    return y;
+  }
+
+  /* not two numbers, let the builtin handle (or report) it */
+  if (x->type != LVAL_NUM || y->type != LVAL_NUM) {
+    _lquick_deopt(n);
+    lval* a = lval_add(lval_add(lval_sexpr(), x), y);
+    return n->builtin(e, a);
+  }
+
+  long a = x->num;
+  long b = y->num;
+
+  /* on an overflow the builtin makes it a bignum */
+  long r = 0;
+  int overflow = 0;
+  switch (n->op) {
+    case LOP_ADD: overflow = LBIG_ADD(a, b, &r); break;
+    case LOP_SUB: overflow = LBIG_SUB(a, b, &r); break;
+    case LOP_MUL: overflow = LBIG_MUL(a, b, &r); break;
+    case LOP_DIV:
+      if (b == 0) {
+        lval_del(x);
+        lval_del(y);
+        return lval_err("division by zero");
+      }
+      overflow = a == LONG_MIN && b == -1;
+      r = overflow ? 0 : a / b;
+      break;
+
+    case LOP_GT:  r = a >  b; break;
+    case LOP_GTE: r = a >= b; break;
+    case LOP_LT:  r = a <  b; break;
+    case LOP_LTE: r = a <= b; break;
+
+    case LOP_EQ:  r = a == b; break;
+    case LOP_NEQ: r = a != b; break;
+  }
+
+  if (overflow) {
+    return n->builtin(e, lval_add(lval_add(lval_sexpr(), x), y));
+  }
+
+  lval_del(y);
+  x->num = r;
+  return x;
+}
+
+lval* _lquick_if(lenv* e, lnode* n)
+{
+  if (n->epoch != lenv_epoch) {
+    _lquick_deopt(n);
+    return _lquick_call(e, n);
+  }
+
+  lval* c = lquick_exec(e, n->child[1]);
+  if (c->type == LVAL_ERR) {
+    return c;
+  }
+
+  /* not a number, let the builtin report it */
+  if (c->type != LVAL_NUM) {
+    _lquick_deopt(n);
+    lval* a = lval_add(lval_sexpr(), c);
+    for (int i = 2; i < n->count; i++) {
+      lval_add(a, lval_copy(n->child[i]->val));
+    }
+    return BTNAME(IF)(e, a);
+  }
+
+  int b = c->num ? 0 : 1;
+  lval_del(c);
+
+  if (b + 2 >= n->count) {
+    return lval_sexpr();
+  }
+
+  if (!n->branch[b]) {
+    n->branch[b] = lquick_compile_body(n->child[b + 2]->val);
+  }
+
+  return lquick_exec(e, n->branch[b]);
+}
+
+lval* lquick_exec(lenv* e, lnode* n)
+{
+  switch (n->kind) {
+    case LNODE_CONST: return lval_copy(n->val);
+    case LNODE_SYM:   return _lquick_sym(e, n);
+    case LNODE_LOCAL: return _lquick_local(e, n);
+    case LNODE_CALL:  return _lquick_call(e, n);
+    case LNODE_NUMOP: return _lquick_numop(e, n);
+    case LNODE_IF:    return _lquick_if(e, n);
+  }
+
+  return lval_err("invalid node");
+}
+
+lval* lquick_eval(lenv* e, lval* v)
+{
+  lnode* n = lquick_compile(v);
+  lval_del(v);
+  lval* x = lquick_exec(e, n);
+  lquick_del(n);
+  return x;
+}
+
+lval* lquick_call(lval* f)
+{
+  if (!f->code->quick) {
+    f->code->quick = lquick_compile_body(f->body);
+  }
+
+  return lquick_exec(f->env, f->code->quick);
+}
@@ -0,0 +1,122 @@
+#ifndef LISPY_QUICK_H
+#define LISPY_QUICK_H
+
+#include "env.h"
+#include "val.h"
+
+/**
+ * Number of times a node can fail its assumptions before it
+ * stays generic for good
+ */
+#define LQUICK_MISSES 8
+
+/**
+ * KINDS of nodes of the quickening engine
+ *
+ * Every node starts generic (LNODE_CONST, LNODE_SYM or LNODE_CALL) and
+ * rewrites its own kind after it sees what it evaluates to:
+ *
+ *    LNODE_SYM     becomes LNODE_LOCAL when the symbol is found in the
+ *                  environment of the function, and then reads it from
+ *                  there without going through the parents
+ *
+ *    LNODE_CALL    becomes LNODE_NUMOP when it calls an arithmetic,
+ *                  order or equality builtin with two numbers, and then
+ *                  computes the result without looking up the builtin
+ *                  or building the list of arguments
+ *
+ *    LNODE_CALL    becomes LNODE_IF when it calls 'if' with literal
+ *                  branches, and then evaluates the branch taken with
+ *                  nodes compiled only once
+ *
+ * When an assumption fails (the symbol is not bound there, an argument
+ * is not a number, a builtin may have been rebound) the node goes back
+ * to its generic kind and evaluates just like leval() does.
+ */
+enum {  LNODE_CONST, LNODE_SYM,   LNODE_LOCAL,
+        LNODE_CALL,  LNODE_NUMOP, LNODE_IF };
+
+/**
+ * A node of code evaluated by the quickening engine
+ */
+struct lnode
+{
+  /** the kind of node (one of the enum 'KINDS') **/
+  int kind;
+
+  /** value for LNODE_CONST, symbol for LNODE_SYM and LNODE_LOCAL **/
+  lval* val;
+
+  /** operation and builtin for LNODE_NUMOP **/
+  int op;
+  lbuiltin builtin;
+
+  /** value of lenv_epoch when the call was quickened **/
+  long epoch;
+
+  /** times the assumptions of the node failed **/
+  int misses;
+
+  /** children for LNODE_CALL, LNODE_NUMOP and LNODE_IF **/
+  int count;
+  lnode** child;
+
+  /** branches for LNODE_IF, compiled the first time they are taken **/
+  lnode* branch[2];
+};
+
+/**
+ * Compiles a form into a tree of nodes
+ *
+ * lval* v    the form to compile, it is not modified
+ *
+ * return     the root node of the tree
+ */
+lnode* lquick_compile(lval* v);
+
+/**
+ * Compiles the body of a function (or the branch of an 'if')
+ *
+ * lval* body     a Q-Expression, compiled as the S-Expression it
+ *                becomes when evaluated
+ *
+ * return     the root node of the tree
+ */
+lnode* lquick_compile_body(lval* body);
+
+/**
+ * Destroys a tree of nodes
+ */
+void lquick_del(lnode* n);
+
+/**
+ * Evaluates a tree of nodes, rewriting them as needed
+ *
+ * lenv* e      the environment to evaluate in
+ * lnode* n     the root of the tree
+ *
+ * return       the resulting value
+ */
+lval* lquick_exec(lenv* e, lnode* n);
+
+/**
+ * Evaluates a form with the quickening engine
+ *
+ * lenv* e    the environment to evaluate in
+ * lval* v    the form to evaluate, it is consumed
+ *
+ * return     the resulting value
+ */
+lval* lquick_eval(lenv* e, lval* v);
+
+/**
+ * Evaluates the body of a function with all its formals bound, the
+ * body is compiled the first time and shared by every copy of f
+ *
+ * lval* f    the function, its environment ready to evaluate the body
+ *
+ * return     the resulting value
+ */
+lval* lquick_call(lval* f);
+
+#endif//LISPY_QUICK_H
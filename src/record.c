@@ -0,0 +1,69 @@
+#include "record.h"
+#include "val.h"
+#include "utils.h"
+
+#include <string.h>
+
+/* every record type declared, by id */
+lrtype** _lrtype_all = NULL;
+long _lrtype_count = 0;
+
+char* _lrtype_strdup(char* s)
+{
+  char* x = malloc(strlen(s) + 1);
+  strcpy(x, s);
+  return x;
+}
+
+lrtype* lrtype_new(char* name, int count, char** fields, char** types)
+{
+  lrtype* t = malloc(sizeof(lrtype));
+  t->name = _lrtype_strdup(name);
+  t->count = count;
+  t->fields = malloc(sizeof(char*) * count);
+  t->types = malloc(sizeof(char*) * count);
+  for (int i = 0; i < count; i++) {
+    t->fields[i] = _lrtype_strdup(fields[i]);
+    t->types[i] = types && types[i] ? _lrtype_strdup(types[i]) : NULL;
+  }
+
+  t->id = _lrtype_count++;
+  _lrtype_all = realloc(_lrtype_all, sizeof(lrtype*) * _lrtype_count);
+  _lrtype_all[t->id] = t;
+  return t;
+}
+
+lrtype* lrtype_find(long id)
+{
+  return id >= 0 && id < _lrtype_count ? _lrtype_all[id] : NULL;
+}
+
+int lrtype_can(lrtype* t, int i, lval* x)
+{
+  char* type = t->types[i];
+  if (!type) {
+    return 1;
+  }
+  if (x->type == LVAL_RECORD) {
+    return is(x->rec->type->name, type);
+  }
+  return is(ltype_name(x->type), type);
+}
+
+lrecord* lrecord_new(lrtype* t)
+{
+  lrecord* r = malloc(sizeof(lrecord) + sizeof(lval*) * t->count);
+  r->refs = 1;
+  r->type = t;
+  return r;
+}
+
+void lrecord_del(lrecord* r)
+{
+  if (--r->refs == 0) {
+    for (int i = 0; i < r->type->count; i++) {
+      lval_del(r->fields[i]);
+    }
+    free(r);
+  }
+}
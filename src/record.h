@@ -0,0 +1,89 @@
+#ifndef LISPY_RECORD_H
+#define LISPY_RECORD_H
+
+#include "fwd.h"
+
+/**
+ * A record type, declared by defrecord: its name and the names of its
+ * fields, in order, with the type each one must have (if any)
+ *
+ * Every type declared is kept (for as long as the program runs) under a
+ * number, its id: the functions defrecord makes for a type have that
+ * number in their bodies, so they find the type without looking it up by
+ * name, and a type declared again with the same name is a different one.
+ */
+struct lrtype
+{
+  /** the number of the type, its index among all the types declared **/
+  long id;
+
+  /** the name of the type **/
+  char* name;
+
+  /** number of fields, their names and the name of the type of each one (NULL if any) **/
+  int count;
+  char** fields;
+  char** types;
+};
+
+/**
+ * The fields of a value of type LVAL_RECORD, in the order of its type,
+ * right after the type in the same allocation, so a field is read at a
+ * fixed index. A record does not change, so it is shared by every copy.
+ */
+struct lrecord
+{
+  /** number of values sharing the record **/
+  int refs;
+
+  /** the type of the record **/
+  lrtype* type;
+
+  /** the fields, 'type->count' of them, owned by the record **/
+  lval* fields[];
+};
+
+/**
+ * Declares a new record type
+ *
+ * char* name       the name of the type
+ * int count        the number of fields
+ * char** fields    the name of each field
+ * char** types     the name of the type of each field, a type (see
+ *                  ltype_name()) or a record type, NULL for any, or
+ *                  NULL if none of them has one
+ *
+ * The names are copied
+ *
+ * return     the new type, with the next id
+ */
+lrtype* lrtype_new(char* name, int count, char** fields, char** types);
+
+/**
+ * The record type with a given id
+ *
+ * return     the type, or NULL if there is no type with that id
+ */
+lrtype* lrtype_find(long id);
+
+/**
+ * If a value can be the field i of a record of type t
+ *
+ * return     1 (true) if it can, 0 (false) otherwise
+ */
+int lrtype_can(lrtype* t, int i, lval* x);
+
+/**
+ * Creates a record of type t, its fields are to be set by the caller
+ *
+ * return     the new record, with one reference
+ */
+lrecord* lrecord_new(lrtype* t);
+
+/**
+ * Releases a reference to a record, it is destroyed with its fields
+ * when there are no more
+ */
+void lrecord_del(lrecord* r);
+
+#endif//LISPY_RECORD_H
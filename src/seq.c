@@ -0,0 +1,281 @@
+#include "seq.h"
+#include "eval.h"
+#include "iter.h"
+
+lseq* lseq_new(int kind)
+{
+  lseq* s = malloc(sizeof(lseq));
+  s->refs = 1;
+  s->state = LSEQ_PENDING;
+  s->head = NULL;
+  s->tail = NULL;
+  s->kind = kind;
+  s->fn = NULL;
+  s->val = NULL;
+  s->from = 0;
+  s->to = 0;
+  s->step = 0;
+  s->n = 0;
+  s->src = NULL;
+  return s;
+}
+
+lseq* lseq_list(lval* v)
+{
+  lseq* s = lseq_new(LSEQ_RANGE);
+  s->state = LSEQ_END;
+
+  /* built from the end, every cell is the tail of the one before */
+  for (int i = v->count - 1; i >= 0; i--) {
+    lseq* c = lseq_new(LSEQ_RANGE);
+    c->state = LSEQ_CELL;
+    c->head = lval_copy(v->cell[i]);
+    c->tail = s;
+    s = c;
+  }
+
+  return s;
+}
+
+lseq* lseq_coll(lval* v)
+{
+  lseq* s = lseq_new(LSEQ_COLL);
+  s->val = lval_copy(v);
+  return s;
+}
+
+void _lseq_generator_del(lseq* s)
+{
+  if (s->fn) {
+    lval_del(s->fn);
+    s->fn = NULL;
+  }
+  if (s->val) {
+    lval_del(s->val);
+    s->val = NULL;
+  }
+  if (s->src) {
+    lseq_del(s->src);
+    s->src = NULL;
+  }
+}
+
+void lseq_del(lseq* s)
+{
+  /* the chain is freed in a loop, it may be too long to recurse */
+  while (s && --s->refs == 0) {
+    lseq* tail = s->tail;
+    if (s->head) {
+      lval_del(s->head);
+    }
+    _lseq_generator_del(s);
+    free(s);
+    s = tail;
+  }
+}
+
+lval* _lseq_call(lenv* e, lval* f, lval* x)
+{
+  lval* v = lval_add(lval_sexpr(), lval_copy(f));
+  return leval_apply(e, lval_add(v, x));
+}
+
+/* a pending cell after s, with the same generator */
+lseq* _lseq_next(lseq* s, lseq* src)
+{
+  lseq* t = lseq_new(s->kind);
+  t->fn = s->fn ? lval_copy(s->fn) : NULL;
+  t->from = s->from;
+  t->to = s->to;
+  t->step = s->step;
+  t->n = s->n;
+  if (src) {
+    src->refs++;
+    t->src = src;
+  }
+  return t;
+}
+
+/* the cell is x followed by the pending cell t */
+void _lseq_cell(lseq* s, lval* x, lseq* t)
+{
+  _lseq_generator_del(s);
+  s->state = LSEQ_CELL;
+  s->head = x;
+  s->tail = t;
+}
+
+void _lseq_end(lseq* s)
+{
+  _lseq_generator_del(s);
+  s->state = LSEQ_END;
+}
+
+lval* lseq_force(lenv* e, lseq* s)
+{
+  if (s->state != LSEQ_PENDING) {
+    return NULL;
+  }
+
+  switch (s->kind) {
+    case LSEQ_RANGE: {
+      if ((s->step > 0 && s->from >= s->to) || (s->step < 0 && s->from <= s->to)) {
+        _lseq_end(s);
+        break;
+      }
+      /* a step past 'to' ends the range there, it could overflow */
+      unsigned long left = s->step > 0 ? (unsigned long)s->to - (unsigned long)s->from
+                                       : (unsigned long)s->from - (unsigned long)s->to;
+      unsigned long step = s->step > 0 ? (unsigned long)s->step : -(unsigned long)s->step;
+      lseq* t = _lseq_next(s, NULL);
+      t->from = step < left ? s->from + s->step : s->to;
+      _lseq_cell(s, lval_num(s->from), t);
+      break;
+    }
+
+    case LSEQ_ITERATE: {
+      lval* x = s->n ? _lseq_call(e, s->fn, lval_copy(s->val)) : lval_copy(s->val);
+      if (x->type == LVAL_ERR) {
+        return x;
+      }
+      lseq* t = _lseq_next(s, NULL);
+      t->val = lval_copy(x);
+      t->n = 1;
+      _lseq_cell(s, x, t);
+      break;
+    }
+
+    case LSEQ_MAP: {
+      lval* err = lseq_force(e, s->src);
+      if (err) {
+        return err;
+      }
+      if (s->src->state == LSEQ_END) {
+        _lseq_end(s);
+        break;
+      }
+      lval* x = _lseq_call(e, s->fn, lval_copy(s->src->head));
+      if (x->type == LVAL_ERR) {
+        return x;
+      }
+      _lseq_cell(s, x, _lseq_next(s, s->src->tail));
+      break;
+    }
+
+    case LSEQ_FILTER: {
+      /* the elements skipped are not kept, only the cell where it stops */
+      lseq* c = s->src;
+      while (1) {
+        lval* err = lseq_force(e, c);
+        if (err) {
+          return err;
+        }
+        if (c->state == LSEQ_END) {
+          _lseq_end(s);
+          break;
+        }
+
+        lval* r = _lseq_call(e, s->fn, lval_copy(c->head));
+        if (r->type != LVAL_NUM) {
+          if (r->type != LVAL_ERR) {
+            lval* err = lval_err("function '%s' got '%s' from the predicate, expected '%s'.",
+                KW_LAZY_FILTER, ltype_name(r->type), ltype_name(LVAL_NUM));
+            lval_del(r);
+            r = err;
+          }
+          return r;
+        }
+
+        int keep = r->num != 0;
+        lval_del(r);
+        if (keep) {
+          _lseq_cell(s, lval_copy(c->head), _lseq_next(s, c->tail));
+          break;
+        }
+
+        /* move the source forward, dropping the cells already filtered */
+        c->tail->refs++;
+        lseq* next = c->tail;
+        lseq_del(s->src);
+        s->src = next;
+        c = next;
+      }
+      break;
+    }
+
+    case LSEQ_TAKE: {
+      if (s->n == 0) {
+        _lseq_end(s);
+        break;
+      }
+      lval* err = lseq_force(e, s->src);
+      if (err) {
+        return err;
+      }
+      if (s->src->state == LSEQ_END) {
+        _lseq_end(s);
+        break;
+      }
+      lseq* t = _lseq_next(s, s->src->tail);
+      t->n--;
+      _lseq_cell(s, lval_copy(s->src->head), t);
+      break;
+    }
+
+    case LSEQ_GEN: {
+      lval* r = _lseq_call(e, s->fn, lval_copy(s->val));
+      if (r->type == LVAL_ERR) {
+        return r;
+      }
+      if (r->type != LVAL_QEXPR || (r->count != 0 && r->count != 2)) {
+        lval* err = lval_err("function '%s' got '%s' from the generator function, "
+            "expected {} or {element next}.", KW_GENERATOR, ltype_name(r->type));
+        lval_del(r);
+        return err;
+      }
+      if (r->count == 0) {
+        lval_del(r);
+        _lseq_end(s);
+        break;
+      }
+      lseq* t = _lseq_next(s, NULL);
+      t->val = lval_pop(r, 1);
+      _lseq_cell(s, lval_take(r, 0), t);
+      break;
+    }
+
+    /* the copies of a collection share it, every cell has one */
+    case LSEQ_COLL: {
+      liter it;
+      liter_init(&it, s->val);
+      it.i = s->n;
+      lval* x = liter_next(e, &it);
+      liter_done(&it);
+      if (!x) {
+        _lseq_end(s);
+        break;
+      }
+      lseq* t = _lseq_next(s, NULL);
+      t->val = lval_copy(s->val);
+      t->n = it.i;
+      _lseq_cell(s, x, t);
+      break;
+    }
+  }
+
+  return NULL;
+}
+
+void lseq_print(lseq* s)
+{
+  printf("<lazy-seq");
+
+  int i = 0;
+  while (s->state == LSEQ_CELL && i++ < LSEQ_PRINT) {
+    putchar(' ');
+    lval_print(s->head);
+    s = s->tail;
+  }
+
+  printf(s->state == LSEQ_END ? ">" : " ...>");
+}
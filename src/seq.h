@@ -0,0 +1,121 @@
+#ifndef LISPY_SEQ_H
+#define LISPY_SEQ_H
+
+#include "env.h"
+#include "val.h"
+
+/**
+ * Number of elements printed of a lazy sequence
+ */
+#define LSEQ_PRINT 16
+
+/**
+ * STATES of a cell of a lazy sequence
+ *
+ *    LSEQ_PENDING    not computed yet, its generator computes it
+ *    LSEQ_CELL       an element (head) and the rest of the sequence (tail)
+ *    LSEQ_END        the end of the sequence
+ */
+enum { LSEQ_PENDING, LSEQ_CELL, LSEQ_END };
+
+/**
+ * GENERATORS of a pending cell
+ *
+ *    LSEQ_RANGE      the numbers from 'from' to 'to' (exclusive) by 'step'
+ *    LSEQ_ITERATE    val, then fn of it, then fn of that... (if n is set
+ *                    val is the previous element, and fn of it is the next)
+ *    LSEQ_MAP        fn of every element of src
+ *    LSEQ_FILTER     the elements of src that fn is true of
+ *    LSEQ_TAKE       the first n elements of src
+ *    LSEQ_GEN        fn of val is {x next} for the element x (and next is
+ *                    the val of the cell after), or {} for the end
+ *    LSEQ_COLL       the elements of val, a collection, taken with a cursor
+ *                    from its index n (see liter_next())
+ */
+enum { LSEQ_RANGE, LSEQ_ITERATE, LSEQ_MAP, LSEQ_FILTER, LSEQ_TAKE, LSEQ_GEN, LSEQ_COLL };
+
+/**
+ * A cell of a lazy sequence, shared by every value and cell that has it
+ *
+ * A sequence is a chain of cells, each one computed the first time it is
+ * forced and kept (memoized) from then on. Once computed a cell drops
+ * its generator, so cells no longer referenced by a value are freed as
+ * soon as the sequence goes past them: walking an unbounded sequence
+ * without keeping its first cell needs bounded memory.
+ */
+struct lseq
+{
+  /** number of values and cells sharing the cell **/
+  int refs;
+
+  /** the state (one of the enum 'STATES') **/
+  int state;
+
+  /** the element and the rest of the sequence (LSEQ_CELL) **/
+  lval* head;
+  lseq* tail;
+
+  /** the generator (one of the enum 'GENERATORS') and its state **/
+  int kind;
+  lval* fn;
+  lval* val;
+  long from;
+  long to;
+  long step;
+  long n;
+  lseq* src;
+};
+
+/**
+ * Creates a pending cell
+ *
+ * int kind     the generator (one of the enum 'GENERATORS'), the rest
+ *              of its state must be set by the caller
+ *
+ * return     the cell, with one reference
+ */
+lseq* lseq_new(int kind);
+
+/**
+ * Creates a sequence (already computed) with the children of a list
+ *
+ * lval* v    the list (LVAL_QEXPR), it is not consumed
+ *
+ * return     the first cell, with one reference
+ */
+lseq* lseq_list(lval* v);
+
+/**
+ * Creates a sequence with the elements of a collection, taken from it
+ * as the sequence is forced
+ *
+ * lval* v    the collection (one liter_can() is true of, but a Lazy
+ *            Sequence), it is not consumed
+ *
+ * return     the first cell, with one reference
+ */
+lseq* lseq_coll(lval* v);
+
+/**
+ * Drops a reference to a cell, freeing it (and the cells after it no
+ * longer referenced) when there are no more
+ */
+void lseq_del(lseq* s);
+
+/**
+ * Computes a cell if it is pending
+ *
+ * lenv* e      the environment to call functions in
+ * lseq* s      the cell
+ *
+ * return     NULL if the cell is computed (it may be the end), or the
+ *            error of a function called, the cell is still pending then
+ */
+lval* lseq_force(lenv* e, lseq* s);
+
+/**
+ * Prints the elements of a sequence computed so far
+ */
+void lseq_print(lseq* s);
+
+#endif//LISPY_SEQ_H
@@ -0,0 +1,73 @@
+#include "str.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+lstr* lstr_new(char* s, long len)
+{
+  lstr* x = malloc(sizeof(lstr) + len + 1);
+  x->refs = 1;
+  x->len = len;
+  x->hash = 0;
+  memcpy(x->bytes, s, len);
+  x->bytes[len] = '\0';
+  return x;
+}
+
+void lstr_del(lstr* s)
+{
+  if (--s->refs == 0) {
+    free(s);
+  }
+}
+
+uint64_t lstr_hash(lstr* s)
+{
+  if (s->hash) {
+    return s->hash;
+  }
+
+  /* 8 bytes at a time, mixed in with a multiplication, then the rest */
+  uint64_t h = 0x9e3779b97f4a7c15ULL ^ (uint64_t)s->len;
+  uint64_t w;
+  long i = 0;
+  for (; i + 8 <= s->len; i += 8) {
+    memcpy(&w, s->bytes + i, 8);
+    h = (h ^ w) * 0xff51afd7ed558ccdULL;
+    h ^= h >> 32;
+  }
+  w = 0;
+  memcpy(&w, s->bytes + i, s->len - i);
+  h = (h ^ w) * 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 29;
+
+  /* 0 is for a hash not computed yet */
+  s->hash = h ? h : 1;
+  return s->hash;
+}
+
+int lstr_eq(lstr* x, lstr* y)
+{
+  if (x == y) {
+    return 1;
+  }
+  if (x->len != y->len) {
+    return 0;
+  }
+  if ((x->hash && y->hash) || x->len >= LSTR_HASHED) {
+    if (lstr_hash(x) != lstr_hash(y)) {
+      return 0;
+    }
+  }
+  return memcmp(x->bytes, y->bytes, x->len) == 0;
+}
+
+int lstr_cmp(lstr* x, lstr* y)
+{
+  long n = x->len < y->len ? x->len : y->len;
+  int c = memcmp(x->bytes, y->bytes, n);
+  if (c) {
+    return c;
+  }
+  return (x->len > y->len) - (x->len < y->len);
+}
@@ -0,0 +1,70 @@
+#ifndef LISPY_STR_H
+#define LISPY_STR_H
+
+#include "fwd.h"
+
+#include <stdint.h>
+
+/**
+ * Length from which the equality of two strings compares their hashes
+ * before their bytes, the shorter ones are compared as fast as hashed
+ */
+#define LSTR_HASHED 32
+
+/**
+ * The bytes of a String (LVAL_STR), right after its length and hash in
+ * the same allocation, with a '\0' after them for the C functions (but
+ * the string can have others in it). A string does not change, so it is
+ * shared by every copy of the value: passing a long one around copies
+ * no bytes, and its hash is computed once.
+ */
+struct lstr
+{
+  /** number of values sharing the string **/
+  int refs;
+
+  /** number of bytes, without the '\0' after them **/
+  long len;
+
+  /** hash of the bytes, 0 until first needed (see lstr_hash()) **/
+  uint64_t hash;
+
+  /** the bytes **/
+  char bytes[];
+};
+
+/**
+ * Creates a string with a copy of len bytes of s
+ *
+ * return     the new string, with one reference
+ */
+lstr* lstr_new(char* s, long len);
+
+/**
+ * Releases a reference to a string (freed with the last one)
+ */
+void lstr_del(lstr* s);
+
+/**
+ * The hash of the bytes of a string, computed the first time and kept
+ */
+uint64_t lstr_hash(lstr* s);
+
+/**
+ * If two strings have the same bytes: the same string, then the lengths,
+ * then the hashes (if known, or if long enough to be worth computing)
+ * are compared before the bytes
+ *
+ * return     1 (true) if they do, 0 (false) otherwise
+ */
+int lstr_eq(lstr* x, lstr* y);
+
+/**
+ * The order of two strings, byte by byte (as unsigned), a string before
+ * the longer ones starting with it
+ *
+ * return     < 0 if x goes first, > 0 if y does, 0 if equal
+ */
+int lstr_cmp(lstr* x, lstr* y);
+
+#endif//LISPY_STR_H
@@ -0,0 +1,546 @@
+#include "table.h"
+#include "dict.h"
+#include "nvec.h"
+#include "val.h"
+
+#include <math.h>
+#include <string.h>
+
+#if defined(__GNUC__) || defined(__clang__)
+#define LTABLE_POPCOUNT(x) __builtin_popcountll(x)
+#define LTABLE_CTZ(x) __builtin_ctzll(x)
+#else
+#define LTABLE_POPCOUNT(x) _ltable_popcount(x)
+#define LTABLE_CTZ(x) _ltable_ctz(x)
+#endif
+
+/**
+ * A hash table of the groups of rows with equal keys, each one known by
+ * its first row
+ */
+typedef struct
+{
+  /** number of slots (a power of 2), each one a group + 1 or 0 if empty **/
+  long cap;
+  long* slots;
+
+  /** number of groups, and room for them in 'first' and 'hash' **/
+  long count;
+  long size;
+  long* first;
+  uint64_t* hash;
+} ltable_index;
+
+int _ltable_popcount(uint64_t x)
+{
+  int n = 0;
+  while (x) {
+    x &= x - 1;
+    n++;
+  }
+  return n;
+}
+
+int _ltable_ctz(uint64_t x)
+{
+  int i = 0;
+  while (!(x & 1)) {
+    x >>= 1;
+    i++;
+  }
+  return i;
+}
+
+ltable* ltable_new(long rows, int count)
+{
+  ltable* t = malloc(sizeof(ltable));
+  t->refs = 1;
+  t->rows = rows;
+  t->count = count;
+  t->cols = malloc(sizeof(lcolumn) * (count > 0 ? count : 1));
+  for (int i = 0; i < count; i++) {
+    t->cols[i].name = NULL;
+    t->cols[i].vec = NULL;
+    t->cols[i].strs = NULL;
+  }
+  return t;
+}
+
+void ltable_del(ltable* t)
+{
+  if (--t->refs > 0) {
+    return;
+  }
+
+  for (int i = 0; i < t->count; i++) {
+    free(t->cols[i].name);
+    if (t->cols[i].vec) {
+      lnvec_del(t->cols[i].vec);
+    }
+    if (t->cols[i].strs) {
+      lval_del(t->cols[i].strs);
+    }
+  }
+  free(t->cols);
+  free(t);
+}
+
+void ltable_set(ltable* t, int i, char* name, int type, lnvec* vec, lval* strs)
+{
+  lcolumn* c = &t->cols[i];
+  c->name = malloc(strlen(name) + 1);
+  strcpy(c->name, name);
+  c->type = type;
+  c->vec = vec;
+  c->strs = strs;
+}
+
+int ltable_find(ltable* t, char* name)
+{
+  for (int i = 0; i < t->count; i++) {
+    if (strcmp(t->cols[i].name, name) == 0) {
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+lval* ltable_cell(ltable* t, int col, long row)
+{
+  lcolumn* c = &t->cols[col];
+  switch (c->type) {
+    case LVAL_FLOAT: return lval_float(c->vec->f[row]);
+    case LVAL_STR:   return lval_copy(c->strs->cell[c->vec->i[row]]);
+  }
+
+  return lval_num((long)c->vec->i[row]);
+}
+
+lnvec* ltable_encode(lval** s, long n, lval** strs)
+{
+  ldict* d = ldict_new(16);
+  lnvec* v = lnvec_new(n);
+  *strs = lval_qexpr();
+  for (long k = 0; k < n; k++) {
+    lval* i = ldict_get(d, s[k]);
+    if (!i) {
+      i = lval_num((*strs)->count);
+      ldict_put(d, lval_copy(s[k]), i);
+      lval_add(*strs, lval_copy(s[k]));
+    }
+    v->i[k] = i->num;
+  }
+  ldict_del(d);
+  return v;
+}
+
+/* sets the column 'at' of r to the cells of the column 'col' of t in the rows idx[0..n) */
+void _ltable_gather(ltable* r, int at, ltable* t, int col, long* idx, long n)
+{
+  lcolumn* c = &t->cols[col];
+  lnvec* v = lnvec_new(n);
+  if (c->type == LVAL_FLOAT) {
+    for (long k = 0; k < n; k++) {
+      v->f[k] = c->vec->f[idx[k]];
+    }
+  } else {
+    for (long k = 0; k < n; k++) {
+      v->i[k] = c->vec->i[idx[k]];
+    }
+  }
+
+  ltable_set(r, at, c->name, c->type, v, c->strs ? lval_copy(c->strs) : NULL);
+}
+
+ltable* ltable_select(ltable* t, uint64_t* sel)
+{
+  long words = (t->rows + 63) / 64;
+  long n = 0;
+  for (long w = 0; w < words; w++) {
+    n += LTABLE_POPCOUNT(sel[w]);
+  }
+
+  /* the rows selected, found a word at a time */
+  long* idx = malloc(sizeof(long) * (n + 1));
+  long k = 0;
+  for (long w = 0; w < words; w++) {
+    for (uint64_t m = sel[w]; m; m &= m - 1) {
+      idx[k++] = w * 64 + LTABLE_CTZ(m);
+    }
+  }
+
+  ltable* r = ltable_new(n, t->count);
+  for (int i = 0; i < t->count; i++) {
+    _ltable_gather(r, i, t, i, idx, n);
+  }
+  free(idx);
+  return r;
+}
+
+uint64_t _ltable_mix(uint64_t x)
+{
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+/**
+ * The cells of a key column as 64 bits, equal where the cells are equal
+ * (0.0 and -0.0 are, and so are all the nans); the strings are the index
+ * given to them in 'remap' if there is one (-1 for a string not there)
+ */
+uint64_t* _ltable_keys(lcolumn* c, long rows, long* remap)
+{
+  uint64_t* k = malloc(sizeof(uint64_t) * (rows + 1));
+  if (c->type == LVAL_FLOAT) {
+    for (long r = 0; r < rows; r++) {
+      double d = c->vec->f[r];
+      d = d == 0 ? 0.0 : (d != d ? NAN : d);
+      memcpy(&k[r], &d, sizeof(uint64_t));
+    }
+  } else if (remap) {
+    for (long r = 0; r < rows; r++) {
+      k[r] = (uint64_t)remap[c->vec->i[r]];
+    }
+  } else {
+    for (long r = 0; r < rows; r++) {
+      k[r] = (uint64_t)c->vec->i[r];
+    }
+  }
+  return k;
+}
+
+uint64_t _ltable_hash(uint64_t** k, int nk, long r)
+{
+  uint64_t h = 0;
+  for (int j = 0; j < nk; j++) {
+    h = _ltable_mix(h ^ (k[j][r] + 0x9e3779b97f4a7c15ULL));
+  }
+  return h;
+}
+
+int _ltable_same(uint64_t** a, long ra, uint64_t** b, long rb, int nk)
+{
+  for (int j = 0; j < nk; j++) {
+    if (a[j][ra] != b[j][rb]) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+void _ltable_index_init(ltable_index* ix)
+{
+  ix->cap = 16;
+  ix->slots = calloc(ix->cap, sizeof(long));
+  ix->count = 0;
+  ix->size = 8;
+  ix->first = malloc(sizeof(long) * ix->size);
+  ix->hash = malloc(sizeof(uint64_t) * ix->size);
+}
+
+void _ltable_index_done(ltable_index* ix)
+{
+  free(ix->slots);
+  free(ix->first);
+  free(ix->hash);
+}
+
+/* twice the slots, every group put again by its hash */
+void _ltable_index_grow(ltable_index* ix)
+{
+  free(ix->slots);
+  ix->cap *= 2;
+  ix->slots = calloc(ix->cap, sizeof(long));
+
+  long m = ix->cap - 1;
+  for (long g = 0; g < ix->count; g++) {
+    long s = ix->hash[g] & m;
+    while (ix->slots[s]) {
+      s = (s + 1) & m;
+    }
+    ix->slots[s] = g + 1;
+  }
+}
+
+/**
+ * The group of the keys k of row r (of hash h), the keys of its first row
+ * are in gk; if there is none it is made (with 'add', and gk being k) or
+ * -1 is returned
+ */
+long _ltable_probe(ltable_index* ix, uint64_t** gk, uint64_t** k, int nk, long r, uint64_t h, int add)
+{
+  long m = ix->cap - 1;
+  for (long s = h & m;; s = (s + 1) & m) {
+    long g = ix->slots[s] - 1;
+    if (g >= 0) {
+      if (ix->hash[g] == h && _ltable_same(gk, ix->first[g], k, r, nk)) {
+        return g;
+      }
+      continue;
+    }
+    if (!add) {
+      return -1;
+    }
+
+    g = ix->count++;
+    if (g == ix->size) {
+      ix->size *= 2;
+      ix->first = realloc(ix->first, sizeof(long) * ix->size);
+      ix->hash = realloc(ix->hash, sizeof(uint64_t) * ix->size);
+    }
+    ix->first[g] = r;
+    ix->hash[g] = h;
+    ix->slots[s] = g + 1;
+
+    /* at most half of the slots full, so probes stay short */
+    if (ix->count * 2 > ix->cap) {
+      _ltable_index_grow(ix);
+    }
+    return g;
+  }
+}
+
+/* the group of every row of t by the key columns, the groups in ix */
+long* _ltable_groups(ltable* t, uint64_t** k, int nk, ltable_index* ix)
+{
+  _ltable_index_init(ix);
+  long* gid = malloc(sizeof(long) * (t->rows + 1));
+  for (long r = 0; r < t->rows; r++) {
+    gid[r] = _ltable_probe(ix, k, k, nk, r, _ltable_hash(k, nk, r), 1);
+  }
+  return gid;
+}
+
+/**
+ * Sets the column 'at' of r to an aggregate of the column 'col' of t in
+ * every group, returns 1 if a sum of integers overflowed (0 otherwise)
+ */
+int _ltable_aggregate(ltable* r, int at, ltable* t, int op, int col, char* name,
+    long* gid, long* first, long* counts)
+{
+  long n = r->rows;
+  lnvec* v = lnvec_new(n);
+
+  if (op == LTABLE_COUNT) {
+    for (long g = 0; g < n; g++) {
+      v->i[g] = counts[g];
+    }
+    ltable_set(r, at, name, LVAL_NUM, v, NULL);
+    return 0;
+  }
+
+  lcolumn* c = &t->cols[col];
+  int type = op == LTABLE_MEAN ? LVAL_FLOAT : c->type;
+  int64_t over = 0;
+
+  /* min and max start from the first row of the group, the sums from 0 */
+  for (long g = 0; g < n; g++) {
+    if ((op == LTABLE_MIN || op == LTABLE_MAX) && type == LVAL_FLOAT) {
+      v->f[g] = c->vec->f[first[g]];
+    } else if (op == LTABLE_MIN || op == LTABLE_MAX) {
+      v->i[g] = c->vec->i[first[g]];
+    } else if (type == LVAL_FLOAT) {
+      v->f[g] = 0;
+    } else {
+      v->i[g] = 0;
+    }
+  }
+
+  if (c->type == LVAL_FLOAT) {
+    double* x = c->vec->f;
+    double* a = v->f;
+    switch (op) {
+      case LTABLE_SUM:
+      case LTABLE_MEAN:
+        for (long k = 0; k < t->rows; k++) { a[gid[k]] += x[k]; }
+        break;
+      case LTABLE_MIN:
+        for (long k = 0; k < t->rows; k++) { if (x[k] < a[gid[k]]) { a[gid[k]] = x[k]; } }
+        break;
+      case LTABLE_MAX:
+        for (long k = 0; k < t->rows; k++) { if (x[k] > a[gid[k]]) { a[gid[k]] = x[k]; } }
+        break;
+    }
+  } else {
+    int64_t* x = c->vec->i;
+    int64_t* a = v->i;
+    switch (op) {
+      /* added unsigned, a sum overflowed if it does not have the sign both added have */
+      case LTABLE_SUM:
+        for (long k = 0; k < t->rows; k++) {
+          int64_t s = (int64_t)((uint64_t)a[gid[k]] + (uint64_t)x[k]);
+          over |= (a[gid[k]] ^ s) & (x[k] ^ s);
+          a[gid[k]] = s;
+        }
+        break;
+      case LTABLE_MEAN:
+        for (long k = 0; k < t->rows; k++) { v->f[gid[k]] += (double)x[k]; }
+        break;
+      case LTABLE_MIN:
+        for (long k = 0; k < t->rows; k++) { if (x[k] < a[gid[k]]) { a[gid[k]] = x[k]; } }
+        break;
+      case LTABLE_MAX:
+        for (long k = 0; k < t->rows; k++) { if (x[k] > a[gid[k]]) { a[gid[k]] = x[k]; } }
+        break;
+    }
+  }
+
+  if (op == LTABLE_MEAN) {
+    for (long g = 0; g < n; g++) {
+      v->f[g] /= counts[g];
+    }
+  }
+
+  ltable_set(r, at, name, type, v, NULL);
+  return over < 0;
+}
+
+ltable* ltable_group(ltable* t, int* keys, int nkeys, int* ops, int* cols, int naggs,
+    char** names, int* over)
+{
+  uint64_t** k = malloc(sizeof(uint64_t*) * nkeys);
+  for (int j = 0; j < nkeys; j++) {
+    k[j] = _ltable_keys(&t->cols[keys[j]], t->rows, NULL);
+  }
+
+  ltable_index ix;
+  long* gid = _ltable_groups(t, k, nkeys, &ix);
+  long n = ix.count;
+
+  long* counts = calloc(n + 1, sizeof(long));
+  for (long r = 0; r < t->rows; r++) {
+    counts[gid[r]]++;
+  }
+
+  /* the keys of every group are those of its first row */
+  ltable* r = ltable_new(n, nkeys + naggs);
+  for (int j = 0; j < nkeys; j++) {
+    _ltable_gather(r, j, t, keys[j], ix.first, n);
+  }
+  *over = -1;
+  for (int j = 0; j < naggs && *over < 0; j++) {
+    if (_ltable_aggregate(r, nkeys + j, t, ops[j], cols[j], names[j], gid, ix.first, counts)) {
+      *over = j;
+    }
+  }
+
+  for (int j = 0; j < nkeys; j++) {
+    free(k[j]);
+  }
+  free(k);
+  free(gid);
+  free(counts);
+  _ltable_index_done(&ix);
+
+  if (*over >= 0) {
+    ltable_del(r);
+    return NULL;
+  }
+  return r;
+}
+
+/* the index in y of every string of x, -1 for those not in y */
+long* _ltable_remap(lval* x, lval* y)
+{
+  ldict* d = ldict_new(y->count);
+  for (int i = 0; i < y->count; i++) {
+    ldict_put(d, lval_copy(y->cell[i]), lval_num(i));
+  }
+
+  long* remap = malloc(sizeof(long) * (x->count + 1));
+  for (int i = 0; i < x->count; i++) {
+    lval* v = ldict_get(d, x->cell[i]);
+    remap[i] = v ? v->num : -1;
+  }
+
+  ldict_del(d);
+  return remap;
+}
+
+ltable* ltable_join(ltable* x, ltable* y, int* xk, int* yk, int nkeys)
+{
+  /* the keys of both in the terms of y, the strings of x by their index in y */
+  uint64_t** kx = malloc(sizeof(uint64_t*) * nkeys);
+  uint64_t** ky = malloc(sizeof(uint64_t*) * nkeys);
+  for (int j = 0; j < nkeys; j++) {
+    lcolumn* cx = &x->cols[xk[j]];
+    lcolumn* cy = &y->cols[yk[j]];
+    long* remap = cx->type == LVAL_STR ? _ltable_remap(cx->strs, cy->strs) : NULL;
+    kx[j] = _ltable_keys(cx, x->rows, remap);
+    ky[j] = _ltable_keys(cy, y->rows, NULL);
+    free(remap);
+  }
+
+  /* the rows of y by group, in their order: those of group g from start[g] */
+  ltable_index ix;
+  long* gid = _ltable_groups(y, ky, nkeys, &ix);
+  long* start = calloc(ix.count + 1, sizeof(long));
+  for (long r = 0; r < y->rows; r++) {
+    start[gid[r] + 1]++;
+  }
+  for (long g = 0; g < ix.count; g++) {
+    start[g + 1] += start[g];
+  }
+  long* rows = malloc(sizeof(long) * (y->rows + 1));
+  long* fill = malloc(sizeof(long) * (ix.count + 1));
+  memcpy(fill, start, sizeof(long) * (ix.count + 1));
+  for (long r = 0; r < y->rows; r++) {
+    rows[fill[gid[r]]++] = r;
+  }
+
+  /* every row of x with the rows of y of its keys */
+  long n = 0;
+  long cap = 16;
+  long* ix_x = malloc(sizeof(long) * cap);
+  long* ix_y = malloc(sizeof(long) * cap);
+  for (long r = 0; r < x->rows; r++) {
+    long g = _ltable_probe(&ix, ky, kx, nkeys, r, _ltable_hash(kx, nkeys, r), 0);
+    if (g < 0) {
+      continue;
+    }
+    for (long s = start[g]; s < start[g + 1]; s++) {
+      if (n == cap) {
+        cap *= 2;
+        ix_x = realloc(ix_x, sizeof(long) * cap);
+        ix_y = realloc(ix_y, sizeof(long) * cap);
+      }
+      ix_x[n] = r;
+      ix_y[n] = rows[s];
+      n++;
+    }
+  }
+
+  ltable* t = ltable_new(n, x->count + y->count - nkeys);
+  int at = 0;
+  for (int i = 0; i < x->count; i++) {
+    _ltable_gather(t, at++, x, i, ix_x, n);
+  }
+  for (int i = 0; i < y->count; i++) {
+    int key = 0;
+    for (int j = 0; j < nkeys; j++) {
+      key = key || yk[j] == i;
+    }
+    if (!key) {
+      _ltable_gather(t, at++, y, i, ix_y, n);
+    }
+  }
+
+  for (int j = 0; j < nkeys; j++) {
+    free(kx[j]);
+    free(ky[j]);
+  }
+  free(kx);
+  free(ky);
+  free(gid);
+  free(start);
+  free(rows);
+  free(fill);
+  free(ix_x);
+  free(ix_y);
+  _ltable_index_done(&ix);
+  return t;
+}
@@ -0,0 +1,133 @@
+#ifndef LISPY_TABLE_H
+#define LISPY_TABLE_H
+
+#include "fwd.h"
+
+#include <stdint.h>
+
+/**
+ * A column of a table, all of its cells of one type, unboxed in one array
+ */
+typedef struct
+{
+  /** the name of the column **/
+  char* name;
+
+  /**
+   * the type of the cells: LVAL_NUM (integers in 'vec->i'), LVAL_FLOAT
+   * (doubles in 'vec->f') or LVAL_STR (in 'vec->i' the index of each one
+   * in 'strs', every different string kept once)
+   */
+  int type;
+  lnvec* vec;
+  lval* strs;
+} lcolumn;
+
+/**
+ * The columns of a Table (LVAL_TABLE), every one of 'rows' cells: a cell
+ * takes 8 bytes instead of an lval. A table is never changed once made,
+ * it is shared by every copy of the value, and so are its columns by the
+ * tables made from it.
+ */
+struct ltable
+{
+  /** number of values sharing the table **/
+  int refs;
+
+  /** number of rows, and number of columns **/
+  long rows;
+  int count;
+  lcolumn* cols;
+};
+
+/**
+ * OPERATIONS of the aggregates of group-by
+ */
+enum { LTABLE_COUNT, LTABLE_SUM, LTABLE_MIN, LTABLE_MAX, LTABLE_MEAN };
+
+/**
+ * Creates a table, its columns are to be set with ltable_set()
+ *
+ * long rows    number of rows
+ * int count    number of columns
+ */
+ltable* ltable_new(long rows, int count);
+
+/**
+ * Releases a reference to a table (freed with the last one)
+ */
+void ltable_del(ltable* t);
+
+/**
+ * Sets the column i of a table
+ *
+ * char* name     its name, copied
+ * int type       the type of its cells (see lcolumn)
+ * lnvec* vec     its cells, 'rows' of them, the reference is taken
+ * lval* strs     the strings (an LVAL_QEXPR) of a column of Strings, the
+ *                reference is taken (NULL for numbers)
+ */
+void ltable_set(ltable* t, int i, char* name, int type, lnvec* vec, lval* strs);
+
+/**
+ * The cells of a column of Strings
+ *
+ * lval** s       n Strings, not taken
+ * lval** strs    set to a new Q-Expression with every different string
+ *                of s once, in the order they are first found
+ *
+ * return     the index in *strs of every string of s
+ */
+lnvec* ltable_encode(lval** s, long n, lval** strs);
+
+/**
+ * The index of the column with a given name, -1 if there is none
+ */
+int ltable_find(ltable* t, char* name);
+
+/**
+ * The cell of a column in a given row, as a new value
+ */
+lval* ltable_cell(ltable* t, int col, long row);
+
+/**
+ * A new table with the rows of t selected by a bitmap: the row r is in
+ * it if the bit (r % 64) of sel[r / 64] is set, in the same order
+ */
+ltable* ltable_select(ltable* t, uint64_t* sel);
+
+/**
+ * Groups the rows of a table by the cells of some of its columns (the
+ * keys) and aggregates other columns in every group
+ *
+ * int* keys, nkeys     the index of each key column
+ * int* ops, cols       for each aggregate, its operation (one of the enum
+ *                      'OPERATIONS') and the column it aggregates (not
+ *                      read for LTABLE_COUNT); columns of Strings can only
+ *                      be counted
+ * char** names         the name of each aggregate column
+ * int* over            set to the index of an aggregate with a sum that
+ *                      does not fit in a 64 bits integer, -1 if none
+ *
+ * return     a new table with a row for every group, in the order of its
+ *            first row in t: the key columns, then the aggregates (COUNT
+ *            and MEAN give a Number and a Float, the rest the type of the
+ *            column), or NULL if a sum overflowed
+ */
+ltable* ltable_group(ltable* t, int* keys, int nkeys, int* ops, int* cols, int naggs,
+    char** names, int* over);
+
+/**
+ * The inner join of two tables on equal keys, with a hash table of the
+ * rows of y
+ *
+ * int* xk, yk    the key columns of x and of y, of the same types
+ * int nkeys      number of keys
+ *
+ * return     a new table with a row for every pair of rows with equal
+ *            keys, in the order of x, then of y: the columns of x and
+ *            those of y but its keys
+ */
+ltable* ltable_join(ltable* x, ltable* y, int* xk, int* yk, int nkeys);
+
+#endif//LISPY_TABLE_H
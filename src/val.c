@@ -1,6 +1,23 @@
 #include "val.h"
 #include "utils.h"
 #include "mpc.h"
+#include "big.h"
+#include "bitset.h"
+#include "btree.h"
+#include "closure.h"
+#include "dict.h"
+#include "hamt.h"
+#include "ir.h"
+#include "jit.h"
+#include "nvec.h"
+#include "opt.h"
+#include "queue.h"
+#include "quick.h"
+#include "record.h"
+#include "seq.h"
+#include "str.h"
+#include "table.h"
+#include "vec.h"
 
 #define ERR_MSG_BUFFER_SIZE 512
 
@@ -12,6 +29,24 @@ char* ltype_name(int type)
     case LVAL_ERR:    return  "Error";
     case LVAL_SYM:    return  "Symbol";
     case LVAL_STR:    return  "String";
+    case LVAL_LAZYSEQ: return "Lazy Sequence";
+    case LVAL_RANGE:  return  "Range";
+    case LVAL_BIGNUM: return  "Bignum";
+    case LVAL_FLOAT:  return  "Float";
+    case LVAL_F64VEC: return  "F64 Vector";
+    case LVAL_I64VEC: return  "I64 Vector";
+    case LVAL_MATRIX: return  "Matrix";
+    case LVAL_DICT:   return  "Dict";
+    case LVAL_MAP:    return  "Map";
+    case LVAL_SMAP:   return  "Sorted Map";
+    case LVAL_SSET:   return  "Sorted Set";
+    case LVAL_VEC:    return  "Vector";
+    case LVAL_DEQUE:  return  "Deque";
+    case LVAL_PQUEUE: return  "Priority Queue";
+    case LVAL_RECORD: return  "Record";
+    case LVAL_TABLE:  return  "Table";
+    case LVAL_BITSET: return  "Bitset";
+    case LVAL_XFORM:  return  "Transducer";
     case LVAL_SEXPR:  return  "S-Expression";
     case LVAL_QEXPR:  return  "Q-Expression";
   }
@@ -27,6 +62,142 @@ lval* lval_num(long n)
   return v;
 }
 
+lval* lval_bignum(lbig* b)
+{
+  /* back to a long whenever it fits */
+  long n;
+  if (lbig_long(b, &n)) {
+    lbig_del(b);
+    return lval_num(n);
+  }
+
+  lval* v = malloc(sizeof(lval));
+  v->type = LVAL_BIGNUM;
+  v->big = b;
+  return v;
+}
+
+lval* lval_float(double d)
+{
+  lval* v = malloc(sizeof(lval));
+  v->type = LVAL_FLOAT;
+  v->dbl = d;
+  return v;
+}
+
+lval* lval_nvec(int type, lnvec* vec)
+{
+  lval* v = malloc(sizeof(lval));
+  v->type = type;
+  v->vec = vec;
+  return v;
+}
+
+lval* lval_matrix(long rows, long cols, lnvec* vec)
+{
+  lval* v = malloc(sizeof(lval));
+  v->type = LVAL_MATRIX;
+  v->rows = rows;
+  v->cols = cols;
+  v->vec = vec;
+  return v;
+}
+
+lval* lval_dict(ldict* d)
+{
+  lval* v = malloc(sizeof(lval));
+  v->type = LVAL_DICT;
+  v->dict = d;
+  return v;
+}
+
+lval* lval_map(lhamt* h)
+{
+  lval* v = malloc(sizeof(lval));
+  v->type = LVAL_MAP;
+  v->map = h;
+  return v;
+}
+
+lval* lval_sorted(int type, lbtree* t)
+{
+  lval* v = malloc(sizeof(lval));
+  v->type = type;
+  v->tree = t;
+  return v;
+}
+
+lval* lval_vec(lvec* x)
+{
+  lval* v = malloc(sizeof(lval));
+  v->type = LVAL_VEC;
+  v->mvec = x;
+  return v;
+}
+
+lval* lval_deque(ldeque* q)
+{
+  lval* v = malloc(sizeof(lval));
+  v->type = LVAL_DEQUE;
+  v->deque = q;
+  return v;
+}
+
+lval* lval_pqueue(lheap* h)
+{
+  lval* v = malloc(sizeof(lval));
+  v->type = LVAL_PQUEUE;
+  v->heap = h;
+  return v;
+}
+
+lval* lval_record(lrecord* r)
+{
+  lval* v = malloc(sizeof(lval));
+  v->type = LVAL_RECORD;
+  v->rec = r;
+  return v;
+}
+
+lval* lval_table(ltable* t)
+{
+  lval* v = malloc(sizeof(lval));
+  v->type = LVAL_TABLE;
+  v->table = t;
+  return v;
+}
+
+lval* lval_bitset(lbitset* b)
+{
+  lval* v = malloc(sizeof(lval));
+  v->type = LVAL_BITSET;
+  v->bits = b;
+  return v;
+}
+
+lval* lval_xform(char* stage, lval* a)
+{
+  lval* v = malloc(sizeof(lval));
+  v->type = LVAL_XFORM;
+  v->stage = stage;
+  v->count = a->count;
+  v->cell = a->cell;
+
+  a->count = 0;
+  a->cell = NULL;
+  lval_del(a);
+  return v;
+}
+
+int lval_entry(lval* v, long* i, lval** k, lval** x)
+{
+  switch (v->type) {
+    case LVAL_DICT: return ldict_next(v->dict, i, k, x);
+    case LVAL_MAP:  return lhamt_nth(v->map, (*i)++, k, x);
+  }
+  return lbtree_nth(v->tree, (*i)++, k, x);
+}
+
 lval* lval_err(char* fmt, ...)
 {
   lval* v = malloc(sizeof(lval));
@@ -54,14 +225,67 @@ lval* lval_sym(char* s)
 }
 
 lval* lval_str(char* s)
+{
+  return lval_strn(s, strlen(s));
+}
+
+lval* lval_strn(char* s, long len)
 {
   lval* v = malloc(sizeof(lval));
   v->type = LVAL_STR;
-  v->str = malloc(strlen(s) + 1);
-  strcpy(v->str, s);
+  v->str = lstr_new(s, len);
   return v;
 }
 
+lval* lval_lazyseq(lseq* s)
+{
+  lval* v = malloc(sizeof(lval));
+  v->type = LVAL_LAZYSEQ;
+  v->seq = s;
+  return v;
+}
+
+lval* lval_range(long from, long step, long len)
+{
+  lval* v = malloc(sizeof(lval));
+  v->type = LVAL_RANGE;
+  v->num = from;
+  v->step = step;
+  v->len = len;
+  return v;
+}
+
+long lval_range_at(lval* v, long i)
+{
+  return (long)((unsigned long)v->num + (unsigned long)i * (unsigned long)v->step);
+}
+
+long lval_range_end(lval* v)
+{
+  if (v->len == 0) {
+    return v->num;
+  }
+
+  long last = lval_range_at(v, v->len - 1);
+  long end = lval_range_at(v, v->len);
+  if ((v->step > 0) != (end > last)) {
+    end = v->step > 0 ? last + 1 : last - 1;
+  }
+  return end;
+}
+
+lval* lval_range_list(lval* v)
+{
+  lval* x = lval_qexpr();
+  x->count = v->len;
+  x->cell = malloc(sizeof(lval*) * v->len);
+  for (long i = 0; i < v->len; i++) {
+    x->cell[i] = lval_num(lval_range_at(v, i));
+  }
+  lval_del(v);
+  return x;
+}
+
 lval* lval_fun(lbuiltin func, char* name)
 {
   lval* v = malloc(sizeof(lval));
@@ -80,9 +304,33 @@ lval* lval_lambda(lval* formals, lval* body)
   v->env = lenv_new();
   v->formals = formals;
   v->body = body;
+  v->code = NULL;
   return v;
 }
 
+lcode* lval_code(lval* f)
+{
+  if (f->code) {
+    return f->code;
+  }
+
+  /* no formal has been bound yet: that only happens in a call, which creates the code first */
+  lcode* c = malloc(sizeof(lcode));
+  c->refs = 1;
+  c->formals = lval_copy(f->formals);
+  c->quick = NULL;
+  c->clos = NULL;
+  c->native = NULL;
+  c->calls = 0;
+  c->jit = NULL;
+  c->ir = NULL;
+  c->optimized = 0;
+  c->opt = NULL;
+  c->guard = -1;
+  f->code = c;
+  return c;
+}
+
 lval* lval_sexpr(void)
 {
   lval* v = malloc(sizeof(lval));
@@ -118,6 +366,8 @@ lval* lval_copy(lval* v)
         x->env = lenv_copy(v->env);
         x->formals = lval_copy(v->formals);
         x->body = lval_copy(v->body);
+        x->code = lval_code(v);
+        x->code->refs++;
       }
       break;
 
@@ -125,6 +375,69 @@ lval* lval_copy(lval* v)
       x->num = v->num;
       break;
 
+    case LVAL_FLOAT:
+      x->dbl = v->dbl;
+      break;
+
+    case LVAL_F64VEC:
+    case LVAL_I64VEC:
+      x->vec = v->vec;
+      x->vec->refs++;
+      break;
+
+    case LVAL_MATRIX:
+      x->rows = v->rows;
+      x->cols = v->cols;
+      x->vec = v->vec;
+      x->vec->refs++;
+      break;
+
+    case LVAL_DICT:
+      x->dict = v->dict;
+      x->dict->refs++;
+      break;
+
+    case LVAL_MAP:
+      x->map = lhamt_share(v->map);
+      break;
+
+    case LVAL_SMAP:
+    case LVAL_SSET:
+      x->tree = lbtree_share(v->tree);
+      break;
+
+    /* the copy is the same vector, a change to it is seen in both */
+    case LVAL_VEC:
+      x->mvec = v->mvec;
+      x->mvec->refs++;
+      break;
+
+    case LVAL_DEQUE:
+      x->deque = v->deque;
+      x->deque->refs++;
+      break;
+
+    case LVAL_PQUEUE:
+      x->heap = v->heap;
+      x->heap->refs++;
+      break;
+
+    case LVAL_RECORD:
+      x->rec = v->rec;
+      x->rec->refs++;
+      break;
+
+    case LVAL_TABLE:
+      x->table = v->table;
+      x->table->refs++;
+      break;
+
+    /* the copy is the same bitset, like a vector */
+    case LVAL_BITSET:
+      x->bits = v->bits;
+      x->bits->refs++;
+      break;
+
     case LVAL_ERR:
       x->err = malloc(strlen(v->err) + 1);
       strcpy(x->err, v->err);
@@ -135,11 +448,30 @@ lval* lval_copy(lval* v)
       strcpy(x->sym, v->sym);
       break;
 
+    /* a string does not change, the copy is the same one */
     case LVAL_STR:
-      x->str = malloc(strlen(v->str) + 1);
-      strcpy(x->str, v->str);
+      x->str = v->str;
+      x->str->refs++;
       break;
 
+    case LVAL_LAZYSEQ:
+      x->seq = v->seq;
+      x->seq->refs++;
+      break;
+
+    case LVAL_RANGE:
+      x->num = v->num;
+      x->step = v->step;
+      x->len = v->len;
+      break;
+
+    case LVAL_BIGNUM:
+      x->big = lbig_copy(v->big);
+      break;
+
+    case LVAL_XFORM:
+      x->stage = v->stage;
+      /* fall through, to copy the arguments */
     case LVAL_SEXPR:
     case LVAL_QEXPR:
       x->count = v->count;
@@ -158,6 +490,8 @@ void lval_del(lval* v)
   switch (v->type)
   {
     case LVAL_NUM:
+    case LVAL_FLOAT:
+    case LVAL_RANGE:
       break;
 
     case LVAL_FUN:
@@ -167,6 +501,18 @@ void lval_del(lval* v)
         lenv_del(v->env);
         lval_del(v->formals);
         lval_del(v->body);
+        if (v->code && --v->code->refs == 0) {
+          lval_del(v->code->formals);
+          lquick_del(v->code->quick);
+          lclos_del(v->code->clos);
+          ljit_del(v->code->jit);
+          lir_del(v->code->ir);
+          if (v->code->opt) {
+            lval_del(v->code->opt);
+          }
+          lopt_release(v->code->guard);
+          free(v->code);
+        }
       }
       break;
 
@@ -179,11 +525,63 @@ void lval_del(lval* v)
       break;
 
     case LVAL_STR:
-      free(v->str);
+      lstr_del(v->str);
+      break;
+
+    case LVAL_LAZYSEQ:
+      lseq_del(v->seq);
+      break;
+
+    case LVAL_BIGNUM:
+      lbig_del(v->big);
+      break;
+
+    case LVAL_F64VEC:
+    case LVAL_I64VEC:
+    case LVAL_MATRIX:
+      lnvec_del(v->vec);
+      break;
+
+    case LVAL_DICT:
+      ldict_del(v->dict);
+      break;
+
+    case LVAL_MAP:
+      lhamt_del(v->map);
+      break;
+
+    case LVAL_SMAP:
+    case LVAL_SSET:
+      lbtree_del(v->tree);
+      break;
+
+    case LVAL_VEC:
+      lvec_del(v->mvec);
+      break;
+
+    case LVAL_DEQUE:
+      ldeque_del(v->deque);
+      break;
+
+    case LVAL_PQUEUE:
+      lheap_del(v->heap);
+      break;
+
+    case LVAL_RECORD:
+      lrecord_del(v->rec);
+      break;
+
+    case LVAL_TABLE:
+      ltable_del(v->table);
+      break;
+
+    case LVAL_BITSET:
+      lbitset_del(v->bits);
       break;
 
     case LVAL_SEXPR:
     case LVAL_QEXPR:
+    case LVAL_XFORM:
       for (int i = 0; i < v->count; i++) {
         lval_del(v->cell[i]);
       }
@@ -220,8 +618,12 @@ lval* lval_take(lval* v, int i)
 
 lval* lval_join(lval* x, lval* y)
 {
-  while (y->count) {
-    x = lval_add(x, lval_pop(y, 0));
+  /* move every child at once, popping them one by one is quadratic */
+  if (y->count > 0) {
+    x->cell = realloc(x->cell, sizeof(lval*) * (x->count + y->count));
+    memcpy(&x->cell[x->count], y->cell, sizeof(lval*) * y->count);
+    x->count += y->count;
+    y->count = 0;
   }
 
   lval_del(y);
@@ -247,13 +649,39 @@ int lval_print_expr(lval* v, char open, char close)
 
 void lval_print_str(lval* v, char* open, char* close)
 {
-  char* escaped = malloc(strlen(v->str) + 1);
-  strcpy(escaped, v->str);
-  escaped = mpcf_escape(escaped);
   if (open) { printf("%s", open); }
-  printf("%s", escaped);
+
+  /* escaped up to each '\0' in it, written as \0 */
+  for (long i = 0; i <= v->str->len; i++) {
+    char* s = v->str->bytes + i;
+    long n = strlen(s);
+    char* escaped = malloc(n + 1);
+    memcpy(escaped, s, n + 1);
+    escaped = mpcf_escape(escaped);
+    printf(i > 0 ? "\\0%s" : "%s", escaped);
+    free(escaped);
+    i += n;
+  }
+
   if (close) { printf("%s", close); }
-  free(escaped);
+}
+
+/* the fewest digits that read back as the same double, always with a '.' */
+void _lval_print_float(double d)
+{
+  char buf[32];
+  for (int digits = 15; digits <= 17; digits++) {
+    snprintf(buf, sizeof(buf), "%.*g", digits, d);
+    if (strtod(buf, NULL) == d) {
+      break;
+    }
+  }
+  printf("%s", buf);
+
+  /* not to be read as an integer (nor inf and nan to be given one) */
+  if (!strpbrk(buf, ".eni")) {
+    printf(".0");
+  }
 }
 
 int lval_print(lval* v)
@@ -264,6 +692,150 @@ int lval_print(lval* v)
       printf("%li", v->num);
       break;
 
+    case LVAL_BIGNUM: {
+      char* s = lbig_str(v->big);
+      printf("%s", s);
+      free(s);
+      break;
+    }
+
+    case LVAL_FLOAT:
+      _lval_print_float(v->dbl);
+      break;
+
+    case LVAL_F64VEC:
+    case LVAL_I64VEC:
+      printf(v->type == LVAL_F64VEC ? "<f64vec" : "<i64vec");
+      for (long i = 0; i < v->vec->len && i < LNVEC_PRINT; i++) {
+        putchar(' ');
+        if (v->type == LVAL_F64VEC) {
+          _lval_print_float(v->vec->f[i]);
+        } else {
+          printf("%lli", (long long)v->vec->i[i]);
+        }
+      }
+      printf(v->vec->len > LNVEC_PRINT ? " ...>" : ">");
+      break;
+
+    case LVAL_MATRIX:
+      printf("<matrix %lix%li", v->rows, v->cols);
+      for (long i = 0; i < v->rows && i < LNVEC_PRINT; i++) {
+        printf(" {");
+        for (long j = 0; j < v->cols && j < LNVEC_PRINT; j++) {
+          if (j) {
+            putchar(' ');
+          }
+          _lval_print_float(v->vec->f[i * v->cols + j]);
+        }
+        printf(v->cols > LNVEC_PRINT ? " ...}" : "}");
+      }
+      printf(v->rows > LNVEC_PRINT ? " ...>" : ">");
+      break;
+
+    case LVAL_DICT:
+    case LVAL_MAP: {
+      printf(v->type == LVAL_DICT ? "<dict" : "<map");
+      long i = 0;
+      lval* k;
+      lval* x;
+      for (int n = 0; n < LDICT_PRINT && lval_entry(v, &i, &k, &x); n++) {
+        printf(" {");
+        lval_print(k);
+        putchar(' ');
+        lval_print(x);
+        putchar('}');
+      }
+      long count = v->type == LVAL_DICT ? v->dict->count : lhamt_count(v->map);
+      printf(count > LDICT_PRINT ? " ...>" : ">");
+      break;
+    }
+
+    case LVAL_SMAP:
+    case LVAL_SSET: {
+      printf(v->type == LVAL_SMAP ? "<sorted-map" : "<sorted-set");
+      lval* k;
+      lval* x;
+      for (long i = 0; i < LBTREE_PRINT && lbtree_nth(v->tree, i, &k, &x); i++) {
+        if (v->type == LVAL_SSET) {
+          putchar(' ');
+          lval_print(k);
+          continue;
+        }
+        printf(" {");
+        lval_print(k);
+        putchar(' ');
+        lval_print(x);
+        putchar('}');
+      }
+      printf(lbtree_count(v->tree) > LBTREE_PRINT ? " ...>" : ">");
+      break;
+    }
+
+    case LVAL_VEC:
+      printf("<vec");
+      for (long i = 0; i < v->mvec->len && i < LVEC_PRINT; i++) {
+        putchar(' ');
+        lval_print(v->mvec->items[i]);
+      }
+      printf(v->mvec->len > LVEC_PRINT ? " ...>" : ">");
+      break;
+
+    case LVAL_DEQUE:
+      printf("<deque");
+      for (long i = 0; i < v->deque->len && i < LQUEUE_PRINT; i++) {
+        putchar(' ');
+        lval_print(ldeque_get(v->deque, i));
+      }
+      printf(v->deque->len > LQUEUE_PRINT ? " ...>" : ">");
+      break;
+
+    /* in the order of the heap, the first one is the least */
+    case LVAL_PQUEUE:
+      printf("<pqueue");
+      for (long i = 0; i < v->heap->len && i < LQUEUE_PRINT; i++) {
+        putchar(' ');
+        lval_print(v->heap->items[i]);
+      }
+      printf(v->heap->len > LQUEUE_PRINT ? " ...>" : ">");
+      break;
+
+    case LVAL_RECORD:
+      printf("<%s", v->rec->type->name);
+      for (int i = 0; i < v->rec->type->count; i++) {
+        printf(" %s=", v->rec->type->fields[i]);
+        lval_print(v->rec->fields[i]);
+      }
+      putchar('>');
+      break;
+
+    case LVAL_TABLE:
+      printf("<table");
+      for (int i = 0; i < v->table->count; i++) {
+        printf(" %s", v->table->cols[i].name);
+      }
+      printf(", %li rows>", v->table->rows);
+      break;
+
+    case LVAL_BITSET: {
+      printf("<bitset");
+      long i = lbitset_next(v->bits, 0);
+      for (int n = 0; i >= 0 && n < LBITSET_PRINT; n++) {
+        printf(" %li", i);
+        i = lbitset_next(v->bits, i + 1);
+      }
+      printf(i >= 0 ? " ...>" : ">");
+      break;
+    }
+
+    case LVAL_XFORM:
+      printf("<%s", v->stage);
+      for (int i = 0; i < v->count; i++) {
+        putchar(' ');
+        lval_print(v->cell[i]);
+      }
+      putchar('>');
+      break;
+
     case LVAL_ERR:
       printf("Error: %s", v->err);
       break;
@@ -276,6 +848,18 @@ int lval_print(lval* v)
       lval_print_str(v, "\"", "\"");
       break;
 
+    case LVAL_LAZYSEQ:
+      lseq_print(v->seq);
+      break;
+
+    case LVAL_RANGE:
+      printf("<range %li %li", v->num, lval_range_end(v));
+      if (v->step != 1) {
+        printf(" %li", v->step);
+      }
+      putchar('>');
+      break;
+
     case LVAL_FUN:
       if (v->builtin) {
         printf("<builtin '%s'>", v->sym);
@@ -308,8 +892,34 @@ void lval_println(lval* v)
   }
 }
 
+/* a range is equal to another one, or to a list, with the same numbers */
+int _lval_range_eq(lval* r, lval* b)
+{
+  if (b->type == LVAL_RANGE) {
+    return r->len == b->len && (r->len == 0 || r->num == b->num)
+        && (r->len <= 1 || r->step == b->step);
+  }
+
+  if (b->type != LVAL_QEXPR || b->count != r->len) {
+    return 0;
+  }
+  for (int i = 0; i < b->count; i++) {
+    if (b->cell[i]->type != LVAL_NUM || b->cell[i]->num != lval_range_at(r, i)) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
 int lval_eq(lval* a, lval* b)
 {
+  if (a->type == LVAL_RANGE) {
+    return _lval_range_eq(a, b);
+  }
+  if (b->type == LVAL_RANGE) {
+    return _lval_range_eq(b, a);
+  }
+
   if (a->type != b->type) {
     return 0;
   }
@@ -319,7 +929,174 @@ int lval_eq(lval* a, lval* b)
 
     case LVAL_ERR: return is(a->err, b->err);
     case LVAL_SYM: return is(a->sym, b->sym);
-    case LVAL_STR: return is(a->str, b->str);
+    case LVAL_STR: return lstr_eq(a->str, b->str);
+    case LVAL_LAZYSEQ: return a->seq == b->seq;
+    case LVAL_BIGNUM: return lbig_cmp(a->big, b->big) == 0;
+    case LVAL_FLOAT: return a->dbl == b->dbl;
+
+    case LVAL_F64VEC:
+      if (a->vec->len != b->vec->len) {
+        return 0;
+      }
+      for (long i = 0; i < a->vec->len; i++) {
+        if (a->vec->f[i] != b->vec->f[i]) {
+          return 0;
+        }
+      }
+      return 1;
+
+    case LVAL_I64VEC:
+      return a->vec->len == b->vec->len
+          && memcmp(a->vec->i, b->vec->i, sizeof(int64_t) * a->vec->len) == 0;
+
+    case LVAL_MATRIX:
+      if (a->rows != b->rows || a->cols != b->cols) {
+        return 0;
+      }
+      for (long i = 0; i < a->vec->len; i++) {
+        if (a->vec->f[i] != b->vec->f[i]) {
+          return 0;
+        }
+      }
+      return 1;
+
+    case LVAL_DICT: {
+      /* the same keys, each one with equal values */
+      if (a->dict == b->dict) {
+        return 1;
+      }
+      if (a->dict->count != b->dict->count) {
+        return 0;
+      }
+      long i = 0;
+      lval* k;
+      lval* x;
+      while (ldict_next(a->dict, &i, &k, &x)) {
+        lval* y = ldict_get(b->dict, k);
+        if (!y || !lval_eq(x, y)) {
+          return 0;
+        }
+      }
+      return 1;
+    }
+
+    case LVAL_MAP: {
+      if (a->map == b->map) {
+        return 1;
+      }
+      if (lhamt_count(a->map) != lhamt_count(b->map)) {
+        return 0;
+      }
+      lval* k;
+      lval* x;
+      for (long i = 0; lhamt_nth(a->map, i, &k, &x); i++) {
+        lval* y = lhamt_get(b->map, k);
+        if (!y || !lval_eq(x, y)) {
+          return 0;
+        }
+      }
+      return 1;
+    }
+
+    case LVAL_SMAP:
+    case LVAL_SSET: {
+      /* the same entries, in the same order */
+      if (a->tree == b->tree) {
+        return 1;
+      }
+      if (lbtree_count(a->tree) != lbtree_count(b->tree)) {
+        return 0;
+      }
+      lval* k;
+      lval* x;
+      lval* l;
+      lval* y;
+      for (long i = 0; lbtree_nth(a->tree, i, &k, &x); i++) {
+        lbtree_nth(b->tree, i, &l, &y);
+        if (!lval_eq(k, l) || !lval_eq(x, y)) {
+          return 0;
+        }
+      }
+      return 1;
+    }
+
+    case LVAL_VEC:
+      if (a->mvec == b->mvec) {
+        return 1;
+      }
+      if (a->mvec->len != b->mvec->len) {
+        return 0;
+      }
+      for (long i = 0; i < a->mvec->len; i++) {
+        if (!lval_eq(a->mvec->items[i], b->mvec->items[i])) {
+          return 0;
+        }
+      }
+      return 1;
+
+    case LVAL_DEQUE:
+      if (a->deque == b->deque) {
+        return 1;
+      }
+      if (a->deque->len != b->deque->len) {
+        return 0;
+      }
+      for (long i = 0; i < a->deque->len; i++) {
+        if (!lval_eq(ldeque_get(a->deque, i), ldeque_get(b->deque, i))) {
+          return 0;
+        }
+      }
+      return 1;
+
+    /* only the same queue, the order of a heap depends on how it was filled */
+    case LVAL_PQUEUE:
+      return a->heap == b->heap;
+
+    /* records of the same type with equal fields */
+    case LVAL_RECORD:
+      if (a->rec == b->rec) {
+        return 1;
+      }
+      if (a->rec->type != b->rec->type) {
+        return 0;
+      }
+      for (int i = 0; i < a->rec->type->count; i++) {
+        if (!lval_eq(a->rec->fields[i], b->rec->fields[i])) {
+          return 0;
+        }
+      }
+      return 1;
+
+    /* the same columns (names and types) with equal cells */
+    case LVAL_TABLE: {
+      ltable* x = a->table;
+      ltable* y = b->table;
+      if (x == y) {
+        return 1;
+      }
+      if (x->rows != y->rows || x->count != y->count) {
+        return 0;
+      }
+      for (int i = 0; i < x->count; i++) {
+        lcolumn* cx = &x->cols[i];
+        lcolumn* cy = &y->cols[i];
+        if (!is(cx->name, cy->name) || cx->type != cy->type) {
+          return 0;
+        }
+        for (long r = 0; r < x->rows; r++) {
+          int same = cx->type == LVAL_FLOAT ? cx->vec->f[r] == cy->vec->f[r]
+              : cx->type == LVAL_STR ? lval_eq(cx->strs->cell[cx->vec->i[r]], cy->strs->cell[cy->vec->i[r]])
+              : cx->vec->i[r] == cy->vec->i[r];
+          if (!same) {
+            return 0;
+          }
+        }
+      }
+      return 1;
+    }
+
+    case LVAL_BITSET:
+      return lbitset_eq(a->bits, b->bits);
 
     case LVAL_FUN:
       if (a->builtin || b->builtin) {
@@ -328,6 +1105,11 @@ int lval_eq(lval* a, lval* b)
         return lval_eq(a->formals, b->formals) && lval_eq(a->body, b->body);
       }
 
+    case LVAL_XFORM:
+      if (strcmp(a->stage, b->stage) != 0) {
+        return 0;
+      }
+      /* fall through, to compare the arguments */
     case LVAL_SEXPR:
     case LVAL_QEXPR:
       if (a->count != b->count) {
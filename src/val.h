@@ -9,7 +9,13 @@
  */
 enum {  LVAL_ERR, LVAL_SYM,   LVAL_NUM,
         LVAL_FUN, LVAL_SEXPR, LVAL_QEXPR,
-        LVAL_STR };
+        LVAL_STR,  LVAL_LAZYSEQ, LVAL_RANGE,
+        LVAL_BIGNUM, LVAL_FLOAT,
+        LVAL_F64VEC, LVAL_I64VEC, LVAL_MATRIX,
+        LVAL_DICT, LVAL_MAP, LVAL_SMAP, LVAL_SSET,
+        LVAL_VEC, LVAL_DEQUE, LVAL_PQUEUE,
+        LVAL_RECORD, LVAL_TABLE, LVAL_BITSET,
+        LVAL_XFORM };
 
 char* ltype_name(int type);
 
@@ -19,30 +25,134 @@ char* ltype_name(int type);
  */
 struct lval
 {
-  /** the type of lval (one of the enum 'TYPES') **/
+  /** the type of lval (one of the enum 'TYPES'), which says the member of the union in use **/
   int type;
 
-  /** value for type LVAL_NUM **/
-  long num;
+  union
+  {
+    /** value for type LVAL_NUM, and for type LVAL_RANGE: 'len' numbers from 'num' by 'step' **/
+    struct
+    {
+      long num;
+      long step;
+      long len;
+    };
 
-  /** value for type LVAL_ERR **/
-  char* err;
+    /** value for type LVAL_BIGNUM, a number that does not fit in 'num' **/
+    lbig* big;
 
-  /** value for type LVAL_SYM **/
-  char* sym;
+    /** value for type LVAL_FLOAT **/
+    double dbl;
 
-  /** value for type LVAL_STR **/
-  char* str;
+    /** value for types LVAL_F64VEC and LVAL_I64VEC, and for type LVAL_MATRIX: 'rows' by 'cols' doubles in 'vec', row after row **/
+    struct
+    {
+      lnvec* vec;
+      long rows;
+      long cols;
+    };
 
-  /** value for type LVAL_FUN **/
-  lbuiltin builtin;
-  lenv* env;
+    /** value for type LVAL_DICT **/
+    ldict* dict;
+
+    /** value for type LVAL_MAP (NULL if empty) **/
+    lhamt* map;
+
+    /** value for types LVAL_SMAP and LVAL_SSET (NULL if empty) **/
+    lbtree* tree;
+
+    /** value for type LVAL_VEC **/
+    lvec* mvec;
+
+    /** value for type LVAL_DEQUE **/
+    ldeque* deque;
+
+    /** value for type LVAL_PQUEUE **/
+    lheap* heap;
+
+    /** value for type LVAL_RECORD **/
+    lrecord* rec;
+
+    /** value for type LVAL_TABLE **/
+    ltable* table;
+
+    /** value for type LVAL_BITSET **/
+    lbitset* bits;
+
+    /** value for type LVAL_ERR **/
+    char* err;
+
+    /** value for type LVAL_STR, shared by every copy **/
+    lstr* str;
+
+    /** value for type LVAL_LAZYSEQ **/
+    lseq* seq;
+
+    /**
+     * value for type LVAL_SYM, and for type LVAL_FUN: a builtin and its
+     * name in 'sym', or a lambda ('builtin' NULL) with the rest
+     **/
+    struct
+    {
+      char* sym;
+      lbuiltin builtin;
+      lenv* env;
+      lval* formals;
+      lval* body;
+      lcode* code;
+    };
+
+    /**
+     * values for types LVAL_SEXPR and LVAL_QEXPR, and for type LVAL_XFORM:
+     * its arguments and the name of the builtin that made it (not freed)
+     **/
+    struct
+    {
+      int count;
+      lval** cell;
+      char* stage;
+    };
+  };
+};
+
+/**
+ * The compiled code of a function, shared by every copy of it
+ *
+ * Each engine keeps here what it compiled from the body of
+ * the function, so it is compiled only once
+ */
+struct lcode
+{
+  /** number of functions sharing the code **/
+  int refs;
+
+  /** the formals of the function as it was created **/
   lval* formals;
-  lval* body;
 
-  /** values for type LVAL_SEXPR and LVAL_QEXPR **/
-  int count;
-  lval** cell;
+  /** the body compiled by the quickening engine **/
+  lnode* quick;
+
+  /** the body compiled by the closure-compilation engine **/
+  lclos* clos;
+
+  /** the body compiled ahead of time (see aot.h) **/
+  lnative native;
+
+  /** number of calls counted, and the body compiled to machine code **/
+  long calls;
+  ljit* jit;
+
+  /** the body lowered into the IR (see ir.h) **/
+  lir* ir;
+
+  /**
+   * if the optimizer ran on the body (the first time the function is
+   * evaluated by the tree-walking evaluator), the body it rewrote (NULL
+   * if nothing) and the guard of the calls rewritten (see opt.h)
+   **/
+  int optimized;
+  lval* opt;
+  int guard;
 };
 
 /**
@@ -54,6 +164,152 @@ struct lval
  */
 lval* lval_num(long n);
 
+/**
+ * Creates a Number from an integer of any size
+ *
+ * lbig* b    the integer, it is taken by the value (or destroyed)
+ *
+ * return     an lval* of type LVAL_NUM if it fits in a long, otherwise
+ *            an lval* of type LVAL_BIGNUM
+ */
+lval* lval_bignum(lbig* b);
+
+/**
+ * Creates a Float (double precision)
+ *
+ * double d   assigned to v->dbl
+ *
+ * return     an lval* of type LVAL_FLOAT
+ */
+lval* lval_float(double d);
+
+/**
+ * Creates a Numeric Vector, of doubles or of 64 bits integers
+ *
+ * int type     LVAL_F64VEC or LVAL_I64VEC
+ * lnvec* v     the numbers, its reference is taken by the value
+ *
+ * return     an lval* of type 'type'
+ */
+lval* lval_nvec(int type, lnvec* v);
+
+/**
+ * Creates a Matrix of doubles
+ *
+ * long rows, cols    its size
+ * lnvec* v           the rows * cols elements, one row after the other,
+ *                    its reference is taken by the value
+ *
+ * return     an lval* of type LVAL_MATRIX
+ */
+lval* lval_matrix(long rows, long cols, lnvec* v);
+
+/**
+ * Creates a Dict (a hash table)
+ *
+ * ldict* d   the entries, its reference is taken by the value
+ *
+ * return     an lval* of type LVAL_DICT
+ */
+lval* lval_dict(ldict* d);
+
+/**
+ * Creates a Map (a persistent hash trie)
+ *
+ * lhamt* h   the entries, its reference is taken by the value
+ *
+ * return     an lval* of type LVAL_MAP
+ */
+lval* lval_map(lhamt* h);
+
+/**
+ * Creates a Sorted Map or a Sorted Set (a B-tree)
+ *
+ * int type     LVAL_SMAP or LVAL_SSET
+ * lbtree* t    the entries (without values in a set), its reference is
+ *              taken by the value
+ *
+ * return     an lval* of type 'type'
+ */
+lval* lval_sorted(int type, lbtree* t);
+
+/**
+ * Creates a (mutable) Vector
+ *
+ * lvec* v    the elements, its reference is taken by the value
+ *
+ * return     an lval* of type LVAL_VEC
+ */
+lval* lval_vec(lvec* v);
+
+/**
+ * Creates a (mutable) Deque
+ *
+ * ldeque* q    the elements, its reference is taken by the value
+ *
+ * return     an lval* of type LVAL_DEQUE
+ */
+lval* lval_deque(ldeque* q);
+
+/**
+ * Creates a (mutable) Priority Queue
+ *
+ * lheap* h     the elements, its reference is taken by the value
+ *
+ * return     an lval* of type LVAL_PQUEUE
+ */
+lval* lval_pqueue(lheap* h);
+
+/**
+ * Creates a Record, of a type declared by defrecord
+ *
+ * lrecord* r   the type and the fields, its reference is taken by the value
+ *
+ * return     an lval* of type LVAL_RECORD
+ */
+lval* lval_record(lrecord* r);
+
+/**
+ * Creates a Table, of typed columns
+ *
+ * ltable* t    the columns, its reference is taken by the value
+ *
+ * return     an lval* of type LVAL_TABLE
+ */
+lval* lval_table(ltable* t);
+
+/**
+ * Creates a Bitset, a set of integers from 0
+ *
+ * lbitset* b   the members, its reference is taken by the value
+ *
+ * return     an lval* of type LVAL_BITSET
+ */
+lval* lval_bitset(lbitset* b);
+
+/**
+ * Creates a Transducer, a stage for 'pipe'
+ *
+ * char* stage    the name of the builtin making it (one of its keywords)
+ * lval* a        its arguments, taken by the value
+ *
+ * return     an lval* of type LVAL_XFORM
+ */
+lval* lval_xform(char* stage, lval* a);
+
+/**
+ * Goes through the entries of a Dict, a Map, a Sorted Map or a Sorted Set
+ * (in the order of its keys, the value of each being its key)
+ *
+ * lval* v        the Dict, Map, Sorted Map or Sorted Set
+ * long* i        the position to look from (0 for the first entry),
+ *                moved past the entry found
+ * lval** k, x    set to the key and value found, owned by v
+ *
+ * return     1 (true) if an entry was found, 0 (false) at the end
+ */
+int lval_entry(lval* v, long* i, lval** k, lval** x);
+
 /**
  * Creates an Error
  *
@@ -77,12 +333,67 @@ lval* lval_sym(char* s);
 /**
  * Creates a String
  *
- * char* s    assigned to v->str
+ * char* s    its bytes, up to the '\0', copied
  *
  * return     an lval* of type LVAL_STR
  */
 lval* lval_str(char* s);
 
+/**
+ * Creates a String of the len bytes of s, copied (they can have '\0's)
+ *
+ * return     an lval* of type LVAL_STR
+ */
+lval* lval_strn(char* s, long len);
+
+/**
+ * Creates a Lazy Sequence
+ *
+ * lseq* s    its first cell, the reference is taken by the value
+ *
+ * return     an lval* of type LVAL_LAZYSEQ
+ */
+lval* lval_lazyseq(lseq* s);
+
+/**
+ * Creates a Range, the numbers from, from + step, from + 2 * step...
+ * never kept as a list: its length, every number and every slice of it
+ * are computed when needed
+ *
+ * long from    the first number
+ * long step    the difference between a number and the next
+ * long len     how many numbers
+ *
+ * return     an lval* of type LVAL_RANGE
+ */
+lval* lval_range(long from, long step, long len);
+
+/**
+ * The number at a position of a Range, computed without overflowing
+ * (i * step may not fit in a long where the number does)
+ *
+ * lval* v    the range
+ * long i     the position, from 0 to its length
+ *
+ * return     the number, wrapped around if past the numbers of a long
+ */
+long lval_range_at(lval* v, long i);
+
+/**
+ * The end of a Range (excluded): the number after its last one, or
+ * the one right past it if that does not fit in a long
+ */
+long lval_range_end(lval* v);
+
+/**
+ * Creates the Q-Expression with the numbers of a Range
+ *
+ * lval* v    the range, it is destroyed
+ *
+ * return     an lval* of type LVAL_QEXPR
+ */
+lval* lval_range_list(lval* v);
+
 /**
  * Creates a builtin function
  *
@@ -106,9 +417,17 @@ lval* lval_fun(lbuiltin func, char* name);
  * lval* body       a list (LVAL_QEXPR) of operations to evaluate
  *
  * return     an lval* of type LVAL_FUN, with v->builtin set to NULL
+ *            and no v->code yet (see lval_code())
  */
 lval* lval_lambda(lval* formals, lval* body);
 
+/**
+ * The compiled code of a lambda, created (empty) the first time the
+ * lambda is called or copied, so the copies share it and a lambda
+ * that is never used costs no code
+ */
+lcode* lval_code(lval* f);
+
 /**
  * Creates an S-Expression
  *
@@ -0,0 +1,84 @@
+#include "vec.h"
+#include "val.h"
+
+#include <string.h>
+
+lvec* lvec_new(long cap)
+{
+  lvec* v = malloc(sizeof(lvec));
+  v->refs = 1;
+  v->len = 0;
+  v->cap = cap > 0 ? cap : 1;
+  v->items = malloc(sizeof(lval*) * v->cap);
+  return v;
+}
+
+void lvec_del(lvec* v)
+{
+  if (--v->refs == 0) {
+    for (long i = 0; i < v->len; i++) {
+      lval_del(v->items[i]);
+    }
+    free(v->items);
+    free(v);
+  }
+}
+
+void lvec_push(lvec* v, lval* x)
+{
+  if (v->len == v->cap) {
+    v->cap *= 2;
+    v->items = realloc(v->items, sizeof(lval*) * v->cap);
+  }
+  v->items[v->len++] = x;
+}
+
+lval* lvec_pop(lvec* v)
+{
+  return v->items[--v->len];
+}
+
+/* merge sort of the n elements of x, tmp has room for n, 0 (false) on an error */
+int _lvec_msort(lval** x, long n, lval** tmp, lvec_less less, void* arg)
+{
+  if (n < 2) {
+    return 1;
+  }
+  long m = n / 2;
+  if (!_lvec_msort(x, m, tmp, less, arg) || !_lvec_msort(x + m, n - m, tmp, less, arg)) {
+    return 0;
+  }
+
+  /* an element of the right half goes first only if less than the one of the left */
+  long i = 0;
+  long j = m;
+  long k = 0;
+  while (i < m && j < n) {
+    int r = less(x[j], x[i], arg);
+    if (r < 0) {
+      return 0;
+    }
+    tmp[k++] = r ? x[j++] : x[i++];
+  }
+  while (i < m) {
+    tmp[k++] = x[i++];
+  }
+  memcpy(x, tmp, sizeof(lval*) * k);
+  return 1;
+}
+
+int lvec_sort(lvec* v, lvec_less less, void* arg)
+{
+  /* sorted in a copy, so an error leaves the vector as it was */
+  lval** x = malloc(sizeof(lval*) * (v->len ? v->len : 1));
+  lval** tmp = malloc(sizeof(lval*) * (v->len ? v->len : 1));
+  memcpy(x, v->items, sizeof(lval*) * v->len);
+
+  int ok = _lvec_msort(x, v->len, tmp, less, arg);
+  if (ok) {
+    memcpy(v->items, x, sizeof(lval*) * v->len);
+  }
+  free(x);
+  free(tmp);
+  return ok;
+}
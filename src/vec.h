@@ -0,0 +1,73 @@
+#ifndef LISPY_VEC_H
+#define LISPY_VEC_H
+
+#include "fwd.h"
+
+/**
+ * Number of elements printed of a vector
+ */
+#define LVEC_PRINT 16
+
+/**
+ * The elements of a mutable vector (LVAL_VEC), shared by every copy of
+ * the value: unlike every other value a vector is changed in place, and
+ * the change is seen through all its copies
+ *
+ * The array grows to twice its capacity when full, so pushing n elements
+ * moves them O(n) times in all.
+ */
+struct lvec
+{
+  /** number of values sharing the vector **/
+  int refs;
+
+  /** number of elements, and of the ones there is room for **/
+  long len;
+  long cap;
+
+  /** the elements, owned by the vector **/
+  lval** items;
+};
+
+/**
+ * Creates an empty vector
+ *
+ * long cap     number of elements it has room for before it grows
+ */
+lvec* lvec_new(long cap);
+
+/**
+ * Releases a reference to the vector (freed, with its elements, with the last one)
+ */
+void lvec_del(lvec* v);
+
+/**
+ * Adds an element at the end, x is taken by the vector
+ */
+void lvec_push(lvec* v, lval* x);
+
+/**
+ * Removes the last element (the vector must not be empty)
+ *
+ * return     the element, now owned by the caller
+ */
+lval* lvec_pop(lvec* v);
+
+/**
+ * If the element x goes before y in a sort: 1 (true) or 0 (false), or -1
+ * to stop the sort on an error
+ */
+typedef int(*lvec_less)(lval* x, lval* y, void* arg);
+
+/**
+ * Sorts the elements in place, keeping the order of the equal ones
+ *
+ * lvec_less less     the order of the elements
+ * void* arg          passed to 'less'
+ *
+ * return     1 (true) if sorted, 0 (false) if stopped, with the vector
+ *            left as it was
+ */
+int lvec_sort(lvec* v, lvec_less less, void* arg);
+
+#endif//LISPY_VEC_H